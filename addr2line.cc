@@ -5,16 +5,24 @@
 
 #include "addr2line.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "base/commandlineflags.h"
 #include "base/logging.h"
+#include "binary_image.h"
+#include "parallel_for.h"
 #include "source_info.h"
+#include "trace_event_recorder.h"
 #include "third_party/abseil/absl/container/node_hash_map.h"
+#include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/flags/flag.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
 #include "third_party/abseil/absl/strings/string_view.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
@@ -24,8 +32,12 @@
 #include "llvm/DebugInfo/DWARF/DWARFDebugLine.h"
 #include "llvm/DebugInfo/DWARF/DWARFDie.h"
 #include "llvm/DebugInfo/DWARF/DWARFFormValue.h"
+#include "llvm/DebugInfo/DWARF/DWARFUnit.h"
 #include "llvm/Object/Binary.h"
 #include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/WithColor.h"
 
 ABSL_RETIRED_FLAG(bool, use_legacy_symbolizer, false,
                   "whether to use google3 symbolizer");
@@ -36,24 +48,34 @@ namespace {
 typedef absl::node_hash_map<std::string, std::pair<const char *, uint64_t>>
     SectionMap;
 
-// Given an ELF binary file with path |filename|, create and return an
-// OwningBinary object. If the file does not exist, the OwningBinary object will
-// be empty.
-llvm::object::OwningBinary<llvm::object::ObjectFile> GetOwningBinary(
-    absl::string_view filename) {
-  auto object_owning_binary_or_err =
-      llvm::object::ObjectFile::createObjectFile(llvm::StringRef(filename));
-  if (!object_owning_binary_or_err) {
-    return llvm::object::OwningBinary<llvm::object::ObjectFile>();
-  }
-  return std::move(object_owning_binary_or_err.get());
+// Returns true if [begin, end) overlaps one of the functions in
+// sampled_functions, a map from function start address to size.
+bool OverlapsSampledFunction(
+    const std::map<uint64_t, uint64_t> &sampled_functions, uint64_t begin,
+    uint64_t end) {
+  auto iter = sampled_functions.upper_bound(begin);
+  if (iter != sampled_functions.begin() &&
+      std::prev(iter)->first + std::prev(iter)->second > begin)
+    return true;
+  return iter != sampled_functions.end() && iter->first < end;
 }
 }  // namespace
 
 namespace devtools_crosstool_autofdo {
 
 Addr2line *Addr2line::Create(absl::string_view binary_name) {
-  Addr2line *addr2line = new LLVMAddr2line(binary_name);
+  return Create(BinaryImage::Open(binary_name));
+}
+
+Addr2line *Addr2line::Create(std::shared_ptr<BinaryImage> image) {
+  return CreateWithSampledFunctions(std::move(image), nullptr);
+}
+
+Addr2line *Addr2line::CreateWithSampledFunctions(
+    std::shared_ptr<BinaryImage> image,
+    const std::map<uint64_t, uint64_t> *sampled_functions) {
+  if (!image) return nullptr;
+  Addr2line *addr2line = new LLVMAddr2line(std::move(image), sampled_functions);
   if (!addr2line->Prepare()) {
     delete addr2line;
     return nullptr;
@@ -63,29 +85,114 @@ Addr2line *Addr2line::Create(absl::string_view binary_name) {
 }
 
 LLVMAddr2line::LLVMAddr2line(absl::string_view binary_name)
-    : Addr2line(binary_name), binary_(GetOwningBinary(binary_name)) {}
+    : LLVMAddr2line(BinaryImage::Open(binary_name)) {}
+
+LLVMAddr2line::LLVMAddr2line(
+    std::shared_ptr<BinaryImage> image,
+    const std::map<uint64_t, uint64_t> *sampled_functions)
+    : Addr2line(image ? image->path() : ""),
+      sampled_functions_(sampled_functions),
+      only_sampled_units_(sampled_functions != nullptr),
+      image_(std::move(image)) {}
 
 bool LLVMAddr2line::Prepare() {
-  if (!binary_.getBinary()) return false;
-  dwarf_info_ = llvm::DWARFContext::create(*binary_.getBinary());
-  for (auto &unit : dwarf_info_->compile_units()) {
-    unit_map_[unit->getOffset()] = unit.get();
+  if (getObject() == nullptr) return false;
+  // Split DWARF: the skeleton units in the binary refer to a .dwp next to it.
+  std::string dwp_file = absl::StrCat(binary_name_, ".dwp");
+  if (!llvm::sys::fs::exists(dwp_file)) dwp_file = "";
+  // The sampled units are parsed on parallel threads, which needs the
+  // context's shared caches to be locked. The context can not be made
+  // thread-unsafe afterwards, so later lookups also take its lock.
+  dwarf_info_ = llvm::DWARFContext::create(
+      *getObject(), llvm::DWARFContext::ProcessDebugRelocations::Process,
+      /*const LoadedObjectInfo *L=*/nullptr, dwp_file,
+      llvm::WithColor::defaultErrorHandler,
+      llvm::WithColor::defaultWarningHandler,
+      /*ThreadSafe=*/only_sampled_units_);
+  if (only_sampled_units_) {
+    IndexSampledUnits();
+  } else {
+    for (auto &unit : dwarf_info_->compile_units()) {
+      unit_map_[unit->getOffset()] = unit.get();
+    }
   }
+  sampled_functions_ = nullptr;
   return true;
 }
 
+void LLVMAddr2line::IndexSampledUnits() {
+  // Only the unit DIEs are read here; the DIE trees, line tables and .dwo
+  // units of the other units are never read.
+  std::vector<uint64_t> first_addresses;
+  for (const std::unique_ptr<llvm::DWARFUnit> &unit :
+       dwarf_info_->compile_units()) {
+    llvm::Expected<llvm::DWARFAddressRangesVector> ranges =
+        unit->collectAddressRanges();
+    if (!ranges) {
+      LOG(WARNING) << "Cannot read the address ranges of the unit at offset "
+                   << unit->getOffset() << ": "
+                   << llvm::toString(ranges.takeError());
+      continue;
+    }
+    if (absl::c_none_of(*ranges, [&](const llvm::DWARFAddressRange &range) {
+          return OverlapsSampledFunction(*sampled_functions_, range.LowPC,
+                                         range.HighPC);
+        }))
+      continue;
+    const int unit_index = sampled_units_.size();
+    sampled_units_.push_back({.unit = unit.get()});
+    first_addresses.push_back(ranges->front().LowPC);
+    for (const llvm::DWARFAddressRange &range : *ranges) {
+      if (range.LowPC < range.HighPC)
+        unit_ranges_.push_back({range.LowPC, range.HighPC, unit_index});
+    }
+  }
+  absl::c_sort(unit_ranges_, [](const UnitRange &a, const UnitRange &b) {
+    return a.begin < b.begin;
+  });
+
+  ParallelFor(sampled_units_.size(), GetDefaultNumThreads(), [&](int64_t i) {
+    ScopedTraceEvent trace_event("autofdo", "index compilation unit");
+    UnitInfo &info = sampled_units_[i];
+    info.line_table = dwarf_info_->getLineTableForUnit(info.unit);
+    // Looking up one address extracts the DIE tree, the .dwo unit and the
+    // address-to-DIE map of the whole unit.
+    llvm::SmallVector<llvm::DWARFDie, 4> inlined_chain;
+    info.unit->getInlinedChainForAddress(first_addresses[i], inlined_chain);
+  });
+  LOG(INFO) << "Indexed " << sampled_units_.size()
+            << " compilation units covering " << sampled_functions_->size()
+            << " sampled functions";
+}
+
+LLVMAddr2line::UnitInfo LLVMAddr2line::FindUnit(uint64_t address) const {
+  if (!only_sampled_units_) {
+    auto cu_iter =
+        unit_map_.find(dwarf_info_->getDebugAranges()->findAddress(address));
+    if (cu_iter == unit_map_.end()) return {};
+    return {.unit = cu_iter->second,
+            .line_table = dwarf_info_->getLineTableForUnit(cu_iter->second)};
+  }
+  auto iter = absl::c_upper_bound(
+      unit_ranges_, address,
+      [](uint64_t address, const UnitRange &range) {
+        return address < range.begin;
+      });
+  if (iter == unit_ranges_.begin()) return {};
+  --iter;
+  if (address >= iter->end) return {};
+  return sampled_units_[iter->unit_index];
+}
+
 void LLVMAddr2line::GetInlineStack(uint64_t address, SourceStack *stack) const {
-  auto cu_iter =
-      unit_map_.find(dwarf_info_->getDebugAranges()->findAddress(address));
-  if (cu_iter == unit_map_.end()) return;
-  const llvm::DWARFDebugLine::LineTable *line_table =
-      dwarf_info_->getLineTableForUnit(cu_iter->second);
+  const auto [unit, line_table] = FindUnit(address);
+  if (unit == nullptr) return;
   if (line_table == nullptr) {
     LOG_EVERY_N(WARNING, 1000) << "Missed line table.";
     return;
   }
   llvm::SmallVector<llvm::DWARFDie, 4> InlinedChain;
-  cu_iter->second->getInlinedChainForAddress(address, InlinedChain);
+  unit->getInlinedChainForAddress(address, InlinedChain);
 
   uint32_t row_index = line_table->lookupAddress(
       {address, llvm::object::SectionedAddress::UndefSection});
@@ -10,13 +10,16 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "base/integral_types.h"
+#include "binary_image.h"
 #include "source_info.h"
 #include "third_party/abseil/absl/strings/string_view.h"
 
 #if defined(HAVE_LLVM)
 #include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFDebugLine.h"
 #include "llvm/Object/Binary.h"
 #include "llvm/Object/ObjectFile.h"
 #endif
@@ -35,6 +38,18 @@ class Addr2line {
 
   static Addr2line *Create(absl::string_view binary_name);
 
+  // Same as above, but reads the debug info from an image that is already
+  // mapped. The returned object keeps the image alive.
+  static Addr2line *Create(std::shared_ptr<BinaryImage> image);
+
+  // Same as above, but only reads the debug info of the compilation units
+  // that cover sampled_functions, a map from the start address of each
+  // sampled function to its size. Addresses outside of those units get an
+  // empty inline stack. sampled_functions is only used during the call.
+  static Addr2line *CreateWithSampledFunctions(
+      std::shared_ptr<BinaryImage> image,
+      const std::map<uint64_t, uint64_t> *sampled_functions);
+
   // Reads the binary to prepare necessary binary in data.
   // Returns True on success.
   virtual bool Prepare() = 0;
@@ -55,16 +70,52 @@ class Addr2line {
 class LLVMAddr2line : public Addr2line {
  public:
   explicit LLVMAddr2line(absl::string_view binary_name);
+  explicit LLVMAddr2line(
+      std::shared_ptr<BinaryImage> image,
+      const std::map<uint64_t, uint64_t> *sampled_functions = nullptr);
   bool Prepare() override;
   void GetInlineStack(uint64_t address, SourceStack *stack) const override;
   const llvm::object::ObjectFile *getObject() const override {
-    return binary_.getBinary();
+    return image_ ? image_->object_file() : nullptr;
   }
 
  private:
+  // A compilation unit and its line table.
+  struct UnitInfo {
+    llvm::DWARFUnit *unit = nullptr;
+    const llvm::DWARFDebugLine::LineTable *line_table = nullptr;
+  };
+
+  // An address range of a sampled compilation unit.
+  struct UnitRange {
+    uint64_t begin;
+    uint64_t end;
+    // Index into sampled_units_.
+    int unit_index;
+  };
+
+  // Returns the compilation unit that contains address. The unit is nullptr
+  // if there is none.
+  UnitInfo FindUnit(uint64_t address) const;
+
+  // Fills sampled_units_ and unit_ranges_ with the compilation units that
+  // overlap a function in sampled_functions_, then parses their line tables
+  // and DIE trees on parallel threads.
+  void IndexSampledUnits();
+
   // map from cu_offset to the CompileUnit.
   std::map<uint32_t, llvm::DWARFUnit *> unit_map_;
-  llvm::object::OwningBinary<llvm::object::ObjectFile> binary_;
+  // The sampled compilation units, fully parsed by Prepare and only read
+  // afterwards, so lookups add no locking of their own. The DWARFContext is
+  // still thread-safe, so its lookups keep taking its internal lock.
+  std::vector<UnitInfo> sampled_units_;
+  // Ranges of the sampled compilation units, sorted by begin. Used instead of
+  // unit_map_ when only sampled functions are indexed.
+  std::vector<UnitRange> unit_ranges_;
+  // Only set until Prepare returns.
+  const std::map<uint64_t, uint64_t> *sampled_functions_;
+  bool only_sampled_units_;
+  std::shared_ptr<BinaryImage> image_;
   std::unique_ptr<llvm::DWARFContext> dwarf_info_;
 };
 
@@ -78,6 +129,9 @@ class AddressToLineMap;
 class Google3Addr2line : public Addr2line {
  public:
   explicit Google3Addr2line(const string &binary_name);
+  explicit Google3Addr2line(
+      std::shared_ptr<BinaryImage> image,
+      const std::map<uint64_t, uint64_t> *sampled_functions = NULL);
   virtual ~Google3Addr2line();
   virtual bool Prepare();
   virtual void GetInlineStack(uint64_t address, SourceStack *stack) const;
@@ -85,6 +139,9 @@ class Google3Addr2line : public Addr2line {
  private:
   AddressToLineMap *line_map_;
   InlineStackHandler *inline_stack_handler_;
+  // Only set until Prepare returns.
+  const std::map<uint64_t, uint64_t> *sampled_functions_;
+  std::shared_ptr<BinaryImage> image_;
   ElfReader *elf_;
   DISALLOW_COPY_AND_ASSIGN(Google3Addr2line);
 };
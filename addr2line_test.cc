@@ -1,10 +1,23 @@
 #include "addr2line.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "binary_image.h"
+#include "source_info.h"
 #include "third_party/abseil/absl/strings/str_cat.h"
+#include "util/symbolize/elf_reader.h"
 #include "util/testing/status_matchers.h"
 
 namespace {
 
 using ::devtools_crosstool_autofdo::Addr2line;
+using ::devtools_crosstool_autofdo::BinaryImage;
+using ::devtools_crosstool_autofdo::ElfReader;
+using ::devtools_crosstool_autofdo::SourceStack;
 
 TEST(Addr2lineTest, Dwarf2Dwarf5Binary) {
   const std::string binary =
@@ -15,4 +28,45 @@ TEST(Addr2lineTest, Dwarf2Dwarf5Binary) {
   Addr2line* addr2line = Addr2line::Create(binary);
   EXPECT_TRUE(addr2line != NULL);
 }
+
+TEST(Addr2lineTest, CreateWithSampledFunctions) {
+  std::shared_ptr<BinaryImage> image = BinaryImage::Open(
+      absl::StrCat(::testing::SrcDir(), "/testdata/test.binary"));
+  ASSERT_TRUE(image != nullptr);
+  std::vector<ElfReader::SymbolInfo> symbols = image->elf_reader().ReadSymbols(
+      [](const char *name, uint64 address, uint64 size, int binding, int type,
+         int section) { return std::string(name) == "main"; },
+      1);
+  ASSERT_EQ(symbols.size(), 1);
+  const uint64_t main_begin = symbols[0].address;
+  const uint64_t main_end = main_begin + symbols[0].size;
+
+  std::unique_ptr<Addr2line> all(Addr2line::Create(image));
+  const std::map<uint64_t, uint64_t> sampled_functions = {
+      {main_begin, main_end - main_begin}};
+  std::unique_ptr<Addr2line> sampled(
+      Addr2line::CreateWithSampledFunctions(image, &sampled_functions));
+  const std::map<uint64_t, uint64_t> no_functions;
+  std::unique_ptr<Addr2line> none(
+      Addr2line::CreateWithSampledFunctions(image, &no_functions));
+  ASSERT_TRUE(all != nullptr);
+  ASSERT_TRUE(sampled != nullptr);
+  ASSERT_TRUE(none != nullptr);
+
+  bool found_stack = false;
+  for (uint64_t address = main_begin; address < main_end; ++address) {
+    SourceStack all_stack, sampled_stack, none_stack;
+    all->GetInlineStack(address, &all_stack);
+    sampled->GetInlineStack(address, &sampled_stack);
+    none->GetInlineStack(address, &none_stack);
+    ASSERT_EQ(sampled_stack.size(), all_stack.size());
+    for (int i = 0; i < all_stack.size(); ++i) {
+      EXPECT_EQ(sampled_stack[i].line, all_stack[i].line);
+      EXPECT_EQ(sampled_stack[i].start_line, all_stack[i].start_line);
+    }
+    EXPECT_TRUE(none_stack.empty());
+    found_stack |= !all_stack.empty();
+  }
+  EXPECT_TRUE(found_stack);
+}
 }  // namespace
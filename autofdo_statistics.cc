@@ -0,0 +1,55 @@
+#include "autofdo_statistics.h"
+
+#include <string>
+#include <vector>
+
+#include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/strings/str_join.h"
+
+namespace devtools_crosstool_autofdo {
+
+std::string AutoFdoStats::SampleStats::DebugString() const {
+  return absl::StrJoin(
+      {absl::StrCat("Read ", perf_files_read, " perf files (",
+                    perf_files_without_binary,
+                    " without the profiled binary)."),
+       absl::StrCat("Read ", samples_read, " samples (",
+                    samples_not_matching_binary,
+                    " outside the profiled binary)."),
+       absl::StrCat("Read ", lbr_entries_read, " LBR entries (",
+                    lbr_entries_not_matching_binary,
+                    " outside the profiled binary)."),
+       absl::StrCat("Skipped bogus LBR entries: ",
+                    bogus_lbr_duplicated_top_entries, " duplicated top, ",
+                    bogus_lbr_negative_ranges, " negative range, ",
+                    bogus_lbr_too_large_ranges, " too large range.")},
+      "\n");
+}
+
+std::string AutoFdoStats::ProfileStats::DebugString() const {
+  return absl::StrJoin(
+      {absl::StrCat("Dropped ", addresses_without_symbol, " addresses, ",
+                    ranges_without_symbol, " ranges and ",
+                    branches_without_symbol,
+                    " branches not in any symbol."),
+       absl::StrCat(functions_sampled, " functions sampled, ",
+                    functions_processed, " processed, ",
+                    functions_below_threshold, " below threshold."),
+       absl::StrCat("Made ", symbolization_queries,
+                    " symbolization queries.")},
+      "\n");
+}
+
+std::string AutoFdoStats::WriterStats::DebugString() const {
+  return absl::StrCat("Wrote ", functions_written, " functions in ",
+                      profiles_written, " profiles.");
+}
+
+std::string AutoFdoStats::DebugString() const {
+  std::vector<std::string> stat_lines = {
+      sample_stats.DebugString(), profile_stats.DebugString(),
+      writer_stats.DebugString(), phase_stats.DebugString()};
+  return absl::StrJoin(stat_lines, "\n");
+}
+
+}  // namespace devtools_crosstool_autofdo
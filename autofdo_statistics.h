@@ -0,0 +1,110 @@
+#ifndef AUTOFDO_AUTOFDO_STATISTICS_H_
+#define AUTOFDO_AUTOFDO_STATISTICS_H_
+
+#include <cstdint>
+#include <string>
+
+#include "phase_timer.h"
+
+namespace devtools_crosstool_autofdo {
+
+// Statistics of converting perf samples into an AutoFDO profile. This is the
+// AutoFDO counterpart of `PropellerStats`.
+struct AutoFdoStats {
+  // Statistics of reading the samples, filled in by `SampleReader`.
+  struct SampleStats {
+    int perf_files_read = 0;
+    // Number of perf files which have no mmaps of the profiled binary.
+    int perf_files_without_binary = 0;
+    uint64_t samples_read = 0;
+    // Number of samples whose IP is outside the profiled binary.
+    uint64_t samples_not_matching_binary = 0;
+    // Number of LBR entries examined, excluding wrong-path entries.
+    uint64_t lbr_entries_read = 0;
+    // Number of LBR entries whose branch target is outside the profiled
+    // binary.
+    uint64_t lbr_entries_not_matching_binary = 0;
+    uint64_t bogus_lbr_duplicated_top_entries = 0;
+    uint64_t bogus_lbr_negative_ranges = 0;
+    uint64_t bogus_lbr_too_large_ranges = 0;
+
+    void operator+=(const SampleStats &other) {
+      perf_files_read += other.perf_files_read;
+      perf_files_without_binary += other.perf_files_without_binary;
+      samples_read += other.samples_read;
+      samples_not_matching_binary += other.samples_not_matching_binary;
+      lbr_entries_read += other.lbr_entries_read;
+      lbr_entries_not_matching_binary += other.lbr_entries_not_matching_binary;
+      bogus_lbr_duplicated_top_entries +=
+          other.bogus_lbr_duplicated_top_entries;
+      bogus_lbr_negative_ranges += other.bogus_lbr_negative_ranges;
+      bogus_lbr_too_large_ranges += other.bogus_lbr_too_large_ranges;
+    }
+
+    std::string DebugString() const;
+  };
+
+  // Statistics of mapping the samples to functions and source locations,
+  // filled in by `Profile`.
+  struct ProfileStats {
+    // Number of distinct sampled addresses, ranges and branches which do not
+    // fall into any symbol of the binary and are dropped.
+    uint64_t addresses_without_symbol = 0;
+    uint64_t ranges_without_symbol = 0;
+    uint64_t branches_without_symbol = 0;
+    // Number of functions with at least one sample attributed to them.
+    int functions_sampled = 0;
+    // Number of functions processed into the symbol map.
+    int functions_processed = 0;
+    // Number of functions dropped for being below the emission threshold.
+    int functions_below_threshold = 0;
+    // Number of addresses looked up in the debug info.
+    uint64_t symbolization_queries = 0;
+
+    void operator+=(const ProfileStats &other) {
+      addresses_without_symbol += other.addresses_without_symbol;
+      ranges_without_symbol += other.ranges_without_symbol;
+      branches_without_symbol += other.branches_without_symbol;
+      functions_sampled += other.functions_sampled;
+      functions_processed += other.functions_processed;
+      functions_below_threshold += other.functions_below_threshold;
+      symbolization_queries += other.symbolization_queries;
+    }
+
+    std::string DebugString() const;
+  };
+
+  // Statistics of writing the profile.
+  struct WriterStats {
+    int profiles_written = 0;
+    // Number of top-level functions in the written profiles.
+    int functions_written = 0;
+
+    void operator+=(const WriterStats &other) {
+      profiles_written += other.profiles_written;
+      functions_written += other.functions_written;
+    }
+
+    std::string DebugString() const;
+  };
+
+  using PhaseStats = ::devtools_crosstool_autofdo::PhaseStats;
+
+  SampleStats sample_stats;
+  ProfileStats profile_stats;
+  WriterStats writer_stats;
+  PhaseStats phase_stats;
+
+  void operator+=(const AutoFdoStats &other) {
+    sample_stats += other.sample_stats;
+    profile_stats += other.profile_stats;
+    writer_stats += other.writer_stats;
+    phase_stats += other.phase_stats;
+  }
+
+  std::string DebugString() const;
+};
+
+}  // namespace devtools_crosstool_autofdo
+
+#endif  // AUTOFDO_AUTOFDO_STATISTICS_H_
@@ -0,0 +1,30 @@
+#include "autofdo_telemetry_reporter.h"
+
+#include <utility>
+#include <vector>
+
+namespace devtools_crosstool_autofdo {
+namespace {
+// Returns the global registry of AutoFDO telemetry reporters.
+std::vector<AutoFdoTelemetryReporter>& GetAutoFdoTelemetryReporters() {
+  static auto* const reporters = new std::vector<AutoFdoTelemetryReporter>;
+  return *reporters;
+}
+}  // namespace
+
+void RegisterAutoFdoTelemetryReporter(AutoFdoTelemetryReporter reporter) {
+  GetAutoFdoTelemetryReporters().push_back(std::move(reporter));
+}
+
+void InvokeAutoFdoTelemetryReporters(absl::string_view binary,
+                                     const AutoFdoStats& autofdo_stats) {
+  for (const AutoFdoTelemetryReporter& reporter :
+       GetAutoFdoTelemetryReporters()) {
+    reporter(binary, autofdo_stats);
+  }
+}
+
+void UnregisterAllAutoFdoTelemetryReportersForTest() {
+  GetAutoFdoTelemetryReporters().clear();
+}
+}  // namespace devtools_crosstool_autofdo
@@ -0,0 +1,30 @@
+#ifndef AUTOFDO_AUTOFDO_TELEMETRY_REPORTER_H_
+#define AUTOFDO_AUTOFDO_TELEMETRY_REPORTER_H_
+
+#include "autofdo_statistics.h"
+#include "third_party/abseil/absl/functional/any_invocable.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+
+namespace devtools_crosstool_autofdo {
+// Signature of an AutoFDO telemetry reporting function, called with the path
+// of the profiled binary. The alias is a part of the public API of this
+// module.
+using AutoFdoTelemetryReporter =
+    absl::AnyInvocable<void(absl::string_view binary,
+                            const AutoFdoStats& autofdo_stats) const>;
+
+// Registers `reporter` in the global registry of AutoFDO telemetry reporting
+// functions. Not safe to call concurrently.
+void RegisterAutoFdoTelemetryReporter(AutoFdoTelemetryReporter reporter);
+
+// Invokes all registered AutoFDO telemetry reporters. Not safe to call
+// concurrently.
+void InvokeAutoFdoTelemetryReporters(absl::string_view binary,
+                                     const AutoFdoStats& autofdo_stats);
+
+// Unregisters all AutoFDO telemetry reporting functions. To be only used in
+// tests. Not safe to call concurrently.
+void UnregisterAllAutoFdoTelemetryReportersForTest();
+}  // namespace devtools_crosstool_autofdo
+
+#endif  // AUTOFDO_AUTOFDO_TELEMETRY_REPORTER_H_
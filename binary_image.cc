@@ -0,0 +1,88 @@
+// Class to share one read-only mapping of a binary between the components
+// that read it.
+
+#include "binary_image.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "base/logging.h"
+#include "util/symbolize/elf_reader.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+
+#if defined(HAVE_LLVM)
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBufferRef.h"
+#include "llvm/Object/ObjectFile.h"
+#endif
+
+namespace devtools_crosstool_autofdo {
+
+std::shared_ptr<BinaryImage> BinaryImage::Open(absl::string_view path) {
+  const std::string path_str(path);
+  const int fd = open(path_str.c_str(), O_RDONLY);
+  if (fd == -1) {
+    PLOG(ERROR) << "Could not open " << path;
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    LOG(ERROR) << "Could not read " << path;
+    close(fd);
+    return nullptr;
+  }
+  const size_t size = st.st_size;
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+    PLOG(ERROR) << "Could not mmap " << path;
+    return nullptr;
+  }
+  return std::shared_ptr<BinaryImage>(
+      new BinaryImage(path, static_cast<const char *>(data), size));
+}
+
+BinaryImage::BinaryImage(absl::string_view path, const char *data,
+                         size_t size)
+    : path_(path),
+      data_(data),
+      size_(size),
+      elf_reader_(path_, data, size) {
+#if defined(HAVE_LLVM)
+  auto object_file_or_err = llvm::object::ObjectFile::createObjectFile(
+      llvm::MemoryBufferRef(llvm::StringRef(data, size), path_));
+  if (object_file_or_err) {
+    object_file_ = std::move(object_file_or_err.get());
+  } else {
+    LOG(WARNING) << "LLVM could not parse " << path_ << ": "
+                 << llvm::toString(object_file_or_err.takeError());
+  }
+#endif
+}
+
+BinaryImage::~BinaryImage() {
+#if defined(HAVE_LLVM)
+  // The object file points into the mapping.
+  object_file_.reset();
+#endif
+  munmap(const_cast<char *>(data_), size_);
+}
+
+const std::string &BinaryImage::build_id() {
+  if (!build_id_read_) {
+    build_id_ = elf_reader_.GetBuildId();
+    build_id_read_ = true;
+  }
+  return build_id_;
+}
+
+}  // namespace devtools_crosstool_autofdo
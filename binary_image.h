@@ -0,0 +1,75 @@
+// Class to share one read-only mapping of a binary between the components
+// that read it.
+
+#ifndef AUTOFDO_BINARY_IMAGE_H_
+#define AUTOFDO_BINARY_IMAGE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "util/symbolize/elf_reader.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+
+#if defined(HAVE_LLVM)
+#include "llvm/Object/ObjectFile.h"
+#endif
+
+namespace devtools_crosstool_autofdo {
+
+// BinaryImage maps a binary file into memory once and exposes the views
+// that the rest of a run needs: an ElfReader for symbols, segments and the
+// build id, and (with LLVM) the parsed object file used for DWARF and
+// disassembly. Sections handed out by either view point into the same
+// mapping, so they stay valid for as long as the image is alive.
+//
+// Images are shared through std::shared_ptr; every component that keeps
+// pointers into the binary also keeps a reference to its image.
+// This class is not thread-safe: the ElfReader caches sections lazily.
+class BinaryImage {
+ public:
+  // Maps the file at `path`. Returns nullptr if the file cannot be opened or
+  // mapped.
+  static std::shared_ptr<BinaryImage> Open(absl::string_view path);
+
+  // This type is neither copyable nor movable.
+  BinaryImage(const BinaryImage &) = delete;
+  BinaryImage &operator=(const BinaryImage &) = delete;
+
+  ~BinaryImage();
+
+  const std::string &path() const { return path_; }
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  ElfReader &elf_reader() { return elf_reader_; }
+
+  // Returns the build id of the binary, or an empty string if it has none.
+  // The value is computed on first use.
+  const std::string &build_id();
+
+#if defined(HAVE_LLVM)
+  // Returns the parsed object file, or nullptr if LLVM cannot parse the
+  // binary.
+  const llvm::object::ObjectFile *object_file() const {
+    return object_file_.get();
+  }
+#endif
+
+ private:
+  BinaryImage(absl::string_view path, const char *data, size_t size);
+
+  const std::string path_;
+  const char *const data_;
+  const size_t size_;
+  ElfReader elf_reader_;
+  bool build_id_read_ = false;
+  std::string build_id_;
+#if defined(HAVE_LLVM)
+  std::unique_ptr<llvm::object::ObjectFile> object_file_;
+#endif
+};
+
+}  // namespace devtools_crosstool_autofdo
+
+#endif  // AUTOFDO_BINARY_IMAGE_H_
@@ -14,12 +14,15 @@
 
 #include "base/commandlineflags.h"
 #include "base/logging.h"
+#include "live_metrics.h"
 #include "llvm_profile_writer.h"
 #include "llvm_propeller_options.pb.h"
 #include "llvm_propeller_options_builder.h"
 #include "llvm_propeller_profile_generator.h"
 #include "profile_creator.h"
+#include "status_consumer_registry.h"
 #include "symbol_map.h"
+#include "trace_event_recorder.h"
 #include "third_party/abseil/absl/status/status.h"
 #include "third_party/abseil/absl/strings/match.h"
 #include "third_party/abseil/absl/flags/flag.h"
@@ -41,6 +44,9 @@ ABSL_FLAG(std::string, gcov, "",
           "Output profile file name. Alias for --out; used for "
           "flag compatibility with create_gcov");
 ABSL_FLAG(std::string, binary, "a.out", "Binary file name");
+ABSL_FLAG(std::string, trace_out, "",
+          "If set, write a Chrome trace event JSON timeline of the run to this "
+          "path, viewable with chrome://tracing or Perfetto.");
 // FIXME(dnovillo) - This should default to 'binary'.  However, the binary
 // representation is currently version locked to the latest LLVM upstream
 // sources. This may cause incompatibilities with the currently released version
@@ -58,6 +64,10 @@ ABSL_FLAG(std::string, propeller_symorder, "",
 ABSL_FLAG(std::string, propeller_cfg_dump_dir, "",
           "Directory for dumping the cfgs. The directory will be created if "
           "does not exist.");
+ABSL_FLAG(std::string, propeller_binary_cache_dir, "",
+          "Directory for caching the decoded BB address map and symbols of the "
+          "binary across runs, keyed by build id. The directory will be "
+          "created if does not exist.");
 ABSL_FLAG(uint32_t, propeller_chain_split_threshold, 0,
           "Maximum chain length (in number of nodes) for which propeller tries "
           "splitting and remerging at every splitting position.");
@@ -73,6 +83,50 @@ ABSL_FLAG(bool, propeller_inter_function_ordering, false,
           "Whether propeller should reorder basic blocks inter-procedurally, "
           "i.e., basic blocks of a function can be interleaved by basic blocks "
           "from other functions.");
+ABSL_FLAG(uint32_t, propeller_inter_function_community_size_threshold, 0,
+          "Maximum number of basic blocks in a call graph community for "
+          "inter-procedural reordering. When nonzero, chains are built for "
+          "each community of heavily-calling functions in parallel instead of "
+          "for all functions together.");
+ABSL_FLAG(uint32_t, propeller_layout_time_budget_ms, 0,
+          "Wall time budget in milliseconds for propeller code layout of each "
+          "section. Once exhausted, the remaining (colder) functions keep "
+          "their original block order. Zero means no budget.");
+ABSL_FLAG(uint32_t, propeller_hot_text_page_size, 0,
+          "Page size in bytes (e.g., 4096 or 2097152) for packing the hottest "
+          "functions into a fixed number of pages. Zero disables packing.");
+ABSL_FLAG(uint32_t, propeller_hot_text_page_budget, 0,
+          "Number of pages of --propeller_hot_text_page_size bytes to pack "
+          "with the hottest functions.");
+ABSL_FLAG(bool, propeller_simulate_layout, false,
+          "Replay a trace generated from the profile against a simulated "
+          "i-cache and iTLB to compare the original and the optimized layouts. "
+          "Results are reported in the stats and, with "
+          "--propeller_verbose_cluster_output, for every function.");
+// The simulation flags below override the corresponding fields of
+// LayoutSimulationParameters when nonzero, and keep their defaults otherwise.
+ABSL_FLAG(uint64_t, propeller_simulation_trace_length, 0,
+          "Number of basic blocks in the trace replayed by "
+          "--propeller_simulate_layout. Zero keeps the default.");
+ABSL_FLAG(uint32_t, propeller_simulation_icache_size, 0,
+          "Size in bytes of the i-cache simulated by "
+          "--propeller_simulate_layout. Zero keeps the default.");
+ABSL_FLAG(uint32_t, propeller_simulation_icache_associativity, 0,
+          "Associativity of the i-cache simulated by "
+          "--propeller_simulate_layout. Zero keeps the default.");
+ABSL_FLAG(uint32_t, propeller_simulation_icache_line_size, 0,
+          "Line size in bytes of the i-cache simulated by "
+          "--propeller_simulate_layout. Zero keeps the default.");
+ABSL_FLAG(uint32_t, propeller_simulation_itlb_entries, 0,
+          "Number of entries of the iTLB simulated by "
+          "--propeller_simulate_layout. Zero keeps the default.");
+ABSL_FLAG(uint32_t, propeller_simulation_itlb_associativity, 0,
+          "Associativity of the iTLB simulated by "
+          "--propeller_simulate_layout. Zero keeps the default.");
+ABSL_FLAG(uint32_t, propeller_simulation_itlb_page_size, 0,
+          "Page size in bytes of the iTLB simulated by "
+          "--propeller_simulate_layout, e.g., 2097152 for text mapped on huge "
+          "pages. Zero keeps the default.");
 ABSL_FLAG(uint32_t, propeller_forward_jump_distance, 1024,
           "Distance threshold to use for forward branches in propeller code "
           "layout score computation.");
@@ -93,6 +147,10 @@ ABSL_FLAG(bool, prof_sym_list, false,
           "when --format=extbinary.");
 ABSL_FLAG(bool, http, false,
           "Enable http to server statusz requests.");
+ABSL_FLAG(int, metrics_port, 0,
+          "If non-zero, serve live throughput metrics in the Prometheus text "
+          "format on http://127.0.0.1:<port>/metrics while generating a "
+          "Propeller profile. Implies --http.");
 
 // While reading perfdata file, we use build id to match a binary and its pids
 // in perf file. We may also want to use file name to do the match, which is
@@ -161,6 +219,32 @@ devtools_crosstool_autofdo::PropellerOptions CreatePropellerOptionsFromFlags() {
     option_builder.SetCfgDumpDirName(
         absl::GetFlag(FLAGS_propeller_cfg_dump_dir));
   }
+  if (!absl::GetFlag(FLAGS_propeller_binary_cache_dir).empty()) {
+    option_builder.SetBinaryAddressMapperCacheDir(
+        absl::GetFlag(FLAGS_propeller_binary_cache_dir));
+  }
+  if (absl::GetFlag(FLAGS_propeller_simulate_layout)) {
+    devtools_crosstool_autofdo::LayoutSimulationParameters simulation_params;
+    if (uint64_t value = absl::GetFlag(FLAGS_propeller_simulation_trace_length))
+      simulation_params.set_trace_length(value);
+    if (uint32_t value = absl::GetFlag(FLAGS_propeller_simulation_icache_size))
+      simulation_params.set_icache_size(value);
+    if (uint32_t value =
+            absl::GetFlag(FLAGS_propeller_simulation_icache_associativity))
+      simulation_params.set_icache_associativity(value);
+    if (uint32_t value =
+            absl::GetFlag(FLAGS_propeller_simulation_icache_line_size))
+      simulation_params.set_icache_line_size(value);
+    if (uint32_t value = absl::GetFlag(FLAGS_propeller_simulation_itlb_entries))
+      simulation_params.set_itlb_entries(value);
+    if (uint32_t value =
+            absl::GetFlag(FLAGS_propeller_simulation_itlb_associativity))
+      simulation_params.set_itlb_associativity(value);
+    if (uint32_t value =
+            absl::GetFlag(FLAGS_propeller_simulation_itlb_page_size))
+      simulation_params.set_itlb_page_size(value);
+    option_builder.SetLayoutSimulationParams(simulation_params);
+  }
 
   return devtools_crosstool_autofdo::PropellerOptions(
       option_builder.SetBinaryName(absl::GetFlag(FLAGS_binary))
@@ -184,7 +268,17 @@ devtools_crosstool_autofdo::PropellerOptions CreatePropellerOptionsFromFlags() {
               !absl::GetFlag(FLAGS_propeller_layout_only))
           .SetCodeLayoutParamsInterFunctionReordering(
               absl::GetFlag(FLAGS_propeller_inter_function_ordering))
-          .SetHttp(absl::GetFlag(FLAGS_http))
+          .SetCodeLayoutParamsInterFunctionCommunitySizeThreshold(
+              absl::GetFlag(
+                  FLAGS_propeller_inter_function_community_size_threshold))
+          .SetCodeLayoutParamsLayoutTimeBudgetMs(
+              absl::GetFlag(FLAGS_propeller_layout_time_budget_ms))
+          .SetCodeLayoutParamsHotTextPageSize(
+              absl::GetFlag(FLAGS_propeller_hot_text_page_size))
+          .SetCodeLayoutParamsHotTextPageBudget(
+              absl::GetFlag(FLAGS_propeller_hot_text_page_budget))
+          .SetHttp(absl::GetFlag(FLAGS_http) ||
+                   absl::GetFlag(FLAGS_metrics_port) != 0)
           .SetOutputModuleName(
               absl::GetFlag(FLAGS_propeller_output_module_name))
           .SetClusterOutVersion(
@@ -197,6 +291,13 @@ devtools_crosstool_autofdo::PropellerOptions CreatePropellerOptionsFromFlags() {
 int main(int argc, char **argv) {
   absl::SetProgramUsageMessage(argv[0]);
   absl::ParseCommandLine(argc, argv);
+  devtools_crosstool_autofdo::ScopedTraceEventRecording trace_event_recording(
+      absl::GetFlag(FLAGS_trace_out));
+  if (absl::GetFlag(FLAGS_metrics_port) != 0) {
+    devtools_crosstool_autofdo::StatusConsumerRegistry::GetInstance().Register(
+        std::make_unique<devtools_crosstool_autofdo::LiveMetricsHttpServer>(
+            absl::GetFlag(FLAGS_metrics_port)));
+  }
 
   // If the user specified --gcov instead of --out, use that value.
   // If both are used, they must match.
@@ -0,0 +1,85 @@
+// This program writes a synthetic perf.data file with LBR samples for a given
+// binary, for benchmarking profile ingestion at scale. Example usage:
+// $ generate_synthetic_perf_data --binary=testdata/propeller_sample.bin \
+//     --out=/tmp/synthetic.perfdata --samples=10000000 --lbr_depth=32 \
+//     --pids=4 --mmap_layout=pie
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "base/logging.h"
+#include "llvm_propeller_binary_content.h"
+#include "synthetic_perf_data.h"
+#include "third_party/abseil/absl/flags/flag.h"
+#include "third_party/abseil/absl/flags/parse.h"
+#include "third_party/abseil/absl/flags/usage.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/status/statusor.h"
+
+ABSL_FLAG(std::string, binary, "", "Binary file name");
+ABSL_FLAG(std::string, out, "", "Output perf.data file name");
+ABSL_FLAG(int64_t, samples, 10000, "Number of LBR samples");
+ABSL_FLAG(int, lbr_depth, 32, "Number of LBR entries in every sample");
+ABSL_FLAG(int, pids, 1, "Number of profiled processes");
+ABSL_FLAG(std::string, mmap_layout, "nonpie",
+          "How the binary is mapped: 'nonpie', 'pie' or 'kernel'");
+ABSL_FLAG(double, branch_target_skew, 1.0,
+          "Exponent of the Zipf distribution of branch targets over the "
+          "functions of the binary. 0 spreads branches uniformly.");
+ABSL_FLAG(double, call_probability, 0.1,
+          "Probability that a branch leaves its function.");
+ABSL_FLAG(std::string, mmap_file_name, "",
+          "File name recorded in the mmap events. Defaults to --binary.");
+ABSL_FLAG(uint64_t, seed, 1, "Seed of the pseudo-random generator");
+
+using ::devtools_crosstool_autofdo::BinaryContent;
+using ::devtools_crosstool_autofdo::GetBinaryContent;
+using ::devtools_crosstool_autofdo::SyntheticMmapLayout;
+using ::devtools_crosstool_autofdo::SyntheticPerfDataOptions;
+using ::devtools_crosstool_autofdo::WriteSyntheticPerfData;
+
+int main(int argc, char **argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  if (absl::GetFlag(FLAGS_binary).empty() || absl::GetFlag(FLAGS_out).empty()) {
+    LOG(ERROR) << "Both --binary and --out must be specified.";
+    return 1;
+  }
+
+  SyntheticPerfDataOptions options = {
+      .n_samples = absl::GetFlag(FLAGS_samples),
+      .lbr_depth = absl::GetFlag(FLAGS_lbr_depth),
+      .n_pids = absl::GetFlag(FLAGS_pids),
+      .branch_target_skew = absl::GetFlag(FLAGS_branch_target_skew),
+      .call_probability = absl::GetFlag(FLAGS_call_probability),
+      .mmap_file_name = absl::GetFlag(FLAGS_mmap_file_name),
+      .seed = absl::GetFlag(FLAGS_seed)};
+  const std::string mmap_layout = absl::GetFlag(FLAGS_mmap_layout);
+  if (mmap_layout == "nonpie") {
+    options.mmap_layout = SyntheticMmapLayout::kNonPie;
+  } else if (mmap_layout == "pie") {
+    options.mmap_layout = SyntheticMmapLayout::kPie;
+  } else if (mmap_layout == "kernel") {
+    options.mmap_layout = SyntheticMmapLayout::kKernel;
+  } else {
+    LOG(ERROR) << "--mmap_layout=" << mmap_layout << " is not supported. "
+               << "Use one of 'nonpie', 'pie' or 'kernel'.";
+    return 1;
+  }
+
+  absl::StatusOr<std::unique_ptr<BinaryContent>> binary_content =
+      GetBinaryContent(absl::GetFlag(FLAGS_binary));
+  if (!binary_content.ok()) {
+    LOG(ERROR) << binary_content.status();
+    return 1;
+  }
+  if (absl::Status status = WriteSyntheticPerfData(
+          **binary_content, options, absl::GetFlag(FLAGS_out));
+      !status.ok()) {
+    LOG(ERROR) << status;
+    return 1;
+  }
+  return 0;
+}
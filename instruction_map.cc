@@ -7,6 +7,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "base/logging.h"
 #include "addr2line.h"
@@ -29,14 +30,17 @@ void InstructionMap::BuildPerFunctionInstructionMap(absl::string_view name,
   // LOG(INFO) << "Building per function instruction map: " << start_addr << " to "
   //           << end_addr << " (size: " << end_addr - start_addr << ")";
   inst_map_.resize(end_addr - start_addr);
+  std::vector<SymbolMap::SourceCount> source_counts;
   for (uint64_t addr = start_addr; addr < end_addr; addr++) {
     InstInfo *info = &inst_map_[addr - start_addr];
     addr2line_->GetInlineStack(addr, &info->source_stack);
     if (!info->source_stack.empty()) {
-      symbol_map_->AddSourceCount(name, info->source_stack, 0, 1, 1,
-                                  SymbolMap::PERFDATA);
+      source_counts.push_back(
+          {.source = &info->source_stack, .count = 0, .num_inst = 1});
     }
   }
+  symbol_map_->AddSourceCounts(symbol_map_->GetMutableSymbolByName(name),
+                               source_counts, SymbolMap::PERFDATA);
 }
 
 }  // namespace devtools_crosstool_autofdo
@@ -18,6 +18,9 @@
 
 #include <string.h>
 
+#include <memory>
+#include <utility>
+
 #include "base/logging.h"
 #include "symbolize/bytereader.h"
 #include "symbolize/dwarf2reader.h"
@@ -25,6 +28,7 @@
 #include "symbolize/addr2line_inlinestack.h"
 #include "symbolize/functioninfo.h"
 #include "symbolize/elf_reader.h"
+#include "binary_image.h"
 #include "symbol_map.h"
 
 namespace {
@@ -54,7 +58,19 @@ void GetSection(const devtools_crosstool_autofdo::SectionMap &sections,
 namespace devtools_crosstool_autofdo {
 
 Addr2line *Addr2line::Create(absl::string_view binary_name) {
-    Addr2line *addr2line = new Google3Addr2line(std::string(binary_name));
+  return Create(BinaryImage::Open(binary_name));
+}
+
+Addr2line *Addr2line::Create(std::shared_ptr<BinaryImage> image) {
+  return CreateWithSampledFunctions(std::move(image), NULL);
+}
+
+Addr2line *Addr2line::CreateWithSampledFunctions(
+    std::shared_ptr<BinaryImage> image,
+    const std::map<uint64_t, uint64_t> *sampled_functions) {
+  if (!image) return NULL;
+  Addr2line *addr2line =
+      new Google3Addr2line(std::move(image), sampled_functions);
   if (!addr2line->Prepare()) {
     delete addr2line;
     return NULL;
@@ -64,12 +80,18 @@ Addr2line *Addr2line::Create(absl::string_view binary_name) {
 }
 
 Google3Addr2line::Google3Addr2line(const std::string& binary_name)
-    : Addr2line(binary_name), line_map_(new AddressToLineMap()),
-      inline_stack_handler_(NULL), elf_(new ElfReader(binary_name)) {}
+    : Google3Addr2line(BinaryImage::Open(binary_name)) {}
+
+Google3Addr2line::Google3Addr2line(
+    std::shared_ptr<BinaryImage> image,
+    const std::map<uint64_t, uint64_t> *sampled_functions)
+    : Addr2line(image ? image->path() : ""), line_map_(new AddressToLineMap()),
+      inline_stack_handler_(NULL), sampled_functions_(sampled_functions),
+      image_(std::move(image)),
+      elf_(image_ ? &image_->elf_reader() : NULL) {}
 
 Google3Addr2line::~Google3Addr2line() {
   delete line_map_;
-  delete elf_;
   if (inline_stack_handler_) {
     delete inline_stack_handler_;
   }
@@ -78,7 +100,10 @@ Google3Addr2line::~Google3Addr2line() {
 bool Google3Addr2line::Prepare() {
   ByteReader reader(ENDIANNESS_LITTLE);
   int width;
-  if (elf_->IsElf32File()) {
+  if (elf_ == NULL) {
+    LOG(ERROR) << "Could not read '" << binary_name_ << "'";
+    return false;
+  } else if (elf_->IsElf32File()) {
     width = 4;
   } else if (elf_->IsElf64File()) {
     width = 8;
@@ -130,7 +155,7 @@ bool Google3Addr2line::Prepare() {
                                 debug_addr_data, 
                                 debug_addr_size);
   inline_stack_handler_ = new InlineStackHandler(
-      &debug_ranges, sections, &reader, nullptr,
+      &debug_ranges, sections, &reader, sampled_functions_,
       elf_->VaddrOfFirstLoadSegment());
 
   // Extract the line information
@@ -142,7 +167,7 @@ bool Google3Addr2line::Prepare() {
     while (debug_info_pos < debug_info_size) {
       DirectoryVector dirs;
       FileVector files;
-      CULineInfoHandler handler(&files, &dirs, line_map_, nullptr);
+      CULineInfoHandler handler(&files, &dirs, line_map_, sampled_functions_);
       inline_stack_handler_->set_directory_names(&dirs);
       inline_stack_handler_->set_file_names(&files);
       inline_stack_handler_->set_line_handler(&handler);
@@ -167,7 +192,8 @@ bool Google3Addr2line::Prepare() {
       while (pos < size) {
         DirectoryVector dirs;
         FileVector files;
-        CULineInfoHandler handler(&files, &dirs, line_map_);
+        CULineInfoHandler handler(&files, &dirs, line_map_,
+                                  sampled_functions_);
         LineInfo line(data + pos, size - pos, &reader, &handler);
         uint64_t read = line.Start();
         if (line.malformed()) {
@@ -184,6 +210,7 @@ bool Google3Addr2line::Prepare() {
       LOG(WARNING) << "File '" << binary_name_ << "' does not have .debug_line section.";
   }
   inline_stack_handler_->PopulateSubprogramsByAddress();
+  sampled_functions_ = NULL;
 
   return true;
 }
@@ -0,0 +1,225 @@
+#include "live_metrics.h"
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>  // NOLINT
+
+#include "status_provider.h"
+#include "base/logging.h"
+#include "third_party/abseil/absl/strings/match.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/strings/str_format.h"
+#include "third_party/abseil/absl/strings/str_replace.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "third_party/abseil/absl/time/clock.h"
+#include "third_party/abseil/absl/time/time.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+// How long a client may take to send its request before it is dropped. This
+// bounds how long one client can hold up the serving thread, and with it
+// `LiveMetricsHttpServer::Stop`.
+constexpr int kRequestTimeoutMs = 1000;
+
+struct LiveCounterInfo {
+  absl::string_view metric_name;
+  absl::string_view help;
+  // Whether to also export the average rate of the counter.
+  bool export_rate;
+};
+
+constexpr std::array<LiveCounterInfo, 5> kLiveCounterInfos = {{
+    {"autofdo_perf_bytes_decoded", "Bytes of perf data decoded.", true},
+    {"autofdo_samples_aggregated", "Perf samples aggregated.", true},
+    {"autofdo_branches_mapped", "Branches mapped to basic blocks.", true},
+    {"autofdo_cfgs_built", "Control flow graphs built.", false},
+    {"autofdo_assemblies_evaluated",
+     "Node chain assemblies evaluated by code layout.", true},
+}};
+
+struct LiveMetrics {
+  // Time the live metrics were first used, which approximates the start of
+  // the process.
+  const absl::Time start_time = absl::Now();
+  std::array<std::atomic<int64_t>, kLiveCounterInfos.size()> counters = {};
+};
+
+LiveMetrics &GetLiveMetrics() {
+  static auto *const live_metrics = new LiveMetrics;
+  return *live_metrics;
+}
+
+// Escapes `value` for use as a Prometheus label value.
+std::string EscapeLabelValue(absl::string_view value) {
+  return absl::StrReplaceAll(value,
+                             {{"\\", "\\\\"}, {"\"", "\\\""}, {"\n", "\\n"}});
+}
+
+// Returns an HTTP/1.0 response with `status`, `content_type` and `body`.
+std::string MakeHttpResponse(absl::string_view status,
+                             absl::string_view content_type,
+                             absl::string_view body) {
+  return absl::StrCat("HTTP/1.0 ", status, "\r\nContent-Type: ", content_type,
+                      "\r\nContent-Length: ", body.size(),
+                      "\r\nConnection: close\r\n\r\n", body);
+}
+
+// Writes all of `data` to the socket `fd`, giving up on the first error.
+// Uses MSG_NOSIGNAL so a client which closed or reset the connection is
+// dropped (EPIPE or ECONNRESET) rather than killing the process with SIGPIPE.
+void WriteFully(int fd, absl::string_view data) {
+  while (!data.empty()) {
+    const ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && errno != EPIPE && errno != ECONNRESET) {
+      LOG(WARNING) << "Failed to write live metrics response: "
+                   << std::strerror(errno);
+    }
+    if (n <= 0) return;
+    data.remove_prefix(n);
+  }
+}
+}  // namespace
+
+void IncrementLiveCounter(LiveCounter counter, int64_t delta) {
+  GetLiveMetrics()
+      .counters[static_cast<int>(counter)]
+      .fetch_add(delta, std::memory_order_relaxed);
+}
+
+int64_t GetLiveCounter(LiveCounter counter) {
+  return GetLiveMetrics()
+      .counters[static_cast<int>(counter)]
+      .load(std::memory_order_relaxed);
+}
+
+int64_t GetCurrentRssBytes() {
+  std::ifstream statm("/proc/self/statm");
+  int64_t size_pages = 0, resident_pages = 0;
+  if (!(statm >> size_pages >> resident_pages)) return 0;
+  return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+std::string RenderLiveMetricsInPrometheusFormat(
+    const StatusProvider &status_provider) {
+  LiveMetrics &live_metrics = GetLiveMetrics();
+  const double uptime_seconds =
+      absl::ToDoubleSeconds(absl::Now() - live_metrics.start_time);
+  std::string out;
+  for (int i = 0; i != kLiveCounterInfos.size(); ++i) {
+    const LiveCounterInfo &info = kLiveCounterInfos[i];
+    const int64_t value =
+        live_metrics.counters[i].load(std::memory_order_relaxed);
+    absl::StrAppendFormat(&out,
+                          "# HELP %s_total %s\n# TYPE %s_total counter\n"
+                          "%s_total %d\n",
+                          info.metric_name, info.help, info.metric_name,
+                          info.metric_name, value);
+    if (!info.export_rate) continue;
+    absl::StrAppendFormat(
+        &out,
+        "# HELP %s_per_second Average rate of %s_total since the process "
+        "started.\n# TYPE %s_per_second gauge\n%s_per_second %g\n",
+        info.metric_name, info.metric_name, info.metric_name, info.metric_name,
+        uptime_seconds > 0 ? value / uptime_seconds : 0.0);
+  }
+  absl::StrAppendFormat(
+      &out,
+      "# HELP autofdo_resident_memory_bytes Resident set size of the "
+      "process.\n# TYPE autofdo_resident_memory_bytes gauge\n"
+      "autofdo_resident_memory_bytes %d\n",
+      GetCurrentRssBytes());
+  absl::StrAppendFormat(
+      &out,
+      "# HELP autofdo_uptime_seconds Seconds since the process started.\n"
+      "# TYPE autofdo_uptime_seconds gauge\nautofdo_uptime_seconds %g\n",
+      uptime_seconds);
+  absl::StrAppendFormat(
+      &out,
+      "# HELP autofdo_progress_percent Progress of the running job.\n"
+      "# TYPE autofdo_progress_percent gauge\n"
+      "autofdo_progress_percent{job=\"%s\"} %d\n",
+      EscapeLabelValue(status_provider.GetJob()),
+      status_provider.GetProgress());
+  return out;
+}
+
+void ResetLiveCountersForTest() {
+  for (std::atomic<int64_t> &counter : GetLiveMetrics().counters)
+    counter.store(0, std::memory_order_relaxed);
+}
+
+void LiveMetricsHttpServer::Start(StatusProvider &status_provider) {
+  const int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    LOG(WARNING) << "Cannot create the live metrics socket: "
+                 << std::strerror(errno);
+    return;
+  }
+  const int reuse_addr = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse_addr,
+             sizeof(reuse_addr));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port_);
+  if (bind(listen_fd, reinterpret_cast<const sockaddr *>(&addr),
+           sizeof(addr)) != 0 ||
+      listen(listen_fd, /*backlog=*/8) != 0) {
+    LOG(WARNING) << "Cannot serve live metrics on port " << port_ << ": "
+                 << std::strerror(errno);
+    close(listen_fd);
+    return;
+  }
+  LOG(INFO) << "Serving live metrics on http://127.0.0.1:" << port_
+            << "/metrics";
+  stopping_ = false;
+  thread_ = std::thread(
+      [this, listen_fd, &status_provider] { Serve(listen_fd, status_provider); });
+}
+
+void LiveMetricsHttpServer::Stop() {
+  if (!thread_.joinable()) return;
+  stopping_ = true;
+  thread_.join();
+}
+
+void LiveMetricsHttpServer::Serve(int listen_fd,
+                                  const StatusProvider &status_provider) {
+  while (!stopping_) {
+    // Wake up periodically to check whether `Stop` has been called.
+    pollfd listen_poll_fd = {.fd = listen_fd, .events = POLLIN};
+    if (poll(&listen_poll_fd, 1, /*timeout=*/100) <= 0) continue;
+    const int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) continue;
+    // Only the request line is needed, which fits in the first read.
+    char request[1024];
+    ssize_t n = 0;
+    pollfd request_poll_fd = {.fd = fd, .events = POLLIN};
+    if (poll(&request_poll_fd, 1, kRequestTimeoutMs) > 0)
+      n = read(fd, request, sizeof(request));
+    const absl::string_view request_line =
+        n > 0 ? absl::string_view(request, n) : absl::string_view();
+    if (absl::StartsWith(request_line, "GET /metrics ")) {
+      WriteFully(fd, MakeHttpResponse(
+                         "200 OK", "text/plain; version=0.0.4",
+                         RenderLiveMetricsInPrometheusFormat(status_provider)));
+    } else {
+      WriteFully(fd, MakeHttpResponse("404 Not Found", "text/plain",
+                                      "Only /metrics is served.\n"));
+    }
+    close(fd);
+  }
+  close(listen_fd);
+}
+}  // namespace devtools_crosstool_autofdo
@@ -0,0 +1,102 @@
+#ifndef AUTOFDO_LIVE_METRICS_H_
+#define AUTOFDO_LIVE_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>  // NOLINT
+
+#include "status_consumer_registry.h"
+#include "status_provider.h"
+
+namespace devtools_crosstool_autofdo {
+
+// Process-wide counters updated while profiles are generated, so that long
+// running jobs can be monitored while they run.
+enum class LiveCounter {
+  // Bytes of perf data files decoded.
+  kPerfBytesDecoded,
+  // Perf samples whose LBR stack has been aggregated.
+  kSamplesAggregated,
+  // Aggregated branches mapped to basic blocks.
+  kBranchesMapped,
+  // Control flow graphs built.
+  kCfgsBuilt,
+  // Node chain assemblies evaluated by code layout.
+  kAssembliesEvaluated,
+};
+
+// Adds `delta` to `counter`. Safe to call concurrently.
+void IncrementLiveCounter(LiveCounter counter, int64_t delta = 1);
+
+// Counts increments of a live counter locally and adds them to the counter in
+// batches of `batch_size`, and when destroyed. Use it for counters updated in
+// hot loops, where an atomic increment per event is too costly. Not safe to use
+// concurrently.
+class BatchedLiveCounter {
+ public:
+  explicit BatchedLiveCounter(LiveCounter counter, int64_t batch_size = 4096)
+      : counter_(counter), batch_size_(batch_size) {}
+  ~BatchedLiveCounter() { Flush(); }
+
+  BatchedLiveCounter(const BatchedLiveCounter &) = delete;
+  BatchedLiveCounter &operator=(const BatchedLiveCounter &) = delete;
+
+  void Increment() {
+    if (++pending_ == batch_size_) Flush();
+  }
+
+  // Adds the pending increments to the counter.
+  void Flush() {
+    if (pending_ == 0) return;
+    IncrementLiveCounter(counter_, pending_);
+    pending_ = 0;
+  }
+
+ private:
+  const LiveCounter counter_;
+  const int64_t batch_size_;
+  int64_t pending_ = 0;
+};
+
+// Returns the current value of `counter`.
+int64_t GetLiveCounter(LiveCounter counter);
+
+// Returns the current resident set size of the process, or 0 if unavailable.
+int64_t GetCurrentRssBytes();
+
+// Returns the live counters, their average rates since the process started,
+// the current resident set size and the progress of `status_provider` in the
+// Prometheus text exposition format.
+std::string RenderLiveMetricsInPrometheusFormat(
+    const StatusProvider &status_provider);
+
+// Resets all live counters to zero. To be only used in tests.
+void ResetLiveCountersForTest();
+
+// Serves `RenderLiveMetricsInPrometheusFormat` over HTTP on
+// `127.0.0.1:<port>/metrics` while the status provider is running. Register it
+// in `StatusConsumerRegistry` so it is started together with the other status
+// consumers.
+class LiveMetricsHttpServer : public StatusConsumer {
+ public:
+  explicit LiveMetricsHttpServer(int port) : port_(port) {}
+  ~LiveMetricsHttpServer() override { Stop(); }
+
+  LiveMetricsHttpServer(const LiveMetricsHttpServer &) = delete;
+  LiveMetricsHttpServer &operator=(const LiveMetricsHttpServer &) = delete;
+
+  void Start(StatusProvider &status_provider) override;
+  void Stop() override;
+
+ private:
+  // Accepts and answers requests until `Stop` is called.
+  void Serve(int listen_fd, const StatusProvider &status_provider);
+
+  const int port_;
+  std::atomic<bool> stopping_ = false;
+  std::thread thread_;
+};
+}  // namespace devtools_crosstool_autofdo
+
+#endif  // AUTOFDO_LIVE_METRICS_H_
@@ -0,0 +1,182 @@
+#include "live_metrics.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "status_provider.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "third_party/abseil/absl/time/clock.h"
+#include "third_party/abseil/absl/time/time.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+
+using ::testing::AllOf;
+using ::testing::ContainsRegex;
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+// Returns a socket connected to the loopback `port`, or -1 on failure.
+int ConnectToLoopback(int port) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) !=
+      0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Returns a loopback port which is currently free.
+int GetFreeLoopbackPort() {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addr_len = sizeof(addr);
+  bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
+  getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &addr_len);
+  close(fd);
+  return ntohs(addr.sin_port);
+}
+
+class LiveMetricsTest : public testing::Test {
+ protected:
+  void SetUp() override { ResetLiveCountersForTest(); }
+  void TearDown() override { ResetLiveCountersForTest(); }
+};
+
+TEST_F(LiveMetricsTest, IncrementsCounters) {
+  IncrementLiveCounter(LiveCounter::kPerfBytesDecoded, 4096);
+  IncrementLiveCounter(LiveCounter::kSamplesAggregated);
+  IncrementLiveCounter(LiveCounter::kSamplesAggregated);
+  EXPECT_EQ(GetLiveCounter(LiveCounter::kPerfBytesDecoded), 4096);
+  EXPECT_EQ(GetLiveCounter(LiveCounter::kSamplesAggregated), 2);
+  EXPECT_EQ(GetLiveCounter(LiveCounter::kCfgsBuilt), 0);
+
+  ResetLiveCountersForTest();
+  EXPECT_EQ(GetLiveCounter(LiveCounter::kPerfBytesDecoded), 0);
+}
+
+TEST_F(LiveMetricsTest, IncrementsCountersConcurrently) {
+  std::vector<std::thread> threads;
+  for (int i = 0; i != 4; ++i) {
+    threads.emplace_back([] {
+      for (int j = 0; j != 1000; ++j)
+        IncrementLiveCounter(LiveCounter::kAssembliesEvaluated);
+    });
+  }
+  for (std::thread &thread : threads) thread.join();
+  EXPECT_EQ(GetLiveCounter(LiveCounter::kAssembliesEvaluated), 4000);
+}
+
+TEST_F(LiveMetricsTest, RendersPrometheusFormat) {
+  IncrementLiveCounter(LiveCounter::kBranchesMapped, 7);
+  IncrementLiveCounter(LiveCounter::kCfgsBuilt, 3);
+  DefaultStatusProvider status_provider("map \"branches\"");
+  status_provider.SetProgress(40);
+
+  const std::string metrics =
+      RenderLiveMetricsInPrometheusFormat(status_provider);
+  EXPECT_THAT(
+      metrics,
+      AllOf(HasSubstr("# TYPE autofdo_branches_mapped_total counter\n"
+                      "autofdo_branches_mapped_total 7\n"),
+            HasSubstr("# TYPE autofdo_branches_mapped_per_second gauge\n"),
+            HasSubstr("autofdo_cfgs_built_total 3\n"),
+            Not(HasSubstr("autofdo_cfgs_built_per_second")),
+            HasSubstr("autofdo_perf_bytes_decoded_total 0\n"),
+            ContainsRegex("autofdo_resident_memory_bytes [1-9][0-9]*\n"),
+            HasSubstr("autofdo_progress_percent{job=\"map \\\"branches\\\"\"} "
+                      "40\n")));
+}
+
+TEST_F(LiveMetricsTest, BatchedCounterAddsInBatches) {
+  {
+    BatchedLiveCounter counter(LiveCounter::kSamplesAggregated,
+                               /*batch_size=*/3);
+    for (int i = 0; i < 7; ++i) counter.Increment();
+    EXPECT_EQ(GetLiveCounter(LiveCounter::kSamplesAggregated), 6);
+    counter.Flush();
+    EXPECT_EQ(GetLiveCounter(LiveCounter::kSamplesAggregated), 7);
+    counter.Increment();
+  }
+  // The remaining increments are added on destruction.
+  EXPECT_EQ(GetLiveCounter(LiveCounter::kSamplesAggregated), 8);
+}
+
+TEST_F(LiveMetricsTest, SilentClientDoesNotBlockServer) {
+  DefaultStatusProvider status_provider("job");
+  const int port = GetFreeLoopbackPort();
+  LiveMetricsHttpServer server(port);
+  server.Start(status_provider);
+
+  // A client which connects and never sends a request.
+  const int silent_fd = ConnectToLoopback(port);
+  ASSERT_GE(silent_fd, 0);
+
+  // The server drops the silent client and answers the next one.
+  const int fd = ConnectToLoopback(port);
+  ASSERT_GE(fd, 0);
+  const std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+  ASSERT_EQ(write(fd, request.data(), request.size()),
+            static_cast<ssize_t>(request.size()));
+  std::string response;
+  char buffer[4096];
+  for (ssize_t n; (n = read(fd, buffer, sizeof(buffer))) > 0;)
+    response.append(buffer, n);
+  close(fd);
+  EXPECT_THAT(response, HasSubstr("200 OK"));
+
+  // Stopping does not wait for a client which sends nothing.
+  const int other_silent_fd = ConnectToLoopback(port);
+  ASSERT_GE(other_silent_fd, 0);
+  const absl::Time stop_start = absl::Now();
+  server.Stop();
+  EXPECT_LT(absl::Now() - stop_start, absl::Seconds(10));
+  close(silent_fd);
+  close(other_silent_fd);
+}
+
+TEST_F(LiveMetricsTest, ResetClientDoesNotKillServer) {
+  DefaultStatusProvider status_provider("job");
+  const int port = GetFreeLoopbackPort();
+  LiveMetricsHttpServer server(port);
+  server.Start(status_provider);
+
+  // A client which resets the connection before the response is written.
+  // Writing to it must not raise SIGPIPE.
+  const int reset_fd = ConnectToLoopback(port);
+  ASSERT_GE(reset_fd, 0);
+  const linger reset_linger = {.l_onoff = 1, .l_linger = 0};
+  setsockopt(reset_fd, SOL_SOCKET, SO_LINGER, &reset_linger,
+             sizeof(reset_linger));
+  close(reset_fd);
+
+  // The server keeps answering.
+  const int fd = ConnectToLoopback(port);
+  ASSERT_GE(fd, 0);
+  const std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+  ASSERT_EQ(write(fd, request.data(), request.size()),
+            static_cast<ssize_t>(request.size()));
+  std::string response;
+  char buffer[4096];
+  for (ssize_t n; (n = read(fd, buffer, sizeof(buffer))) > 0;)
+    response.append(buffer, n);
+  close(fd);
+  EXPECT_THAT(response, HasSubstr("200 OK"));
+  server.Stop();
+}
+
+}  // namespace
+}  // namespace devtools_crosstool_autofdo
@@ -1,11 +1,14 @@
 #include "llvm_propeller_binary_address_mapper.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <stack>
+#include <string>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -13,6 +16,7 @@
 
 #include "bb_handle.h"
 #include "binary_address_branch.h"
+#include "llvm_propeller_binary_address_mapper_cache.h"
 #include "llvm_propeller_binary_content.h"
 #include "llvm_propeller_formatting.h"
 #include "llvm_propeller_options.pb.h"
@@ -36,9 +40,11 @@
 #include "llvm/Object/ELFTypes.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FormatAdapters.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/LEB128.h"
 #include "base/logging.h"
 #include "base/status_macros.h"
 
@@ -116,6 +122,244 @@ absl::StatusOr<std::vector<BBAddrMap>> ReadBbAddrMap(
   return std::move(*bb_addr_map);
 }
 
+// Minimal reader over the contents of a SHT_LLVM_BB_ADDR_MAP section, used to
+// scan and selectively decode function entries without going through
+// `ELFObjectFileBase::readBBAddrMap`.
+class BbAddrMapSectionReader {
+ public:
+  BbAddrMapSectionReader(StringRef contents, uint64_t offset,
+                         bool is_little_endian)
+      : contents_(contents),
+        offset_(offset),
+        is_little_endian_(is_little_endian) {}
+
+  bool done() const { return offset_ >= contents_.size(); }
+  uint64_t offset() const { return offset_; }
+
+  absl::StatusOr<uint8_t> ReadU8() {
+    if (done()) return Truncated();
+    return static_cast<uint8_t>(contents_[offset_++]);
+  }
+
+  absl::StatusOr<uint64_t> ReadAddress() {
+    if (contents_.size() - offset_ < sizeof(uint64_t)) return Truncated();
+    const char *p = contents_.data() + offset_;
+    offset_ += sizeof(uint64_t);
+    return is_little_endian_ ? llvm::support::endian::read64le(p)
+                             : llvm::support::endian::read64be(p);
+  }
+
+  // Reads a ULEB128-encoded value, which must fit in 32 bits.
+  absl::StatusOr<uint32_t> ReadUleb32() {
+    ASSIGN_OR_RETURN(uint64_t value, ReadUleb64());
+    if (value > std::numeric_limits<uint32_t>::max()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "ULEB128 value at offset 0x%x exceeds 32 bits.", offset_));
+    }
+    return static_cast<uint32_t>(value);
+  }
+
+  absl::StatusOr<uint64_t> ReadUleb64() {
+    unsigned length = 0;
+    const char *error = nullptr;
+    const auto *begin =
+        reinterpret_cast<const uint8_t *>(contents_.data()) + offset_;
+    const auto *end =
+        reinterpret_cast<const uint8_t *>(contents_.data()) + contents_.size();
+    uint64_t value = llvm::decodeULEB128(begin, &length, end, &error);
+    if (error != nullptr) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Malformed ULEB128 at offset 0x%x: %s.", offset_, error));
+    }
+    offset_ += length;
+    return value;
+  }
+
+ private:
+  absl::Status Truncated() const {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Unexpected end of BB address map section at offset 0x%x.", offset_));
+  }
+
+  StringRef contents_;
+  uint64_t offset_;
+  bool is_little_endian_;
+};
+
+// Feature bits of SHT_LLVM_BB_ADDR_MAP function entries which are understood
+// by `ScanBbAddrMap`: function entry count (0x1), basic block frequencies (0x2)
+// and branch probabilities (0x4). Entries with any other feature (e.g.,
+// multiple BB ranges) are left to LLVM's decoder.
+constexpr uint8_t kScannableBbAddrMapFeatures = 0x7;
+
+// Location of one function's entry in a SHT_LLVM_BB_ADDR_MAP section, as found
+// by `ScanBbAddrMap`. Only the information needed to select hot functions is
+// extracted; the BB entries are decoded later by `DecodeBbAddrMapFunction`.
+struct BbAddrMapFunctionRef {
+  // Contents of the section holding the entry.
+  StringRef section_contents;
+  // Offset of the function address field of the entry in `section_contents`.
+  uint64_t offset;
+  uint8_t version;
+  uint64_t function_address;
+  // The end address of the function's last basic block.
+  uint64_t end_address;
+};
+
+// Scans all function entries in the BB address map sections of
+// `binary_content`, skipping over (but not materializing) their BB entries.
+// Returns an error if the sections use an encoding not supported here, in which
+// case the caller should fall back to `ReadBbAddrMap`.
+absl::StatusOr<std::vector<BbAddrMapFunctionRef>> ScanBbAddrMap(
+    const BinaryContent &binary_content) {
+  const llvm::object::ObjectFile &object_file = *binary_content.object_file;
+  if (object_file.getBytesInAddress() != sizeof(uint64_t)) {
+    return absl::UnimplementedError("Only 64-bit binaries can be scanned.");
+  }
+  std::vector<BbAddrMapFunctionRef> function_refs;
+  for (const llvm::object::SectionRef &section : object_file.sections()) {
+    if (llvm::object::ELFSectionRef(section).getType() !=
+        llvm::ELF::SHT_LLVM_BB_ADDR_MAP)
+      continue;
+    Expected<StringRef> contents = section.getContents();
+    if (!contents) {
+      return absl::InternalError(llvm::toString(contents.takeError()));
+    }
+    BbAddrMapSectionReader reader(*contents, 0, object_file.isLittleEndian());
+    while (!reader.done()) {
+      ASSIGN_OR_RETURN(uint8_t version, reader.ReadU8());
+      ASSIGN_OR_RETURN(uint8_t features, reader.ReadU8());
+      if (version < 1 || version > 2 ||
+          (features & ~kScannableBbAddrMapFeatures) != 0) {
+        return absl::UnimplementedError(absl::StrFormat(
+            "BB address map entry with version %d and features 0x%x cannot be "
+            "scanned.",
+            version, features));
+      }
+      BbAddrMapFunctionRef function_ref = {.section_contents = *contents,
+                                           .offset = reader.offset(),
+                                           .version = version};
+      ASSIGN_OR_RETURN(function_ref.function_address, reader.ReadAddress());
+      ASSIGN_OR_RETURN(uint32_t num_blocks, reader.ReadUleb32());
+      uint64_t end_offset = 0;
+      for (uint32_t i = 0; i != num_blocks; ++i) {
+        if (version >= 2) {
+          RETURN_IF_ERROR(reader.ReadUleb32().status());
+        }
+        ASSIGN_OR_RETURN(uint32_t offset, reader.ReadUleb32());
+        ASSIGN_OR_RETURN(uint32_t size, reader.ReadUleb32());
+        RETURN_IF_ERROR(reader.ReadUleb32().status());
+        // Block offsets are relative to the end of the previous block.
+        end_offset += offset + size;
+      }
+      function_ref.end_address = function_ref.function_address + end_offset;
+      // Skip over the PGO analysis data.
+      if (features & 0x1) {
+        RETURN_IF_ERROR(reader.ReadUleb64().status());
+      }
+      if (features & 0x6) {
+        for (uint32_t i = 0; i != num_blocks; ++i) {
+          if (features & 0x2) {
+            RETURN_IF_ERROR(reader.ReadUleb64().status());
+          }
+          if (features & 0x4) {
+            ASSIGN_OR_RETURN(uint64_t num_successors, reader.ReadUleb64());
+            for (uint64_t j = 0; j != num_successors; ++j) {
+              RETURN_IF_ERROR(reader.ReadUleb32().status());
+              RETURN_IF_ERROR(reader.ReadUleb32().status());
+            }
+          }
+        }
+      }
+      function_refs.push_back(function_ref);
+    }
+  }
+  if (function_refs.empty()) {
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "'%s' does not have a non-empty LLVM_BB_ADDR_MAP section.",
+        binary_content.file_name));
+  }
+  return function_refs;
+}
+
+// Fully decodes the function entry referenced by `function_ref`.
+absl::StatusOr<BBAddrMap> DecodeBbAddrMapFunction(
+    const BbAddrMapFunctionRef &function_ref, bool is_little_endian) {
+  BbAddrMapSectionReader reader(function_ref.section_contents,
+                                function_ref.offset, is_little_endian);
+  ASSIGN_OR_RETURN(uint64_t function_address, reader.ReadAddress());
+  ASSIGN_OR_RETURN(uint32_t num_blocks, reader.ReadUleb32());
+  std::vector<BBAddrMap::BBEntry> bb_entries;
+  bb_entries.reserve(num_blocks);
+  uint32_t prev_bb_end_offset = 0;
+  for (uint32_t bb_index = 0; bb_index != num_blocks; ++bb_index) {
+    uint32_t id = bb_index;
+    if (function_ref.version >= 2) {
+      ASSIGN_OR_RETURN(id, reader.ReadUleb32());
+    }
+    ASSIGN_OR_RETURN(uint32_t offset, reader.ReadUleb32());
+    ASSIGN_OR_RETURN(uint32_t size, reader.ReadUleb32());
+    ASSIGN_OR_RETURN(uint32_t metadata, reader.ReadUleb32());
+    offset += prev_bb_end_offset;
+    prev_bb_end_offset = offset + size;
+    Expected<BBAddrMap::BBEntry::Metadata> decoded_metadata =
+        BBAddrMap::BBEntry::Metadata::decode(metadata);
+    if (!decoded_metadata) {
+      return absl::InvalidArgumentError(
+          llvm::toString(decoded_metadata.takeError()));
+    }
+    bb_entries.push_back({id, offset, size, *decoded_metadata});
+  }
+  return BBAddrMap({BBAddrMap::BBRangeEntry{
+      .BaseAddress = function_address, .BBEntries = std::move(bb_entries)}});
+}
+
+// Returns the binary's `BBAddrMap`s, given the `function_refs` returned by
+// `ScanBbAddrMap`, only decoding the BB entries of functions containing any of
+// `hot_addresses`. All other functions are represented by an entry with their
+// function address and no BB entries. Function indices are identical to those
+// of `ReadBbAddrMap`. Returns an error if the functions are not sorted by
+// address, in which case the caller should fall back to `ReadBbAddrMap`.
+absl::StatusOr<std::vector<BBAddrMap>> ReadHotBbAddrMap(
+    const BinaryContent &binary_content,
+    absl::Span<const BbAddrMapFunctionRef> function_refs,
+    const absl::flat_hash_set<uint64_t> &hot_addresses) {
+  if (!absl::c_is_sorted(function_refs, [](const BbAddrMapFunctionRef &a,
+                                           const BbAddrMapFunctionRef &b) {
+        return a.function_address < b.function_address;
+      })) {
+    return absl::UnimplementedError(
+        "BB address map functions are not sorted by address.");
+  }
+  std::vector<bool> is_hot(function_refs.size(), false);
+  for (uint64_t address : hot_addresses) {
+    auto it = absl::c_upper_bound(
+        function_refs, address,
+        [](uint64_t addr, const BbAddrMapFunctionRef &function_ref) {
+          return addr < function_ref.function_address;
+        });
+    if (it == function_refs.begin()) continue;
+    it = std::prev(it);
+    if (address >= it->end_address) continue;
+    is_hot[it - function_refs.begin()] = true;
+  }
+  std::vector<BBAddrMap> bb_addr_map;
+  bb_addr_map.reserve(function_refs.size());
+  for (int i = 0; i != function_refs.size(); ++i) {
+    if (!is_hot[i]) {
+      bb_addr_map.push_back(BBAddrMap({BBAddrMap::BBRangeEntry{
+          .BaseAddress = function_refs[i].function_address}}));
+      continue;
+    }
+    ASSIGN_OR_RETURN(
+        BBAddrMap function_bb_addr_map,
+        DecodeBbAddrMapFunction(function_refs[i],
+                                binary_content.object_file->isLittleEndian()));
+    bb_addr_map.push_back(std::move(function_bb_addr_map));
+  }
+  return bb_addr_map;
+}
+
 // Returns a map from BB-address-map function indexes to their symbol info.
 absl::flat_hash_map<int, BinaryAddressMapper::FunctionSymbolInfo>
 GetSymbolInfoMap(
@@ -153,10 +397,7 @@ GetSymbolInfoMap(
 class BinaryAddressMapperBuilder {
  public:
   BinaryAddressMapperBuilder(
-      absl::flat_hash_map<uint64_t,
-                          llvm::SmallVector<llvm::object::ELFSymbolRef>>
-          symtab,
-      std::vector<llvm::object::BBAddrMap> bb_addr_map, PropellerStats &stats,
+      BinaryAddressMapperInputs inputs, PropellerStats &stats,
       absl::Nonnull<const PropellerOptions *> options
           ABSL_ATTRIBUTE_LIFETIME_BOUND);
 
@@ -173,8 +414,7 @@ class BinaryAddressMapperBuilder {
       const absl::flat_hash_set<uint64_t> *hot_addresses) &&;
 
  private:
-  // Returns a list of hot functions based on addresses `hot_addresses`. This
-  // must be called after `ReadSymbolTable`, which initializes `symtab_`.
+  // Returns a list of hot functions based on addresses `hot_addresses`.
   // The returned `btree_set`
   // specifies the hot functions by their index in `bb_addr_map()`.
   absl::btree_set<int> CalculateHotFunctions(
@@ -190,7 +430,8 @@ class BinaryAddressMapperBuilder {
 
   // Removes all functions that are not included (selected) in the
   // `selected_functions` set. Clears their associated BB entries from
-  // `bb_addr_map_` and also removes their associated entries from `symtab_`.
+  // `bb_addr_map_` and also removes their associated entries from
+  // `symbol_info_map_`.
   void DropNonSelectedFunctions(const absl::btree_set<int> &selected_functions);
 
   // Removes all functions without associated symbol names from the given
@@ -208,10 +449,6 @@ class BinaryAddressMapperBuilder {
 
   // BB address map of functions.
   std::vector<llvm::object::BBAddrMap> bb_addr_map_;
-  // Non-zero sized function symbols from elf symbol table, indexed by
-  // symbol address. Multiple function symbols may exist on the same address.
-  absl::flat_hash_map<uint64_t, llvm::SmallVector<llvm::object::ELFSymbolRef>>
-      symtab_;
 
   // Map from every function index (in `bb_addr_map_`) to its symbol info.
   absl::flat_hash_map<int, BinaryAddressMapper::FunctionSymbolInfo>
@@ -224,10 +461,53 @@ class BinaryAddressMapperBuilder {
 
 std::optional<int> BinaryAddressMapper::FindBbHandleIndexUsingBinaryAddress(
     uint64_t address, BranchDirection direction) const {
-  std::vector<BbHandle>::const_iterator it = absl::c_upper_bound(
-      bb_handles_, address, [this](uint64_t addr, const BbHandle &bb_handle) {
-        return addr < GetAddress(bb_handle);
-      });
+  return FindBbHandleIndexUsingUpperBound(
+      address, direction,
+      absl::c_upper_bound(bb_handles_, address,
+                          [this](uint64_t addr, const BbHandle &bb_handle) {
+                            return addr < GetAddress(bb_handle);
+                          }));
+}
+
+std::vector<std::optional<int>>
+BinaryAddressMapper::FindBbHandleIndicesUsingBinaryAddresses(
+    absl::Span<const AddressQuery> queries) const {
+  std::vector<std::optional<int>> results(queries.size());
+  std::vector<int> order(queries.size());
+  for (int i = 0; i != order.size(); ++i) order[i] = i;
+  absl::c_sort(order, [&queries](int a, int b) {
+    return queries[a].address < queries[b].address;
+  });
+  // `upper` always points to the first BB handle with an address greater than
+  // the current query's address. Since queries are visited in increasing
+  // address order, it only ever moves forward. We gallop forward to skip large
+  // runs of unsampled blocks quickly and then binary search the last step.
+  std::vector<BbHandle>::const_iterator upper = bb_handles_.begin();
+  auto address_is_less = [this](uint64_t addr, const BbHandle &bb_handle) {
+    return addr < GetAddress(bb_handle);
+  };
+  for (int query_index : order) {
+    const AddressQuery &query = queries[query_index];
+    std::ptrdiff_t step = 1;
+    std::vector<BbHandle>::const_iterator low = upper;
+    while (bb_handles_.end() - low > step &&
+           GetAddress(*(low + step)) <= query.address) {
+      low += step;
+      step *= 2;
+    }
+    upper = std::upper_bound(
+        low, low + std::min(step + 1, bb_handles_.end() - low), query.address,
+        address_is_less);
+    results[query_index] =
+        FindBbHandleIndexUsingUpperBound(query.address, query.direction, upper);
+  }
+  return results;
+}
+
+std::optional<int> BinaryAddressMapper::FindBbHandleIndexUsingUpperBound(
+    uint64_t address, BranchDirection direction,
+    std::vector<BbHandle>::const_iterator upper) const {
+  std::vector<BbHandle>::const_iterator it = upper;
   if (it == bb_handles_.begin()) return std::nullopt;
   it = std::prev(it);
   if (address > GetAddress(*it)) {
@@ -312,6 +592,9 @@ absl::btree_set<int> BinaryAddressMapperBuilder::CalculateHotFunctions(
                             });
     if (it == bb_addr_map_.begin()) return;
     it = std::prev(it);
+    // Functions whose BB entries were not decoded (see `ReadHotBbAddrMap`)
+    // are known not to contain any hot address.
+    if (it->getBBEntries().empty()) return;
     // We know the address is bigger than or equal to the function address. Make
     // sure that it doesn't point beyond the last basic block.
     if (binary_address >= it->getFunctionAddress() +
@@ -434,13 +717,10 @@ absl::btree_set<int> BinaryAddressMapperBuilder::SelectFunctions(
 }
 
 BinaryAddressMapperBuilder::BinaryAddressMapperBuilder(
-    absl::flat_hash_map<uint64_t, llvm::SmallVector<llvm::object::ELFSymbolRef>>
-        symtab,
-    std::vector<llvm::object::BBAddrMap> bb_addr_map, PropellerStats &stats,
+    BinaryAddressMapperInputs inputs, PropellerStats &stats,
     const PropellerOptions *options)
-    : bb_addr_map_(std::move(bb_addr_map)),
-      symtab_(std::move(symtab)),
-      symbol_info_map_(GetSymbolInfoMap(symtab_, bb_addr_map_)),
+    : bb_addr_map_(std::move(inputs.bb_addr_map)),
+      symbol_info_map_(std::move(inputs.symbol_info_map)),
       stats_(&stats),
       options_(options) {
   stats_->bbaddrmap_stats.bbaddrmap_function_does_not_have_symtab_entry +=
@@ -462,13 +742,81 @@ absl::StatusOr<std::unique_ptr<BinaryAddressMapper>> BuildBinaryAddressMapper(
     PropellerStats &stats, const absl::flat_hash_set<uint64_t> *hot_addresses) {
   LOG(INFO) << "Started reading the binary content from: "
             << binary_content.file_name;
+  // Kernel modules need relocations applied to the BB address map, so they
+  // are neither cached nor lazily decoded.
+  std::optional<std::string> cache_path;
+  if (!options.binary_address_mapper_cache_dir().empty() &&
+      !binary_content.is_relocatable) {
+    absl::StatusOr<std::string> path = GetBinaryAddressMapperCachePath(
+        options.binary_address_mapper_cache_dir(), binary_content);
+    if (path.ok()) {
+      cache_path = *std::move(path);
+    } else {
+      LOG(WARNING) << "Not using the binary cache: " << path.status();
+    }
+  }
+  if (cache_path.has_value()) {
+    absl::StatusOr<BinaryAddressMapperInputs> cached_inputs =
+        ReadBinaryAddressMapperCache(*cache_path, binary_content,
+                                     hot_addresses);
+    if (cached_inputs.ok()) {
+      LOG(INFO) << "Read the BB address map and symbols from the binary cache: "
+                << *cache_path;
+      return BinaryAddressMapperBuilder(*std::move(cached_inputs), stats,
+                                        &options)
+          .Build(hot_addresses);
+    }
+    LOG(INFO) << "Binary cache miss: " << cached_inputs.status();
+  }
+
   absl::flat_hash_map<uint64_t, llvm::SmallVector<llvm::object::ELFSymbolRef>>
       symtab = ReadSymbolTable(binary_content);
   std::vector<llvm::object::BBAddrMap> bb_addr_map;
-  ASSIGN_OR_RETURN(bb_addr_map, ReadBbAddrMap(binary_content));
+  // When only hot functions are needed, avoid decoding the BB entries of all
+  // other functions.
+  absl::StatusOr<std::vector<BbAddrMapFunctionRef>> function_refs =
+      absl::FailedPreconditionError("The BB address map was not scanned.");
+  if (hot_addresses != nullptr && !binary_content.is_relocatable) {
+    function_refs = ScanBbAddrMap(binary_content);
+    absl::StatusOr<std::vector<BBAddrMap>> hot_bb_addr_map =
+        function_refs.ok()
+            ? ReadHotBbAddrMap(binary_content, *function_refs, *hot_addresses)
+            : function_refs.status();
+    if (hot_bb_addr_map.ok()) {
+      bb_addr_map = *std::move(hot_bb_addr_map);
+    } else {
+      LOG(INFO) << "Decoding the full BB address map: "
+                << hot_bb_addr_map.status();
+    }
+  }
+  if (bb_addr_map.empty()) {
+    ASSIGN_OR_RETURN(bb_addr_map, ReadBbAddrMap(binary_content));
+  }
 
-  return BinaryAddressMapperBuilder(std::move(symtab), std::move(bb_addr_map),
-                                    stats, &options)
+  BinaryAddressMapperInputs inputs = {
+      .symbol_info_map = GetSymbolInfoMap(symtab, bb_addr_map)};
+  inputs.bb_addr_map = std::move(bb_addr_map);
+  if (cache_path.has_value()) {
+    // The cache holds the BB entries of all functions. Those which were not
+    // decoded above are decoded one at a time while the cache is written.
+    auto get_function =
+        [&](int function_index) -> absl::StatusOr<BBAddrMap> {
+      const BBAddrMap &function_bb_addr_map =
+          inputs.bb_addr_map[function_index];
+      if (!function_bb_addr_map.getBBEntries().empty() || !function_refs.ok())
+        return function_bb_addr_map;
+      return DecodeBbAddrMapFunction(
+          (*function_refs)[function_index],
+          binary_content.object_file->isLittleEndian());
+    };
+    if (absl::Status status = WriteBinaryAddressMapperCache(
+            *cache_path, binary_content, inputs.bb_addr_map.size(),
+            get_function, inputs.symbol_info_map);
+        !status.ok()) {
+      LOG(WARNING) << "Failed to write the binary cache: " << status;
+    }
+  }
+  return BinaryAddressMapperBuilder(std::move(inputs), stats, &options)
       .Build(hot_addresses);
 }
 
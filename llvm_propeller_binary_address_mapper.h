@@ -20,6 +20,7 @@
 #include "third_party/abseil/absl/strings/str_join.h"
 #include "third_party/abseil/absl/strings/string_view.h"
 #include "third_party/abseil/absl/time/time.h"
+#include "third_party/abseil/absl/types/span.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Object/ELFTypes.h"
@@ -115,6 +116,13 @@ class BinaryAddressMapper {
     llvm::StringRef section_name;
   };
 
+  // A single binary address lookup, as passed to
+  // `FindBbHandleIndicesUsingBinaryAddresses`.
+  struct AddressQuery {
+    uint64_t address;
+    BranchDirection direction;
+  };
+
   BinaryAddressMapper(
       absl::btree_set<int> selected_functions,
       std::vector<llvm::object::BBAddrMap> bb_addr_map,
@@ -173,6 +181,14 @@ class BinaryAddressMapper {
   std::optional<int> FindBbHandleIndexUsingBinaryAddress(
       uint64_t address, BranchDirection direction) const;
 
+  // Batched version of `FindBbHandleIndexUsingBinaryAddress`. Returns a vector
+  // with the `bb_handles_` index (or nullopt) for every query in `queries`, in
+  // the same order as `queries`. The queries are sorted by address and resolved
+  // in a single forward walk over `bb_handles_`, which is much cheaper than
+  // independent binary searches when looking up many addresses.
+  std::vector<std::optional<int>> FindBbHandleIndicesUsingBinaryAddresses(
+      absl::Span<const AddressQuery> queries) const;
+
   // Returns the full function's BB address map associated with the given
   // `bb_handle`.
   const llvm::object::BBAddrMap &GetFunctionEntry(BbHandle bb_handle) const {
@@ -228,6 +244,12 @@ class BinaryAddressMapper {
   bool CanFallThrough(int from, int to) const;
 
  private:
+  // Implements `FindBbHandleIndexUsingBinaryAddress` given `upper`, the first
+  // element in `bb_handles_` whose address is greater than `address`.
+  std::optional<int> FindBbHandleIndexUsingUpperBound(
+      uint64_t address, BranchDirection direction,
+      std::vector<BbHandle>::const_iterator upper) const;
+
   absl::btree_set<int> selected_functions_;
 
   // BB handles for all basic blocks of the selected functions. BB handles are
@@ -243,7 +265,8 @@ class BinaryAddressMapper {
   // ...
   std::vector<BbHandle> bb_handles_;
 
-  // Handle to .llvm_bb_addr_map section.
+  // Handle to .llvm_bb_addr_map section. BB entries are only guaranteed to be
+  // decoded for the selected functions.
   std::vector<llvm::object::BBAddrMap> bb_addr_map_;
 
   // A map from function indices to their symbol info (function names and
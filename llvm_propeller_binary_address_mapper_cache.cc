@@ -0,0 +1,440 @@
+#include "llvm_propeller_binary_address_mapper_cache.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "llvm_propeller_binary_address_mapper.h"
+#include "llvm_propeller_binary_content.h"
+#include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "third_party/abseil/absl/container/flat_hash_set.h"
+#include "third_party/abseil/absl/functional/function_ref.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/strings/str_format.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Object/ELFTypes.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "base/status_macros.h"
+
+namespace devtools_crosstool_autofdo {
+
+namespace {
+using ::llvm::StringRef;
+using ::llvm::object::BBAddrMap;
+
+// Cache file layout (all fields in host byte order):
+//   CacheHeader
+//   build id, padded with zeros to a multiple of 8 bytes
+//   FunctionRecord[num_functions]  (in BB address map order)
+//   BbEntryRecord[num_bb_entries]
+//   NameRecord[num_names]
+// Every table consists of fixed-size records, so any record can be read
+// straight from the memory-mapped file. Each function record holds the range of
+// its BB entries in the BB entry table, which lets readers decode the BB
+// entries of a few functions without touching those of the others.
+// Names are not stored in the cache. Instead, they are recorded as ranges in
+// the binary file, whose contents `BinaryContent::file_content` already holds.
+constexpr char kCacheMagic[8] = {'P', 'R', 'O', 'P', 'B', 'A', 'M', '\0'};
+constexpr uint32_t kCacheVersion = 2;
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t build_id_size;
+  uint64_t binary_size;
+  int64_t binary_mtime_ns;
+  uint64_t num_functions;
+  uint64_t num_bb_entries;
+  uint64_t num_names;
+};
+
+// A range of bytes in the binary file.
+struct NameRecord {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct FunctionRecord {
+  uint64_t function_address;
+  // The end address of the function's last basic block.
+  uint64_t end_address;
+  // Index of the function's first BB entry in the BB entry table.
+  uint64_t first_bb_entry;
+  uint64_t num_bb_entries;
+  // Index of the function's section name in the name table. The section name
+  // is followed by the function's aliases.
+  uint64_t first_name;
+  // Number of aliases. Zero if the function has no symbol info.
+  uint64_t num_aliases;
+};
+
+struct BbEntryRecord {
+  uint32_t id;
+  uint32_t offset;
+  uint32_t size;
+  uint32_t metadata;
+};
+
+static_assert(std::is_trivially_copyable_v<CacheHeader> &&
+              std::is_trivially_copyable_v<NameRecord> &&
+              std::is_trivially_copyable_v<FunctionRecord> &&
+              std::is_trivially_copyable_v<BbEntryRecord>);
+
+uint64_t AlignTo8(uint64_t size) { return (size + 7) & ~uint64_t{7}; }
+
+// The size and modification time of a file, used to detect stale caches.
+struct FileStamp {
+  uint64_t size;
+  int64_t mtime_ns;
+};
+
+absl::StatusOr<FileStamp> GetFileStamp(absl::string_view file_name) {
+  llvm::sys::fs::file_status status;
+  if (std::error_code ec = llvm::sys::fs::status(file_name, status)) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Failed to stat '", file_name, "': ", ec.message()));
+  }
+  return FileStamp{
+      .size = status.getSize(),
+      .mtime_ns = static_cast<int64_t>(std::chrono::duration_cast<
+                                           std::chrono::nanoseconds>(
+                                           status.getLastModificationTime()
+                                               .time_since_epoch())
+                                           .count())};
+}
+
+// Returns the position of `name` within the binary's file content.
+absl::StatusOr<NameRecord> GetNameRecord(StringRef name,
+                                         const llvm::MemoryBuffer &file) {
+  const char *begin = file.getBufferStart();
+  if (name.data() < begin || name.data() + name.size() > file.getBufferEnd()) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Name '", name.str(), "' does not point into the binary's content."));
+  }
+  return NameRecord{.offset = static_cast<uint64_t>(name.data() - begin),
+                    .size = name.size()};
+}
+
+// A table of fixed-size records in the cache file. Records are copied out one
+// at a time when accessed, so only the accessed records are read.
+template <typename T>
+class RecordTable {
+ public:
+  // Creates a table of `size` records starting at `contents.data()`, which must
+  // be followed by at least `size * sizeof(T)` bytes.
+  RecordTable(StringRef contents, uint64_t size)
+      : data_(contents.data()), size_(size) {}
+
+  T operator[](uint64_t index) const {
+    T record;
+    std::memcpy(&record, data_ + index * sizeof(T), sizeof(T));
+    return record;
+  }
+
+  uint64_t size() const { return size_; }
+  uint64_t byte_size() const { return size_ * sizeof(T); }
+
+ private:
+  const char *data_;
+  uint64_t size_;
+};
+
+// Returns the index of the function in `functions`, which must be sorted by
+// address, whose address range contains `address`, or `std::nullopt` if there
+// is no such function.
+std::optional<uint64_t> FindFunction(
+    const RecordTable<FunctionRecord> &functions, uint64_t address) {
+  // Find the first function which starts after `address`.
+  uint64_t begin = 0, end = functions.size();
+  while (begin != end) {
+    uint64_t mid = begin + (end - begin) / 2;
+    if (functions[mid].function_address <= address) {
+      begin = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  if (begin == 0 || address >= functions[begin - 1].end_address)
+    return std::nullopt;
+  return begin - 1;
+}
+
+// Returns the name referenced by `record` within the binary's file content.
+absl::StatusOr<StringRef> GetName(const NameRecord &record,
+                                  const llvm::MemoryBuffer &file) {
+  if (record.offset > file.getBufferSize() ||
+      file.getBufferSize() - record.offset < record.size) {
+    return absl::DataLossError("Name out of the binary's bounds in cache.");
+  }
+  return file.getBuffer().substr(record.offset, record.size);
+}
+}  // namespace
+
+absl::StatusOr<std::string> GetBinaryAddressMapperCachePath(
+    absl::string_view cache_dir, const BinaryContent &binary_content) {
+  if (binary_content.build_id.empty()) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("'", binary_content.file_name,
+                     "' has no build id to key the binary cache on."));
+  }
+  llvm::SmallString<256> path(cache_dir);
+  llvm::sys::path::append(path,
+                          absl::StrCat(binary_content.build_id, ".bam_cache"));
+  return std::string(path);
+}
+
+absl::StatusOr<BinaryAddressMapperInputs> ReadBinaryAddressMapperCache(
+    absl::string_view cache_path, const BinaryContent &binary_content,
+    const absl::flat_hash_set<uint64_t> *hot_addresses) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(cache_path, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    return absl::NotFoundError(absl::StrCat("Failed to read '", cache_path,
+                                            "': ",
+                                            buffer.getError().message()));
+  }
+  StringRef contents = (*buffer)->getBuffer();
+  if (contents.size() < sizeof(CacheHeader))
+    return absl::DataLossError("Truncated binary address mapper cache.");
+  CacheHeader header;
+  std::memcpy(&header, contents.data(), sizeof(CacheHeader));
+  if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+      header.version != kCacheVersion) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "'", cache_path, "' is not a binary address mapper cache of version ",
+        kCacheVersion, "."));
+  }
+  // Validate the record counts against the file size up front, so every record
+  // of the tables below is within the file.
+  if (header.num_functions > contents.size() ||
+      header.num_bb_entries > contents.size() ||
+      header.num_names > contents.size() ||
+      sizeof(CacheHeader) + AlignTo8(header.build_id_size) +
+              header.num_functions * sizeof(FunctionRecord) +
+              header.num_bb_entries * sizeof(BbEntryRecord) +
+              header.num_names * sizeof(NameRecord) !=
+          contents.size()) {
+    return absl::DataLossError(
+        absl::StrCat("'", cache_path, "' has an inconsistent size."));
+  }
+  contents = contents.drop_front(sizeof(CacheHeader));
+  StringRef build_id = contents.take_front(header.build_id_size);
+  contents = contents.drop_front(AlignTo8(header.build_id_size));
+  ASSIGN_OR_RETURN(FileStamp binary_stamp,
+                   GetFileStamp(binary_content.file_name));
+  if (build_id != binary_content.build_id ||
+      header.binary_size != binary_stamp.size ||
+      header.binary_mtime_ns != binary_stamp.mtime_ns) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("'", cache_path, "' is stale for '",
+                     binary_content.file_name, "'."));
+  }
+  const RecordTable<FunctionRecord> functions(contents, header.num_functions);
+  contents = contents.drop_front(functions.byte_size());
+  const RecordTable<BbEntryRecord> bb_entries(contents, header.num_bb_entries);
+  contents = contents.drop_front(bb_entries.byte_size());
+  const RecordTable<NameRecord> names(contents, header.num_names);
+
+  bool functions_are_sorted = true;
+  for (uint64_t i = 0; i != functions.size(); ++i) {
+    const FunctionRecord function = functions[i];
+    if (function.first_bb_entry > bb_entries.size() ||
+        bb_entries.size() - function.first_bb_entry < function.num_bb_entries)
+      return absl::DataLossError("BB entry index out of bounds in cache.");
+    if (function.num_aliases != 0 &&
+        (function.first_name >= names.size() ||
+         names.size() - function.first_name - 1 < function.num_aliases))
+      return absl::DataLossError("Name index out of bounds in cache.");
+    if (i != 0 && function.function_address < functions[i - 1].function_address)
+      functions_are_sorted = false;
+  }
+
+  // Like `ReadHotBbAddrMap`, only decode the BB entries of functions containing
+  // any of `hot_addresses`. Functions can only be looked up by address if they
+  // are sorted, so all functions are decoded otherwise.
+  std::vector<bool> is_hot(functions.size(),
+                           hot_addresses == nullptr || !functions_are_sorted);
+  if (hot_addresses != nullptr && functions_are_sorted) {
+    for (uint64_t address : *hot_addresses) {
+      if (std::optional<uint64_t> function_index =
+              FindFunction(functions, address);
+          function_index.has_value()) {
+        is_hot[*function_index] = true;
+      }
+    }
+  }
+
+  const llvm::MemoryBuffer &file = *binary_content.file_content;
+  BinaryAddressMapperInputs inputs;
+  inputs.bb_addr_map.reserve(functions.size());
+  for (int function_index = 0; function_index != functions.size();
+       ++function_index) {
+    const FunctionRecord function = functions[function_index];
+    std::vector<BBAddrMap::BBEntry> function_bb_entries;
+    if (is_hot[function_index]) {
+      function_bb_entries.reserve(function.num_bb_entries);
+      for (uint64_t i = function.first_bb_entry;
+           i != function.first_bb_entry + function.num_bb_entries; ++i) {
+        const BbEntryRecord record = bb_entries[i];
+        llvm::Expected<BBAddrMap::BBEntry::Metadata> metadata =
+            BBAddrMap::BBEntry::Metadata::decode(record.metadata);
+        if (!metadata) {
+          return absl::DataLossError(llvm::toString(metadata.takeError()));
+        }
+        function_bb_entries.push_back(
+            {record.id, record.offset, record.size, *metadata});
+      }
+    }
+    inputs.bb_addr_map.push_back(BBAddrMap({BBAddrMap::BBRangeEntry{
+        .BaseAddress = function.function_address,
+        .BBEntries = std::move(function_bb_entries)}}));
+
+    if (function.num_aliases == 0) continue;
+    BinaryAddressMapper::FunctionSymbolInfo symbol_info;
+    ASSIGN_OR_RETURN(symbol_info.section_name,
+                     GetName(names[function.first_name], file));
+    for (uint64_t i = function.first_name + 1;
+         i != function.first_name + 1 + function.num_aliases; ++i) {
+      ASSIGN_OR_RETURN(symbol_info.aliases.emplace_back(),
+                       GetName(names[i], file));
+    }
+    inputs.symbol_info_map.emplace(function_index, std::move(symbol_info));
+  }
+  return inputs;
+}
+
+absl::Status WriteBinaryAddressMapperCache(
+    absl::string_view cache_path, const BinaryContent &binary_content,
+    int num_functions,
+    absl::FunctionRef<absl::StatusOr<BBAddrMap>(int function_index)>
+        get_function,
+    const absl::flat_hash_map<int, BinaryAddressMapper::FunctionSymbolInfo>
+        &symbol_info_map) {
+  if (binary_content.build_id.empty()) {
+    return absl::FailedPreconditionError(
+        "Cannot cache a binary without build id.");
+  }
+  ASSIGN_OR_RETURN(FileStamp binary_stamp,
+                   GetFileStamp(binary_content.file_name));
+
+  std::vector<FunctionRecord> functions;
+  std::vector<BbEntryRecord> bb_entries;
+  std::vector<NameRecord> names;
+  functions.reserve(num_functions);
+  for (int function_index = 0; function_index != num_functions;
+       ++function_index) {
+    ASSIGN_OR_RETURN(const BBAddrMap function_bb_addr_map,
+                     get_function(function_index));
+    if (function_bb_addr_map.getBBRanges().size() != 1) {
+      return absl::UnimplementedError(
+          "Functions with multiple BB ranges cannot be cached.");
+    }
+    FunctionRecord function = {
+        .function_address = function_bb_addr_map.getFunctionAddress(),
+        .end_address = function_bb_addr_map.getFunctionAddress(),
+        .first_bb_entry = bb_entries.size(),
+        .num_bb_entries = function_bb_addr_map.getBBEntries().size(),
+        .first_name = names.size(),
+        .num_aliases = 0};
+    if (!function_bb_addr_map.getBBEntries().empty()) {
+      const BBAddrMap::BBEntry &last_bb_entry =
+          function_bb_addr_map.getBBEntries().back();
+      function.end_address += last_bb_entry.Offset + last_bb_entry.Size;
+    }
+    for (const BBAddrMap::BBEntry &bb_entry :
+         function_bb_addr_map.getBBEntries()) {
+      bb_entries.push_back({.id = bb_entry.ID,
+                            .offset = bb_entry.Offset,
+                            .size = bb_entry.Size,
+                            .metadata = bb_entry.MD.encode()});
+    }
+    if (auto it = symbol_info_map.find(function_index);
+        it != symbol_info_map.end() && !it->second.aliases.empty()) {
+      ASSIGN_OR_RETURN(names.emplace_back(),
+                       GetNameRecord(it->second.section_name,
+                                     *binary_content.file_content));
+      for (StringRef alias : it->second.aliases) {
+        ASSIGN_OR_RETURN(names.emplace_back(),
+                         GetNameRecord(alias, *binary_content.file_content));
+      }
+      function.num_aliases = it->second.aliases.size();
+    }
+    functions.push_back(function);
+  }
+
+  CacheHeader header = {.version = kCacheVersion,
+                        .build_id_size = static_cast<uint32_t>(
+                            binary_content.build_id.size()),
+                        .binary_size = binary_stamp.size,
+                        .binary_mtime_ns = binary_stamp.mtime_ns,
+                        .num_functions = functions.size(),
+                        .num_bb_entries = bb_entries.size(),
+                        .num_names = names.size()};
+  std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+
+  StringRef parent_dir = llvm::sys::path::parent_path(cache_path);
+  if (!parent_dir.empty()) {
+    if (std::error_code ec = llvm::sys::fs::create_directories(parent_dir)) {
+      return absl::InternalError(absl::StrCat("Failed to create '",
+                                              parent_dir.str(),
+                                              "': ", ec.message()));
+    }
+  }
+  int fd;
+  llvm::SmallString<256> temp_path;
+  if (std::error_code ec = llvm::sys::fs::createUniqueFile(
+          absl::StrCat(cache_path, ".tmp-%%%%%%"), fd, temp_path)) {
+    return absl::InternalError(absl::StrCat(
+        "Failed to create a temporary file for '", cache_path,
+        "': ", ec.message()));
+  }
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    auto write_records = [&os](const auto &records) {
+      os.write(reinterpret_cast<const char *>(records.data()),
+               records.size() * sizeof(records[0]));
+    };
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    os << binary_content.build_id;
+    os.write_zeros(AlignTo8(binary_content.build_id.size()) -
+                   binary_content.build_id.size());
+    write_records(functions);
+    write_records(bb_entries);
+    write_records(names);
+    os.close();
+    if (os.has_error()) {
+      std::error_code ec = os.error();
+      os.clear_error();
+      llvm::sys::fs::remove(temp_path);
+      return absl::InternalError(absl::StrCat(
+          "Failed to write '", temp_path.str().str(), "': ", ec.message()));
+    }
+  }
+  if (std::error_code ec = llvm::sys::fs::rename(temp_path, cache_path)) {
+    llvm::sys::fs::remove(temp_path);
+    return absl::InternalError(absl::StrCat("Failed to rename '",
+                                            temp_path.str().str(), "' to '",
+                                            cache_path, "': ", ec.message()));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace devtools_crosstool_autofdo
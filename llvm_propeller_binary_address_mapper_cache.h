@@ -0,0 +1,65 @@
+#ifndef AUTOFDO_LLVM_PROPELLER_BINARY_ADDRESS_MAPPER_CACHE_H_
+#define AUTOFDO_LLVM_PROPELLER_BINARY_ADDRESS_MAPPER_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "llvm_propeller_binary_address_mapper.h"
+#include "llvm_propeller_binary_content.h"
+#include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "third_party/abseil/absl/container/flat_hash_set.h"
+#include "third_party/abseil/absl/functional/function_ref.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "llvm/Object/ELFTypes.h"
+
+namespace devtools_crosstool_autofdo {
+
+// The information decoded from a binary which `BuildBinaryAddressMapper` needs
+// before selecting functions: the BB address map of every function and the
+// symbol info of every function index which has one.
+struct BinaryAddressMapperInputs {
+  std::vector<llvm::object::BBAddrMap> bb_addr_map;
+  absl::flat_hash_map<int, BinaryAddressMapper::FunctionSymbolInfo>
+      symbol_info_map;
+};
+
+// Returns the path of the cache file for `binary_content` under `cache_dir`.
+// Cache files are keyed by build id, so this returns an error if the binary
+// does not have one.
+absl::StatusOr<std::string> GetBinaryAddressMapperCachePath(
+    absl::string_view cache_dir, const BinaryContent &binary_content);
+
+// Reads the cache file at `cache_path` and returns its contents. The cache file
+// is only accepted if it was written for a binary with the same build id, file
+// size and modification time as `binary_content`. If `hot_addresses !=
+// nullptr`, the BB entries are only decoded for functions containing any of
+// `*hot_addresses`. All other functions are represented by an entry with their
+// function address and no BB entries. Function names and section names in the
+// returned `symbol_info_map` point into `binary_content.file_content`, which
+// must outlive them.
+absl::StatusOr<BinaryAddressMapperInputs> ReadBinaryAddressMapperCache(
+    absl::string_view cache_path, const BinaryContent &binary_content,
+    const absl::flat_hash_set<uint64_t> *hot_addresses = nullptr);
+
+// Writes the BB address maps of `num_functions` functions decoded from
+// `binary_content`, along with their `symbol_info_map`, to the cache file at
+// `cache_path`, creating the parent directory if needed. `get_function` is
+// called once for each function index, in order, and must return the
+// function's fully decoded BB address map. The file is written to a temporary
+// path first and then renamed, so concurrent readers never see a
+// partially-written cache file.
+absl::Status WriteBinaryAddressMapperCache(
+    absl::string_view cache_path, const BinaryContent &binary_content,
+    int num_functions,
+    absl::FunctionRef<absl::StatusOr<llvm::object::BBAddrMap>(
+        int function_index)>
+        get_function,
+    const absl::flat_hash_map<int, BinaryAddressMapper::FunctionSymbolInfo>
+        &symbol_info_map);
+
+}  // namespace devtools_crosstool_autofdo
+
+#endif  // AUTOFDO_LLVM_PROPELLER_BINARY_ADDRESS_MAPPER_CACHE_H_
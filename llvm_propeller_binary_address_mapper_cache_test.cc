@@ -0,0 +1,182 @@
+#include "llvm_propeller_binary_address_mapper_cache.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "llvm_propeller_binary_address_mapper.h"
+#include "llvm_propeller_binary_content.h"
+#include "llvm_propeller_options.pb.h"
+#include "llvm_propeller_statistics.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "third_party/abseil/absl/container/flat_hash_set.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "llvm/Support/FileSystem.h"
+#include "util/testing/status_matchers.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+
+using ::testing::AllOf;
+using ::testing::Contains;
+using ::testing::ElementsAreArray;
+using ::testing::Eq;
+using ::testing::Field;
+using ::testing::HasSubstr;
+using ::testing::Pair;
+using ::testing::status::StatusIs;
+
+std::string GetAutoFdoTestDataFilePath(absl::string_view filename) {
+  const std::string testdata_filepath =
+      absl::StrCat(::testing::SrcDir(),
+                   "/testdata/", filename);
+  return testdata_filepath;
+}
+
+TEST(BinaryAddressMapperCache, CachePathIsKeyedByBuildId) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetAutoFdoTestDataFilePath("propeller_sample.bin")));
+  ASSERT_OK_AND_ASSIGN(
+      std::string cache_path,
+      GetBinaryAddressMapperCachePath("/cache", *binary_content));
+  EXPECT_THAT(cache_path, HasSubstr(binary_content->build_id));
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> no_build_id_content,
+                       GetBinaryContent(GetAutoFdoTestDataFilePath(
+                           "propeller_barebone_pie_nobuildid.bin")));
+  EXPECT_THAT(
+      GetBinaryAddressMapperCachePath("/cache", *no_build_id_content),
+      StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST(BinaryAddressMapperCache, BuildBinaryAddressMapperReusesCache) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetAutoFdoTestDataFilePath("propeller_sample.bin")));
+  PropellerOptions options;
+  options.set_binary_address_mapper_cache_dir(
+      absl::StrCat(::testing::TempDir(), "/bam_cache_reuse"));
+  ASSERT_OK_AND_ASSIGN(
+      std::string cache_path,
+      GetBinaryAddressMapperCachePath(
+          options.binary_address_mapper_cache_dir(), *binary_content));
+  llvm::sys::fs::remove(cache_path);
+
+  PropellerStats stats;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryAddressMapper> uncached_mapper,
+      BuildBinaryAddressMapper(options, *binary_content, stats,
+                               /*hot_addresses=*/nullptr));
+  ASSERT_TRUE(llvm::sys::fs::exists(cache_path));
+
+  ASSERT_OK_AND_ASSIGN(BinaryAddressMapperInputs cached_inputs,
+                       ReadBinaryAddressMapperCache(cache_path,
+                                                    *binary_content));
+  EXPECT_THAT(cached_inputs.bb_addr_map,
+              ElementsAreArray(uncached_mapper->bb_addr_map()));
+  ASSERT_EQ(cached_inputs.symbol_info_map.size(),
+            uncached_mapper->symbol_info_map().size());
+  for (const auto &[function_index, symbol_info] :
+       uncached_mapper->symbol_info_map()) {
+    EXPECT_THAT(
+        cached_inputs.symbol_info_map,
+        Contains(Pair(
+            function_index,
+            AllOf(Field(&BinaryAddressMapper::FunctionSymbolInfo::aliases,
+                        ElementsAreArray(symbol_info.aliases)),
+                  Field(&BinaryAddressMapper::FunctionSymbolInfo::section_name,
+                        Eq(symbol_info.section_name))))));
+  }
+
+  // A mapper built from the cache selects the same functions and blocks.
+  absl::flat_hash_set<uint64_t> hot_addresses = {0x1850, 0x17D5};
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryAddressMapper> cached_mapper,
+      BuildBinaryAddressMapper(options, *binary_content, stats,
+                               &hot_addresses));
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryAddressMapper> expected_mapper,
+      BuildBinaryAddressMapper(PropellerOptions(), *binary_content, stats,
+                               &hot_addresses));
+  EXPECT_THAT(cached_mapper->selected_functions(),
+              ElementsAreArray(expected_mapper->selected_functions()));
+  EXPECT_THAT(cached_mapper->bb_handles(),
+              ElementsAreArray(expected_mapper->bb_handles()));
+}
+
+TEST(BinaryAddressMapperCache, DecodesOnlyHotFunctionsFromCache) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetAutoFdoTestDataFilePath("propeller_sample.bin")));
+  PropellerOptions options;
+  options.set_binary_address_mapper_cache_dir(
+      absl::StrCat(::testing::TempDir(), "/bam_cache_hot"));
+  ASSERT_OK_AND_ASSIGN(
+      std::string cache_path,
+      GetBinaryAddressMapperCachePath(
+          options.binary_address_mapper_cache_dir(), *binary_content));
+  llvm::sys::fs::remove(cache_path);
+
+  // Building the mapper for hot functions only on a cache miss still writes
+  // the BB entries of all functions to the cache.
+  absl::flat_hash_set<uint64_t> hot_addresses = {0x1850, 0x17D5};
+  PropellerStats stats;
+  ASSERT_OK(BuildBinaryAddressMapper(options, *binary_content, stats,
+                                     &hot_addresses)
+                .status());
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryAddressMapper> full_mapper,
+      BuildBinaryAddressMapper(PropellerOptions(), *binary_content, stats,
+                               /*hot_addresses=*/nullptr));
+  ASSERT_OK_AND_ASSIGN(BinaryAddressMapperInputs all_inputs,
+                       ReadBinaryAddressMapperCache(cache_path,
+                                                    *binary_content));
+  EXPECT_THAT(all_inputs.bb_addr_map,
+              ElementsAreArray(full_mapper->bb_addr_map()));
+
+  ASSERT_OK_AND_ASSIGN(
+      BinaryAddressMapperInputs hot_inputs,
+      ReadBinaryAddressMapperCache(cache_path, *binary_content,
+                                   &hot_addresses));
+  ASSERT_EQ(hot_inputs.bb_addr_map.size(), all_inputs.bb_addr_map.size());
+  EXPECT_EQ(hot_inputs.symbol_info_map.size(),
+            all_inputs.symbol_info_map.size());
+  int num_decoded_functions = 0;
+  for (int i = 0; i != hot_inputs.bb_addr_map.size(); ++i) {
+    EXPECT_EQ(hot_inputs.bb_addr_map[i].getFunctionAddress(),
+              all_inputs.bb_addr_map[i].getFunctionAddress());
+    if (hot_inputs.bb_addr_map[i].getBBEntries().empty()) continue;
+    ++num_decoded_functions;
+    EXPECT_EQ(hot_inputs.bb_addr_map[i], all_inputs.bb_addr_map[i]);
+  }
+  EXPECT_EQ(num_decoded_functions, 2);
+}
+
+TEST(BinaryAddressMapperCache, RejectsCacheOfDifferentBinary) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetAutoFdoTestDataFilePath("propeller_sample.bin")));
+  PropellerOptions options;
+  options.set_binary_address_mapper_cache_dir(
+      absl::StrCat(::testing::TempDir(), "/bam_cache_stale"));
+  PropellerStats stats;
+  ASSERT_OK(BuildBinaryAddressMapper(options, *binary_content, stats,
+                                     /*hot_addresses=*/nullptr)
+                .status());
+  ASSERT_OK_AND_ASSIGN(
+      std::string cache_path,
+      GetBinaryAddressMapperCachePath(
+          options.binary_address_mapper_cache_dir(), *binary_content));
+
+  binary_content->build_id = "0123456789abcdef";
+  EXPECT_THAT(ReadBinaryAddressMapperCache(cache_path, *binary_content),
+              StatusIs(absl::StatusCode::kFailedPrecondition,
+                       HasSubstr("stale")));
+}
+
+}  // namespace
+}  // namespace devtools_crosstool_autofdo
@@ -36,6 +36,7 @@ using ::testing::Not;
 using ::testing::Optional;
 using ::testing::Pair;
 using ::testing::ResultOf;
+using ::testing::SizeIs;
 using ::testing::UnorderedElementsAre;
 
 using ::llvm::object::BBAddrMap;
@@ -337,6 +338,41 @@ TEST(LlvmBinaryAddressMapper, CheckNoHotFunctions) {
                     Not(Contains(Key("sample1_func")))));
 }
 
+TEST(LlvmBinaryAddressMapper, OnlyHotFunctionsAreDecoded) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetAutoFdoTestDataFilePath("propeller_sample.bin")));
+  // Addresses within main and compute_flag.
+  absl::flat_hash_set<uint64_t> hot_addresses = {0x1850, 0x17D5};
+
+  PropellerStats stats;
+  PropellerOptions options;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryAddressMapper> hot_binary_address_mapper,
+      BuildBinaryAddressMapper(options, *binary_content, stats,
+                               &hot_addresses));
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryAddressMapper> full_binary_address_mapper,
+      BuildBinaryAddressMapper(options, *binary_content, stats,
+                               /*hot_addresses=*/nullptr));
+
+  // Function indices are the same as with full decoding, and hot functions
+  // have identical BB entries.
+  ASSERT_EQ(hot_binary_address_mapper->bb_addr_map().size(),
+            full_binary_address_mapper->bb_addr_map().size());
+  EXPECT_THAT(hot_binary_address_mapper->selected_functions(), SizeIs(2));
+  for (int function_index : hot_binary_address_mapper->selected_functions()) {
+    EXPECT_EQ(hot_binary_address_mapper->bb_addr_map()[function_index],
+              full_binary_address_mapper->bb_addr_map()[function_index]);
+  }
+  auto bb_addr_map_by_func_name =
+      GetBBAddrMapByFunctionName(*hot_binary_address_mapper);
+  EXPECT_THAT(bb_addr_map_by_func_name,
+              UnorderedElementsAre(
+                  Pair("main", BbAddrMapIs(0x1820, SizeIs(9))),
+                  Pair("compute_flag", BbAddrMapIs(0x17D0, SizeIs(4)))));
+}
+
 TEST(LlvmBinaryAddressMapper, FindBbHandleIndexUsingBinaryAddress) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
                        GetBinaryContent(GetAutoFdoTestDataFilePath(
@@ -373,5 +409,40 @@ TEST(LlvmBinaryAddressMapper, FindBbHandleIndexUsingBinaryAddress) {
                   0x1e63500, BranchDirection::kFrom),
               Optional(ResultOf(bb_index_from_handle_index, 1)));
 }
+
+TEST(LlvmBinaryAddressMapper, FindBbHandleIndicesUsingBinaryAddresses) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(GetAutoFdoTestDataFilePath(
+                           "propeller_clang_v0_labels.binary")));
+  PropellerStats stats;
+  PropellerOptions options;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryAddressMapper> binary_address_mapper,
+      BuildBinaryAddressMapper(options, *binary_content, stats,
+                               /*hot_addresses=*/nullptr));
+  // Queries are deliberately unsorted and include duplicates and an address
+  // which does not map to any block.
+  std::vector<BinaryAddressMapper::AddressQuery> queries = {
+      {.address = 0x1e63500, .direction = BranchDirection::kFrom},
+      {.address = 0x1b3d0a8, .direction = BranchDirection::kTo},
+      {.address = 0x1e63500, .direction = BranchDirection::kTo},
+      {.address = 0x1, .direction = BranchDirection::kFrom},
+      {.address = 0x1b3f5b0, .direction = BranchDirection::kTo},
+      {.address = 0x1b3d0a8, .direction = BranchDirection::kTo},
+      {.address = 0x1b3f5b4, .direction = BranchDirection::kFrom}};
+  std::vector<std::optional<int>> expected;
+  for (const BinaryAddressMapper::AddressQuery &query : queries) {
+    expected.push_back(
+        binary_address_mapper->FindBbHandleIndexUsingBinaryAddress(
+            query.address, query.direction));
+  }
+  EXPECT_EQ(
+      binary_address_mapper->FindBbHandleIndicesUsingBinaryAddresses(queries),
+      expected);
+  EXPECT_EQ(expected[3], std::nullopt);
+  EXPECT_THAT(
+      binary_address_mapper->FindBbHandleIndicesUsingBinaryAddresses({}),
+      IsEmpty());
+}
 }  // namespace
 }  // namespace devtools_crosstool_autofdo
@@ -1,12 +1,15 @@
 #include "llvm_propeller_cfg.h"
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <ostream>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/strings/str_cat.h"
 #include "third_party/abseil/absl/types/span.h"
@@ -22,16 +25,42 @@ std::string CFGNode::GetName() const {
 }
 
 CFGEdge *CFGNode::GetEdgeTo(const CFGNode &node, CFGEdge::Kind kind) const {
-  for (const std::vector<CFGEdge *> *edges : {&intra_outs_, &inter_outs_})
-    for (CFGEdge *edge : *edges) {
-      if (edge->kind() != kind) continue;
-      if (edge->sink() == &node) return edge;
-    }
+  // Edges within a function are always in `intra_outs()`, see `CreateEdge`.
+  absl::Span<CFGEdge *const> edges =
+      node.function_index() == function_index() ? intra_outs() : inter_outs();
+  for (CFGEdge *edge : edges) {
+    if (edge->kind() != kind) continue;
+    if (edge->sink() == &node) return edge;
+  }
   return nullptr;
 }
 
+void CFGNode::AddEdge(EdgeList list, CFGEdge *edge) {
+  auto get_room = [&](int i) {
+    const int next_begin =
+        i + 1 == kNumEdgeLists ? edges_.size() : edge_list_begins_[i + 1];
+    return next_begin - edge_list_begins_[i];
+  };
+  if (edge_list_sizes_[list] == get_room(list)) {
+    std::array<int, kNumEdgeLists> rooms;
+    for (int i = 0; i != kNumEdgeLists; ++i) rooms[i] = get_room(i);
+    rooms[list] = std::max(2 * edge_list_sizes_[list], 1);
+    std::vector<CFGEdge *> edges;
+    edges.reserve(absl::c_accumulate(rooms, 0));
+    for (int i = 0; i != kNumEdgeLists; ++i) {
+      absl::Span<CFGEdge *const> edge_list = GetEdgeList(EdgeList(i));
+      edge_list_begins_[i] = edges.size();
+      edges.insert(edges.end(), edge_list.begin(), edge_list.end());
+      edges.resize(edges.size() + rooms[i] - edge_list.size(), nullptr);
+    }
+    edges_ = std::move(edges);
+  }
+  edges_[edge_list_begins_[list] + edge_list_sizes_[list]++] = edge;
+}
+
 CFGEdge *ControlFlowGraph::CreateOrUpdateEdge(CFGNode *from, CFGNode *to,
-                                              int weight, CFGEdge::Kind kind,
+                                              int64_t weight,
+                                              CFGEdge::Kind kind,
                                               bool inter_section) {
   CFGEdge *edge = from->GetEdgeTo(*to, kind);
   if (edge == nullptr) return CreateEdge(from, to, weight, kind, inter_section);
@@ -39,16 +68,16 @@ CFGEdge *ControlFlowGraph::CreateOrUpdateEdge(CFGNode *from, CFGNode *to,
   return edge;
 }
 
-CFGEdge *ControlFlowGraph::CreateEdge(CFGNode *from, CFGNode *to, int weight,
-                                      CFGEdge::Kind kind, bool inter_section) {
+CFGEdge *ControlFlowGraph::CreateEdge(CFGNode *from, CFGNode *to,
+                                      int64_t weight, CFGEdge::Kind kind,
+                                      bool inter_section) {
   if (inter_section)
     CHECK_NE(from->function_index(), to->function_index())
         << " intra-function edges cannot be inter-section.";
-  auto edge = std::make_unique<CFGEdge>(from, to, weight, kind, inter_section);
-  auto *ret = edge.get();
-  auto has_duplicates = [from,
-                         to](absl::Span<const std::unique_ptr<CFGEdge>> edges) {
-    for (auto &e : edges)
+  CFGEdge *edge =
+      &edge_arena_.emplace_back(from, to, weight, kind, inter_section);
+  auto has_duplicates = [from, to](absl::Span<CFGEdge *const> edges) {
+    for (const CFGEdge *e : edges)
       if (e->src() == from && e->sink() == to) return true;
     return false;
   };
@@ -56,16 +85,16 @@ CFGEdge *ControlFlowGraph::CreateEdge(CFGNode *from, CFGNode *to, int weight,
   if (from->function_index() == to->function_index()) {
     CHECK(!has_duplicates(intra_edges_))
         << " " << from->inter_cfg_id() << " to " << to->inter_cfg_id();
-    from->intra_outs_.push_back(edge.get());
-    to->intra_ins_.push_back(edge.get());
-    intra_edges_.push_back(std::move(edge));
+    from->AddEdge(CFGNode::kIntraOuts, edge);
+    to->AddEdge(CFGNode::kIntraIns, edge);
+    intra_edges_.push_back(edge);
   } else {
     DCHECK(!has_duplicates(inter_edges_));
-    from->inter_outs_.push_back(edge.get());
-    to->inter_ins_.push_back(edge.get());
-    inter_edges_.push_back(std::move(edge));
+    from->AddEdge(CFGNode::kInterOuts, edge);
+    to->AddEdge(CFGNode::kInterIns, edge);
+    inter_edges_.push_back(edge);
   }
-  return ret;
+  return edge;
 }
 
 void ControlFlowGraph::WriteDotFormat(
@@ -97,7 +126,8 @@ void ControlFlowGraph::WriteDotFormat(
 }
 
 std::vector<int> ControlFlowGraph::GetHotJoinNodes(
-    int hot_node_frequency_threshold, int hot_edge_frequency_threshold) const {
+    int64_t hot_node_frequency_threshold,
+    int64_t hot_edge_frequency_threshold) const {
   std::vector<int> ret;
   for (const std::unique_ptr<CFGNode> &node : nodes_) {
     if (node->is_entry()) continue;
@@ -115,7 +145,7 @@ std::vector<int> ControlFlowGraph::GetHotJoinNodes(
   return ret;
 }
 
-int CFGNode::CalculateFrequency() const {
+int64_t CFGNode::CalculateFrequency() const {
   // A node (basic block) may have multiple outgoing calls to different
   // functions. In that case, a single execution of that node counts toward
   // the weight of each of its calls as wells as returns back to the
@@ -128,33 +158,29 @@ int CFGNode::CalculateFrequency() const {
   // but if different functions are called by that indirect call, the node's
   // frequency is equal to the aggregation of call-outs rather than their max.
 
-  int max_call_out = 0;
-  int max_ret_in = 0;
+  int64_t max_call_out = 0;
+  int64_t max_ret_in = 0;
 
   // Total incoming edge frequency to the node's entry (first instruction).
-  int sum_in = 0;
+  int64_t sum_in = 0;
   // Total outgoing edge frequency from the node's exit (last instruction).
-  int sum_out = 0;
-
-  for (auto *out_edges : {&inter_outs_, &intra_outs_}) {
-    for (auto &edge : *out_edges) {
-      if (edge->IsCall()) {
-        max_call_out = std::max(max_call_out, edge->weight());
-      } else {
-        sum_out += edge->weight();
-      }
+  int64_t sum_out = 0;
+
+  ForEachOutEdgeRef([&](const CFGEdge &edge) {
+    if (edge.IsCall()) {
+      max_call_out = std::max(max_call_out, edge.weight());
+    } else {
+      sum_out += edge.weight();
     }
-  }
+  });
 
-  for (auto *in_edges : {&inter_ins_, &intra_ins_}) {
-    for (auto &edge : *in_edges) {
-      if (edge->IsReturn()) {
-        max_ret_in = std::max(max_ret_in, edge->weight());
-      } else {
-        sum_in += edge->weight();
-      }
+  ForEachInEdgeRef([&](const CFGEdge &edge) {
+    if (edge.IsReturn()) {
+      max_ret_in = std::max(max_ret_in, edge.weight());
+    } else {
+      sum_in += edge.weight();
     }
-  }
+  });
   return std::max({max_call_out, max_ret_in, sum_out, sum_in});
 }
 
@@ -187,7 +213,7 @@ std::unique_ptr<ControlFlowGraph> CloneCfg(const ControlFlowGraph &cfg) {
       cfg.section_name(), cfg.function_index(), cfg.module_name(), cfg.names(),
       std::move(nodes));
   // Now copy the intra-function edges.
-  for (const std::unique_ptr<CFGEdge> &edge : cfg.intra_edges()) {
+  for (const CFGEdge *edge : cfg.intra_edges()) {
     CHECK_EQ(edge->src()->function_index(), edge->sink()->function_index());
     cfg_clone->CreateEdge(&cfg_clone->GetNodeById(edge->src()->intra_cfg_id()),
                           &cfg_clone->GetNodeById(edge->sink()->intra_cfg_id()),
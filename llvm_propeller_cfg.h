@@ -2,7 +2,9 @@
 #define AUTOFDOLLVM_PROPELLER_CFG_H_
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
+#include <deque>
 #include <iterator>
 #include <memory>
 #include <optional>
@@ -38,7 +40,8 @@ class CFGEdge final {
     kRet,
   };
 
-  CFGEdge(CFGNode *n1, CFGNode *n2, int weight, Kind kind, bool inter_section)
+  CFGEdge(CFGNode *n1, CFGNode *n2, int64_t weight, Kind kind,
+          bool inter_section)
       : src_(n1),
         sink_(n2),
         weight_(weight),
@@ -47,7 +50,7 @@ class CFGEdge final {
 
   CFGNode *src() const { return src_; }
   CFGNode *sink() const { return sink_; }
-  int weight() const { return weight_; }
+  int64_t weight() const { return weight_; }
   Kind kind() const { return kind_; }
   bool inter_section() const { return inter_section_; }
 
@@ -59,12 +62,12 @@ class CFGEdge final {
 
   static std::string GetCfgEdgeKindString(Kind kind);
 
-  void IncrementWeight(int increment) { weight_ += increment; }
+  void IncrementWeight(int64_t increment) { weight_ += increment; }
 
   // Decrements the weight of this edge by the minimum of `value` and `weight_`.
   // Returns the weight reduction applied.
-  int DecrementWeight(int value) {
-    int reduction = std::min(value, weight_);
+  int64_t DecrementWeight(int64_t value) {
+    int64_t reduction = std::min(value, weight_);
     if (weight_ < value) {
       LOG(ERROR) << absl::StrFormat(
           "Edge weight is lower than value (%lld): %v", value, *this);
@@ -86,7 +89,7 @@ class CFGEdge final {
 
   CFGNode *src_ = nullptr;
   CFGNode *sink_ = nullptr;
-  int weight_ = 0;
+  int64_t weight_ = 0;
   const Kind kind_;
   // Whether the edge is across functions in different sections.
   bool inter_section_ = false;
@@ -172,7 +175,7 @@ class CFGNode final {
 
   CFGNode(uint64_t addr, int bb_index, int bb_id, int size,
           const llvm::object::BBAddrMap::BBEntry::Metadata &metadata,
-          int function_index, int freq = 0, int clone_number = 0,
+          int function_index, int64_t freq = 0, int clone_number = 0,
           int node_index = -1)
       : inter_cfg_id_({function_index, {bb_index, clone_number}}),
         bb_id_(bb_id),
@@ -205,7 +208,7 @@ class CFGNode final {
   bool is_cloned() const { return clone_number() != 0; }
   // Computes and returns the execution frequency of the node based on its
   // edges.
-  int CalculateFrequency() const;
+  int64_t CalculateFrequency() const;
   int size() const { return size_; }
   bool is_landing_pad() const { return metadata_.IsEHPad; }
   bool can_fallthrough() const { return metadata_.CanFallThrough; }
@@ -214,19 +217,27 @@ class CFGNode final {
   bool has_indirect_branch() const { return metadata_.HasIndirectBranch; }
   int function_index() const { return inter_cfg_id_.function_index; }
 
-  const std::vector<CFGEdge *> &intra_outs() const { return intra_outs_; }
-  const std::vector<CFGEdge *> &intra_ins() const { return intra_ins_; }
-  const std::vector<CFGEdge *> &inter_outs() const { return inter_outs_; }
-  const std::vector<CFGEdge *> &inter_ins() const { return inter_ins_; }
+  absl::Span<CFGEdge *const> intra_outs() const {
+    return GetEdgeList(kIntraOuts);
+  }
+  absl::Span<CFGEdge *const> inter_outs() const {
+    return GetEdgeList(kInterOuts);
+  }
+  absl::Span<CFGEdge *const> intra_ins() const {
+    return GetEdgeList(kIntraIns);
+  }
+  absl::Span<CFGEdge *const> inter_ins() const {
+    return GetEdgeList(kInterIns);
+  }
 
   void ForEachInEdgeRef(absl::FunctionRef<void(CFGEdge &edge)> func) const {
-    for (CFGEdge *edge : intra_ins_) func(*edge);
-    for (CFGEdge *edge : inter_ins_) func(*edge);
+    for (CFGEdge *edge : intra_ins()) func(*edge);
+    for (CFGEdge *edge : inter_ins()) func(*edge);
   }
 
   void ForEachOutEdgeRef(absl::FunctionRef<void(CFGEdge &edge)> func) const {
-    for (CFGEdge *edge : intra_outs_) func(*edge);
-    for (CFGEdge *edge : inter_outs_) func(*edge);
+    for (CFGEdge *edge : intra_outs()) func(*edge);
+    for (CFGEdge *edge : inter_outs()) func(*edge);
   }
 
   // Returns if this is the entry of the function.
@@ -256,7 +267,7 @@ class CFGNode final {
     return result;
   }
 
-  void set_freq(int freq) { freq_ = freq; }
+  void set_freq(int64_t freq) { freq_ = freq; }
 
   InterCfgId inter_cfg_id_;
   // Fixed ID of the basic block, as defined by the compiler. Must be unique
@@ -267,12 +278,39 @@ class CFGNode final {
   const int addr_;
   int size_ = 0;
   const llvm::object::BBAddrMap::BBEntry::Metadata metadata_;
-  int freq_ = 0;
+  int64_t freq_ = 0;
+
+  // The edge lists of a node, in the order they are stored in `edges_`.
+  enum EdgeList {
+    // Intra function out-edges.
+    kIntraOuts,
+    // Calls to other functions.
+    kInterOuts,
+    // Intra function in-edges.
+    kIntraIns,
+    // Returns from other functions.
+    kInterIns,
+    kNumEdgeLists,
+  };
 
-  std::vector<CFGEdge *> intra_outs_ = {};  // Intra function edges.
-  std::vector<CFGEdge *> intra_ins_ = {};   // Intra function edges.
-  std::vector<CFGEdge *> inter_outs_ = {};  // Calls to other functions.
-  std::vector<CFGEdge *> inter_ins_ = {};   // Returns from other functions.
+  absl::Span<CFGEdge *const> GetEdgeList(EdgeList list) const {
+    return absl::MakeConstSpan(edges_).subspan(edge_list_begins_[list],
+                                               edge_list_sizes_[list]);
+  }
+
+  // Appends `edge` to `list`. If `list` has no room left, lays out all lists
+  // again with twice the room for `list`, so adding the `d` edges of a node
+  // takes O(d log d) time rather than the O(d^2) of inserting in place.
+  void AddEdge(EdgeList list, CFGEdge *edge);
+
+  // All edges of this node in a single array, holding the four edge lists in
+  // the order of `EdgeList`. List `i` starts at `edge_list_begins_[i]` and is
+  // followed by spare room up to the start of the next list (or the end of
+  // the array). Keeping them in one array saves three allocations per node
+  // and keeps edge walks within one block of memory.
+  std::vector<CFGEdge *> edges_ = {};
+  std::array<int, kNumEdgeLists> edge_list_begins_ = {};
+  std::array<int, kNumEdgeLists> edge_list_sizes_ = {};
 };
 
 class ControlFlowGraph {
@@ -368,18 +406,18 @@ class ControlFlowGraph {
 
   // Create edge and take ownership. Note: the caller must be responsible for
   // not creating duplicated edges.
-  CFGEdge *CreateEdge(CFGNode *from, CFGNode *to, int weight,
+  CFGEdge *CreateEdge(CFGNode *from, CFGNode *to, int64_t weight,
                       CFGEdge::Kind kind, bool inter_section);
 
   // If an edge already exists from `from` to `to` of kind `kind`, then
   // increments its edge weight by weight. Otherwise, creates the edge.
-  CFGEdge *CreateOrUpdateEdge(CFGNode *from, CFGNode *to, int weight,
+  CFGEdge *CreateOrUpdateEdge(CFGNode *from, CFGNode *to, int64_t weight,
                               CFGEdge::Kind kind, bool inter_section);
 
   // Returns the frequencies of nodes in this CFG in a vector, in the same order
   // as in `nodes_`.
-  std::vector<int> GetNodeFrequencies() const {
-    std::vector<int> node_frequencies;
+  std::vector<int64_t> GetNodeFrequencies() const {
+    std::vector<int64_t> node_frequencies;
     node_frequencies.reserve(nodes_.size());
     for (const auto &node : nodes_)
       node_frequencies.push_back(node->CalculateFrequency());
@@ -407,13 +445,9 @@ class ControlFlowGraph {
   const llvm::SmallVector<llvm::StringRef, 3> &names() const { return names_; }
   const std::vector<std::unique_ptr<CFGNode>> &nodes() const { return nodes_; }
 
-  const std::vector<std::unique_ptr<CFGEdge>> &intra_edges() const {
-    return intra_edges_;
-  }
+  const std::vector<CFGEdge *> &intra_edges() const { return intra_edges_; }
 
-  const std::vector<std::unique_ptr<CFGEdge>> &inter_edges() const {
-    return inter_edges_;
-  }
+  const std::vector<CFGEdge *> &inter_edges() const { return inter_edges_; }
 
   const absl::flat_hash_map<int, std::vector<CFGNode *>> &clones_by_bb_index()
       const {
@@ -479,8 +513,8 @@ class ControlFlowGraph {
   // have a frequency of at least `hot_node_frequency_threshold` and at least
   // two incoming intra-function edges at least as heavy as
   // hot_edge_frequency_threshold`.
-  std::vector<int> GetHotJoinNodes(int hot_node_frequency_threshold,
-                                   int hot_edge_frequency_threshold) const;
+  std::vector<int> GetHotJoinNodes(int64_t hot_node_frequency_threshold,
+                                   int64_t hot_edge_frequency_threshold) const;
 
   NodeFrequencyStats GetNodeFrequencyStats() const;
 
@@ -512,13 +546,15 @@ class ControlFlowGraph {
   // Cloned paths starting with their path predecessor block ID.
   std::vector<std::vector<CFGNode::FullIntraCfgId>> clone_paths_;
 
-  // CFGs own all edges. All edges are owned by their src's CFGs and they
-  // appear exactly once in one of the following two fields. The src and sink
-  // nodes of each edge contain a pointer to the edge, which means, each edge is
-  // recorded exactly twice in Nodes' inter_ins_, inter_outs, intra_ints or
-  // intra_out_.
-  std::vector<std::unique_ptr<CFGEdge>> intra_edges_;
-  std::vector<std::unique_ptr<CFGEdge>> inter_edges_;
+  // CFGs own all edges. All edges are owned by their src's CFGs and are
+  // allocated in `edge_arena_`, which allocates them in contiguous chunks and
+  // never moves them. Each edge appears exactly once in one of
+  // `intra_edges_` or `inter_edges_`. The src and sink nodes of each edge
+  // contain a pointer to the edge, which means, each edge is recorded exactly
+  // twice in Nodes' edge lists.
+  std::deque<CFGEdge> edge_arena_;
+  std::vector<CFGEdge *> intra_edges_;
+  std::vector<CFGEdge *> inter_edges_;
 };
 
 template <typename Sink>
@@ -1,5 +1,6 @@
 #ifndef AUTOFDOLLVM_PROPELLER_CFG_MATCHERS_H_
 #define AUTOFDOLLVM_PROPELLER_CFG_MATCHERS_H_
+#include <cstdint>
 #include <memory>
 #include <ostream>
 #include <utility>
@@ -56,7 +57,7 @@ MATCHER_P(NodeIndexIs, bb_index_matcher,
 
 MATCHER_P(NodeFreqIs, freq_matcher,
           "has frequency that " +
-              testing::DescribeMatcher<int>(freq_matcher, negation)) {
+              testing::DescribeMatcher<int64_t>(freq_matcher, negation)) {
   return testing::ExplainMatchResult(
       testing::Property("frequency", &CFGNode::CalculateFrequency,
                         freq_matcher),
@@ -69,7 +70,7 @@ MATCHER_P4(IsCfgEdge, src_matcher, sink_matcher, weight_matcher, kind_matcher,
                (negation ? " or" : " and") + " has sink that " +
                testing::DescribeMatcher<CFGNode*>(sink_matcher, negation) +
                (negation ? " or" : " and") + " has weight that " +
-               testing::DescribeMatcher<int>(weight_matcher, negation) +
+               testing::DescribeMatcher<int64_t>(weight_matcher, negation) +
                (negation ? " or" : " and") + " has kind that " +
                testing::DescribeMatcher<CFGEdge::Kind>(kind_matcher,
                                                        negation)) {
@@ -141,7 +142,7 @@ class CfgIntraEdgesMatcher {
     matcher_.DescribeTo(os);
   }
 
-  testing::Matcher<std::vector<std::unique_ptr<CFGEdge>>> matcher_;
+  testing::Matcher<std::vector<CFGEdge*>> matcher_;
 };
 
 // Matches the `inter_edges()` of a CFG against an unordered list of matchers.
@@ -175,7 +176,7 @@ class CfgInterEdgesMatcher {
     matcher_.DescribeTo(os);
   }
 
-  testing::Matcher<std::vector<std::unique_ptr<CFGEdge>>> matcher_;
+  testing::Matcher<std::vector<CFGEdge*>> matcher_;
 };
 
 // Matches `nodes()`, `intra_edges()` and `inter_edges()` of a CFG.
@@ -1,7 +1,9 @@
 #include "llvm_propeller_cfg.h"
 
+#include <cstdint>
 #include <memory>
 #include <sstream>
+#include <vector>
 
 #include "llvm_propeller_cfg_matchers.h"
 #include "llvm_propeller_cfg_testutil.h"
@@ -15,6 +17,7 @@ namespace {
 
 using ::testing::AllOf;
 using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
 using ::testing::FieldsAre;
 using ::testing::IsEmpty;
 using ::testing::Key;
@@ -72,6 +75,31 @@ TEST(LlvmPropellerCfg, CalculateNodeFreqs_FunctionWithLoop) {
   EXPECT_THAT(cfgs.at(0)->GetNodeFrequencies(), ElementsAre(10, 110, 0, 100));
 }
 
+TEST(LlvmPropellerCfg, CalculateNodeFreqsBeyond32Bits) {
+  // Edge weights aggregated from large profiles may exceed 2^31.
+  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs =
+      TestCfgBuilder(
+          {.cfg_args = {{".text",
+                         0,
+                         "foo",
+                         {{0x1000, 0, 0x10}, {0x1010, 1, 0x7}},
+                         {{0, 1, int64_t{3} << 31,
+                           CFGEdge::Kind::kBranchOrFallthough},
+                          {1, 0, int64_t{1} << 32,
+                           CFGEdge::Kind::kBranchOrFallthough}}}}})
+          .Build();
+
+  ASSERT_THAT(cfgs, UnorderedElementsAre(Key(0)));
+  CFGNode &node0 = cfgs.at(0)->GetNodeById({.bb_index = 0});
+  CFGNode &node1 = cfgs.at(0)->GetNodeById({.bb_index = 1});
+  CFGEdge *edge = node0.GetEdgeTo(node1, CFGEdge::Kind::kBranchOrFallthough);
+  ASSERT_NE(edge, nullptr);
+  edge->IncrementWeight(int64_t{1} << 31);
+  EXPECT_EQ(edge->weight(), int64_t{1} << 33);
+  EXPECT_THAT(cfgs.at(0)->GetNodeFrequencies(),
+              ElementsAre(int64_t{1} << 33, int64_t{1} << 33));
+}
+
 TEST(LlvmPropellerCfg, GetDotFormat) {
   absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs =
       TestCfgBuilder(
@@ -205,5 +233,59 @@ TEST(LlvmPropellerCfg, GetNodeFrequencyStats) {
   ASSERT_THAT(cfgs, UnorderedElementsAre(Key(0)));
   EXPECT_THAT(cfgs.at(0)->GetNodeFrequencyStats(), FieldsAre(4, 1, 1));
 }
+
+TEST(LlvmPropellerCfg, KeepsEdgeListsInCreationOrder) {
+  // A hub node called from many call sites, whose in-edges of different
+  // kinds are created interleaved.
+  constexpr int kNumCallers = 1000;
+  std::vector<NodeArg> caller_node_args;
+  for (int i = 0; i != kNumCallers; ++i)
+    caller_node_args.push_back({0x1000 + 0x10 * static_cast<uint64_t>(i), i,
+                                0x10});
+  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs =
+      TestCfgBuilder(
+          {.cfg_args = {{".text", 0, "foo", caller_node_args, {}},
+                        {".text",
+                         1,
+                         "bar",
+                         {{0x9000, 0, 0x10}, {0x9010, 1, 0x10}},
+                         {}}}})
+          .Build();
+  ASSERT_THAT(cfgs, UnorderedElementsAre(Key(0), Key(1)));
+  ControlFlowGraph &foo_cfg = *cfgs.at(0);
+  ControlFlowGraph &bar_cfg = *cfgs.at(1);
+  CFGNode &bar_entry = bar_cfg.GetNodeById({.bb_index = 0, .clone_number = 0});
+  CFGNode &bar_loop = bar_cfg.GetNodeById({.bb_index = 1, .clone_number = 0});
+
+  std::vector<CFGEdge *> calls;
+  for (int i = 0; i != kNumCallers; ++i) {
+    calls.push_back(foo_cfg.CreateEdge(
+        &foo_cfg.GetNodeById({.bb_index = i, .clone_number = 0}), &bar_entry,
+        i + 1, CFGEdge::Kind::kCall, /*inter_section=*/false));
+    if (i == kNumCallers / 2) {
+      bar_cfg.CreateEdge(&bar_entry, &bar_loop, 5,
+                         CFGEdge::Kind::kBranchOrFallthough,
+                         /*inter_section=*/false);
+      bar_cfg.CreateEdge(&bar_loop, &bar_entry, 3,
+                         CFGEdge::Kind::kBranchOrFallthough,
+                         /*inter_section=*/false);
+    }
+  }
+
+  EXPECT_THAT(bar_entry.inter_ins(), ElementsAreArray(calls));
+  EXPECT_THAT(
+      bar_entry.intra_ins(),
+      ElementsAre(Pointee(IsCfgEdge(&bar_loop, &bar_entry, 3,
+                                    CFGEdge::Kind::kBranchOrFallthough))));
+  EXPECT_THAT(
+      bar_entry.intra_outs(),
+      ElementsAre(Pointee(IsCfgEdge(&bar_entry, &bar_loop, 5,
+                                    CFGEdge::Kind::kBranchOrFallthough))));
+  EXPECT_THAT(bar_entry.inter_outs(), IsEmpty());
+  EXPECT_EQ(bar_entry.CalculateFrequency(),
+            int64_t{kNumCallers} * (kNumCallers + 1) / 2 + 3);
+  EXPECT_EQ(bar_entry.GetEdgeTo(bar_loop, CFGEdge::Kind::kBranchOrFallthough),
+            bar_entry.intra_outs().front());
+}
 }  // namespace
 }  // namespace devtools_crosstool_autofdo
@@ -3,6 +3,7 @@
 
 #include <sys/types.h>
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -24,7 +25,7 @@ struct NodeArg {
 struct IntraEdgeArg {
   int from_bb_index;
   int to_bb_index;
-  int weight;
+  int64_t weight;
   CFGEdge::Kind kind;
 };
 
@@ -33,7 +34,7 @@ struct InterEdgeArg {
   int from_bb_index;
   int to_function_index;
   int to_bb_index;
-  int weight;
+  int64_t weight;
   CFGEdge::Kind kind;
 };
 
@@ -1,6 +1,8 @@
 #include "llvm_propeller_chain_cluster_builder.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <iterator>
 #include <memory>
 #include <tuple>
 #include <utility>
@@ -10,6 +12,8 @@
 #include "llvm_propeller_node_chain.h"
 #include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "third_party/abseil/absl/time/clock.h"
+#include "third_party/abseil/absl/time/time.h"
 #include "third_party/abseil/absl/types/span.h"
 
 namespace devtools_crosstool_autofdo {
@@ -38,9 +42,17 @@ absl::flat_hash_map<const CFGNode *, const NodeChain *> BuildNodeToChainMap(
 
 ChainClusterBuilder::ChainClusterBuilder(
     const PropellerCodeLayoutParameters &code_layout_params,
-    std::vector<std::unique_ptr<const NodeChain>> chains)
+    std::vector<std::unique_ptr<const NodeChain>> chains, absl::Time deadline)
     : code_layout_params_(code_layout_params),
+      deadline_(deadline),
+      cluster_merge_size_threshold_(
+          code_layout_params.cluster_merge_size_threshold()),
       node_to_chain_map_(BuildNodeToChainMap(chains)) {
+  if (int64_t page_budget_size = GetHotTextPageBudgetSize();
+      page_budget_size != 0) {
+    cluster_merge_size_threshold_ =
+        std::min(cluster_merge_size_threshold_, page_budget_size);
+  }
   for (auto &chain : chains) {
     const NodeChain *chain_ptr = chain.get();
     // Transfer the ownership of chains to clusters.
@@ -58,8 +70,7 @@ void ChainClusterBuilder::MergeWithBestPredecessorCluster(
   ChainCluster *cluster = chain_to_cluster_map_.at(&chain);
   // If the cluster is too big, avoid merging as it is unlikely to have
   // significant benefit.
-  if (cluster->size() > code_layout_params_.cluster_merge_size_threshold())
-    return;
+  if (cluster->size() > cluster_merge_size_threshold_) return;
 
   // Create a map to compute the total incoming edge weight to `cluster`
   // from each other cluster.
@@ -84,15 +95,14 @@ void ChainClusterBuilder::MergeWithBestPredecessorCluster(
       ChainCluster *src_cluster = chain_to_cluster_map_.at(&src_chain);
       if (src_cluster->id() == cluster->id()) return;
       // Ignore clusters that are larger than the threshold.
-      if (src_cluster->size() >
-          code_layout_params_.cluster_merge_size_threshold()) {
-        return;
-      }
+      if (src_cluster->size() > cluster_merge_size_threshold_) return;
       // Avoid merging if the predecessor cluster's density would degrade by
-      // more than 1/kDensityDegradationThreshold by the merge.
-      if (kExecutionDensityDegradationThreshold * src_cluster->size() *
-              (cluster->freq() + src_cluster->freq()) <
-          static_cast<int64_t>(src_cluster->freq()) *
+      // more than 1/kDensityDegradationThreshold by the merge. The products
+      // are computed in floating point as 64-bit frequencies times sizes may
+      // overflow.
+      if (static_cast<double>(kExecutionDensityDegradationThreshold) *
+              src_cluster->size() * (cluster->freq() + src_cluster->freq()) <
+          static_cast<double>(src_cluster->freq()) *
               (cluster->size() + src_cluster->size())) {
         return;
       }
@@ -181,6 +191,9 @@ ChainClusterBuilder::BuildClusters() && {
                });
 
   for (const NodeChain *chain : chains_sorted_by_incoming_weight) {
+    // Leave the remaining clusters unmerged once the deadline is reached. They
+    // are still ordered by execution density below.
+    if (deadline_ != absl::InfiniteFuture() && absl::Now() >= deadline_) break;
     // Do not merge clusters when the execution density is negligible.
     if (chain->exec_density() < kChainExecutionDensityThreshold) continue;
     MergeWithBestPredecessorCluster(*chain);
@@ -193,7 +206,35 @@ ChainClusterBuilder::BuildClusters() && {
     return std::forward_as_tuple(-lhs->exec_density(), lhs->id()) <
            std::forward_as_tuple(-rhs->exec_density(), rhs->id());
   });
+  PackHotClustersIntoPages(built_clusters);
   return built_clusters;
 }
 
+int64_t ChainClusterBuilder::GetHotTextPageBudgetSize() const {
+  return static_cast<int64_t>(code_layout_params_.hot_text_page_size()) *
+         code_layout_params_.hot_text_page_budget();
+}
+
+void ChainClusterBuilder::PackHotClustersIntoPages(
+    std::vector<std::unique_ptr<const ChainCluster>> &clusters) const {
+  const int64_t page_budget_size = GetHotTextPageBudgetSize();
+  if (page_budget_size == 0) return;
+  // Greedily fill the page budget with the densest clusters, skipping the
+  // clusters which do not fit in the remaining space.
+  std::vector<std::unique_ptr<const ChainCluster>> packed_clusters;
+  std::vector<std::unique_ptr<const ChainCluster>> remaining_clusters;
+  packed_clusters.reserve(clusters.size());
+  int64_t packed_size = 0;
+  for (std::unique_ptr<const ChainCluster> &cluster : clusters) {
+    if (packed_size + cluster->size() <= page_budget_size) {
+      packed_size += cluster->size();
+      packed_clusters.push_back(std::move(cluster));
+    } else {
+      remaining_clusters.push_back(std::move(cluster));
+    }
+  }
+  absl::c_move(remaining_clusters, std::back_inserter(packed_clusters));
+  clusters = std::move(packed_clusters);
+}
+
 }  // namespace devtools_crosstool_autofdo
@@ -2,6 +2,7 @@
 #define AUTOFDOLLVM_PROPELLER_CHAIN_CLUSTER_BUILDER_H_
 
 #include <algorithm>
+#include <cstdint>
 #include <iterator>
 #include <memory>
 #include <utility>
@@ -12,6 +13,7 @@
 #include "llvm_propeller_options.pb.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/functional/function_ref.h"
+#include "third_party/abseil/absl/time/time.h"
 
 namespace devtools_crosstool_autofdo {
 
@@ -35,17 +37,17 @@ class ChainCluster {
   }
 
   // Returns the total binary size of the cluster.
-  int size() const { return size_; }
+  int64_t size() const { return size_; }
 
   // Returns the total frquency of the cluster.
-  int freq() const { return freq_; }
+  int64_t freq() const { return freq_; }
 
   // Returns the unique identifier for this cluster.
   CFGNode::InterCfgId id() const { return id_; }
 
   // Returns the execution density for this cluster.
   double exec_density() const {
-    return static_cast<double>(freq_) / std::max(size_, 1);
+    return static_cast<double>(freq_) / std::max<int64_t>(size_, 1);
   }
 
   // Merges the chains in `other` cluster into `this` cluster. `other`
@@ -71,20 +73,22 @@ class ChainCluster {
   CFGNode::InterCfgId id_;
 
   // Total size of the cluster.
-  int size_;
+  int64_t size_;
 
   // Total frequency of the cluster.
-  int freq_;
+  int64_t freq_;
 };
 
 class ChainClusterBuilder {
  public:
   // ChainClusterBuilder constructor: This initializes one cluster per each
   // chain and transfers the ownership of the NodeChain pointer to their
-  // associated clusters.
+  // associated clusters. `BuildClusters` stops merging clusters after
+  // `deadline`.
   explicit ChainClusterBuilder(
       const PropellerCodeLayoutParameters &code_layout_params,
-      std::vector<std::unique_ptr<const NodeChain>> chains);
+      std::vector<std::unique_ptr<const NodeChain>> chains,
+      absl::Time deadline = absl::InfiniteFuture());
 
   // Builds and returns the clusters of chains.
   // This function builds clusters of node chains according to the
@@ -103,7 +107,22 @@ class ChainClusterBuilder {
   void MergeClusters(ChainCluster &left_cluster, ChainCluster right_cluster);
 
  private:
+  // Returns the size of the hot text region which the hottest clusters are
+  // packed into, or 0 if page-aware packing is disabled.
+  int64_t GetHotTextPageBudgetSize() const;
+
+  // Reorders `clusters`, which must be sorted in decreasing order of their
+  // execution density, so that the densest clusters which fit together in the
+  // page budget are placed first. The remaining clusters follow in their
+  // original order.
+  void PackHotClustersIntoPages(
+      std::vector<std::unique_ptr<const ChainCluster>> &clusters) const;
+
   PropellerCodeLayoutParameters code_layout_params_;
+  const absl::Time deadline_;
+  // Maximum size of clusters to be merged: `cluster_merge_size_threshold`,
+  // further capped by the page budget when page-aware packing is enabled.
+  int64_t cluster_merge_size_threshold_;
   const absl::flat_hash_map<const CFGNode *, const NodeChain *>
       node_to_chain_map_;
 
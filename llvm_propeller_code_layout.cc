@@ -1,5 +1,7 @@
 #include "llvm_propeller_code_layout.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <iterator>
 #include <memory>
 #include <tuple>
@@ -13,10 +15,15 @@
 #include "llvm_propeller_options.pb.h"
 #include "llvm_propeller_program_cfg.h"
 #include "llvm_propeller_statistics.h"
+#include "parallel_for.h"
+#include "trace_event_recorder.h"
 #include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/container/btree_map.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "third_party/abseil/absl/container/flat_hash_set.h"
 #include "third_party/abseil/absl/functional/function_ref.h"
+#include "third_party/abseil/absl/time/clock.h"
+#include "third_party/abseil/absl/time/time.h"
 #include "third_party/abseil/absl/types/span.h"
 #include "llvm/ADT/StringRef.h"
 
@@ -26,25 +33,112 @@ absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
 GenerateLayoutBySection(const ProgramCfg &program_cfg,
                         const PropellerCodeLayoutParameters &code_layout_params,
                         PropellerStats::CodeLayoutStats &code_layout_stats) {
+  return GenerateLayoutBySection(program_cfg, code_layout_params,
+                                 GetCodeLayoutDeadline(code_layout_params),
+                                 code_layout_stats);
+}
+
+absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
+GenerateLayoutBySection(const ProgramCfg &program_cfg,
+                        const PropellerCodeLayoutParameters &code_layout_params,
+                        absl::Time deadline,
+                        PropellerStats::CodeLayoutStats &code_layout_stats) {
   absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
       cluster_info_by_section_name;
   absl::flat_hash_map<llvm::StringRef, std::vector<const ControlFlowGraph *>>
       cfgs_by_section_name = program_cfg.GetCfgsBySectionName();
+  // All sections share the same deadline.
   for (const auto &[section_name, cfgs] : cfgs_by_section_name) {
     CodeLayout code_layout(code_layout_params, cfgs);
-    cluster_info_by_section_name.emplace(section_name, code_layout.OrderAll());
+    cluster_info_by_section_name.emplace(section_name,
+                                         code_layout.OrderAll(deadline));
     code_layout_stats += code_layout.stats();
   }
   return cluster_info_by_section_name;
 }
 
+absl::Time GetCodeLayoutDeadline(
+    const PropellerCodeLayoutParameters &code_layout_params) {
+  if (code_layout_params.layout_time_budget_ms() == 0)
+    return absl::InfiniteFuture();
+  return absl::Now() +
+         absl::Milliseconds(code_layout_params.layout_time_budget_ms());
+}
+
+std::vector<std::vector<const ControlFlowGraph *>> PartitionCfgsIntoCommunities(
+    absl::Span<const ControlFlowGraph *const> cfgs,
+    int64_t community_size_threshold) {
+  absl::flat_hash_map<int, int> cfg_index_by_function_index;
+  for (int i = 0; i != cfgs.size(); ++i)
+    cfg_index_by_function_index.emplace(cfgs[i]->function_index(), i);
+
+  // Aggregate the weights of inter-function edges between every pair of CFGs,
+  // keyed by the pair of CFG indices in increasing order.
+  absl::flat_hash_map<std::pair<int, int>, int64_t> weight_by_cfg_pair;
+  for (int i = 0; i != cfgs.size(); ++i) {
+    for (const CFGEdge *edge : cfgs[i]->inter_edges()) {
+      if (edge->weight() == 0 || edge->inter_section()) continue;
+      auto it =
+          cfg_index_by_function_index.find(edge->sink()->function_index());
+      if (it == cfg_index_by_function_index.end() || it->second == i) continue;
+      weight_by_cfg_pair[std::minmax(i, it->second)] += edge->weight();
+    }
+  }
+  std::vector<std::pair<std::pair<int, int>, int64_t>> call_graph_edges(
+      weight_by_cfg_pair.begin(), weight_by_cfg_pair.end());
+  // Visit heavier edges first and break ties by the CFG indices to make the
+  // partitioning deterministic.
+  absl::c_sort(call_graph_edges, [](const auto &e1, const auto &e2) {
+    return std::make_tuple(-e1.second, e1.first) <
+           std::make_tuple(-e2.second, e2.first);
+  });
+
+  // Union-find over the CFG indices. Each community is represented by its
+  // smallest CFG index.
+  std::vector<int> parent(cfgs.size());
+  absl::c_iota(parent, 0);
+  std::vector<int64_t> community_size(cfgs.size());
+  for (int i = 0; i != cfgs.size(); ++i)
+    community_size[i] = cfgs[i]->nodes().size();
+  auto find_community = [&](int i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+  for (const auto &[cfg_pair, weight] : call_graph_edges) {
+    int c1 = find_community(cfg_pair.first);
+    int c2 = find_community(cfg_pair.second);
+    if (c1 == c2 ||
+        community_size[c1] + community_size[c2] > community_size_threshold) {
+      continue;
+    }
+    if (c1 > c2) std::swap(c1, c2);
+    parent[c2] = c1;
+    community_size[c1] += community_size[c2];
+  }
+
+  std::vector<std::vector<const ControlFlowGraph *>> communities;
+  absl::flat_hash_map<int, int> community_index_by_root;
+  for (int i = 0; i != cfgs.size(); ++i) {
+    auto [it, inserted] =
+        community_index_by_root.emplace(find_community(i), communities.size());
+    if (inserted) communities.emplace_back();
+    communities[it->second].push_back(cfgs[i]);
+  }
+  return communities;
+}
+
 // Returns the intra-procedural ext-tsp scores for the given CFGs given a
 // function for getting the address of each CFG node.
 // This is called by ComputeOrigLayoutScores and ComputeOptLayoutScores below.
 absl::flat_hash_map<int, CFGScore> CodeLayout::ComputeCfgScores(
     absl::FunctionRef<uint64_t(const CFGNode *)> get_node_addr) {
-  absl::flat_hash_map<int, CFGScore> score_map;
-  for (const ControlFlowGraph *cfg : cfgs_) {
+  // CFGs are scored independently, so score them in parallel.
+  std::vector<CFGScore> scores(cfgs_.size());
+  ParallelFor(cfgs_.size(), GetDefaultNumThreads(), [&](int64_t i) {
+    const ControlFlowGraph *cfg = cfgs_[i];
     double intra_score = 0;
     for (const auto &edge : cfg->intra_edges()) {
       if (edge->weight() == 0 || edge->IsReturn()) continue;
@@ -64,9 +158,11 @@ absl::flat_hash_map<int, CFGScore> CodeLayout::ComputeCfgScores(
         inter_out_score += code_layout_scorer_.GetEdgeScore(*edge, distance);
       }
     }
-    score_map.emplace(cfg->function_index(),
-                      CFGScore({intra_score, inter_out_score}));
-  }
+    scores[i] = CFGScore({intra_score, inter_out_score});
+  });
+  absl::flat_hash_map<int, CFGScore> score_map;
+  for (int i = 0; i != cfgs_.size(); ++i)
+    score_map.emplace(cfgs_[i]->function_index(), scores[i]);
   return score_map;
 }
 
@@ -95,31 +191,115 @@ absl::flat_hash_map<int, CFGScore> CodeLayout::ComputeOptLayoutScores(
   });
 }
 
-std::vector<FunctionClusterInfo> CodeLayout::OrderAll() {
+std::vector<FunctionClusterInfo> CodeLayout::OrderAll(absl::Time deadline) {
   // Build optimal node chains for each CFG.
   std::vector<std::unique_ptr<const NodeChain>> built_chains;
-  if (code_layout_scorer_.code_layout_params().inter_function_reordering()) {
-    absl::c_move(NodeChainBuilder::CreateNodeChainBuilder<
-                     NodeChainAssemblyBalancedTreeQueue>(
-                     code_layout_scorer_, cfgs_, initial_chains_, stats_)
-                     .BuildChains(),
+  const PropellerCodeLayoutParameters &code_layout_params =
+      code_layout_scorer_.code_layout_params();
+  const bool has_time_budget = deadline != absl::InfiniteFuture();
+  stats_.has_layout_deadline = has_time_budget;
+  // Function indices of the CFGs whose layout started after `deadline`.
+  absl::flat_hash_set<int> function_indices_after_deadline;
+  if (code_layout_params.inter_function_reordering() &&
+      code_layout_params.inter_function_community_size_threshold() == 0) {
+    NodeChainBuilder node_chain_builder =
+        NodeChainBuilder::CreateNodeChainBuilderForCfgSize(
+            code_layout_scorer_, cfgs_, initial_chains_, stats_);
+    node_chain_builder.set_deadline(deadline);
+    absl::c_move(node_chain_builder.BuildChains(),
                  std::back_inserter(built_chains));
   } else {
-    for (auto *cfg : cfgs_) {
-      absl::c_move(NodeChainBuilder::CreateNodeChainBuilder<
-                       NodeChainAssemblyIterativeQueue>(
-                       code_layout_scorer_, {cfg}, initial_chains_, stats_)
-                       .BuildChains(),
+    // Groups of CFGs whose chains are built together: call graph communities
+    // for inter-procedural reordering and single CFGs otherwise.
+    std::vector<std::vector<const ControlFlowGraph *>> cfg_groups;
+    if (code_layout_params.inter_function_reordering()) {
+      cfg_groups = PartitionCfgsIntoCommunities(
+          cfgs_, code_layout_params.inter_function_community_size_threshold());
+    } else {
+      cfg_groups.reserve(cfgs_.size());
+      for (const ControlFlowGraph *cfg : cfgs_) cfg_groups.push_back({cfg});
+    }
+    // Groups are laid out independently, so build their chains in parallel.
+    // Without a time budget, larger groups are dispatched first to balance the
+    // work across threads. With a time budget, hotter groups are dispatched
+    // first so they are optimized before the deadline. Chains are collected
+    // in the order of `cfg_groups` so the result does not depend on
+    // scheduling.
+    std::vector<int64_t> group_keys(cfg_groups.size(), 0);
+    for (int i = 0; i != cfg_groups.size(); ++i) {
+      for (const ControlFlowGraph *cfg : cfg_groups[i]) {
+        if (!has_time_budget) {
+          group_keys[i] += cfg->nodes().size();
+          continue;
+        }
+        for (const auto &node : cfg->nodes())
+          group_keys[i] += node->CalculateFrequency();
+      }
+    }
+    std::vector<int> group_indices(cfg_groups.size());
+    absl::c_iota(group_indices, 0);
+    absl::c_stable_sort(group_indices, [&](int a, int b) {
+      return group_keys[a] > group_keys[b];
+    });
+    // Groups whose layout starts after the deadline keep the original order
+    // of their hot blocks.
+    PropellerCodeLayoutParameters fallback_code_layout_params =
+        code_layout_params;
+    fallback_code_layout_params.set_reorder_hot_blocks(false);
+    const PropellerCodeLayoutScorer fallback_code_layout_scorer(
+        fallback_code_layout_params);
+    std::vector<std::vector<std::unique_ptr<NodeChain>>> chains_by_group(
+        cfg_groups.size());
+    std::vector<PropellerStats::CodeLayoutStats> stats_by_group(
+        cfg_groups.size());
+    ParallelFor(group_indices.size(), GetDefaultNumThreads(), [&](int64_t i) {
+      ScopedTraceEvent trace_event("propeller", "build chains");
+      int group_index = group_indices[i];
+      const bool after_deadline = has_time_budget && absl::Now() >= deadline;
+      NodeChainBuilder node_chain_builder =
+          NodeChainBuilder::CreateNodeChainBuilderForCfgSize(
+              after_deadline ? fallback_code_layout_scorer
+                             : code_layout_scorer_,
+              cfg_groups[group_index], initial_chains_,
+              stats_by_group[group_index]);
+      node_chain_builder.set_deadline(deadline);
+      chains_by_group[group_index] = node_chain_builder.BuildChains();
+      if (after_deadline) {
+        stats_by_group[group_index].n_cfgs_laid_out_after_deadline +=
+            cfg_groups[group_index].size();
+      }
+    });
+    for (int group_index = 0; group_index != cfg_groups.size();
+         ++group_index) {
+      absl::c_move(chains_by_group[group_index],
                    std::back_inserter(built_chains));
+      stats_ += stats_by_group[group_index];
+      if (stats_by_group[group_index].n_cfgs_laid_out_after_deadline == 0)
+        continue;
+      for (const ControlFlowGraph *cfg : cfg_groups[group_index])
+        function_indices_after_deadline.insert(cfg->function_index());
     }
   }
 
   // Further cluster the constructed chains to get the global order of all
   // nodes.
+  const absl::Time clustering_start_time = absl::Now();
   const std::vector<std::unique_ptr<const ChainCluster>> clusters =
       ChainClusterBuilder(code_layout_scorer_.code_layout_params(),
-                          std::move(built_chains))
+                          std::move(built_chains), deadline)
           .BuildClusters();
+  RecordTraceEvent("propeller", "build clusters", clustering_start_time,
+                   absl::Now());
+
+  int64_t hot_text_size = 0;
+  for (const std::unique_ptr<const ChainCluster> &cluster : clusters)
+    hot_text_size += cluster->size();
+  stats_.hot_text_size += hot_text_size;
+  if (code_layout_params.hot_text_page_size() != 0) {
+    stats_.hot_text_pages +=
+        (hot_text_size + code_layout_params.hot_text_page_size() - 1) /
+        code_layout_params.hot_text_page_size();
+  }
 
   absl::flat_hash_map<int, CFGScore> orig_score_map = ComputeOrigLayoutScores();
   absl::flat_hash_map<int, CFGScore> opt_score_map =
@@ -175,6 +355,12 @@ std::vector<FunctionClusterInfo> CodeLayout::OrderAll() {
         func_cluster_info.original_score.inter_out_score;
     stats_.optimized_inter_score +=
         func_cluster_info.optimized_score.inter_out_score;
+    if (!function_indices_after_deadline.contains(
+            func_cluster_info.function_index)) {
+      stats_.optimized_score_within_budget +=
+          func_cluster_info.optimized_score.intra_score +
+          func_cluster_info.optimized_score.inter_out_score;
+    }
     all_function_cluster_info.push_back(std::move(func_cluster_info));
   }
 
@@ -1,6 +1,7 @@
 #ifndef AUTOFDOLLVM_PROPELLER_CODE_LAYOUT_H_
 #define AUTOFDOLLVM_PROPELLER_CODE_LAYOUT_H_
 
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -15,6 +16,7 @@
 #include "third_party/abseil/absl/container/btree_map.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/functional/function_ref.h"
+#include "third_party/abseil/absl/time/time.h"
 #include "third_party/abseil/absl/types/span.h"
 #include "llvm/ADT/StringRef.h"
 
@@ -22,12 +24,38 @@ namespace devtools_crosstool_autofdo {
 
 // Runs `CodeLayout` on every section in `program_cfg` and returns
 // the code layout results as a map keyed by section names, and valued by the
-// `FunctionClusterInfo` of all functions in each section.
+// `FunctionClusterInfo` of all functions in each section. A non-zero
+// `code_layout_params.layout_time_budget_ms()` bounds the layout of all
+// sections together.
 absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
 GenerateLayoutBySection(const ProgramCfg &program_cfg,
                         const PropellerCodeLayoutParameters &code_layout_params,
                         PropellerStats::CodeLayoutStats &code_layout_stats);
 
+// Like above, but lays out every section by `deadline` instead of using the
+// time budget in `code_layout_params`. `absl::InfiniteFuture()` means no
+// deadline.
+absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
+GenerateLayoutBySection(const ProgramCfg &program_cfg,
+                        const PropellerCodeLayoutParameters &code_layout_params,
+                        absl::Time deadline,
+                        PropellerStats::CodeLayoutStats &code_layout_stats);
+
+// Returns the deadline of code layout starting now under the time budget in
+// `code_layout_params`, or `absl::InfiniteFuture()` if there is no budget.
+absl::Time GetCodeLayoutDeadline(
+    const PropellerCodeLayoutParameters &code_layout_params);
+
+// Partitions `cfgs` into communities of functions which call each other
+// heavily. Functions are greedily merged along the heaviest call graph edges
+// first (regardless of the call direction), as long as the merged community has
+// at most `community_size_threshold` basic blocks. Communities are returned in
+// the order of their first CFG in `cfgs`, and each community keeps the relative
+// order of its CFGs in `cfgs`.
+std::vector<std::vector<const ControlFlowGraph *>> PartitionCfgsIntoCommunities(
+    absl::Span<const ControlFlowGraph *const> cfgs,
+    int64_t community_size_threshold);
+
 class CodeLayout {
  public:
   // `initial_chains` describes the cfg nodes that must be placed in single
@@ -44,8 +72,16 @@ class CodeLayout {
         initial_chains_(std::move(initial_chains)) {}
 
   // This performs code layout on all hot cfgs in the prop_prof_writer instance
-  // and returns the global order information for all function.
-  std::vector<FunctionClusterInfo> OrderAll();
+  // and returns the global order information for all function. Optimization
+  // stops at `deadline`; `absl::InfiniteFuture()` means no deadline.
+  std::vector<FunctionClusterInfo> OrderAll(absl::Time deadline);
+
+  // Like above, with the deadline given by the time budget in the code layout
+  // parameters, starting now.
+  std::vector<FunctionClusterInfo> OrderAll() {
+    return OrderAll(
+        GetCodeLayoutDeadline(code_layout_scorer_.code_layout_params()));
+  }
 
   PropellerStats::CodeLayoutStats stats() const { return stats_; }
 
@@ -61,7 +97,8 @@ class CodeLayout {
   PropellerStats::CodeLayoutStats stats_;
 
   // Returns the intra-procedural ext-tsp scores for the given CFGs given a
-  // function for getting the address of each CFG node.
+  // function for getting the address of each CFG node. CFGs are scored in
+  // parallel, so the function must be safe to call concurrently.
   // This is called by ComputeOrigLayoutScores and ComputeOptLayoutScores below.
   absl::flat_hash_map<int, CFGScore> ComputeCfgScores(
       absl::FunctionRef<uint64_t(const CFGNode *)>);
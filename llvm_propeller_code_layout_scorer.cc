@@ -32,20 +32,23 @@ double PropellerCodeLayoutScorer::GetEdgeScore(const CFGEdge &edge,
 
   if (edge.IsReturn()) src_sink_distance += edge.sink()->size() / 2;
 
+  // Edge weights are 64-bit, so score in floating point to avoid overflowing
+  // the integer product.
+  const double weight = static_cast<double>(edge.weight());
   if (src_sink_distance == 0 && edge.IsBranchOrFallthrough())
-    return edge.weight() * code_layout_params_.fallthrough_weight();
+    return weight * code_layout_params_.fallthrough_weight();
 
   double absolute_src_sink_distance =
       static_cast<double>(std::abs(src_sink_distance));
   if (src_sink_distance > 0 &&
       absolute_src_sink_distance < code_layout_params_.forward_jump_distance())
-    return edge.weight() * code_layout_params_.forward_jump_weight() *
+    return weight * code_layout_params_.forward_jump_weight() *
            (1.0 - absolute_src_sink_distance /
                     code_layout_params_.forward_jump_distance());
 
   if (src_sink_distance < 0 &&
       absolute_src_sink_distance < code_layout_params_.backward_jump_distance())
-    return edge.weight() * code_layout_params_.backward_jump_weight() *
+    return weight * code_layout_params_.backward_jump_weight() *
            (1.0 - absolute_src_sink_distance /
                     code_layout_params_.backward_jump_distance());
   return 0;
@@ -1,8 +1,11 @@
 #include "llvm_propeller_code_layout.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <iterator>
 #include <memory>
 #include <optional>
+#include <random>
 #include <string>
 #include <utility>
 #include <vector>
@@ -25,11 +28,13 @@
 #include "base/logging.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/container/btree_map.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/status/statusor.h"
 #include "third_party/abseil/absl/strings/str_cat.h"
 #include "third_party/abseil/absl/strings/string_view.h"
+#include "third_party/abseil/absl/time/time.h"
 #include "third_party/abseil/absl/types/span.h"
 #include "util/testing/status_matchers.h"
 
@@ -46,6 +51,7 @@ using ::testing::HasSubstr;
 using ::testing::IsEmpty;
 using ::testing::Key;
 using ::testing::Matcher;
+using ::testing::Not;
 using ::testing::Pair;
 using ::testing::Pointee;
 using ::testing::ResultOf;
@@ -228,7 +234,7 @@ TEST(CodeLayoutScorerTest, GetEdgeScore) {
   }
 
   ASSERT_THAT(foo_cfg.inter_edges(), SizeIs(2));
-  for (const std::unique_ptr<CFGEdge> &ret_edge : foo_cfg.inter_edges()) {
+  for (const CFGEdge *ret_edge : foo_cfg.inter_edges()) {
     ASSERT_TRUE(ret_edge->IsReturn());
     ASSERT_NE(ret_edge->weight(), 0);
     ASSERT_NE(ret_edge->sink()->size(), 0);
@@ -250,7 +256,7 @@ TEST(CodeLayoutScorerTest, GetEdgeScore) {
     EXPECT_EQ(scorer.GetEdgeScore(*ret_edge, -150), 0);
   }
 
-  for (const std::unique_ptr<CFGEdge> &edge : foo_cfg.intra_edges()) {
+  for (const CFGEdge *edge : foo_cfg.intra_edges()) {
     ASSERT_EQ(edge->kind(),
               devtools_crosstool_autofdo::CFGEdge::Kind::kBranchOrFallthough);
     ASSERT_NE(edge->weight(), 0);
@@ -269,8 +275,9 @@ TEST(CodeLayoutScorerTest, GetEdgeScore) {
 }
 
 // Type-parameterized test fixture for `NodeChainBuilder` tests. This allows
-// testing `NodeChainBuilder` with both `NodeChainAssemblyIterativeQueue` and
-// and `NodeChainAssemblyBalancedTreeQueue` implementations.
+// testing `NodeChainBuilder` with the `NodeChainAssemblyIterativeQueue`,
+// `NodeChainAssemblyBalancedTreeQueue` and `NodeChainAssemblyHeapQueue`
+// implementations.
 template <typename NodeChainAssemblyQueueImpl>
 class NodeChainBuilderTest : public testing::Test {
  protected:
@@ -293,7 +300,8 @@ class NodeChainBuilderTest : public testing::Test {
 
 using NodeChainAssemblyQueueTypes =
     testing::Types<NodeChainAssemblyIterativeQueue,
-                   NodeChainAssemblyBalancedTreeQueue>;
+                   NodeChainAssemblyBalancedTreeQueue,
+                   NodeChainAssemblyHeapQueue>;
 TYPED_TEST_SUITE(NodeChainBuilderTest, NodeChainAssemblyQueueTypes);
 
 // Check that MergeChain(NodeChain&, NodeChain&) properly updates the chain
@@ -858,6 +866,27 @@ TYPED_TEST(NodeChainBuilderTest, LargeBlocksPreventMerge) {
                                        CFGNode::InterCfgId{1, {0, 0}})))));
 }
 
+TYPED_TEST(NodeChainBuilderTest, BuildChainsStopsAtDeadline) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
+                       BuildFromCfgProtoPath(GetTestInputPath(
+                           "/testdata/"
+                           "propeller_two_large_blocks.protobuf")));
+  PropellerStats::CodeLayoutStats stats;
+  NodeChainBuilder chain_builder = this->InitializeNodeChainBuilderForCfgs(
+      proto_program_cfg->program_cfg(), /*function_indices=*/{0, 1},
+      // Use inter-function-reordering to disable coalescing.
+      PropellerCodeLayoutParametersBuilder().SetInterFunctionReordering(true),
+      stats);
+  chain_builder.set_deadline(absl::InfinitePast());
+
+  std::vector<std::unique_ptr<NodeChain>> chains = chain_builder.BuildChains();
+
+  // No chains are merged, so the initial chains are returned.
+  EXPECT_THAT(chains,
+              SizeIs(stats.n_single_node_chains + stats.n_multi_node_chains));
+  EXPECT_EQ(stats.n_chain_builds_stopped_at_deadline, 1);
+}
+
 // Tests building and applying a SU NodeChainAssembly.
 TEST(NodeChainAssemblyTest, ApplySUChainMergeOrder) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
@@ -1168,6 +1197,89 @@ TEST(NodeChainAssemblyTest, ApplyS2US1ChainMergeOrder) {
                           CFGNode::InterCfgId{10, {2, 0}}));
 }
 
+// Checks that scoring assemblies from the resolved `NodeChainPairEdges` yields
+// exactly the same result as resolving every edge for each assembly, for every
+// merge order and slice position of every chain pair of random programs.
+TEST(NodeChainAssemblyTest, ChainPairEdgesYieldSameScoreGain) {
+  for (uint32_t seed = 1; seed <= 8; ++seed) {
+    const SyntheticProgram program =
+        CreateSyntheticProgram({.n_functions = 4,
+                                .n_blocks_per_function = 12,
+                                .loop_depth = 2,
+                                .call_density = 0.3,
+                                .seed = seed});
+    PropellerCodeLayoutParameters params;
+    params.set_inter_function_reordering(true);
+    PropellerStats::CodeLayoutStats stats;
+    NodeChainBuilder chain_builder = NodeChainBuilder::CreateNodeChainBuilder(
+        PropellerCodeLayoutScorer(params), program.program_cfg->GetCfgs(),
+        /*initial_chains=*/{}, stats);
+    chain_builder.InitNodeChains();
+    chain_builder.InitChainEdges();
+
+    // Returns the chains sorted by id, so the test is deterministic.
+    auto get_sorted_chains = [&]() {
+      std::vector<NodeChain *> chains;
+      for (const auto &[unused, chain] : chain_builder.chains())
+        chains.push_back(chain.get());
+      absl::c_sort(chains, [](const NodeChain *a, const NodeChain *b) {
+        return a->id() < b->id();
+      });
+      return chains;
+    };
+    // Merge random chains so that chains have multiple bundles.
+    std::mt19937 rng(seed);
+    for (int i = 0; i != 24; ++i) {
+      std::vector<NodeChain *> chains = get_sorted_chains();
+      if (chains.size() < 2) break;
+      std::shuffle(chains.begin(), chains.end(), rng);
+      chain_builder.MergeChains(*chains[0], *chains[1]);
+    }
+
+    int n_split_assemblies_compared = 0;
+    for (NodeChain *split_chain : get_sorted_chains()) {
+      for (NodeChain *unsplit_chain : get_sorted_chains()) {
+        if (split_chain == unsplit_chain) continue;
+        const NodeChainPairEdges chain_pair_edges(
+            chain_builder.node_to_bundle_mapper(), *split_chain,
+            *unsplit_chain);
+        auto expect_same_assembly =
+            [&](NodeChainAssembly::NodeChainAssemblyBuildingOptions options) {
+              options.error_on_zero_score_gain = false;
+              absl::StatusOr<NodeChainAssembly> uncached =
+                  NodeChainAssembly::BuildNodeChainAssembly(
+                      chain_builder.node_to_bundle_mapper(),
+                      chain_builder.code_layout_scorer(), *split_chain,
+                      *unsplit_chain, options);
+              options.chain_pair_edges = &chain_pair_edges;
+              absl::StatusOr<NodeChainAssembly> cached =
+                  NodeChainAssembly::BuildNodeChainAssembly(
+                      chain_builder.node_to_bundle_mapper(),
+                      chain_builder.code_layout_scorer(), *split_chain,
+                      *unsplit_chain, options);
+              // A negative score gain is reported in the status message, so
+              // this compares the score gains of rejected assemblies too.
+              ASSERT_EQ(cached.status(), uncached.status());
+              if (cached.ok())
+                EXPECT_EQ(cached->score_gain(), uncached->score_gain());
+            };
+        expect_same_assembly({.merge_order = ChainMergeOrder::kSU});
+        for (ChainMergeOrder merge_order :
+             {ChainMergeOrder::kS1US2, ChainMergeOrder::kS2S1U,
+              ChainMergeOrder::kUS2S1, ChainMergeOrder::kS2US1}) {
+          for (int slice_pos = 1;
+               slice_pos != split_chain->node_bundles().size(); ++slice_pos) {
+            expect_same_assembly(
+                {.merge_order = merge_order, .slice_pos = slice_pos});
+            ++n_split_assemblies_compared;
+          }
+        }
+      }
+    }
+    EXPECT_GT(n_split_assemblies_compared, 0);
+  }
+}
+
 struct NodeChainAssemblyBuildStatusTestCase {
   std::string test_name;
   // Pairs of chain ids which must be merged in order by
@@ -1455,6 +1567,41 @@ TEST(CodeLayoutTest, BuildClusters) {
                            ElementsAre(CFGNode::InterCfgId{100, {0, 0}})))));
 }
 
+TEST(CodeLayoutTest, PacksHotClustersIntoPageBudget) {
+  // Three functions with no calls between them, in decreasing order of
+  // execution density: foo (32 bytes), bar (64 bytes), and baz (16 bytes).
+  std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
+      {.cfg_args = {{".text",
+                     0,
+                     "foo",
+                     {{0x1000, 0, 0x10}, {0x1010, 1, 0x10}},
+                     {{0, 1, 100, CFGEdge::Kind::kBranchOrFallthough}}},
+                    {".text",
+                     1,
+                     "bar",
+                     {{0x2000, 0, 0x20}, {0x2020, 1, 0x20}},
+                     {{0, 1, 150, CFGEdge::Kind::kBranchOrFallthough}}},
+                    {".text",
+                     2,
+                     "baz",
+                     {{0x3000, 0, 0x8}, {0x3008, 1, 0x8}},
+                     {{0, 1, 10, CFGEdge::Kind::kBranchOrFallthough}}}}});
+  CodeLayout code_layout(PropellerCodeLayoutParametersBuilder()
+                             .SetHotTextPageSize(64)
+                             .SetHotTextPageBudget(1),
+                         program_cfg->GetCfgs());
+
+  // bar does not fit in the 64-byte page with foo, so baz is packed in the
+  // page instead.
+  EXPECT_THAT(code_layout.OrderAll(),
+              UnorderedElementsAre(
+                  FieldsAre(0, ElementsAre(FieldsAre(0, _)), _, _, _),
+                  FieldsAre(1, ElementsAre(FieldsAre(2, _)), _, _, _),
+                  FieldsAre(2, ElementsAre(FieldsAre(1, _)), _, _, _)));
+  EXPECT_EQ(code_layout.stats().hot_text_size, 112);
+  EXPECT_EQ(code_layout.stats().hot_text_pages, 2);
+}
+
 TEST(CodeLayoutTest, FindOptimalFallthroughNoSplitChains) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
                        BuildFromCfgProtoPath(GetTestInputPath(
@@ -1718,6 +1865,85 @@ TEST(CodeLayoutTest, PlacesEntryBlockFirstInIntraFunctionOrdering) {
                   _, _, _)));
 }
 
+// Returns a program with four functions, each with two basic blocks, and calls
+// foo->bar (100), bar->baz (50), baz->qux (10), and foo->qux (5).
+std::unique_ptr<ProgramCfg> BuildCallGraphCommunitiesProgramCfg() {
+  return BuildFromCfgArg(
+      {.cfg_args =
+           {{".text",
+             0,
+             "foo",
+             {{0x1000, 0, 0x10}, {0x1010, 1, 0x10}},
+             {{0, 1, 100, CFGEdge::Kind::kBranchOrFallthough}}},
+            {".text",
+             1,
+             "bar",
+             {{0x2000, 0, 0x10}, {0x2010, 1, 0x10}},
+             {{0, 1, 100, CFGEdge::Kind::kBranchOrFallthough}}},
+            {".text",
+             2,
+             "baz",
+             {{0x3000, 0, 0x10}, {0x3010, 1, 0x10}},
+             {{0, 1, 50, CFGEdge::Kind::kBranchOrFallthough}}},
+            {".text",
+             3,
+             "qux",
+             {{0x4000, 0, 0x10}, {0x4010, 1, 0x10}},
+             {{0, 1, 10, CFGEdge::Kind::kBranchOrFallthough}}}},
+       .inter_edge_args = {{0, 1, 1, 0, 100, CFGEdge::Kind::kCall},
+                           {1, 1, 2, 0, 50, CFGEdge::Kind::kCall},
+                           {2, 1, 3, 0, 10, CFGEdge::Kind::kCall},
+                           {0, 0, 3, 0, 5, CFGEdge::Kind::kCall}}});
+}
+
+TEST(CodeLayoutTest, PartitionCfgsIntoCommunities) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildCallGraphCommunitiesProgramCfg();
+  auto get_function_indices =
+      [](const std::vector<std::vector<const ControlFlowGraph *>>
+             &communities) {
+        std::vector<std::vector<int>> function_indices;
+        for (const auto &community : communities) {
+          function_indices.emplace_back();
+          for (const ControlFlowGraph *cfg : community)
+            function_indices.back().push_back(cfg->function_index());
+        }
+        return function_indices;
+      };
+
+  // foo and bar are merged first. bar and baz cannot be merged without
+  // exceeding the threshold, so baz and qux form the second community.
+  EXPECT_THAT(get_function_indices(PartitionCfgsIntoCommunities(
+                  program_cfg->GetCfgs(), /*community_size_threshold=*/4)),
+              ElementsAre(ElementsAre(0, 1), ElementsAre(2, 3)));
+  EXPECT_THAT(get_function_indices(PartitionCfgsIntoCommunities(
+                  program_cfg->GetCfgs(), /*community_size_threshold=*/8)),
+              ElementsAre(ElementsAre(0, 1, 2, 3)));
+  EXPECT_THAT(get_function_indices(PartitionCfgsIntoCommunities(
+                  program_cfg->GetCfgs(), /*community_size_threshold=*/2)),
+              ElementsAre(ElementsAre(0), ElementsAre(1), ElementsAre(2),
+                          ElementsAre(3)));
+}
+
+TEST(CodeLayoutTest, OrderAllWithInterFunctionCommunities) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildCallGraphCommunitiesProgramCfg();
+  std::vector<FunctionClusterInfo> all_func_cluster_info =
+      CodeLayout(PropellerCodeLayoutParametersBuilder()
+                     .SetInterFunctionReordering(true)
+                     .SetInterFunctionCommunitySizeThreshold(4),
+                 program_cfg->GetCfgs())
+          .OrderAll();
+
+  // Every function is laid out even though chains are built separately for
+  // each community.
+  EXPECT_THAT(all_func_cluster_info,
+              UnorderedElementsAre(FieldsAre(0, _, _, _, _),
+                                   FieldsAre(1, _, _, _, _),
+                                   FieldsAre(2, _, _, _, _),
+                                   FieldsAre(3, _, _, _, _)));
+}
+
 TEST(CodeLayoutTest, FindOptimalLayoutHotAndColdLandingPads) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
                        BuildFromCfgProtoPath(GetTestInputPath(
@@ -1955,5 +2181,47 @@ TEST(CodeLayoutTest, FailsWithDuplicateNodesInInitialChains) {
                 "already in a bundle"));
 }
 
+// Returns a program with two hot functions in two different sections.
+std::unique_ptr<ProgramCfg> BuildTwoSectionProgramCfg() {
+  return BuildFromCfgArg(
+      {.cfg_args = {{".text.foo",
+                     0,
+                     "foo",
+                     {{0x1000, 0, 0x10}, {0x1010, 1, 0x10}, {0x1020, 2, 0x10}},
+                     {{0, 2, 100, CFGEdge::Kind::kBranchOrFallthough},
+                      {2, 1, 100, CFGEdge::Kind::kBranchOrFallthough}}},
+                    {".text.bar",
+                     1,
+                     "bar",
+                     {{0x2000, 0, 0x10}, {0x2010, 1, 0x10}, {0x2020, 2, 0x10}},
+                     {{0, 2, 150, CFGEdge::Kind::kBranchOrFallthough},
+                      {2, 1, 150, CFGEdge::Kind::kBranchOrFallthough}}}}});
+}
+
+TEST(CodeLayoutTest, GenerateLayoutBySectionSharesDeadlineAcrossSections) {
+  std::unique_ptr<ProgramCfg> program_cfg = BuildTwoSectionProgramCfg();
+  PropellerStats::CodeLayoutStats stats;
+  // Every section is laid out against the same deadline, so once it has
+  // passed no section gets a fresh budget.
+  EXPECT_THAT(GenerateLayoutBySection(*program_cfg,
+                                      PropellerCodeLayoutParameters(),
+                                      absl::InfinitePast(), stats),
+              UnorderedElementsAre(Key(".text.foo"), Key(".text.bar")));
+  EXPECT_EQ(stats.n_cfgs_laid_out_after_deadline, 2);
+  EXPECT_EQ(stats.optimized_score_within_budget, 0);
+  EXPECT_THAT(stats.DebugString(), HasSubstr("Layout budget stats"));
+}
+
+TEST(CodeLayoutTest, GenerateLayoutBySectionWithoutTimeBudget) {
+  std::unique_ptr<ProgramCfg> program_cfg = BuildTwoSectionProgramCfg();
+  PropellerStats::CodeLayoutStats stats;
+  EXPECT_THAT(
+      GenerateLayoutBySection(*program_cfg, PropellerCodeLayoutParameters(),
+                              stats),
+      UnorderedElementsAre(Key(".text.foo"), Key(".text.bar")));
+  EXPECT_EQ(stats.n_cfgs_laid_out_after_deadline, 0);
+  EXPECT_THAT(stats.DebugString(), Not(HasSubstr("Layout budget stats")));
+}
+
 }  // namespace
 }  // namespace devtools_crosstool_autofdo
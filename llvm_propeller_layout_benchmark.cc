@@ -0,0 +1,216 @@
+// Benchmarks Propeller code layout (`NodeChainBuilder` with every
+// `NodeChainAssemblyQueue` implementation, `ChainClusterBuilder` and
+// `CodeLayout::OrderAll`) on synthetic whole-program CFGs. Besides the total
+// time, every benchmark reports the time and the heap allocations per basic
+// block.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "llvm_propeller_cfg.h"
+#include "llvm_propeller_chain_cluster_builder.h"
+#include "llvm_propeller_code_layout.h"
+#include "llvm_propeller_code_layout_scorer.h"
+#include "llvm_propeller_mock_program_cfg_builder.h"
+#include "llvm_propeller_node_chain.h"
+#include "llvm_propeller_node_chain_builder.h"
+#include "llvm_propeller_options.pb.h"
+#include "llvm_propeller_program_cfg.h"
+#include "llvm_propeller_statistics.h"
+#include "third_party/abseil/absl/algorithm/container.h"
+
+// Number of heap allocations made by the process so far. Every replaceable
+// allocation function which does not forward to another one is replaced, so
+// aligned and nothrow allocations are counted too. The array forms forward to
+// these by default.
+static std::atomic<int64_t> n_allocations = 0;
+
+static void *CountedAllocate(std::size_t size) {
+  n_allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+static void *CountedAllocate(std::size_t size, std::align_val_t alignment) {
+  n_allocations.fetch_add(1, std::memory_order_relaxed);
+  const std::size_t align = static_cast<std::size_t>(alignment);
+  // `aligned_alloc` requires the size to be a multiple of the alignment.
+  const std::size_t aligned_size =
+      (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+  return std::aligned_alloc(align, aligned_size);
+}
+
+void *operator new(std::size_t size) {
+  if (void *ptr = CountedAllocate(size)) return ptr;
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return CountedAllocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  if (void *ptr = CountedAllocate(size, alignment)) return ptr;
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+  return CountedAllocate(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+namespace devtools_crosstool_autofdo {
+namespace {
+
+// Returns the synthetic program parameters given by the benchmark arguments:
+// the number of functions, the number of blocks per function, the loop depth,
+// the hot edge skew in percent and the call density in percent.
+SyntheticProgramParameters GetSyntheticProgramParameters(
+    const benchmark::State &state) {
+  return {.n_functions = static_cast<int>(state.range(0)),
+          .n_blocks_per_function = static_cast<int>(state.range(1)),
+          .loop_depth = static_cast<int>(state.range(2)),
+          .hot_edge_skew = state.range(3) / 100.0,
+          .call_density = state.range(4) / 100.0};
+}
+
+// Tracks the heap allocations made while the benchmark loop runs and reports
+// the time and allocations per basic block of the program.
+class PerNodeCounters {
+ public:
+  explicit PerNodeCounters(int64_t n_nodes)
+      : n_nodes_(n_nodes), start_allocations_(n_allocations.load()) {}
+
+  // Reports the counters to `state`, not counting `excluded_allocations` made
+  // outside of the measured code.
+  void Report(benchmark::State &state, int64_t excluded_allocations = 0) const {
+    state.counters["nodes"] = n_nodes_;
+    state.counters["time_per_node"] = benchmark::Counter(
+        n_nodes_, benchmark::Counter::kIsIterationInvariantRate |
+                      benchmark::Counter::kInvert);
+    state.counters["allocs_per_node"] = benchmark::Counter(
+        static_cast<double>(n_allocations.load() - start_allocations_ -
+                            excluded_allocations) /
+            n_nodes_,
+        benchmark::Counter::kAvgIterations);
+  }
+
+ private:
+  const int64_t n_nodes_;
+  const int64_t start_allocations_;
+};
+
+// Builds the chains of all the CFGs of `program` together, as done for
+// inter-procedural layout.
+template <class AssemblyQueueImpl>
+std::vector<std::unique_ptr<NodeChain>> BuildAllChains(
+    const PropellerCodeLayoutScorer &scorer, const SyntheticProgram &program) {
+  PropellerStats::CodeLayoutStats stats;
+  return NodeChainBuilder::CreateNodeChainBuilder<AssemblyQueueImpl>(
+             scorer, program.program_cfg->GetCfgs(), /*initial_chains=*/{},
+             stats)
+      .BuildChains();
+}
+
+template <class AssemblyQueueImpl>
+void BM_NodeChainBuilder(benchmark::State &state) {
+  const SyntheticProgram program =
+      CreateSyntheticProgram(GetSyntheticProgramParameters(state));
+  const PropellerCodeLayoutScorer scorer((PropellerCodeLayoutParameters()));
+  PerNodeCounters counters(program.n_nodes);
+  for (auto s : state) {
+    benchmark::DoNotOptimize(BuildAllChains<AssemblyQueueImpl>(scorer, program));
+  }
+  counters.Report(state);
+}
+
+void BM_ChainClusterBuilder(benchmark::State &state) {
+  const SyntheticProgram program =
+      CreateSyntheticProgram(GetSyntheticProgramParameters(state));
+  PropellerCodeLayoutParameters params;
+  params.set_call_chain_clustering(true);
+  const PropellerCodeLayoutScorer scorer(params);
+  int64_t excluded_allocations = 0;
+  PerNodeCounters counters(program.n_nodes);
+  for (auto s : state) {
+    state.PauseTiming();
+    const int64_t start_allocations = n_allocations.load();
+    std::vector<std::unique_ptr<const NodeChain>> chains;
+    absl::c_move(BuildAllChains<NodeChainAssemblyHeapQueue>(scorer, program),
+                 std::back_inserter(chains));
+    excluded_allocations += n_allocations.load() - start_allocations;
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(
+        ChainClusterBuilder(params, std::move(chains)).BuildClusters());
+  }
+  counters.Report(state, excluded_allocations);
+}
+
+void BM_OrderAll(benchmark::State &state, bool inter_function_reordering) {
+  const SyntheticProgram program =
+      CreateSyntheticProgram(GetSyntheticProgramParameters(state));
+  PropellerCodeLayoutParameters params;
+  params.set_inter_function_reordering(inter_function_reordering);
+  const std::vector<const ControlFlowGraph *> cfgs =
+      program.program_cfg->GetCfgs();
+  PerNodeCounters counters(program.n_nodes);
+  for (auto s : state)
+    benchmark::DoNotOptimize(CodeLayout(params, cfgs).OrderAll());
+  counters.Report(state);
+}
+
+// Registers the synthetic program shapes as benchmark arguments: programs of
+// increasing size with the default shape, and medium-sized programs with
+// varying loop depth, hot edge skew and call density.
+void SyntheticProgramArguments(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgNames({"functions", "blocks", "loop_depth", "skew_pct",
+                       "call_pct"});
+  for (int n_functions : {1, 16, 256}) {
+    for (int n_blocks : {16, 128})
+      benchmark->Args({n_functions, n_blocks, 1, 100, 5});
+  }
+  for (int loop_depth : {0, 4}) benchmark->Args({64, 64, loop_depth, 100, 5});
+  for (int skew_pct : {0, 200}) benchmark->Args({64, 64, 1, skew_pct, 5});
+  for (int call_pct : {0, 25}) benchmark->Args({64, 64, 1, 100, call_pct});
+}
+
+BENCHMARK_TEMPLATE(BM_NodeChainBuilder, NodeChainAssemblyIterativeQueue)
+    ->Apply(SyntheticProgramArguments);
+BENCHMARK_TEMPLATE(BM_NodeChainBuilder, NodeChainAssemblyBalancedTreeQueue)
+    ->Apply(SyntheticProgramArguments);
+BENCHMARK_TEMPLATE(BM_NodeChainBuilder, NodeChainAssemblyHeapQueue)
+    ->Apply(SyntheticProgramArguments);
+BENCHMARK(BM_ChainClusterBuilder)->Apply(SyntheticProgramArguments);
+BENCHMARK_CAPTURE(BM_OrderAll, intra_function, false)
+    ->Apply(SyntheticProgramArguments);
+BENCHMARK_CAPTURE(BM_OrderAll, inter_function, true)
+    ->Apply(SyntheticProgramArguments);
+
+}  // namespace
+}  // namespace devtools_crosstool_autofdo
@@ -0,0 +1,248 @@
+#include "llvm_propeller_layout_simulator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "llvm_propeller_cfg.h"
+#include "llvm_propeller_function_cluster_info.h"
+#include "llvm_propeller_options.pb.h"
+#include "llvm_propeller_program_cfg.h"
+#include "base/logging.h"
+#include "base/status_macros.h"
+#include "third_party/abseil/absl/algorithm/container.h"
+#include "third_party/abseil/absl/container/btree_map.h"
+#include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "third_party/abseil/absl/functional/function_ref.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/types/span.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+// Returns the index of the element picked from a distribution given by its
+// running sums in `cumulative_weights`, using the random number `rand`.
+int PickWeightedIndex(absl::Span<const int64_t> cumulative_weights,
+                      uint64_t rand) {
+  const int64_t target = rand % cumulative_weights.back();
+  return absl::c_upper_bound(cumulative_weights, target) -
+         cumulative_weights.begin();
+}
+
+// Accesses every line of `cache` overlapping [`addr`, `addr` + `size`) and
+// returns the number of accesses and misses.
+std::pair<int64_t, int64_t> AccessRange(SetAssociativeCache &cache,
+                                        uint64_t addr, int size) {
+  // Zero-sized blocks still need their address to be fetched.
+  const uint64_t first_line = addr / cache.line_size();
+  const uint64_t last_line =
+      (addr + std::max(size, 1) - 1) / cache.line_size();
+  int64_t n_misses = 0;
+  for (uint64_t line = first_line; line <= last_line; ++line)
+    if (!cache.Access(line * cache.line_size())) ++n_misses;
+  return {last_line - first_line + 1, n_misses};
+}
+}  // namespace
+
+SetAssociativeCache::SetAssociativeCache(int n_entries, int associativity,
+                                         uint64_t line_size)
+    : associativity_(associativity),
+      n_sets_(n_entries / associativity),
+      line_size_(line_size),
+      tags_(n_entries),
+      set_sizes_(n_sets_, 0) {
+  CHECK_GT(associativity, 0);
+  CHECK_GT(line_size, 0);
+  CHECK_GT(n_sets_, 0);
+  CHECK_EQ(n_entries % associativity, 0)
+      << "Number of entries must be a multiple of the associativity.";
+}
+
+bool SetAssociativeCache::Access(uint64_t addr) {
+  const uint64_t tag = addr / line_size_;
+  const int set_index = tag % n_sets_;
+  auto set_begin = tags_.begin() + set_index * associativity_;
+  int &set_size = set_sizes_[set_index];
+  auto set_end = set_begin + set_size;
+  auto it = std::find(set_begin, set_end, tag);
+  const bool hit = it != set_end;
+  if (!hit) {
+    // Evict the least recently used line if the set is full.
+    if (set_size == associativity_) {
+      it = set_end - 1;
+    } else {
+      it = set_end;
+      ++set_size;
+    }
+  }
+  // Move the accessed line to the most recently used position.
+  std::move_backward(set_begin, it, it + 1);
+  *set_begin = tag;
+  return hit;
+}
+
+ReplayTraceGenerator::ReplayTraceGenerator(const ProgramCfg &program_cfg,
+                                           uint64_t seed)
+    : rng_(seed) {
+  for (const ControlFlowGraph *cfg : program_cfg.GetCfgs()) {
+    cfg->ForEachNodeRef([&](const CFGNode &node) {
+      if (int64_t freq = node.CalculateFrequency(); freq != 0) {
+        hot_nodes_.push_back(&node);
+        cumulative_freqs_.push_back(
+            (cumulative_freqs_.empty() ? 0 : cumulative_freqs_.back()) + freq);
+      }
+      WeightedSuccessors node_successors;
+      node.ForEachOutEdgeRef([&](const CFGEdge &edge) {
+        if (edge.weight() == 0) return;
+        node_successors.sinks.push_back(edge.sink());
+        node_successors.cumulative_weights.push_back(
+            (node_successors.cumulative_weights.empty()
+                 ? 0
+                 : node_successors.cumulative_weights.back()) +
+            edge.weight());
+      });
+      if (!node_successors.sinks.empty())
+        successors_.emplace(&node, std::move(node_successors));
+    });
+  }
+}
+
+const CFGNode *ReplayTraceGenerator::Next() {
+  CHECK(!empty());
+  const CFGNode *node = next_node_;
+  // Use the raw engine output rather than a distribution so the trace is the
+  // same across standard library implementations.
+  if (node == nullptr)
+    node = hot_nodes_[PickWeightedIndex(cumulative_freqs_, rng_())];
+  auto it = successors_.find(node);
+  next_node_ = it == successors_.end()
+                   ? nullptr
+                   : it->second.sinks[PickWeightedIndex(
+                         it->second.cumulative_weights, rng_())];
+  return node;
+}
+
+absl::flat_hash_map<const CFGNode *, uint64_t> GetLayoutNodeAddresses(
+    const ProgramCfg &program_cfg,
+    const absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
+        &cluster_info_by_section_name) {
+  absl::flat_hash_map<const CFGNode *, uint64_t> node_addresses;
+  for (const auto &[section_name, section_cluster_info] :
+       cluster_info_by_section_name) {
+    uint64_t addr = std::numeric_limits<uint64_t>::max();
+    int total_clusters = 0;
+    for (const FunctionClusterInfo &func_cluster_info : section_cluster_info) {
+      const ControlFlowGraph *cfg =
+          program_cfg.GetCfgByIndex(func_cluster_info.function_index);
+      CHECK_NE(cfg, nullptr);
+      for (const auto &node : cfg->nodes()) addr = std::min(addr, node->addr());
+      total_clusters += func_cluster_info.clusters.size();
+    }
+
+    std::vector<std::pair<const ControlFlowGraph *,
+                          const FunctionClusterInfo::BBCluster *>>
+        hot_clusters(total_clusters);
+    std::vector<const FunctionClusterInfo *> cold_parts(
+        section_cluster_info.size());
+    for (const FunctionClusterInfo &func_cluster_info : section_cluster_info) {
+      const ControlFlowGraph *cfg =
+          program_cfg.GetCfgByIndex(func_cluster_info.function_index);
+      for (const FunctionClusterInfo::BBCluster &cluster :
+           func_cluster_info.clusters)
+        hot_clusters[cluster.layout_index] = {cfg, &cluster};
+      cold_parts[func_cluster_info.cold_cluster_layout_index] =
+          &func_cluster_info;
+    }
+
+    for (const auto &[cfg, cluster] : hot_clusters) {
+      for (const CFGNode::FullIntraCfgId &full_bb_id : cluster->full_bb_ids) {
+        const CFGNode &node = cfg->GetNodeById(full_bb_id.intra_cfg_id);
+        node_addresses.emplace(&node, addr);
+        addr += node.size();
+      }
+    }
+    // The cold part of each function holds its remaining blocks in their
+    // original order.
+    for (const FunctionClusterInfo *func_cluster_info : cold_parts) {
+      const ControlFlowGraph *cfg =
+          program_cfg.GetCfgByIndex(func_cluster_info->function_index);
+      for (const auto &node : cfg->nodes()) {
+        if (node_addresses.emplace(node.get(), addr).second)
+          addr += node->size();
+      }
+    }
+  }
+  return node_addresses;
+}
+
+absl::Status ValidateLayoutSimulationParameters(
+    const LayoutSimulationParameters &params) {
+  if (params.icache_line_size() == 0 || params.icache_associativity() == 0) {
+    return absl::InvalidArgumentError(
+        "i-cache line size and associativity must be non-zero.");
+  }
+  const uint64_t icache_set_size =
+      static_cast<uint64_t>(params.icache_line_size()) *
+      params.icache_associativity();
+  if (params.icache_size() == 0 ||
+      params.icache_size() % icache_set_size != 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "i-cache size (", params.icache_size(),
+        ") must be a non-zero multiple of line size times associativity (",
+        icache_set_size, ")."));
+  }
+  if (params.itlb_page_size() == 0 || params.itlb_associativity() == 0) {
+    return absl::InvalidArgumentError(
+        "iTLB page size and associativity must be non-zero.");
+  }
+  if (params.itlb_entries() == 0 ||
+      params.itlb_entries() % params.itlb_associativity() != 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "iTLB entries (", params.itlb_entries(),
+        ") must be a non-zero multiple of the associativity (",
+        params.itlb_associativity(), ")."));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<LayoutSimulator> LayoutSimulator::Create(
+    const LayoutSimulationParameters &params) {
+  RETURN_IF_ERROR(ValidateLayoutSimulationParameters(params));
+  return LayoutSimulator(
+      SetAssociativeCache(params.icache_size() / params.icache_line_size(),
+                          params.icache_associativity(),
+                          params.icache_line_size()),
+      SetAssociativeCache(params.itlb_entries(), params.itlb_associativity(),
+                          params.itlb_page_size()));
+}
+
+void LayoutSimulator::Access(const CFGNode &node, uint64_t addr) {
+  auto [n_icache_accesses, n_icache_misses] =
+      AccessRange(icache_, addr, node.size());
+  auto [n_itlb_accesses, n_itlb_misses] = AccessRange(itlb_, addr, node.size());
+  result_.n_icache_accesses += n_icache_accesses;
+  result_.n_itlb_accesses += n_itlb_accesses;
+  if (n_icache_misses == 0 && n_itlb_misses == 0) return;
+  SimulatedMisses misses = {.icache_misses = n_icache_misses,
+                            .itlb_misses = n_itlb_misses};
+  result_.total_misses += misses;
+  result_.misses_by_function_index[node.function_index()] += misses;
+}
+
+absl::StatusOr<LayoutSimulationResult> SimulateLayout(
+    absl::Span<const CFGNode *const> trace,
+    absl::FunctionRef<uint64_t(const CFGNode *)> get_node_addr,
+    const LayoutSimulationParameters &params) {
+  ASSIGN_OR_RETURN(LayoutSimulator simulator, LayoutSimulator::Create(params));
+  for (const CFGNode *node : trace)
+    simulator.Access(*node, get_node_addr(node));
+  return simulator.result();
+}
+
+}  // namespace devtools_crosstool_autofdo
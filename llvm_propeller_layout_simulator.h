@@ -0,0 +1,165 @@
+#ifndef AUTOFDO_LLVM_PROPELLER_LAYOUT_SIMULATOR_H_
+#define AUTOFDO_LLVM_PROPELLER_LAYOUT_SIMULATOR_H_
+
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "llvm_propeller_cfg.h"
+#include "llvm_propeller_function_cluster_info.h"
+#include "llvm_propeller_options.pb.h"
+#include "llvm_propeller_program_cfg.h"
+#include "third_party/abseil/absl/container/btree_map.h"
+#include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "third_party/abseil/absl/functional/function_ref.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/types/span.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace devtools_crosstool_autofdo {
+
+// Simulates a set-associative cache with LRU replacement. Each cache entry
+// covers `line_size` bytes. This is used both for the instruction cache (with
+// cache lines) and the instruction TLB (with pages as lines).
+class SetAssociativeCache {
+ public:
+  // Constructs a cache with `n_entries` entries in total, organized in sets of
+  // `associativity` entries. `n_entries` must be a multiple of
+  // `associativity`.
+  SetAssociativeCache(int n_entries, int associativity, uint64_t line_size);
+
+  // Accesses the line containing `addr` and returns whether it was a hit.
+  bool Access(uint64_t addr);
+
+  uint64_t line_size() const { return line_size_; }
+
+ private:
+  const int associativity_;
+  const int n_sets_;
+  const uint64_t line_size_;
+  // Line tags of every set, from the most recently used to the least recently
+  // used. Set `i` occupies `tags_[i * associativity_, (i+1) * associativity_)`
+  // and its first `set_sizes_[i]` entries are valid.
+  std::vector<uint64_t> tags_;
+  std::vector<int> set_sizes_;
+};
+
+// Misses of the simulated instruction cache and instruction TLB.
+struct SimulatedMisses {
+  int64_t icache_misses = 0;
+  int64_t itlb_misses = 0;
+
+  void operator+=(const SimulatedMisses &other) {
+    icache_misses += other.icache_misses;
+    itlb_misses += other.itlb_misses;
+  }
+};
+
+// Simulated misses of a function under the original and the optimized layouts.
+struct FunctionSimulatedMisses {
+  SimulatedMisses original;
+  SimulatedMisses optimized;
+};
+
+// Result of simulating one layout.
+struct LayoutSimulationResult {
+  // Total number of cache line accesses.
+  int64_t n_icache_accesses = 0;
+  // Total number of page accesses.
+  int64_t n_itlb_accesses = 0;
+  // Total misses.
+  SimulatedMisses total_misses;
+  // Misses attributed to the function of the accessing basic block, keyed by
+  // function index.
+  absl::flat_hash_map<int, SimulatedMisses> misses_by_function_index;
+};
+
+// Generates a trace of executed basic blocks, replayed from the profile of a
+// `ProgramCfg`, one basic block at a time. The trace is a random walk along
+// the profiled (non-zero weight) edges, where every edge out of a block is
+// taken with probability proportional to its weight. The walk restarts from a
+// block chosen proportional to its frequency whenever it reaches a block
+// without profiled outgoing edges. The trace only depends on the profile and
+// the seed, and is never materialized, so arbitrarily long traces can be
+// replayed in constant memory.
+class ReplayTraceGenerator {
+ public:
+  // `program_cfg` must outlive this object.
+  ReplayTraceGenerator(const ProgramCfg &program_cfg, uint64_t seed);
+
+  // Returns whether the profile has no hot blocks, in which case the trace is
+  // empty and `Next` must not be called.
+  bool empty() const { return hot_nodes_.empty(); }
+
+  // Returns the next basic block of the trace.
+  const CFGNode *Next();
+
+ private:
+  // The profiled successors of a basic block, along with the running sum of
+  // their edge weights.
+  struct WeightedSuccessors {
+    std::vector<const CFGNode *> sinks;
+    std::vector<int64_t> cumulative_weights;
+  };
+
+  absl::flat_hash_map<const CFGNode *, WeightedSuccessors> successors_;
+  // Hot nodes and the running sum of their frequencies, for picking the start
+  // of every walk.
+  std::vector<const CFGNode *> hot_nodes_;
+  std::vector<int64_t> cumulative_freqs_;
+  std::mt19937_64 rng_;
+  // The next node of the current walk, or nullptr if a new walk must start.
+  const CFGNode *next_node_ = nullptr;
+};
+
+// Returns an error if the cache geometry in `params` can not be simulated.
+absl::Status ValidateLayoutSimulationParameters(
+    const LayoutSimulationParameters &params);
+
+// Replays basic block accesses against the instruction cache and TLB
+// described by the parameters and accumulates the simulated misses.
+class LayoutSimulator {
+ public:
+  // Returns an error if `params` is invalid, as determined by
+  // `ValidateLayoutSimulationParameters`.
+  static absl::StatusOr<LayoutSimulator> Create(
+      const LayoutSimulationParameters &params);
+
+  // Accesses the basic block `node`, placed at address `addr`.
+  void Access(const CFGNode &node, uint64_t addr);
+
+  const LayoutSimulationResult &result() const { return result_; }
+
+ private:
+  LayoutSimulator(SetAssociativeCache icache, SetAssociativeCache itlb)
+      : icache_(std::move(icache)), itlb_(std::move(itlb)) {}
+
+  SetAssociativeCache icache_;
+  SetAssociativeCache itlb_;
+  LayoutSimulationResult result_;
+};
+
+// Returns the address of every node of `program_cfg` under the layout
+// described by `cluster_info_by_section_name`, as emitted by
+// `PropellerProfileWriter`: the hot clusters of each section in the order of
+// their layout index, followed by the cold parts of the functions in the order
+// of their cold cluster layout index. Each section starts at the lowest
+// original address of its functions. Function alignment is not modeled.
+absl::flat_hash_map<const CFGNode *, uint64_t> GetLayoutNodeAddresses(
+    const ProgramCfg &program_cfg,
+    const absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
+        &cluster_info_by_section_name);
+
+// Replays `trace` against the instruction cache and TLB described by `params`,
+// with basic blocks placed at the addresses given by `get_node_addr`, and
+// returns the simulated misses. Returns an error if `params` is invalid.
+absl::StatusOr<LayoutSimulationResult> SimulateLayout(
+    absl::Span<const CFGNode *const> trace,
+    absl::FunctionRef<uint64_t(const CFGNode *)> get_node_addr,
+    const LayoutSimulationParameters &params);
+
+}  // namespace devtools_crosstool_autofdo
+
+#endif  // AUTOFDO_LLVM_PROPELLER_LAYOUT_SIMULATOR_H_
@@ -0,0 +1,186 @@
+#include "llvm_propeller_layout_simulator.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "llvm_propeller_cfg.h"
+#include "llvm_propeller_cfg_testutil.h"
+#include "llvm_propeller_function_cluster_info.h"
+#include "llvm_propeller_mock_program_cfg_builder.h"
+#include "llvm_propeller_options.pb.h"
+#include "llvm_propeller_program_cfg.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/container/btree_map.h"
+#include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "util/testing/status_matchers.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+
+using ::testing::Each;
+using ::testing::Field;
+using ::testing::FieldsAre;
+using ::testing::Ne;
+using ::testing::Pair;
+using ::testing::UnorderedElementsAre;
+using ::testing::status::StatusIs;
+
+// Returns a single-function program with three 16-byte blocks, where only
+// blocks 0 and 1 are hot.
+std::unique_ptr<ProgramCfg> BuildSimpleProgramCfg() {
+  return BuildFromCfgArg(
+      {.cfg_args = {{".text",
+                     0,
+                     "foo",
+                     {{0x1000, 0, 0x10}, {0x1010, 1, 0x10}, {0x1020, 2, 0x10}},
+                     {{0, 1, 10, CFGEdge::Kind::kBranchOrFallthough},
+                      {1, 0, 5, CFGEdge::Kind::kBranchOrFallthough},
+                      {0, 2, 0, CFGEdge::Kind::kBranchOrFallthough}}}}});
+}
+
+TEST(SetAssociativeCacheTest, EvictsLeastRecentlyUsedLine) {
+  // Two sets of two 64-byte lines each.
+  SetAssociativeCache cache(/*n_entries=*/4, /*associativity=*/2,
+                            /*line_size=*/64);
+  EXPECT_FALSE(cache.Access(0));
+  EXPECT_TRUE(cache.Access(63));
+  // Lines 0, 2, and 4 all map to set 0.
+  EXPECT_FALSE(cache.Access(128));
+  // Line 1 maps to set 1 and does not evict anything from set 0.
+  EXPECT_FALSE(cache.Access(64));
+  EXPECT_TRUE(cache.Access(0));
+  // Evicts line 2, which is now the least recently used in set 0.
+  EXPECT_FALSE(cache.Access(256));
+  EXPECT_TRUE(cache.Access(0));
+  EXPECT_FALSE(cache.Access(128));
+  EXPECT_TRUE(cache.Access(64));
+}
+
+// Returns the first `trace_length` basic blocks of the replay trace of
+// `program_cfg`.
+std::vector<const CFGNode *> GenerateReplayTrace(const ProgramCfg &program_cfg,
+                                                 int trace_length,
+                                                 uint64_t seed) {
+  ReplayTraceGenerator trace_generator(program_cfg, seed);
+  std::vector<const CFGNode *> trace;
+  for (int i = 0; i < trace_length; ++i)
+    trace.push_back(trace_generator.Next());
+  return trace;
+}
+
+TEST(LayoutSimulatorTest, ReplayTraceVisitsOnlyHotBlocks) {
+  std::unique_ptr<ProgramCfg> program_cfg = BuildSimpleProgramCfg();
+  const CFGNode &cold_node =
+      program_cfg->GetCfgByIndex(0)->GetNodeById({.bb_index = 2});
+  const std::vector<const CFGNode *> trace =
+      GenerateReplayTrace(*program_cfg, /*trace_length=*/1000, /*seed=*/1);
+  EXPECT_THAT(trace, Each(Ne(&cold_node)));
+  // The trace only depends on the profile and the seed.
+  EXPECT_EQ(GenerateReplayTrace(*program_cfg, /*trace_length=*/1000,
+                                /*seed=*/1),
+            trace);
+}
+
+TEST(LayoutSimulatorTest, ReplayTraceWithoutProfile) {
+  std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
+      {.cfg_args = {{".text", 0, "foo", {{0x1000, 0, 0x10}}, {}}}});
+  EXPECT_TRUE(ReplayTraceGenerator(*program_cfg, /*seed=*/1).empty());
+}
+
+TEST(LayoutSimulatorTest, GetLayoutNodeAddresses) {
+  std::unique_ptr<ProgramCfg> program_cfg = BuildSimpleProgramCfg();
+  const ControlFlowGraph &cfg = *program_cfg->GetCfgByIndex(0);
+  FunctionClusterInfo func_cluster_info = {.function_index = 0};
+  func_cluster_info.clusters.emplace_back(/*_layout_index=*/0);
+  func_cluster_info.clusters.back().full_bb_ids = {
+      {.bb_id = 0, .intra_cfg_id = {.bb_index = 0}},
+      {.bb_id = 2, .intra_cfg_id = {.bb_index = 2}}};
+  absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
+      cluster_info_by_section_name;
+  cluster_info_by_section_name[".text"].push_back(func_cluster_info);
+
+  EXPECT_THAT(
+      GetLayoutNodeAddresses(*program_cfg, cluster_info_by_section_name),
+      UnorderedElementsAre(Pair(&cfg.GetNodeById({.bb_index = 0}), 0x1000),
+                           Pair(&cfg.GetNodeById({.bb_index = 2}), 0x1010),
+                           Pair(&cfg.GetNodeById({.bb_index = 1}), 0x1020)));
+}
+
+TEST(LayoutSimulatorTest, SimulateLayoutCountsConflictMisses) {
+  std::unique_ptr<ProgramCfg> program_cfg = BuildSimpleProgramCfg();
+  const ControlFlowGraph &cfg = *program_cfg->GetCfgByIndex(0);
+  const CFGNode *node0 = &cfg.GetNodeById({.bb_index = 0});
+  const CFGNode *node1 = &cfg.GetNodeById({.bb_index = 1});
+  const std::vector<const CFGNode *> trace = {node0, node1, node0, node1};
+
+  // A direct-mapped i-cache with two 64-byte lines, and a single-entry iTLB.
+  LayoutSimulationParameters params;
+  params.set_icache_size(128);
+  params.set_icache_line_size(64);
+  params.set_icache_associativity(1);
+  params.set_itlb_entries(1);
+  params.set_itlb_associativity(1);
+  params.set_itlb_page_size(4096);
+
+  // Both blocks map to the same i-cache line and conflict on every access.
+  ASSERT_OK_AND_ASSIGN(LayoutSimulationResult conflicting,
+                       SimulateLayout(
+                           trace,
+                           [&](const CFGNode *node) -> uint64_t {
+                             return node == node0 ? 0x1000 : 0x1080;
+                           },
+                           params));
+  EXPECT_EQ(conflicting.n_icache_accesses, 4);
+  EXPECT_EQ(conflicting.n_itlb_accesses, 4);
+  EXPECT_THAT(conflicting.total_misses, FieldsAre(4, 1));
+  EXPECT_THAT(conflicting.misses_by_function_index,
+              UnorderedElementsAre(Pair(0, FieldsAre(4, 1))));
+
+  // Placing the blocks in different lines removes the conflict misses.
+  ASSERT_OK_AND_ASSIGN(LayoutSimulationResult adjacent,
+                       SimulateLayout(
+                           trace,
+                           [&](const CFGNode *node) -> uint64_t {
+                             return node == node0 ? 0x1000 : 0x1040;
+                           },
+                           params));
+  EXPECT_THAT(adjacent.total_misses, FieldsAre(2, 1));
+
+  // The original layout fits both blocks in one line.
+  ASSERT_OK_AND_ASSIGN(
+      LayoutSimulationResult original,
+      SimulateLayout(
+          trace, [](const CFGNode *node) { return node->addr(); }, params));
+  EXPECT_THAT(original.total_misses,
+              Field(&SimulatedMisses::icache_misses, 1));
+}
+
+TEST(LayoutSimulatorTest, RejectsInvalidGeometry) {
+  LayoutSimulationParameters zero_line_size;
+  zero_line_size.set_icache_line_size(0);
+  EXPECT_THAT(LayoutSimulator::Create(zero_line_size),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+
+  LayoutSimulationParameters zero_associativity;
+  zero_associativity.set_itlb_associativity(0);
+  EXPECT_THAT(LayoutSimulator::Create(zero_associativity),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+
+  // 1000 bytes are not a whole number of 8-way sets of 64-byte lines.
+  LayoutSimulationParameters partial_set;
+  partial_set.set_icache_size(1000);
+  EXPECT_THAT(LayoutSimulator::Create(partial_set),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+
+  // Huge pages are supported.
+  LayoutSimulationParameters huge_pages;
+  huge_pages.set_itlb_page_size(2 * 1024 * 1024);
+  EXPECT_OK(LayoutSimulator::Create(huge_pages));
+}
+
+}  // namespace
+}  // namespace devtools_crosstool_autofdo
@@ -2,9 +2,13 @@
 
 #include <fcntl.h>  // for "O_RDONLY"
 
+#include <algorithm>
 #include <cerrno>
+#include <cmath>
+#include <cstdint>
 #include <memory>
 #include <optional>
+#include <random>
 #include <string>
 #include <utility>
 #include <vector>
@@ -15,8 +19,10 @@
 #include "llvm_propeller_program_cfg.h"
 #include "base/logging.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "third_party/abseil/absl/container/flat_hash_set.h"
 #include "third_party/abseil/absl/status/status.h"
 #include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
 #include "third_party/abseil/absl/strings/str_format.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
@@ -149,4 +155,93 @@ std::unique_ptr<ProgramCfg> BuildFromCfgArg(MultiCfgArg multi_cfg_arg) {
           .Build();
   return std::make_unique<ProgramCfg>(std::move(cfgs));
 }
+
+SyntheticProgram CreateSyntheticProgram(
+    const SyntheticProgramParameters &params) {
+  const int n_blocks = params.n_blocks_per_function;
+  std::mt19937 rng(params.seed);
+  std::uniform_int_distribution<int> weight_distribution(1, 1000);
+  std::uniform_int_distribution<int> bb_index_distribution(0, n_blocks - 1);
+  std::uniform_int_distribution<int> function_index_distribution(
+      0, params.n_functions - 1);
+  std::uniform_int_distribution<int> size_distribution(1, 64);
+  std::bernoulli_distribution call_distribution(params.call_density);
+
+  SyntheticProgram program;
+  program.function_names.reserve(params.n_functions);
+  for (int function_index = 0; function_index != params.n_functions;
+       ++function_index) {
+    program.function_names.push_back(
+        absl::StrCat("synthetic_", function_index));
+  }
+
+  // Scales a random edge weight by the Zipf hotness of `function_index`.
+  auto get_weight = [&](int function_index) -> int64_t {
+    return std::max<int64_t>(
+        1, static_cast<int64_t>(
+               weight_distribution(rng) * 1000 /
+               std::pow(function_index + 1, params.hot_edge_skew)));
+  };
+
+  std::vector<CfgArg> cfg_args;
+  std::vector<InterEdgeArg> inter_edge_args;
+  uint64_t addr = 0x1000;
+  for (int function_index = 0; function_index != params.n_functions;
+       ++function_index) {
+    std::vector<NodeArg> node_args;
+    for (int bb_index = 0; bb_index != n_blocks; ++bb_index) {
+      uint64_t size = size_distribution(rng);
+      node_args.push_back({.addr = addr, .bb_index = bb_index, .size = size});
+      addr += size;
+    }
+
+    std::vector<IntraEdgeArg> edge_args;
+    absl::flat_hash_set<std::pair<int, int>> edges;
+    auto add_edge = [&](int from_bb_index, int to_bb_index, int64_t weight) {
+      if (!edges.insert({from_bb_index, to_bb_index}).second) return;
+      edge_args.push_back({.from_bb_index = from_bb_index,
+                           .to_bb_index = to_bb_index,
+                           .weight = weight,
+                           .kind = CFGEdge::Kind::kBranchOrFallthough});
+    };
+    int64_t loop_weight_scale = 10;
+    for (int depth = 0;
+         depth != params.loop_depth && depth < n_blocks - 1 - depth;
+         ++depth, loop_weight_scale *= 10) {
+      add_edge(n_blocks - 1 - depth, depth,
+               get_weight(function_index) * loop_weight_scale);
+    }
+    for (int bb_index = 0; bb_index + 1 < n_blocks; ++bb_index) {
+      add_edge(bb_index, bb_index + 1, get_weight(function_index));
+      if (bb_index % 4 == 0) {
+        add_edge(bb_index, bb_index_distribution(rng),
+                 get_weight(function_index));
+      }
+      if (params.n_functions == 1 || !call_distribution(rng)) continue;
+      int callee_index = function_index_distribution(rng);
+      if (callee_index == function_index) continue;
+      const int64_t weight = get_weight(function_index);
+      inter_edge_args.push_back({.from_function_index = function_index,
+                                 .from_bb_index = bb_index,
+                                 .to_function_index = callee_index,
+                                 .to_bb_index = 0,
+                                 .weight = weight,
+                                 .kind = CFGEdge::Kind::kCall});
+      inter_edge_args.push_back({.from_function_index = callee_index,
+                                 .from_bb_index = n_blocks - 1,
+                                 .to_function_index = function_index,
+                                 .to_bb_index = bb_index + 1,
+                                 .weight = weight,
+                                 .kind = CFGEdge::Kind::kRet});
+    }
+    cfg_args.push_back({".text", function_index,
+                        program.function_names[function_index],
+                        std::move(node_args), std::move(edge_args)});
+  }
+  program.n_nodes = int64_t{params.n_functions} * n_blocks;
+  program.program_cfg =
+      BuildFromCfgArg({.cfg_args = std::move(cfg_args),
+                       .inter_edge_args = std::move(inter_edge_args)});
+  return program;
+}
 }  // namespace devtools_crosstool_autofdo
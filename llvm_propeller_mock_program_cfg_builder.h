@@ -1,9 +1,11 @@
 #ifndef AUTOFDOLLVM_PROPELLER_MOCK_PROGRAM_CFG_BUILDER_H_
 #define AUTOFDOLLVM_PROPELLER_MOCK_PROGRAM_CFG_BUILDER_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "llvm_propeller_cfg.h"
 #include "llvm_propeller_cfg_testutil.h"
@@ -37,6 +39,39 @@ absl::StatusOr<std::unique_ptr<ProtoProgramCfg>> BuildFromCfgProtoPath(
 
 // Constructs and returns a `ProgramCfg` from a the given `multi_cfg_arg`.
 std::unique_ptr<ProgramCfg> BuildFromCfgArg(MultiCfgArg multi_cfg_arg);
+
+// Parameters of a synthetic program for benchmarks and randomized tests.
+struct SyntheticProgramParameters {
+  int n_functions = 1;
+  int n_blocks_per_function = 16;
+  // Depth of the loop nest in every function. Loop `i` spans blocks
+  // [i, n_blocks_per_function - 1 - i] and is ten times hotter than loop
+  // `i - 1`.
+  int loop_depth = 0;
+  // Exponent of the Zipf distribution of function hotness: 0 makes all
+  // functions equally hot and larger values concentrate the samples in fewer
+  // functions.
+  double hot_edge_skew = 1.0;
+  // Probability that a block calls (and is returned to from) another
+  // function.
+  double call_density = 0.05;
+  // Seed of the pseudo-random generator.
+  uint32_t seed = 1;
+};
+
+// A synthetic program along with the storage for its function names.
+struct SyntheticProgram {
+  std::vector<std::string> function_names;
+  std::unique_ptr<ProgramCfg> program_cfg;
+  int64_t n_nodes = 0;
+};
+
+// Returns a program with the shape given by `params`. Every block falls
+// through to the next one and about a quarter of the blocks also branch to a
+// random block of the same function. Block sizes and edge weights are random
+// but the same `params` always yields the same program.
+SyntheticProgram CreateSyntheticProgram(
+    const SyntheticProgramParameters &params);
 }  // namespace devtools_crosstool_autofdo
 
 #endif  // AUTOFDOLLVM_PROPELLER_MOCK_PROGRAM_CFG_BUILDER_H_
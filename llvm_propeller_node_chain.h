@@ -2,6 +2,7 @@
 #define AUTOFDOLLVM_PROPELLER_NODE_CHAIN_H_
 
 #include <algorithm>
+#include <cstdint>
 #include <iterator>
 #include <memory>
 #include <optional>
@@ -89,7 +90,7 @@ class CFGNodeBundle {
   CFGNodeBundle &operator=(CFGNodeBundle &&other) = default;
 
   int size() const { return size_; }
-  int freq() const { return freq_; }
+  int64_t freq() const { return freq_; }
   const std::vector<const CFGNode *> &nodes() const { return nodes_; }
   const ChainMappingEntry &chain_mapping() const { return chain_mapping_; }
   const std::vector<const CFGEdge *> &intra_chain_out_edges() const {
@@ -140,7 +141,7 @@ class CFGNodeBundle {
   int size_;
 
   // Total execution frequency of this bundle.
-  int freq_;
+  int64_t freq_;
 
   // Edges from this bundle to other bundles of `chain_`. Ordered in increasing
   // order of the sink bundle's `chain_index_`. This ordering should be enforced
@@ -199,7 +200,7 @@ class NodeChain {
   std::optional<int> function_index() const { return function_index_; }
   double score() const { return score_; }
   int size() const { return size_; }
-  int freq() const { return freq_; }
+  int64_t freq() const { return freq_; }
   std::vector<std::unique_ptr<CFGNodeBundle>> &mutable_node_bundles() {
     return node_bundles_;
   }
@@ -316,7 +317,7 @@ class NodeChain {
   // Total binary size of the chain.
   int size_;
   // Total execution frequency of the chain.
-  int freq_;
+  int64_t freq_;
   // Total score for this chain.
   double score_ = 0;
 
@@ -11,6 +11,7 @@
 #include "third_party/abseil/absl/status/status.h"
 #include "third_party/abseil/absl/status/statusor.h"
 #include "third_party/abseil/absl/strings/str_format.h"
+#include "third_party/abseil/absl/types/span.h"
 
 namespace devtools_crosstool_autofdo {
 
@@ -31,7 +32,8 @@ absl::StatusOr<NodeChainAssembly> NodeChainAssembly::BuildNodeChainAssembly(
     CHECK_GT(*options.slice_pos, 0) << "Out of bounds slice position.";
   }
   NodeChainAssembly assembly(bundle_mapper, scorer, split_chain, unsplit_chain,
-                             options.merge_order, options.slice_pos);
+                             options.merge_order, options.slice_pos,
+                             options.chain_pair_edges);
   // If `inter_function_ordering = false`, omit assemblies which place the entry
   // node in the middle of the chain. Placing the entry block in the middle is
   // allowed. However, it requires multiple hot function parts (sections) as the
@@ -54,14 +56,50 @@ absl::StatusOr<NodeChainAssembly> NodeChainAssembly::BuildNodeChainAssembly(
   return assembly;
 }
 
+NodeChainPairEdges::NodeChainPairEdges(const NodeToBundleMapper &bundle_mapper,
+                                       const NodeChain &split_chain,
+                                       const NodeChain &unsplit_chain) {
+  auto resolve_edges = [&](const NodeChain &from_chain,
+                           const NodeChain &to_chain, std::vector<Edge> &edges) {
+    auto it = from_chain.inter_chain_out_edges().find(&to_chain);
+    if (it == from_chain.inter_chain_out_edges().end()) return;
+    edges.reserve(it->second.size());
+    for (const CFGEdge *edge : it->second) {
+      const auto &src_bundle_info =
+          bundle_mapper.GetBundleMappingEntry(edge->src());
+      const auto &sink_bundle_info =
+          bundle_mapper.GetBundleMappingEntry(edge->sink());
+      edges.push_back(
+          {.edge = edge,
+           .src_bundle_index = src_bundle_info.bundle->chain_mapping()
+                                   .chain_index,
+           .src_offset = src_bundle_info.GetNodeOffset(),
+           .sink_bundle_index = sink_bundle_info.bundle->chain_mapping()
+                                    .chain_index,
+           .sink_offset = sink_bundle_info.GetNodeOffset()});
+    }
+  };
+  resolve_edges(split_chain, unsplit_chain, split_to_unsplit_edges_);
+  resolve_edges(unsplit_chain, split_chain, unsplit_to_split_edges_);
+}
+
 double NodeChainAssembly::ComputeScoreGain(
     const NodeToBundleMapper &bundle_mapper,
-    const PropellerCodeLayoutScorer &scorer) const {
+    const PropellerCodeLayoutScorer &scorer,
+    const NodeChainPairEdges *chain_pair_edges) const {
   // First compute the inter-chain score.
-  double score_gain = ComputeInterChainScore(bundle_mapper, scorer,
-                                             split_chain(), unsplit_chain()) +
-                      ComputeInterChainScore(bundle_mapper, scorer,
-                                             unsplit_chain(), split_chain());
+  double score_gain =
+      chain_pair_edges != nullptr
+          ? ComputeInterChainScore(scorer,
+                                   chain_pair_edges->split_to_unsplit_edges(),
+                                   /*from_split_chain=*/true) +
+                ComputeInterChainScore(
+                    scorer, chain_pair_edges->unsplit_to_split_edges(),
+                    /*from_split_chain=*/false)
+          : ComputeInterChainScore(bundle_mapper, scorer, split_chain(),
+                                   unsplit_chain()) +
+                ComputeInterChainScore(bundle_mapper, scorer, unsplit_chain(),
+                                       split_chain());
   // As an optimization, if the inter-chain score gain is zero, we omit the
   // exact computation of the score gain and simply return 0.
   if (score_gain == 0) return 0;
@@ -157,14 +195,18 @@ double NodeChainAssembly::ComputeEdgeScore(
   const auto &sink_bundle_info =
       bundle_mapper.GetBundleMappingEntry(edge.sink());
 
-  const int src_slice_idx = FindSliceIndex(edge.src(), src_bundle_info).value();
-  const int sink_slice_idx =
-      FindSliceIndex(edge.sink(), sink_bundle_info).value();
+  return ComputeEdgeScore(
+      scorer, edge, FindSliceIndex(edge.src(), src_bundle_info).value(),
+      src_bundle_info.GetNodeOffset(),
+      FindSliceIndex(edge.sink(), sink_bundle_info).value(),
+      sink_bundle_info.GetNodeOffset());
+}
 
+double NodeChainAssembly::ComputeEdgeScore(
+    const PropellerCodeLayoutScorer &scorer, const CFGEdge &edge,
+    int src_slice_idx, int src_offset, int sink_slice_idx,
+    int sink_offset) const {
   int src_sink_distance = 0;
-  int src_offset = src_bundle_info.GetNodeOffset();
-  int sink_offset = sink_bundle_info.GetNodeOffset();
-
   if (src_slice_idx == sink_slice_idx) {
     src_sink_distance = sink_offset - src_offset - edge.src()->size();
   } else {
@@ -199,6 +241,40 @@ double NodeChainAssembly::ComputeInterChainScore(
   return score;
 }
 
+double NodeChainAssembly::ComputeInterChainScore(
+    const PropellerCodeLayoutScorer &scorer,
+    absl::Span<const NodeChainPairEdges::Edge> edges,
+    bool from_split_chain) const {
+  const int unsplit_slice_idx = unsplit_chain_slice_index();
+  double score = 0;
+  for (const NodeChainPairEdges::Edge &edge : edges) {
+    const int src_slice_idx =
+        from_split_chain ? GetSplitChainSliceIndex(edge.src_bundle_index)
+                         : unsplit_slice_idx;
+    const int sink_slice_idx =
+        from_split_chain ? unsplit_slice_idx
+                         : GetSplitChainSliceIndex(edge.sink_bundle_index);
+    score += ComputeEdgeScore(scorer, *edge.edge, src_slice_idx,
+                              edge.src_offset, sink_slice_idx,
+                              edge.sink_offset);
+  }
+  return score;
+}
+
+int NodeChainAssembly::GetSplitChainSliceIndex(int bundle_index) const {
+  // If this is not a splitting assembly, it will have the SU merge order.
+  // So the slice index will be 0.
+  if (!splits()) return 0;
+  for (int idx : split_chain_slice_indexes()) {
+    if (bundle_index >= slices_[idx].begin_index() &&
+        bundle_index < slices_[idx].end_index()) {
+      return idx;
+    }
+  }
+  LOG(FATAL) << "Bundle index " << bundle_index
+             << " is out of bounds of the split chain.";
+}
+
 // Returns the score gain from intra-chain edges of `split_chain()` for this
 // assembly. Effectively, we aggregate the score difference of inter-slice
 // edges, i.e., edges from one slice of `split_chain()` to the other. This is
@@ -13,6 +13,7 @@
 #include "llvm_propeller_node_chain.h"
 #include "third_party/abseil/absl/functional/function_ref.h"
 #include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/types/span.h"
 
 namespace devtools_crosstool_autofdo {
 
@@ -90,6 +91,11 @@ class NodeChainSlice {
 
   bool empty() const { return begin_index_ == end_index_; }
 
+  // Indices of the first bundle and one after the last bundle of the slice in
+  // `chain().node_bundles()`.
+  int begin_index() const { return begin_index_; }
+  int end_index() const { return end_index_; }
+
  private:
   // The chain from which this slice has been constructed.
   NodeChain *chain_;
@@ -100,6 +106,52 @@ class NodeChainSlice {
   int begin_index_, end_index_;
 };
 
+// The inter-chain edges between two chains `split_chain` and `unsplit_chain`
+// (in both directions) with the positions of their endpoints resolved. All
+// assemblies of one chain pair share the same inter-chain edges and only differ
+// in where the slices are placed. So `NodeChainAssembly` can score every merge
+// order and slice position of the pair from these cached components instead of
+// looking up the bundles of every edge again for each assembly. This only
+// saves the lookups: every assembly still visits each inter-chain edge once,
+// and the edges are resolved again whenever the pair is re-evaluated after a
+// merge, so scoring is not incremental across merges.
+class NodeChainPairEdges {
+ public:
+  struct Edge {
+    const CFGEdge *edge;
+    // Index of the bundle containing the src node in its chain and the offset
+    // of the src node in its chain.
+    int src_bundle_index;
+    int src_offset;
+    // Index of the bundle containing the sink node in its chain and the offset
+    // of the sink node in its chain.
+    int sink_bundle_index;
+    int sink_offset;
+  };
+
+  // Resolves the edges between `split_chain` and `unsplit_chain` using the
+  // current bundle mapping in `bundle_mapper`. The result is invalidated when
+  // either chain is changed.
+  NodeChainPairEdges(const NodeToBundleMapper &bundle_mapper,
+                     const NodeChain &split_chain,
+                     const NodeChain &unsplit_chain);
+
+  // Edges from `split_chain` to `unsplit_chain`, in the same order as in
+  // `split_chain.inter_chain_out_edges()`.
+  const std::vector<Edge> &split_to_unsplit_edges() const {
+    return split_to_unsplit_edges_;
+  }
+  // Edges from `unsplit_chain` to `split_chain`, in the same order as in
+  // `unsplit_chain.inter_chain_out_edges()`.
+  const std::vector<Edge> &unsplit_to_split_edges() const {
+    return unsplit_to_split_edges_;
+  }
+
+ private:
+  std::vector<Edge> split_to_unsplit_edges_;
+  std::vector<Edge> unsplit_to_split_edges_;
+};
+
 // This class abstracts the strategy for assembling two chains together with one
 // of the chains potentially being split into two chains. This strategy is
 // specified by the following fields:
@@ -121,6 +173,10 @@ class NodeChainAssembly {
     // Whether `NodeChainAssembly::BuildNodeChainAssembly` should return error
     // if the constructed assembly's score gain is zero.
     bool error_on_zero_score_gain = true;
+    // The resolved edges between the two chains, if precomputed. Must be
+    // computed for the same chains and their current bundle mapping. The score
+    // gain is the same whether or not this is provided.
+    const NodeChainPairEdges *chain_pair_edges = nullptr;
   };
 
   // Comparator for two NodeChainAssemblies. It compares score_gain and break
@@ -200,13 +256,15 @@ class NodeChainAssembly {
                              const PropellerCodeLayoutScorer &scorer,
                              NodeChain &split_chain, NodeChain &unsplit_chain,
                              ChainMergeOrder merge_order,
-                             std::optional<int> slice_pos)
+                             std::optional<int> slice_pos,
+                             const NodeChainPairEdges *chain_pair_edges)
       : chain_pair_{.split_chain = &split_chain,
                     .unsplit_chain = &unsplit_chain},
         merge_order_(merge_order),
         slice_pos_(slice_pos),
         slices_(ConstructSlices()),
-        score_gain_(ComputeScoreGain(bundle_mapper, scorer)) {}
+        score_gain_(ComputeScoreGain(bundle_mapper, scorer, chain_pair_edges)) {
+  }
 
   // Index of the unsplit_chain in the slices_ vector.
   int unsplit_chain_slice_index() const {
@@ -247,9 +305,11 @@ class NodeChainAssembly {
   std::vector<NodeChainSlice> ConstructSlices() const;
 
   // Returns the gain in Ext-TSP score if this assembly is applied. May return 0
-  // if the actual score gain is negative.
+  // if the actual score gain is negative. Uses `chain_pair_edges` for the
+  // inter-chain edges if it is not nullptr.
   double ComputeScoreGain(const NodeToBundleMapper &bundle_mapper,
-                          const PropellerCodeLayoutScorer &scorer) const;
+                          const PropellerCodeLayoutScorer &scorer,
+                          const NodeChainPairEdges *chain_pair_edges) const;
 
   // Returns the total score contribution of edges running from `from_chain` to
   // `to_chain` for this assembly.
@@ -258,6 +318,18 @@ class NodeChainAssembly {
                                 const NodeChain &from_chain,
                                 const NodeChain &to_chain) const;
 
+  // Returns the total score contribution of the resolved `edges` for this
+  // assembly. `from_split_chain` specifies whether the edges run from
+  // `split_chain()` to `unsplit_chain()` or the other way around.
+  double ComputeInterChainScore(
+      const PropellerCodeLayoutScorer &scorer,
+      absl::Span<const NodeChainPairEdges::Edge> edges,
+      bool from_split_chain) const;
+
+  // Returns the index of the slice containing the bundle at `bundle_index` in
+  // `split_chain()`.
+  int GetSplitChainSliceIndex(int bundle_index) const;
+
   // Returns the total score gain from `split_chain()`'s intra-chain edges for
   // this assembly. This is more efficient than calling
   // `ComputeInterChainScore(scorer, chain, chain)` since it only computes the
@@ -273,6 +345,14 @@ class NodeChainAssembly {
                           const PropellerCodeLayoutScorer &scorer,
                           const CFGEdge &edge) const;
 
+  // Returns the score contribution of `edge` for this assembly given the
+  // indices of the slices containing its src and sink and their offsets in
+  // their chains.
+  double ComputeEdgeScore(const PropellerCodeLayoutScorer &scorer,
+                          const CFGEdge &edge, int src_slice_idx,
+                          int src_offset, int sink_slice_idx,
+                          int sink_offset) const;
+
   // The two chains in the assembly.
   NodeChainPair chain_pair_;
 
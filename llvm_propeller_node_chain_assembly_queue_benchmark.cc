@@ -0,0 +1,55 @@
+// Benchmarks `NodeChainBuilder::BuildChains` with every
+// `NodeChainAssemblyQueue` implementation on synthetic single-function CFGs of
+// increasing size.
+
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "llvm_propeller_cfg.h"
+#include "llvm_propeller_code_layout_scorer.h"
+#include "llvm_propeller_mock_program_cfg_builder.h"
+#include "llvm_propeller_node_chain_builder.h"
+#include "llvm_propeller_options.pb.h"
+#include "llvm_propeller_program_cfg.h"
+#include "llvm_propeller_statistics.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+
+template <class AssemblyQueueImpl>
+void BM_BuildChains(benchmark::State &state) {
+  const int n_nodes = state.range(0);
+  const SyntheticProgram program =
+      CreateSyntheticProgram({.n_functions = 1,
+                              .n_blocks_per_function = n_nodes,
+                              .hot_edge_skew = 0,
+                              .seed = static_cast<uint32_t>(n_nodes)});
+  const std::vector<const ControlFlowGraph *> cfgs = {
+      program.program_cfg->GetCfgByIndex(0)};
+  const PropellerCodeLayoutScorer scorer((PropellerCodeLayoutParameters()));
+  for (auto s : state) {
+    PropellerStats::CodeLayoutStats stats;
+    benchmark::DoNotOptimize(
+        NodeChainBuilder::CreateNodeChainBuilder<AssemblyQueueImpl>(
+            scorer, cfgs, /*initial_chains=*/{}, stats)
+            .BuildChains());
+  }
+  state.SetComplexityN(n_nodes);
+}
+
+BENCHMARK_TEMPLATE(BM_BuildChains, NodeChainAssemblyIterativeQueue)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096)
+    ->Complexity();
+BENCHMARK_TEMPLATE(BM_BuildChains, NodeChainAssemblyBalancedTreeQueue)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096)
+    ->Complexity();
+BENCHMARK_TEMPLATE(BM_BuildChains, NodeChainAssemblyHeapQueue)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096)
+    ->Complexity();
+
+}  // namespace
+}  // namespace devtools_crosstool_autofdo
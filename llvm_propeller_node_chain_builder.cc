@@ -1,10 +1,12 @@
 #include "llvm_propeller_node_chain_builder.h"
 
+#include <cstdint>
 #include <memory>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "live_metrics.h"
 #include "llvm_propeller_cfg.h"
 #include "llvm_propeller_chain_merge_order.h"
 #include "llvm_propeller_code_layout_scorer.h"
@@ -63,7 +65,7 @@ NodeChainBuilder NodeChainBuilder::CreateNodeChainBuilder(
                           std::make_unique<AssemblyQueueImpl>());
 }
 
-// Explicit instantiation of CreateNodeChainBuilder for both AssemblyQueueImpl
+// Explicit instantiation of CreateNodeChainBuilder for all AssemblyQueueImpl
 // types.
 template NodeChainBuilder
 NodeChainBuilder::CreateNodeChainBuilder<NodeChainAssemblyIterativeQueue>(
@@ -81,6 +83,33 @@ NodeChainBuilder::CreateNodeChainBuilder<NodeChainAssemblyBalancedTreeQueue>(
         int, std::vector<std::vector<CFGNode::IntraCfgId>>> &initial_chains,
     PropellerStats::CodeLayoutStats &stats);
 
+template NodeChainBuilder
+NodeChainBuilder::CreateNodeChainBuilder<NodeChainAssemblyHeapQueue>(
+    const PropellerCodeLayoutScorer &scorer,
+    const std::vector<const ControlFlowGraph *> &cfgs,
+    const absl::flat_hash_map<
+        int, std::vector<std::vector<CFGNode::IntraCfgId>>> &initial_chains,
+    PropellerStats::CodeLayoutStats &stats);
+
+NodeChainBuilder NodeChainBuilder::CreateNodeChainBuilderForCfgSize(
+    const PropellerCodeLayoutScorer &scorer,
+    const std::vector<const ControlFlowGraph *> &cfgs,
+    const absl::flat_hash_map<
+        int, std::vector<std::vector<CFGNode::IntraCfgId>>> &initial_chains,
+    PropellerStats::CodeLayoutStats &stats) {
+  // Below this many nodes, scanning all assemblies is cheaper than
+  // maintaining a heap.
+  constexpr int kMinNodesForHeapQueue = 64;
+  int64_t n_nodes = 0;
+  for (const ControlFlowGraph *cfg : cfgs) n_nodes += cfg->nodes().size();
+  if (n_nodes < kMinNodesForHeapQueue) {
+    return CreateNodeChainBuilder<NodeChainAssemblyIterativeQueue>(
+        scorer, cfgs, initial_chains, stats);
+  }
+  return CreateNodeChainBuilder<NodeChainAssemblyHeapQueue>(
+      scorer, cfgs, initial_chains, stats);
+}
+
 using NodeChainAssemblyComparator =
     NodeChainAssembly::NodeChainAssemblyComparator;
 
@@ -100,7 +129,7 @@ GetForcedEdges(const ControlFlowGraph &cfg) {
   // This stores the number of hot (non-zero weight) incoming edges to every
   // node (hot in-degree).
   absl::flat_hash_map<const CFGNode *, int> hot_in_degree;
-  for (const std::unique_ptr<CFGEdge> &edge : cfg.intra_edges()) {
+  for (const CFGEdge *edge : cfg.intra_edges()) {
     if (edge->weight() == 0 || edge->IsCall() || edge->IsReturn()) continue;
     auto [it, inserted] = forced_edges.emplace(edge->src(), edge->sink());
     // Nullify the edge for the source node if an out-edge has already been
@@ -330,8 +359,13 @@ std::vector<std::unique_ptr<NodeChain>> NodeChainBuilder::BuildChains() {
   InitNodeChains();
   InitChainEdges();
   InitChainAssemblies();
-  // Keep merging chains together until no more score gain can be achieved.
+  // Keep merging chains together until no more score gain can be achieved or
+  // the deadline is reached.
   while (!node_chain_assemblies_->empty()) {
+    if (deadline_ != absl::InfiniteFuture() && absl::Now() >= deadline_) {
+      ++stats_.n_chain_builds_stopped_at_deadline;
+      break;
+    }
     MergeChains(node_chain_assemblies_->GetBestAssembly());
   }
 
@@ -347,14 +381,23 @@ std::vector<std::unique_ptr<NodeChain>> NodeChainBuilder::BuildChains() {
 
 void NodeChainBuilder::UpdateNodeChainAssembly(NodeChain &split_chain,
                                                NodeChain &unsplit_chain) {
+  // Resolve the inter-chain edges once and share them across all the
+  // assemblies considered for this chain pair. They are only valid until
+  // either chain changes, so they are not kept beyond this evaluation.
+  const NodeChainPairEdges chain_pair_edges(*node_to_bundle_mapper_,
+                                            split_chain, unsplit_chain);
   absl::StatusOr<NodeChainAssembly> best_assembly =
       NodeChainAssembly::BuildNodeChainAssembly(
           *node_to_bundle_mapper_, code_layout_scorer_, split_chain,
-          unsplit_chain, {.merge_order = ChainMergeOrder::kSU});
+          unsplit_chain,
+          {.merge_order = ChainMergeOrder::kSU,
+           .chain_pair_edges = &chain_pair_edges});
+  int n_assemblies_evaluated = 1;
 
   if (code_layout_scorer_.code_layout_params().chain_split()) {
     auto compare_and_update_best_assembly =
         [&](absl::StatusOr<NodeChainAssembly> assembly) {
+          ++n_assemblies_evaluated;
           if (!assembly.ok()) return;
           if (!best_assembly.ok() ||
               NodeChainAssemblyComparator()(*best_assembly, *assembly)) {
@@ -376,7 +419,9 @@ void NodeChainBuilder::UpdateNodeChainAssembly(NodeChain &split_chain,
               NodeChainAssembly::BuildNodeChainAssembly(
                   *node_to_bundle_mapper_, code_layout_scorer_, split_chain,
                   unsplit_chain,
-                  {.merge_order = merge_order, .slice_pos = slice_pos}));
+                  {.merge_order = merge_order,
+                   .slice_pos = slice_pos,
+                   .chain_pair_edges = &chain_pair_edges}));
         }
       }
     } else {
@@ -393,7 +438,9 @@ void NodeChainBuilder::UpdateNodeChainAssembly(NodeChain &split_chain,
                   NodeChainAssembly::BuildNodeChainAssembly(
                       *node_to_bundle_mapper_, code_layout_scorer_, split_chain,
                       unsplit_chain,
-                      {.merge_order = merge_order, .slice_pos = slice_pos}));
+                      {.merge_order = merge_order,
+                       .slice_pos = slice_pos,
+                       .chain_pair_edges = &chain_pair_edges}));
             }
           };
 
@@ -423,6 +470,9 @@ void NodeChainBuilder::UpdateNodeChainAssembly(NodeChain &split_chain,
       });
     }
   }
+  // Report once per chain pair to keep the shared counter off the hot path.
+  IncrementLiveCounter(LiveCounter::kAssembliesEvaluated,
+                       n_assemblies_evaluated);
   if (best_assembly.ok()) {
     node_chain_assemblies_->InsertAssembly(std::move(*best_assembly));
   } else {
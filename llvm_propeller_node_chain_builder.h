@@ -1,13 +1,18 @@
 #ifndef AUTOFDOLLVM_PROPELLER_NODE_CHAIN_BUILDER_H_
 #define AUTOFDOLLVM_PROPELLER_NODE_CHAIN_BUILDER_H_
 
+#include <algorithm>
+#include <cstdint>
 #include <iterator>
 #include <memory>
+#include <optional>
 #include <set>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 #include "llvm_propeller_cfg.h"
+#include "llvm_propeller_chain_merge_order.h"
 #include "llvm_propeller_code_layout_scorer.h"
 #include "llvm_propeller_node_chain.h"
 #include "llvm_propeller_node_chain_assembly.h"
@@ -16,6 +21,9 @@
 #include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/container/btree_map.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "third_party/abseil/absl/container/flat_hash_set.h"
+#include "third_party/abseil/absl/time/clock.h"
+#include "third_party/abseil/absl/time/time.h"
 
 namespace devtools_crosstool_autofdo {
 // Comparator for comparing CFGNode pointers from a single CFG.
@@ -129,6 +137,104 @@ class NodeChainAssemblyIterativeQueue : public NodeChainAssemblyQueue {
   absl::flat_hash_map<NodeChainPair, NodeChainAssembly> assemblies_;
 };
 
+// Binary-heap implementation of `NodeChainAssemblyQueue` with lazy deletion.
+// Every inserted assembly is stamped with a new version and the latest version
+// of each `NodeChainPair` is recorded. Removed or replaced assemblies stay in
+// the heap until they reach the top, where they are discarded. The heap is
+// compacted whenever stale entries outnumber the live ones.
+// `GetBestAssembly` has constant time complexity.
+// `RemoveAssembly` and `InsertAssembly` have amortized logarithmic time
+// complexity.
+class NodeChainAssemblyHeapQueue : public NodeChainAssemblyQueue {
+ public:
+  bool empty() const override { return versions_.empty(); }
+
+  NodeChainAssembly GetBestAssembly() const override {
+    return heap_.front().assembly;
+  }
+
+  void RemoveAssembly(NodeChainPair chain_pair) override {
+    if (versions_.erase(chain_pair) == 0) return;
+    PopStaleEntries();
+  }
+
+  void InsertAssembly(NodeChainAssembly assembly) override {
+    int64_t version = ++last_version_;
+    versions_.insert_or_assign(assembly.chain_pair(), version);
+    heap_.push_back(Entry(version, std::move(assembly)));
+    absl::c_push_heap(heap_, EntryComparator());
+    PopStaleEntries();
+    if (heap_.size() > 2 * versions_.size() + kMinHeapSizeToCompact) Compact();
+  }
+
+ private:
+  // Heap entries never compare the assemblies themselves since stale
+  // assemblies may refer to chains which have been merged and destroyed.
+  // Instead, the fields used by `NodeChainAssemblyComparator` are captured at
+  // insertion.
+  struct Entry {
+    Entry(int64_t version, NodeChainAssembly assembly)
+        : version(version),
+          score_gain(assembly.score_gain()),
+          split_chain_id(assembly.split_chain().id()),
+          unsplit_chain_id(assembly.unsplit_chain().id()),
+          merge_order(assembly.merge_order()),
+          slice_pos(assembly.slice_pos()),
+          assembly(std::move(assembly)) {}
+
+    int64_t version;
+    double score_gain;
+    CFGNode::InterCfgId split_chain_id;
+    CFGNode::InterCfgId unsplit_chain_id;
+    ChainMergeOrder merge_order;
+    std::optional<int> slice_pos;
+    NodeChainAssembly assembly;
+  };
+
+  // Orders entries consistently with `NodeChainAssemblyComparator`.
+  struct EntryComparator {
+    bool operator()(const Entry &lhs, const Entry &rhs) const {
+      return std::forward_as_tuple(lhs.score_gain, rhs.split_chain_id,
+                                   rhs.unsplit_chain_id, lhs.merge_order,
+                                   lhs.slice_pos) <
+             std::forward_as_tuple(rhs.score_gain, lhs.split_chain_id,
+                                   lhs.unsplit_chain_id, rhs.merge_order,
+                                   rhs.slice_pos);
+    }
+  };
+
+  // Minimum heap size for compaction, to avoid compacting small heaps often.
+  static constexpr int kMinHeapSizeToCompact = 64;
+
+  bool IsLive(const Entry &entry) const {
+    auto it = versions_.find(entry.assembly.chain_pair());
+    return it != versions_.end() && it->second == entry.version;
+  }
+
+  // Discards stale entries from the top of the heap so that the top entry (if
+  // any) is live.
+  void PopStaleEntries() {
+    while (!heap_.empty() && !IsLive(heap_.front())) {
+      absl::c_pop_heap(heap_, EntryComparator());
+      heap_.pop_back();
+    }
+  }
+
+  // Discards all stale entries and rebuilds the heap.
+  void Compact() {
+    heap_.erase(std::remove_if(heap_.begin(), heap_.end(),
+                               [&](const Entry &e) { return !IsLive(e); }),
+                heap_.end());
+    absl::c_make_heap(heap_, EntryComparator());
+  }
+
+  // Max-heap of all entries, ordered by `EntryComparator`.
+  std::vector<Entry> heap_;
+  // Version of the live assembly for every `NodeChainPair` in the queue.
+  absl::flat_hash_map<NodeChainPair, int64_t> versions_;
+  int64_t last_version_ = 0;
+};
+
 // TODO(b/159842094): Make NodeChainBuilder exception-block aware.
 // This class builds BB chains for one or multiple CFGs.
 class NodeChainBuilder {
@@ -145,6 +251,17 @@ class NodeChainBuilder {
           int, std::vector<std::vector<CFGNode::IntraCfgId>>> &initial_chains,
       PropellerStats::CodeLayoutStats &stats);
 
+  // Like `CreateNodeChainBuilder`, but selects the `NodeChainAssemblyQueue`
+  // implementation based on the total number of nodes in `cfgs`: the
+  // iterative queue for small CFGs, where its linear scans are cheapest, and
+  // the heap queue otherwise. All implementations yield the same chains.
+  static NodeChainBuilder CreateNodeChainBuilderForCfgSize(
+      const PropellerCodeLayoutScorer &scorer,
+      const std::vector<const ControlFlowGraph *> &cfgs,
+      const absl::flat_hash_map<
+          int, std::vector<std::vector<CFGNode::IntraCfgId>>> &initial_chains,
+      PropellerStats::CodeLayoutStats &stats);
+
   const NodeToBundleMapper &node_to_bundle_mapper() const {
     return *node_to_bundle_mapper_;
   }
@@ -157,6 +274,10 @@ class NodeChainBuilder {
   // testing only.
   const std::vector<const ControlFlowGraph *> &cfgs() const { return cfgs_; }
 
+  // Sets the time after which `BuildChains` stops merging chains and returns
+  // the chains built so far.
+  void set_deadline(absl::Time deadline) { deadline_ = deadline; }
+
   const absl::flat_hash_map<CFGNode::InterCfgId, std::unique_ptr<NodeChain>> &
   chains() const {
     return chains_;
@@ -210,6 +331,7 @@ class NodeChainBuilder {
         cfgs_(cfgs),
         node_to_bundle_mapper_(
             NodeToBundleMapper::CreateNodeToBundleMapper(cfgs)),
+        function_indices_(GetFunctionIndices(cfgs)),
         initial_chains_(std::move(initial_chains)),
         stats_(stats),
         node_chain_assemblies_(std::move(node_chain_assemblies)) {
@@ -244,12 +366,26 @@ class NodeChainBuilder {
                                NodeChain &unsplit_chain);
 
   // Returns whether `edge` should be considered in constructing the chains.
+  // Edges to or from functions which are not in `cfgs_` are ignored.
   bool ShouldVisitEdge(const CFGEdge &edge) {
     return edge.weight() != 0 && !edge.IsReturn() &&
            ((code_layout_scorer_.code_layout_params()
                  .inter_function_reordering() &&
              cfgs_.size() > 1 && !edge.inter_section()) ||
-            !edge.IsCall());
+            !edge.IsCall()) &&
+           (cfgs_.size() == 1 ||
+            edge.src()->function_index() == edge.sink()->function_index() ||
+            (function_indices_.contains(edge.src()->function_index()) &&
+             function_indices_.contains(edge.sink()->function_index())));
+  }
+
+  // Returns the function indices of `cfgs`.
+  static absl::flat_hash_set<int> GetFunctionIndices(
+      const std::vector<const ControlFlowGraph *> &cfgs) {
+    absl::flat_hash_set<int> function_indices;
+    for (const ControlFlowGraph *cfg : cfgs)
+      function_indices.insert(cfg->function_index());
+    return function_indices;
   }
 
   const PropellerCodeLayoutScorer code_layout_scorer_;
@@ -259,6 +395,9 @@ class NodeChainBuilder {
 
   std::unique_ptr<NodeToBundleMapper> node_to_bundle_mapper_;
 
+  // Function indices of `cfgs_`.
+  const absl::flat_hash_set<int> function_indices_;
+
   // Initial node chains, specified as a map from every function index to the
   // vector of initial node chains for the corresponding CFG. Each node chain is
   // specified by a vector of intra_cfg_ids of its nodes.
@@ -267,6 +406,9 @@ class NodeChainBuilder {
 
   PropellerStats::CodeLayoutStats &stats_;
 
+  // Chain merging stops after this time.
+  absl::Time deadline_ = absl::InfiniteFuture();
+
   // Constructed chains. This starts by having one chain for every CFGNode and
   // as chains keep merging together, defunct chains are removed from this.
   absl::flat_hash_map<CFGNode::InterCfgId, std::unique_ptr<NodeChain>> chains_;
@@ -110,6 +110,26 @@ PropellerOptionsBuilder& PropellerOptionsBuilder::SetCodeLayoutParamsInterFuncti
   return *this;
 }
 
+PropellerOptionsBuilder& PropellerOptionsBuilder::SetCodeLayoutParamsInterFunctionCommunitySizeThreshold(uint32_t value) {
+  data_.mutable_code_layout_params()->set_inter_function_community_size_threshold(value);
+  return *this;
+}
+
+PropellerOptionsBuilder& PropellerOptionsBuilder::SetCodeLayoutParamsLayoutTimeBudgetMs(uint32_t value) {
+  data_.mutable_code_layout_params()->set_layout_time_budget_ms(value);
+  return *this;
+}
+
+PropellerOptionsBuilder& PropellerOptionsBuilder::SetCodeLayoutParamsHotTextPageSize(uint32_t value) {
+  data_.mutable_code_layout_params()->set_hot_text_page_size(value);
+  return *this;
+}
+
+PropellerOptionsBuilder& PropellerOptionsBuilder::SetCodeLayoutParamsHotTextPageBudget(uint32_t value) {
+  data_.mutable_code_layout_params()->set_hot_text_page_budget(value);
+  return *this;
+}
+
 PropellerOptionsBuilder& PropellerOptionsBuilder::SetVerboseClusterOutput(bool value) {
   data_.set_verbose_cluster_output(value);
   return *this;
@@ -145,6 +165,16 @@ PropellerOptionsBuilder& PropellerOptionsBuilder::AddInputProfiles(const InputPr
   return *this;
 }
 
+PropellerOptionsBuilder& PropellerOptionsBuilder::SetBinaryAddressMapperCacheDir(absl::string_view value) {
+  data_.set_binary_address_mapper_cache_dir(std::string(value));
+  return *this;
+}
+
+PropellerOptionsBuilder& PropellerOptionsBuilder::SetLayoutSimulationParams(const LayoutSimulationParameters& value) {
+  *data_.mutable_layout_simulation_params() = value;
+  return *this;
+}
+
 PropellerCodeLayoutParametersBuilder& PropellerCodeLayoutParametersBuilder::SetFallthroughWeight(uint32_t value) {
   data_.set_fallthrough_weight(value);
   return *this;
@@ -205,4 +235,24 @@ PropellerCodeLayoutParametersBuilder& PropellerCodeLayoutParametersBuilder::SetI
   return *this;
 }
 
+PropellerCodeLayoutParametersBuilder& PropellerCodeLayoutParametersBuilder::SetInterFunctionCommunitySizeThreshold(uint32_t value) {
+  data_.set_inter_function_community_size_threshold(value);
+  return *this;
+}
+
+PropellerCodeLayoutParametersBuilder& PropellerCodeLayoutParametersBuilder::SetLayoutTimeBudgetMs(uint32_t value) {
+  data_.set_layout_time_budget_ms(value);
+  return *this;
+}
+
+PropellerCodeLayoutParametersBuilder& PropellerCodeLayoutParametersBuilder::SetHotTextPageSize(uint32_t value) {
+  data_.set_hot_text_page_size(value);
+  return *this;
+}
+
+PropellerCodeLayoutParametersBuilder& PropellerCodeLayoutParametersBuilder::SetHotTextPageBudget(uint32_t value) {
+  data_.set_hot_text_page_budget(value);
+  return *this;
+}
+
 }  // namespace devtools_crosstool_autofdo
\ No newline at end of file
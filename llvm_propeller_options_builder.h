@@ -61,6 +61,10 @@ class PropellerOptionsBuilder {
   PropellerOptionsBuilder& SetCodeLayoutParamsSplitFunctions(bool value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
   PropellerOptionsBuilder& SetCodeLayoutParamsReorderHotBlocks(bool value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
   PropellerOptionsBuilder& SetCodeLayoutParamsInterFunctionReordering(bool value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
+  PropellerOptionsBuilder& SetCodeLayoutParamsInterFunctionCommunitySizeThreshold(uint32_t value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
+  PropellerOptionsBuilder& SetCodeLayoutParamsLayoutTimeBudgetMs(uint32_t value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
+  PropellerOptionsBuilder& SetCodeLayoutParamsHotTextPageSize(uint32_t value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
+  PropellerOptionsBuilder& SetCodeLayoutParamsHotTextPageBudget(uint32_t value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
   PropellerOptionsBuilder& SetVerboseClusterOutput(bool value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
   PropellerOptionsBuilder& SetCfgDumpDirName(absl::string_view value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
   PropellerOptionsBuilder& SetHttp(bool value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
@@ -68,6 +72,8 @@ class PropellerOptionsBuilder {
   PropellerOptionsBuilder& SetFilterNonTextFunctions(bool value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
   PropellerOptionsBuilder& SetClusterOutVersion(ClusterEncodingVersion value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
   PropellerOptionsBuilder& AddInputProfiles(const InputProfile& value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
+  PropellerOptionsBuilder& SetBinaryAddressMapperCacheDir(absl::string_view value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
+  PropellerOptionsBuilder& SetLayoutSimulationParams(const LayoutSimulationParameters& value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
 
  private:
   PropellerOptions data_;
@@ -97,6 +103,10 @@ class PropellerCodeLayoutParametersBuilder {
   PropellerCodeLayoutParametersBuilder& SetSplitFunctions(bool value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
   PropellerCodeLayoutParametersBuilder& SetReorderHotBlocks(bool value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
   PropellerCodeLayoutParametersBuilder& SetInterFunctionReordering(bool value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
+  PropellerCodeLayoutParametersBuilder& SetInterFunctionCommunitySizeThreshold(uint32_t value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
+  PropellerCodeLayoutParametersBuilder& SetLayoutTimeBudgetMs(uint32_t value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
+  PropellerCodeLayoutParametersBuilder& SetHotTextPageSize(uint32_t value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
+  PropellerCodeLayoutParametersBuilder& SetHotTextPageBudget(uint32_t value) ABSL_ATTRIBUTE_LIFETIME_BOUND;
 
  private:
   PropellerCodeLayoutParameters data_;
@@ -8,16 +8,19 @@
 
 #include "binary_address_branch.h"
 #include "lbr_aggregation.h"
+#include "live_metrics.h"
 #include "llvm_propeller_binary_content.h"
 #include "llvm_propeller_options.pb.h"
 #include "llvm_propeller_perf_data_provider.h"
 #include "llvm_propeller_statistics.h"
 #include "mini_disassembler.h"
 #include "perfdata_reader.h"
+#include "phase_timer.h"
 #include "base/logging.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/status/status.h"
 #include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
 #include "third_party/abseil/absl/strings/str_format.h"
 #include "llvm/MC/MCInst.h"
 #include "base/status_macros.h"
@@ -49,6 +52,8 @@ absl::StatusOr<LbrAggregation> PerfLbrAggregator::AggregateLbrData(
 
     const std::string description = perf_data->description;
     LOG(INFO) << "Parsing " << description << " ...";
+    PhaseTimer parse_timer(absl::StrCat("parse ", description));
+    const int64_t perf_data_size = perf_data->buffer->getBufferSize();
     absl::StatusOr<PerfDataReader> perf_data_reader = BuildPerfDataReader(
         std::move(*perf_data), &binary_content, match_mmap_name);
     if (!perf_data_reader.ok()) {
@@ -60,6 +65,8 @@ absl::StatusOr<LbrAggregation> PerfLbrAggregator::AggregateLbrData(
     profile_stats.binary_mmap_num += perf_data_reader->binary_mmaps().size();
     ++stats.profile_stats.perf_file_parsed;
     perf_data_reader->AggregateLBR(&lbr_aggregation);
+    IncrementLiveCounter(LiveCounter::kPerfBytesDecoded, perf_data_size);
+    parse_timer.StopAndRecord(stats.phase_stats);
   }
   profile_stats.br_counters_accumulated +=
       lbr_aggregation.GetNumberOfBranchCounters();
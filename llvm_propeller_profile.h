@@ -5,8 +5,10 @@
 #include <vector>
 
 #include "llvm_propeller_function_cluster_info.h"
+#include "llvm_propeller_layout_simulator.h"
 #include "llvm_propeller_program_cfg.h"
 #include "third_party/abseil/absl/container/btree_map.h"
+#include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "llvm/ADT/StringRef.h"
 
 namespace devtools_crosstool_autofdo {
@@ -16,6 +18,10 @@ struct PropellerProfile {
   // Layout of functions in each section.
   absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
       functions_cluster_info_by_section_name;
+  // Simulated misses of every function with misses in either layout, keyed by
+  // function index. Only populated when layout simulation is requested.
+  absl::flat_hash_map<int, FunctionSimulatedMisses>
+      simulated_misses_by_function_index;
 };
 }  // namespace devtools_crosstool_autofdo
 
@@ -16,6 +16,7 @@
 #include "llvm_propeller_code_layout.h"
 #include "llvm_propeller_file_perf_data_provider.h"
 #include "llvm_propeller_function_cluster_info.h"
+#include "llvm_propeller_layout_simulator.h"
 #include "llvm_propeller_options.pb.h"
 #include "llvm_propeller_perf_data_provider.h"
 #include "llvm_propeller_perf_lbr_aggregator.h"
@@ -23,12 +24,15 @@
 #include "llvm_propeller_program_cfg.h"
 #include "llvm_propeller_program_cfg_builder.h"
 #include "llvm_propeller_statistics.h"
+#include "phase_timer.h"
 #include "status_provider.h"
 #include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/container/btree_map.h"
+#include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/container/flat_hash_set.h"
 #include "third_party/abseil/absl/status/status.h"
 #include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
 #include "third_party/abseil/absl/strings/str_format.h"
 #include "third_party/abseil/absl/strings/string_view.h"
 #include "llvm/ADT/StringRef.h"
@@ -59,24 +63,100 @@ std::vector<std::string> ExtractProfileNames(const PropellerOptions &options) {
 
   return profile_names;
 }
+
+// Returns the job of `status_provider`, or `default_job` if there is no status
+// provider.
+std::string GetJob(const DefaultStatusProvider *status_provider,
+                   absl::string_view default_job) {
+  return status_provider != nullptr ? status_provider->GetJob()
+                                    : std::string(default_job);
+}
+
+// Replays a trace generated from the profile of `program_cfg` against the
+// original layout and the layout given by `cluster_info_by_section_name`.
+// Both layouts see the same trace, which is generated one basic block at a
+// time. Records the totals in `stats` and returns the simulated misses of each
+// function.
+absl::StatusOr<absl::flat_hash_map<int, FunctionSimulatedMisses>>
+SimulateLayouts(
+    const ProgramCfg &program_cfg,
+    const absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
+        &cluster_info_by_section_name,
+    const LayoutSimulationParameters &params,
+    PropellerStats::LayoutSimulationStats &stats) {
+  ASSIGN_OR_RETURN(LayoutSimulator original_simulator,
+                   LayoutSimulator::Create(params));
+  ASSIGN_OR_RETURN(LayoutSimulator optimized_simulator,
+                   LayoutSimulator::Create(params));
+  const absl::flat_hash_map<const CFGNode *, uint64_t> optimized_addresses =
+      GetLayoutNodeAddresses(program_cfg, cluster_info_by_section_name);
+  ReplayTraceGenerator trace_generator(program_cfg, params.seed());
+  for (uint64_t i = 0; i < params.trace_length() && !trace_generator.empty();
+       ++i) {
+    const CFGNode *node = trace_generator.Next();
+    original_simulator.Access(*node, node->addr());
+    // Functions which are not laid out keep their original addresses.
+    auto it = optimized_addresses.find(node);
+    optimized_simulator.Access(
+        *node, it == optimized_addresses.end() ? node->addr() : it->second);
+  }
+  const LayoutSimulationResult &original = original_simulator.result();
+  const LayoutSimulationResult &optimized = optimized_simulator.result();
+
+  stats.n_icache_accesses += original.n_icache_accesses;
+  stats.n_itlb_accesses += original.n_itlb_accesses;
+  stats.original_icache_misses += original.total_misses.icache_misses;
+  stats.original_itlb_misses += original.total_misses.itlb_misses;
+  stats.optimized_icache_misses += optimized.total_misses.icache_misses;
+  stats.optimized_itlb_misses += optimized.total_misses.itlb_misses;
+
+  absl::flat_hash_map<int, FunctionSimulatedMisses> misses_by_function_index;
+  for (const auto &[function_index, misses] :
+       original.misses_by_function_index)
+    misses_by_function_index[function_index].original = misses;
+  for (const auto &[function_index, misses] :
+       optimized.misses_by_function_index)
+    misses_by_function_index[function_index].optimized = misses;
+  return misses_by_function_index;
+}
 }  // namespace
 
 absl::StatusOr<PropellerProfile> PropellerProfileComputer::ComputeProfile(
     DefaultStatusProvider *map_profile_status,
     DefaultStatusProvider *code_layout_status) {
+  // `GetProgramCfg` records the phases of profile mapping.
   ASSIGN_OR_RETURN(std::unique_ptr<ProgramCfg> program_cfg,
                    GetProgramCfg(map_profile_status));
   if (map_profile_status) map_profile_status->SetDone();
 
+  const std::string code_layout_job =
+      GetJob(code_layout_status, kCodeLayoutJob);
+  PhaseTimer code_layout_timer(code_layout_job);
   absl::btree_map<llvm::StringRef, std::vector<FunctionClusterInfo>>
       cluster_info_by_section_name =
           GenerateLayoutBySection(*program_cfg, options_.code_layout_params(),
                                   stats_.code_layout_stats);
+  code_layout_timer.StopAndRecord(stats_.phase_stats);
+
+  absl::flat_hash_map<int, FunctionSimulatedMisses>
+      simulated_misses_by_function_index;
+  if (options_.has_layout_simulation_params()) {
+    PhaseTimer simulation_timer(
+        absl::StrCat(code_layout_job, ": simulate layouts"));
+    ASSIGN_OR_RETURN(
+        simulated_misses_by_function_index,
+        SimulateLayouts(*program_cfg, cluster_info_by_section_name,
+                        options_.layout_simulation_params(),
+                        stats_.layout_simulation_stats));
+    simulation_timer.StopAndRecord(stats_.phase_stats);
+  }
 
   if (code_layout_status) code_layout_status->SetDone();
   return PropellerProfile({.program_cfg = std::move(program_cfg),
                            .functions_cluster_info_by_section_name =
-                               std::move(cluster_info_by_section_name)});
+                               std::move(cluster_info_by_section_name),
+                           .simulated_misses_by_function_index = std::move(
+                               simulated_misses_by_function_index)});
 }
 
 absl::StatusOr<std::unique_ptr<PropellerProfileComputer>>
@@ -126,19 +206,27 @@ PropellerProfileComputer::Create(
 absl::StatusOr<std::unique_ptr<ProgramCfg>>
 PropellerProfileComputer::GetProgramCfg(
     DefaultStatusProvider *status_provider) {
+  const std::string job = GetJob(status_provider, kProfileMappingJob);
+  PhaseTimer read_profiles_timer(absl::StrCat(job, ": read profiles"));
   ASSIGN_OR_RETURN(absl::flat_hash_set<uint64_t> unique_addresses,
                    branch_aggregator_->GetBranchEndpointAddresses());
+  read_profiles_timer.StopAndRecord(stats_.phase_stats);
 
   if (status_provider) status_provider->SetProgress(50);
 
+  PhaseTimer address_mapping_timer(
+      absl::StrCat(job, ": decode bb-address-map"));
   ASSIGN_OR_RETURN(std::unique_ptr<BinaryAddressMapper> binary_address_mapper,
                    BuildBinaryAddressMapper(options_, *binary_content_, stats_,
                                             &unique_addresses));
+  address_mapping_timer.StopAndRecord(stats_.phase_stats);
 
   if (status_provider) status_provider->SetProgress(60);
+  PhaseTimer aggregation_timer(absl::StrCat(job, ": aggregate branches"));
   ASSIGN_OR_RETURN(
       BranchAggregation branch_aggregation,
       branch_aggregator_->Aggregate(*binary_address_mapper, stats_));
+  aggregation_timer.StopAndRecord(stats_.phase_stats);
 
   std::unique_ptr<devtools_crosstool_autofdo::Addr2Cu> addr2cu;
   if (options_.output_module_name()) {
@@ -152,11 +240,14 @@ PropellerProfileComputer::GetProgramCfg(
           options_.binary_name().c_str(), options_.binary_name().c_str()));
     }
   }
+  PhaseTimer cfg_building_timer(
+      absl::StrCat(job, ": build control flow graphs"));
   absl::StatusOr<std::unique_ptr<ProgramCfg>> program_cfg =
       ProgramCfgBuilder(binary_address_mapper.get(), stats_)
           .Build(branch_aggregation, std::move(binary_content_->file_content),
                  addr2cu.get());
   if (!program_cfg.ok()) return program_cfg.status();
+  cfg_building_timer.StopAndRecord(stats_.phase_stats);
 
   if (status_provider) status_provider->SetDone();
   return program_cfg;
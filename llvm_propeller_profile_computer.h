@@ -13,9 +13,17 @@
 #include "llvm_propeller_statistics.h"
 #include "status_provider.h"
 #include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/strings/string_view.h"
 
 namespace devtools_crosstool_autofdo {
 
+// Job names of the status providers of profile mapping and code layout. The
+// phases recorded in `PropellerStats::phase_stats` are named after the same
+// jobs, so that they match the status output.
+inline constexpr absl::string_view kProfileMappingJob =
+    "map profiles to control flow graphs";
+inline constexpr absl::string_view kCodeLayoutJob = "codelayout";
+
 // Computes the `PropellerProfile` by reading the binary and profile.
 // Example:
 //    absl::StatusOr<std::unique_ptr<PropellerProfileComputer>>
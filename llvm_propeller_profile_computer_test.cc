@@ -276,7 +276,7 @@ TEST(LlvmPropellerProfileComputerTest, TestMultiplePerfDataFiles) {
   EXPECT_EQ(union12, edge_set12);
 
   auto accumulator = [](uint64_t acc,
-                        const std::unique_ptr<CFGEdge> &e) -> uint64_t {
+                        const CFGEdge *e) -> uint64_t {
     return acc + e->weight();
   };
   uint64_t weight1 = absl::c_accumulate(cfg1.intra_edges(), 0, accumulator);
@@ -19,7 +19,9 @@
 #include "llvm_propeller_profile.h"
 #include "llvm_propeller_profile_computer.h"
 #include "llvm_propeller_profile_writer.h"
+#include "llvm_propeller_statistics.h"
 #include "llvm_propeller_telemetry_reporter.h"
+#include "phase_timer.h"
 #include "status_consumer_registry.h"
 #include "status_provider.h"
 #include "third_party/abseil/absl/algorithm/container.h"
@@ -77,10 +79,10 @@ namespace devtools_crosstool_autofdo
     {
       auto read_binary_status = std::make_unique<DefaultStatusProvider>(
           "read binary and the bb-address-map section");
-      auto map_profile_status = std::make_unique<DefaultStatusProvider>(
-          "map profiles to control flow graphs");
+      auto map_profile_status =
+          std::make_unique<DefaultStatusProvider>(kProfileMappingJob);
       auto code_layout_status =
-          std::make_unique<DefaultStatusProvider>("codelayout");
+          std::make_unique<DefaultStatusProvider>(kCodeLayoutJob);
       auto write_file_status =
           std::make_unique<DefaultStatusProvider>("result_writer");
 
@@ -162,9 +164,12 @@ namespace devtools_crosstool_autofdo
 
       StatusProviders statuses = AddStatusProviders(main_status);
 
+      PropellerStats::PhaseStats phase_stats;
+      PhaseTimer binary_reading_timer(statuses.binary_reading->GetJob());
       ASSIGN_OR_RETURN(std::unique_ptr<BinaryContent> binary_content,
                        GetBinaryContent(opts.binary_name()));
       statuses.binary_reading->SetDone();
+      binary_reading_timer.StopAndRecord(phase_stats);
 
       ASSIGN_OR_RETURN(std::unique_ptr<BranchAggregator> aggregator,
                        create_aggregator(opts, *binary_content));
@@ -176,11 +181,19 @@ namespace devtools_crosstool_autofdo
                        profile_computer->ComputeProfile(statuses.profile_mapping,
                                                         statuses.code_layout));
 
+      PhaseTimer file_writing_timer(statuses.file_writing->GetJob());
       PropellerProfileWriter(opts).Write(profile);
       statuses.file_writing->SetDone();
-      LOG(INFO) << profile_computer->stats().DebugString();
+
+      // Report the phases of the profile computer between binary reading and
+      // file writing.
+      PropellerStats stats = profile_computer->stats();
+      phase_stats += stats.phase_stats;
+      file_writing_timer.StopAndRecord(phase_stats);
+      stats.phase_stats = std::move(phase_stats);
+      LOG(INFO) << stats.DebugString();
       InvokePropellerTelemetryReporters(profile_computer->binary_content(),
-                                        profile_computer->stats());
+                                        stats);
       return absl::OkStatus();
     }
   } // namespace
@@ -9,6 +9,7 @@
 
 #if defined(HAVE_LLVM)
 
+#include <cstdint>
 #include <fstream>
 #include <memory>
 #include <optional>
@@ -94,7 +95,7 @@ void DumpCfgs(const PropellerProfile &profile,
 // may not precisely add up to the node frequency.
 void DumpCfgProfile(const ControlFlowGraph &cfg, std::ofstream &out) {
   cfg.ForEachNodeRef([&](const CFGNode &node) {
-    int node_frequency = node.CalculateFrequency();
+    int64_t node_frequency = node.CalculateFrequency();
     out << "#cfg-prof " << node.bb_id() << ":" << node_frequency;
     node.ForEachOutEdgeRef([&](const CFGEdge &edge) {
       if (!edge.IsBranchOrFallthrough()) return;
@@ -130,6 +131,8 @@ void PropellerProfileWriter::Write(const PropellerProfile &profile) const {
     // function.
     std::vector<const FunctionClusterInfo *> cold_symbol_order(
         section_function_cluster_info.size());
+    // Total size of the hot clusters in this section.
+    int64_t hot_text_size = 0;
     for (const FunctionClusterInfo &func_layout_info :
          section_function_cluster_info) {
       const ControlFlowGraph *cfg =
@@ -181,6 +184,18 @@ void PropellerProfileWriter::Write(const PropellerProfile &profile) const {
         // Print out the frequency of the function entry node.
         cc_profile_os << absl::StreamFormat(
             "#entry-freq %llu\n", cfg->GetEntryNode()->CalculateFrequency());
+        // Print the simulated i-cache and iTLB misses of this function under
+        // the original and optimized layouts, if simulated.
+        if (auto it = profile.simulated_misses_by_function_index.find(
+                func_layout_info.function_index);
+            it != profile.simulated_misses_by_function_index.end()) {
+          cc_profile_os << absl::StreamFormat(
+              "#simulated-misses [icache: %d -> %d] [itlb: %d -> %d]\n",
+              it->second.original.icache_misses,
+              it->second.optimized.icache_misses,
+              it->second.original.itlb_misses,
+              it->second.optimized.itlb_misses);
+        }
       }
       auto &clusters = func_layout_info.clusters;
       for (unsigned cluster_id = 0; cluster_id < clusters.size();
@@ -198,6 +213,7 @@ void PropellerProfileWriter::Write(const PropellerProfile &profile) const {
                     : cluster_id);
         for (int bbi = 0; bbi < cluster.full_bb_ids.size(); ++bbi) {
           const auto &full_bb_id = cluster.full_bb_ids[bbi];
+          hot_text_size += cfg->GetNodeById(full_bb_id.intra_cfg_id).size();
           cc_profile_os << (bbi ? " " : profile_encoding_.cluster_specifier)
                         << full_bb_id.bb_id;
           if (full_bb_id.intra_cfg_id.clone_number != 0)
@@ -214,6 +230,16 @@ void PropellerProfileWriter::Write(const PropellerProfile &profile) const {
           &func_layout_info;
     }
 
+    // Report the hot text footprint of this section when page-aware packing
+    // is enabled. The linker ignores lines starting with '#'.
+    if (const uint32_t page_size =
+            options_.code_layout_params().hot_text_page_size();
+        page_size != 0) {
+      ld_profile_os << absl::StreamFormat(
+          "#hot-text %s size: %d pages: %d page-size: %d\n", section_name.str(),
+          hot_text_size, (hot_text_size + page_size - 1) / page_size,
+          page_size);
+    }
     for (const auto &[func_names, cluster_id] : symbol_order) {
       // Print the symbol names corresponding to every function name alias. This
       // guarantees we get the right order regardless of which function name is
@@ -1,5 +1,6 @@
 #include "llvm_propeller_program_cfg_builder.h"
 
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <tuple>
@@ -8,11 +9,16 @@
 
 #include "addr2cu.h"
 #include "bb_handle.h"
+#include "binary_address_branch.h"
 #include "branch_aggregation.h"
+#include "live_metrics.h"
 #include "llvm_propeller_binary_address_mapper.h"
 #include "llvm_propeller_cfg.h"
 #include "llvm_propeller_formatting.h"
 #include "llvm_propeller_program_cfg.h"
+#include "llvm_propeller_statistics.h"
+#include "parallel_for.h"
+#include "trace_event_recorder.h"
 #include "base/logging.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/status/status.h"
@@ -46,17 +52,16 @@ std::vector<std::unique_ptr<CFGNode>> CreateCfgNodes(
 absl::StatusOr<std::unique_ptr<ProgramCfg>> ProgramCfgBuilder::Build(
     const BranchAggregation &branch_aggregation,
     std::unique_ptr<llvm::MemoryBuffer> file_content, Addr2Cu *addr2cu) && {
-  // Temporary map from Id -> CFGNode.
-  absl::flat_hash_map<CFGNode::InterCfgId, CFGNode *> node_map;
-  // Insert node mappings for initial CFGs.
-  for (auto &[cfg_index, cfg] : cfgs_) {
-    for (const std::unique_ptr<CFGNode> &node : cfg->nodes()) {
-      node_map.insert({node->inter_cfg_id(), node.get()});
-    }
-  }
+  // Functions which need a new CFG and their module names. Module names are
+  // looked up serially since `addr2cu` is not thread-safe.
+  std::vector<int> new_function_indices;
+  std::vector<std::optional<llvm::StringRef>> module_names;
   for (int func_index : binary_address_mapper_->selected_functions()) {
     const llvm::object::BBAddrMap &func_bb_addr_map =
         binary_address_mapper_->bb_addr_map()[func_index];
+    CHECK(!func_bb_addr_map.getBBEntries().empty());
+    // Skip functions which already have a CFG created for them.
+    if (cfgs_.contains(func_index)) continue;
 
     std::optional<llvm::StringRef> module_name = std::nullopt;
     if (addr2cu) {
@@ -65,27 +70,35 @@ absl::StatusOr<std::unique_ptr<ProgramCfg>> ProgramCfgBuilder::Build(
               func_bb_addr_map.getFunctionAddress());
       if (res.ok()) module_name = llvm::StringRef(res->data(), res->size());
     }
+    new_function_indices.push_back(func_index);
+    module_names.push_back(module_name);
+  }
 
-    CHECK(!func_bb_addr_map.getBBEntries().empty());
-    // Skip functions which already have a CFG created for them.
-    if (cfgs_.contains(func_index)) continue;
-
-    const BinaryAddressMapper::FunctionSymbolInfo symbol_info =
-        binary_address_mapper_->symbol_info_map().at(func_index);
-
-    auto cfg = std::make_unique<ControlFlowGraph>(
-        symbol_info.section_name, func_index, module_name, symbol_info.aliases,
-        CreateCfgNodes(func_index, func_bb_addr_map));
-    // Setup mapping from Ids to nodes.
-    for (const std::unique_ptr<CFGNode> &node : cfg->nodes())
-      node_map.insert({node->inter_cfg_id(), node.get()});
-    CHECK_EQ(cfg->nodes().size(), func_bb_addr_map.getBBEntries().size());
-    stats_->cfg_stats.nodes_created += cfg->nodes().size();
-    cfgs_.insert({func_index, std::move(cfg)});
+  std::vector<std::unique_ptr<ControlFlowGraph>> new_cfgs(
+      new_function_indices.size());
+  ParallelFor(new_function_indices.size(), GetDefaultNumThreads(),
+              [&](int64_t i) {
+                int func_index = new_function_indices[i];
+                const BinaryAddressMapper::FunctionSymbolInfo &symbol_info =
+                    binary_address_mapper_->symbol_info_map().at(func_index);
+                new_cfgs[i] = std::make_unique<ControlFlowGraph>(
+                    symbol_info.section_name, func_index, module_names[i],
+                    symbol_info.aliases,
+                    CreateCfgNodes(
+                        func_index,
+                        binary_address_mapper_->bb_addr_map()[func_index]));
+              });
+  for (int i = 0; i != new_function_indices.size(); ++i) {
+    CHECK_EQ(new_cfgs[i]->nodes().size(),
+             binary_address_mapper_->bb_addr_map()[new_function_indices[i]]
+                 .getBBEntries()
+                 .size());
+    stats_->cfg_stats.nodes_created += new_cfgs[i]->nodes().size();
+    cfgs_.insert({new_function_indices[i], std::move(new_cfgs[i])});
     ++stats_->cfg_stats.cfgs_created;
   }
-  if (absl::Status status = CreateEdges(branch_aggregation, node_map);
-      !status.ok()) {
+  IncrementLiveCounter(LiveCounter::kCfgsBuilt, new_function_indices.size());
+  if (absl::Status status = CreateEdges(branch_aggregation); !status.ok()) {
     return absl::InternalError(absl::StrCat(
         "Unable to create edges from branch profile: ", status.message()));
   }
@@ -105,36 +118,26 @@ absl::StatusOr<std::unique_ptr<ProgramCfg>> ProgramCfgBuilder::Build(
   return std::make_unique<ProgramCfg>(std::move(cfgs), std::move(file_content));
 }
 
+CFGNode *ProgramCfgBuilder::FindNode(int bb_handle_index) const {
+  BbHandle bb_handle = binary_address_mapper_->bb_handles().at(bb_handle_index);
+  auto it = cfgs_.find(bb_handle.function_index);
+  if (it == cfgs_.end() || bb_handle.bb_index >= it->second->nodes().size())
+    return nullptr;
+  return &it->second->GetNodeById({.bb_index = bb_handle.bb_index,
+                                   .clone_number = 0});
+}
+
 // Create edges for fallthroughs.
-// 1. translate fallthrough pairs "<from, to>"s -> "<from_sym, to_sym>"s.
-// 2. calculate all symbols between "from_sym" and "to_sym", so we get the
-//    symbol path: <from_sym, internal_sym1, internal_sym2, ... , internal_symn,
-//    to_sym>.
-// 3. create edges and apply weights for the above path.
+// 1. for every fallthrough block pair "<from_bb, to_bb>", calculate all blocks
+//    between "from_bb" and "to_bb", so we get the block path: <from_bb,
+//    internal_bb1, internal_bb2, ... , internal_bbn, to_bb>.
+// 2. create edges and apply weights for the above path.
 void ProgramCfgBuilder::CreateFallthroughs(
-    const BranchAggregation &branch_aggregation,
-    const absl::flat_hash_map<CFGNode::InterCfgId, CFGNode *> &tmp_node_map,
-    absl::flat_hash_map<std::pair<int, int>, int> *tmp_bb_fallthrough_counters,
-    absl::flat_hash_map<std::pair<CFGNode::InterCfgId, CFGNode::InterCfgId>,
-                        CFGEdge *> *tmp_edge_map) {
-  for (auto [fallthrough, cnt] : branch_aggregation.fallthrough_counters) {
-    // A fallthrough from A to B implies a branch to A followed by a branch
-    // from B. Therefore we respectively use BranchDirection::kTo and
-    // BranchDirection::kFrom for A and B when calling
-    // `FindBbHandleIndexUsingBinaryAddress` to find their associated blocks.
-    std::optional<int> from_index =
-        binary_address_mapper_->FindBbHandleIndexUsingBinaryAddress(
-            fallthrough.from, BranchDirection::kTo);
-    std::optional<int> to_index =
-        binary_address_mapper_->FindBbHandleIndexUsingBinaryAddress(
-            fallthrough.to, BranchDirection::kFrom);
-    if (from_index && to_index)
-      (*tmp_bb_fallthrough_counters)[{*from_index, *to_index}] += cnt;
-  }
-
-  for (auto &i : *tmp_bb_fallthrough_counters) {
-    int fallthrough_from = i.first.first, fallthrough_to = i.first.second;
-    int weight = i.second;
+    const absl::flat_hash_map<std::pair<int, int>, int64_t>
+        &bb_fallthrough_counters,
+    EdgeMap *tmp_edge_map, PropellerStats::CfgStats &cfg_stats) {
+  for (const auto &[fallthrough, weight] : bb_fallthrough_counters) {
+    auto [fallthrough_from, fallthrough_to] = fallthrough;
     if (fallthrough_from == fallthrough_to ||
         !binary_address_mapper_->CanFallThrough(fallthrough_from,
                                                 fallthrough_to))
@@ -142,17 +145,16 @@ void ProgramCfgBuilder::CreateFallthroughs(
     for (int sym = fallthrough_from; sym <= fallthrough_to - 1; ++sym) {
       auto *fallthrough_edge = InternalCreateEdge(
           sym, sym + 1, weight, CFGEdge::Kind::kBranchOrFallthough,
-          tmp_node_map, tmp_edge_map);
+          tmp_edge_map, cfg_stats);
       if (!fallthrough_edge) break;
     }
   }
 }
 
 CFGEdge *ProgramCfgBuilder::InternalCreateEdge(
-    int from_bb_index, int to_bb_index, int weight, CFGEdge::Kind edge_kind,
-    const absl::flat_hash_map<CFGNode::InterCfgId, CFGNode *> &tmp_node_map,
-    absl::flat_hash_map<std::pair<CFGNode::InterCfgId, CFGNode::InterCfgId>,
-                        CFGEdge *> *tmp_edge_map) {
+    int from_bb_index, int to_bb_index, int64_t weight,
+    CFGEdge::Kind edge_kind, EdgeMap *tmp_edge_map,
+    PropellerStats::CfgStats &cfg_stats) {
   BbHandle from_bb = binary_address_mapper_->bb_handles().at(from_bb_index);
   BbHandle to_bb = binary_address_mapper_->bb_handles().at(to_bb_index);
   // Compute the IDs of the corresponding basic blocks.
@@ -168,58 +170,97 @@ CFGEdge *ProgramCfgBuilder::InternalCreateEdge(
                    << CFGEdgeNameFormatter(edge) << " has type "
                    << CFGEdge::GetCfgEdgeKindString(edge_kind) << " and "
                    << CFGEdge::GetCfgEdgeKindString(edge->kind());
-      ++stats_->cfg_stats.edges_with_same_src_sink_but_different_type;
+      ++cfg_stats.edges_with_same_src_sink_but_different_type;
     }
     edge->IncrementWeight(weight);
   } else {
-    auto from_ni = tmp_node_map.find(from_bb_id),
-         to_ni = tmp_node_map.find(to_bb_id);
-    if (from_ni == tmp_node_map.end() || to_ni == tmp_node_map.end())
-      return nullptr;
-    CFGNode *from_node = from_ni->second;
-    CFGNode *to_node = to_ni->second;
-    DCHECK(from_node && to_node);
+    CFGNode *from_node = FindNode(from_bb_index);
+    CFGNode *to_node = FindNode(to_bb_index);
+    if (from_node == nullptr || to_node == nullptr) return nullptr;
     ControlFlowGraph &from_cfg = *cfgs_.at(from_bb.function_index);
     ControlFlowGraph &to_cfg = *cfgs_.at(to_bb.function_index);
-    edge = cfgs_.at(from_bb.function_index)
-               ->CreateEdge(from_node, to_node, weight, edge_kind,
-                            (from_cfg.section_name() != to_cfg.section_name()));
-    ++stats_->cfg_stats.edges_created_by_kind[edge_kind];
+    edge = from_cfg.CreateEdge(
+        from_node, to_node, weight, edge_kind,
+        (from_cfg.section_name() != to_cfg.section_name()));
+    ++cfg_stats.edges_created_by_kind[edge_kind];
     tmp_edge_map->emplace(std::piecewise_construct,
                           std::forward_as_tuple(from_bb_id, to_bb_id),
                           std::forward_as_tuple(edge));
   }
-  stats_->cfg_stats.total_edge_weight_by_kind[edge_kind] += weight;
+  cfg_stats.total_edge_weight_by_kind[edge_kind] += weight;
   return edge;
 }
 
-// Create control flow graph edges from branch_counters_. For each address pair
-// <from_addr, to_addr> in "branch_counters_", we translate it to <from_symbol,
-// to_symbol> and by using tmp_node_map, we further translate it to <from_node,
-// to_node>, and finally create a CFGEdge for such CFGNode pair.
-absl::Status ProgramCfgBuilder::CreateEdges(
-    const BranchAggregation &branch_aggregation,
-    const absl::flat_hash_map<CFGNode::InterCfgId, CFGNode *> &tmp_node_map) {
+namespace {
+// A branch whose endpoints are resolved to basic blocks, specified by their
+// BbHandle indices.
+struct ResolvedBranch {
+  int from_bb_index;
+  int to_bb_index;
+  int64_t weight;
+  CFGEdge::Kind kind;
+};
+
+// The profile of a single function: its intra-function branches and its
+// fallthrough block pairs, together with the state for creating their edges.
+struct FunctionEdgeBucket {
+  std::vector<ResolvedBranch> branches;
+  absl::flat_hash_map<std::pair<int, int>, int64_t> bb_fallthrough_counters;
   // Temp map that records which CFGEdges are created, so we do not re-create
-  // edges. Note this is necessary: although
-  // "branch_counters_" have no duplicated <from_addr, to_addr> pairs, the
-  // translated <from_bb, to_bb> may have duplicates.
+  // edges. Note this is necessary: although "branch_counters" have no
+  // duplicated <from_addr, to_addr> pairs, the translated <from_bb, to_bb> may
+  // have duplicates.
   absl::flat_hash_map<std::pair<CFGNode::InterCfgId, CFGNode::InterCfgId>,
                       CFGEdge *>
-      tmp_edge_map;
+      edge_map;
+  // Stats for the edges created from `branches` only.
+  int64_t branch_edges_created = 0;
+  int64_t branch_edge_weight_created = 0;
+  PropellerStats::CfgStats cfg_stats;
+};
+}  // namespace
 
-  absl::flat_hash_map<std::pair<int, int>, int> tmp_bb_fallthrough_counters;
+// Create control flow graph edges from branch_counters_. For each address pair
+// <from_addr, to_addr> in "branch_counters_", we translate it to <from_symbol,
+// to_symbol> and partition the resulting pairs by function. Edges within each
+// function (and its fallthrough edges) are then created in parallel, and edges
+// between functions in a final serial pass.
+absl::Status ProgramCfgBuilder::CreateEdges(
+    const BranchAggregation &branch_aggregation) {
+  // Buckets of intra-function branches and fallthroughs, and the map from
+  // function index to the index of its bucket.
+  std::vector<FunctionEdgeBucket> buckets;
+  absl::flat_hash_map<int, int> bucket_index_by_function;
+  auto get_bucket = [&](int function_index) -> FunctionEdgeBucket & {
+    auto [it, inserted] =
+        bucket_index_by_function.try_emplace(function_index, buckets.size());
+    if (inserted) buckets.emplace_back();
+    return buckets[it->second];
+  };
+  // Inter-function branches (calls and returns).
+  std::vector<ResolvedBranch> inter_function_branches;
 
-  int weight_on_dubious_edges = 0;
+  int64_t weight_on_dubious_edges = 0;
   int edges_recorded = 0;
-  for (auto [branch, weight] : branch_aggregation.branch_counters) {
+  // Resolve the endpoints of all branches with one batched lookup.
+  std::vector<std::pair<BinaryAddressBranch, int64_t>> branches(
+      branch_aggregation.branch_counters.begin(),
+      branch_aggregation.branch_counters.end());
+  std::vector<BinaryAddressMapper::AddressQuery> queries;
+  queries.reserve(2 * branches.size());
+  for (const auto &[branch, weight] : branches) {
+    queries.push_back(
+        {.address = branch.from, .direction = BranchDirection::kFrom});
+    queries.push_back({.address = branch.to, .direction = BranchDirection::kTo});
+  }
+  std::vector<std::optional<int>> bb_indices =
+      binary_address_mapper_->FindBbHandleIndicesUsingBinaryAddresses(queries);
+  BatchedLiveCounter branches_mapped(LiveCounter::kBranchesMapped);
+  for (int i = 0; i != branches.size(); ++i) {
+    const auto &[branch, weight] = branches[i];
     ++edges_recorded;
-    std::optional<int> from_bb_index =
-        binary_address_mapper_->FindBbHandleIndexUsingBinaryAddress(
-            branch.from, BranchDirection::kFrom);
-    std::optional<int> to_bb_index =
-        binary_address_mapper_->FindBbHandleIndexUsingBinaryAddress(
-            branch.to, BranchDirection::kTo);
+    std::optional<int> from_bb_index = bb_indices[2 * i];
+    std::optional<int> to_bb_index = bb_indices[2 * i + 1];
     if (!to_bb_index.has_value()) continue;
 
     BbHandle to_bb_handle = binary_address_mapper_->bb_handles()[*to_bb_index];
@@ -243,7 +284,9 @@ absl::Status ProgramCfgBuilder::CreateEdges(
         branch.to == binary_address_mapper_->GetAddress(to_bb_handle)) {
       if (to_bb_handle.bb_index != 0) {
         // Account for the fall-through between callSiteSym and toSym.
-        tmp_bb_fallthrough_counters[{*to_bb_index - 1, *to_bb_index}] += weight;
+        get_bucket(to_bb_handle.function_index)
+            .bb_fallthrough_counters[{*to_bb_index - 1, *to_bb_index}] +=
+            weight;
         // Reassign to_bb to be the actual callsite symbol entry.
         --*to_bb_index;
         to_bb_handle = binary_address_mapper_->bb_handles()[*to_bb_index];
@@ -269,30 +312,101 @@ absl::Status ProgramCfgBuilder::CreateEdges(
                binary_address_mapper_->GetBBEntry(from_bb_handle).hasReturn()) {
       edge_kind = CFGEdge::Kind::kRet;
     }
-    InternalCreateEdge(from_bb_index.value(), to_bb_index.value(), weight,
-                       edge_kind, tmp_node_map, &tmp_edge_map);
+    ResolvedBranch resolved_branch = {.from_bb_index = *from_bb_index,
+                                      .to_bb_index = *to_bb_index,
+                                      .weight = weight,
+                                      .kind = edge_kind};
+    branches_mapped.Increment();
+    if (from_bb_handle.function_index == to_bb_handle.function_index) {
+      get_bucket(from_bb_handle.function_index)
+          .branches.push_back(resolved_branch);
+    } else {
+      inter_function_branches.push_back(resolved_branch);
+    }
   }
+  branches_mapped.Flush();
 
-  if (weight_on_dubious_edges /
-          static_cast<double>(stats_->cfg_stats.total_edge_weight_created()) >
+  // A fallthrough from A to B implies a branch to A followed by a branch
+  // from B. Therefore we respectively use BranchDirection::kTo and
+  // BranchDirection::kFrom for A and B when calling
+  // `FindBbHandleIndicesUsingBinaryAddresses` to find their associated blocks.
+  std::vector<std::pair<BinaryAddressFallthrough, int64_t>> fallthroughs(
+      branch_aggregation.fallthrough_counters.begin(),
+      branch_aggregation.fallthrough_counters.end());
+  queries.clear();
+  queries.reserve(2 * fallthroughs.size());
+  for (const auto &[fallthrough, cnt] : fallthroughs) {
+    queries.push_back(
+        {.address = fallthrough.from, .direction = BranchDirection::kTo});
+    queries.push_back(
+        {.address = fallthrough.to, .direction = BranchDirection::kFrom});
+  }
+  bb_indices =
+      binary_address_mapper_->FindBbHandleIndicesUsingBinaryAddresses(queries);
+  for (int i = 0; i != fallthroughs.size(); ++i) {
+    std::optional<int> from_index = bb_indices[2 * i];
+    std::optional<int> to_index = bb_indices[2 * i + 1];
+    if (!from_index || !to_index) continue;
+    // Fallthroughs across functions are rejected by `CanFallThrough`, so
+    // bucketing by the source function is sufficient.
+    get_bucket(binary_address_mapper_->bb_handles()[*from_index].function_index)
+        .bb_fallthrough_counters[{*from_index, *to_index}] +=
+        fallthroughs[i].second;
+  }
+
+  // Intra-function edges only mutate the CFG of their own function, so each
+  // bucket can be processed independently.
+  ParallelFor(buckets.size(), GetDefaultNumThreads(), [&](int64_t i) {
+    ScopedTraceEvent trace_event("propeller", "create intra-function edges");
+    FunctionEdgeBucket &bucket = buckets[i];
+    for (const ResolvedBranch &branch : bucket.branches) {
+      InternalCreateEdge(branch.from_bb_index, branch.to_bb_index,
+                         branch.weight, branch.kind, &bucket.edge_map,
+                         bucket.cfg_stats);
+    }
+    bucket.branch_edges_created = bucket.cfg_stats.total_edges_created();
+    bucket.branch_edge_weight_created =
+        bucket.cfg_stats.total_edge_weight_created();
+    CreateFallthroughs(bucket.bb_fallthrough_counters, &bucket.edge_map,
+                       bucket.cfg_stats);
+  });
+
+  // Inter-function edges mutate the CFGs of both endpoints, so they are
+  // created serially.
+  PropellerStats::CfgStats inter_function_stats;
+  EdgeMap inter_function_edge_map;
+  for (const ResolvedBranch &branch : inter_function_branches) {
+    InternalCreateEdge(branch.from_bb_index, branch.to_bb_index, branch.weight,
+                       branch.kind, &inter_function_edge_map,
+                       inter_function_stats);
+  }
+
+  int64_t branch_edges_created =
+      stats_->cfg_stats.total_edges_created() +
+      inter_function_stats.total_edges_created();
+  int64_t branch_edge_weight_created =
+      stats_->cfg_stats.total_edge_weight_created() +
+      inter_function_stats.total_edge_weight_created();
+  stats_->cfg_stats += inter_function_stats;
+  for (const FunctionEdgeBucket &bucket : buckets) {
+    branch_edges_created += bucket.branch_edges_created;
+    branch_edge_weight_created += bucket.branch_edge_weight_created;
+    stats_->cfg_stats += bucket.cfg_stats;
+  }
+
+  if (weight_on_dubious_edges / static_cast<double>(branch_edge_weight_created) >
       0.3) {
     return absl::InternalError(
         absl::StrFormat("Too many jumps into middle of basic blocks detected, "
                         "probably because of source drift (%d out of %d).",
-                        weight_on_dubious_edges,
-                        stats_->cfg_stats.total_edge_weight_created()));
+                        weight_on_dubious_edges, branch_edge_weight_created));
   }
 
-  if (stats_->cfg_stats.total_edges_created() /
-          static_cast<double>(edges_recorded) <
-      0.0005) {
+  if (branch_edges_created / static_cast<double>(edges_recorded) < 0.0005) {
     return absl::InternalError(
         "Fewer than 0.05% recorded jumps are converted into CFG edges, "
         "probably because of source drift.");
   }
-
-  CreateFallthroughs(branch_aggregation, tmp_node_map,
-                     &tmp_bb_fallthrough_counters, &tmp_edge_map);
   return absl::OkStatus();
 }
 }  // namespace devtools_crosstool_autofdo
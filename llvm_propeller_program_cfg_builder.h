@@ -1,6 +1,7 @@
 #ifndef AUTOFDO_LLVM_PROPELLER_PROGRAM_CFG_BUILDER_H_
 #define AUTOFDO_LLVM_PROPELLER_PROGRAM_CFG_BUILDER_H_
 
+#include <cstdint>
 #include <memory>
 #include <utility>
 
@@ -50,33 +51,43 @@ class ProgramCfgBuilder {
       Addr2Cu *addr2cu = nullptr) &&;
 
  private:
-  // Creates and returns an edge from `from_bb` to `to_bb` (specified by their
-  // BbHandle index) with the given `weight` and `edge_kind` and associates it
-  // to the corresponding nodes specified by `tmp_node_map`. Finally inserts the
-  // edge into `tmp_edge_map` with the key being the pair `{from_bb, to_bb}`.
-  CFGEdge *InternalCreateEdge(
-      int from_bb_index, int to_bb_index, int weight, CFGEdge::Kind edge_kind,
-      const absl::flat_hash_map<CFGNode::InterCfgId, CFGNode *> &tmp_node_map,
+  // Map from the ids of the source and sink nodes of every created edge to the
+  // edge.
+  using EdgeMap =
       absl::flat_hash_map<std::pair<CFGNode::InterCfgId, CFGNode::InterCfgId>,
-                          CFGEdge *> *tmp_edge_map);
+                          CFGEdge *>;
+
+  // Returns the node for the basic block at `bb_handle_index` in
+  // `binary_address_mapper_->bb_handles()`, or nullptr if no CFG exists for
+  // its function.
+  CFGNode *FindNode(int bb_handle_index) const;
+
+  // Creates and returns an edge from `from_bb` to `to_bb` (specified by their
+  // BbHandle index) with the given `weight` and `edge_kind`, or increments the
+  // weight of the existing edge in `tmp_edge_map`. Newly created edges are
+  // inserted into `tmp_edge_map` with the key being the pair
+  // `{from_bb, to_bb}`. Updates `cfg_stats` accordingly.
+  // This only mutates the CFGs of the two endpoints, so it may be called
+  // concurrently for edges of distinct functions as long as each call gets its
+  // own `tmp_edge_map` and `cfg_stats`.
+  CFGEdge *InternalCreateEdge(int from_bb_index, int to_bb_index,
+                              int64_t weight,
+                              CFGEdge::Kind edge_kind, EdgeMap *tmp_edge_map,
+                              PropellerStats::CfgStats &cfg_stats);
 
+  // Creates fallthrough edges along the paths of every `{from_bb, to_bb}` pair
+  // in `bb_fallthrough_counters` which can fall through.
   void CreateFallthroughs(
-      const BranchAggregation &branch_aggregation,
-      const absl::flat_hash_map<CFGNode::InterCfgId, CFGNode *> &tmp_node_map,
-      absl::flat_hash_map<std::pair<int, int>, int>
-          *tmp_bb_fallthrough_counters,
-      absl::flat_hash_map<std::pair<CFGNode::InterCfgId, CFGNode::InterCfgId>,
-                          CFGEdge *> *tmp_edge_map);
+      const absl::flat_hash_map<std::pair<int, int>, int64_t>
+          &bb_fallthrough_counters,
+      EdgeMap *tmp_edge_map, PropellerStats::CfgStats &cfg_stats);
 
-  // Create control flow graph edges from branch_counters_. For each address
-  // pair
-  // <from_addr, to_addr> in "branch_counters_", we translate it to
-  // <from_symbol, to_symbol> and by using tmp_node_map, we further translate
-  // it to <from_node, to_node>, and finally create a CFGEdge for such CFGNode
-  // pair.
-  absl::Status CreateEdges(
-      const BranchAggregation &branch_aggregation,
-      const absl::flat_hash_map<CFGNode::InterCfgId, CFGNode *> &node_map);
+  // Create control flow graph edges from the branch and fallthrough counters
+  // in `branch_aggregation`. Branches are mapped to their <from_bb, to_bb>
+  // pairs and partitioned by function: edges within a function are created on
+  // a thread per function, while edges between functions (calls and returns)
+  // are created in a final serial pass.
+  absl::Status CreateEdges(const BranchAggregation &branch_aggregation);
 
   const BinaryAddressMapper *binary_address_mapper_;
   PropellerStats *stats_;
@@ -7,13 +7,13 @@
 #include "llvm_propeller_mock_program_cfg_builder.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
-#include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/strings/str_cat.h"
 #include "util/testing/status_matchers.h"
 
 namespace devtools_crosstool_autofdo {
 namespace {
 
+using ::testing::Contains;
 using ::testing::ElementsAre;
 using ::testing::Gt;
 using ::testing::IsEmpty;
@@ -44,8 +44,7 @@ TEST(LlvmPropellerWholeProgramCfgInfo, CreateCfgInfoFromProto) {
   EXPECT_NE(edge.sink()->function_index(), main->function_index());
   // The same "edge" instance exists both in src->inter_outs_ and
   // sink->inter_ins_.
-  EXPECT_NE(absl::c_find(edge.sink()->inter_ins(), &edge),
-            edge.sink()->inter_ins().end());
+  EXPECT_THAT(edge.sink()->inter_ins(), Contains(&edge));
 }
 
 TEST(LlvmPropellerWholeProgramCfgInfo, GetNodeFrequencyThreshold) {
@@ -1,5 +1,6 @@
 #include "llvm_propeller_statistics.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <string>
 #include <utility>
@@ -10,6 +11,8 @@
 #include "third_party/abseil/absl/strings/str_cat.h"
 #include "third_party/abseil/absl/strings/str_format.h"
 #include "third_party/abseil/absl/strings/str_join.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "third_party/abseil/absl/time/time.h"
 
 namespace devtools_crosstool_autofdo {
 
@@ -20,28 +23,45 @@ std::string PropellerStats::CodeLayoutStats::DebugString() const {
   const double inter_score_percent_change =
       100 * (optimized_inter_score / original_inter_score - 1);
 
-  return absl::StrJoin(
-      {absl::StrCat(
-           "Merge order stats: ",
-           absl::StrJoin(n_assemblies_by_merge_order, ", ",
-                         [](std::string *out,
-                            const std::pair<ChainMergeOrder, int> &entry) {
-                           absl::StrAppend(out, "[",
-                                           GetMergeOrderName(entry.first), ":",
-                                           entry.second, "]");
-                         })),
-       absl::StrCat("Initial chains stats: single-node chains: [",
-                    n_single_node_chains, "] multi-node chains: [",
-                    n_multi_node_chains, "]"),
-       absl::StrFormat(
-           "Changed inter-function (ext-tsp) score by %+.1f%% from %f to %f.",
-           inter_score_percent_change, original_inter_score,
-           optimized_inter_score),
-       absl::StrFormat(
-           "Changed intra-function (ext-tsp) score by %+.1f%% from %f to %f",
-           intra_score_percent_change, original_intra_score,
-           optimized_intra_score)},
-      "\n");
+  std::vector<std::string> lines = {
+      absl::StrCat(
+          "Merge order stats: ",
+          absl::StrJoin(n_assemblies_by_merge_order, ", ",
+                        [](std::string *out,
+                           const std::pair<ChainMergeOrder, int> &entry) {
+                          absl::StrAppend(out, "[",
+                                          GetMergeOrderName(entry.first), ":",
+                                          entry.second, "]");
+                        })),
+      absl::StrCat("Initial chains stats: single-node chains: [",
+                   n_single_node_chains, "] multi-node chains: [",
+                   n_multi_node_chains, "]"),
+      absl::StrFormat(
+          "Changed inter-function (ext-tsp) score by %+.1f%% from %f to %f.",
+          inter_score_percent_change, original_inter_score,
+          optimized_inter_score),
+      absl::StrFormat(
+          "Changed intra-function (ext-tsp) score by %+.1f%% from %f to %f",
+          intra_score_percent_change, original_intra_score,
+          optimized_intra_score)};
+  if (has_layout_deadline) {
+    // No score is computed if the deadline expires before any CFG is laid
+    // out.
+    const double optimized_score =
+        optimized_intra_score + optimized_inter_score;
+    const double score_within_budget_percent =
+        optimized_score == 0
+            ? 0
+            : 100 * optimized_score_within_budget / optimized_score;
+    lines.push_back(absl::StrFormat(
+        "Layout budget stats: chain builds stopped at deadline: [%d] CFGs "
+        "laid out after deadline: [%d] score optimized within budget: %.1f%%",
+        n_chain_builds_stopped_at_deadline, n_cfgs_laid_out_after_deadline,
+        score_within_budget_percent));
+  }
+  lines.push_back(absl::StrCat("Hot text stats: size: [", hot_text_size,
+                               "] pages: [", hot_text_pages, "]"));
+  return absl::StrJoin(lines, "\n");
 }
 
 std::string PropellerStats::DisassemblyStats::Stat::DebugString() const {
@@ -140,11 +160,32 @@ std::string PropellerStats::CloningStats::DebugString() const {
       "\n");
 }
 
+std::string PropellerStats::LayoutSimulationStats::DebugString() const {
+  if (n_icache_accesses == 0) return "No layout simulation.";
+  auto format_misses = [](absl::string_view name, int64_t n_accesses,
+                          int64_t original_misses, int64_t optimized_misses) {
+    return absl::StrFormat(
+        "Simulated %s misses: %d -> %d (%+.1f%%) in %d accesses.", name,
+        original_misses, optimized_misses,
+        100 * (static_cast<double>(optimized_misses) /
+                   std::max<int64_t>(original_misses, 1) -
+               1),
+        n_accesses);
+  };
+  return absl::StrJoin(
+      {format_misses("i-cache", n_icache_accesses, original_icache_misses,
+                     optimized_icache_misses),
+       format_misses("iTLB", n_itlb_accesses, original_itlb_misses,
+                     optimized_itlb_misses)},
+      "\n");
+}
+
 std::string PropellerStats::DebugString() const {
   std::vector<std::string> stat_lines = {
       profile_stats.DebugString(),     bbaddrmap_stats.DebugString(),
       cfg_stats.DebugString(),         code_layout_stats.DebugString(),
-      disassembly_stats.DebugString(), cloning_stats.DebugString()};
+      disassembly_stats.DebugString(), cloning_stats.DebugString(),
+      layout_simulation_stats.DebugString(), phase_stats.DebugString()};
   return absl::StrJoin(stat_lines, "\n");
 }
 }  // namespace devtools_crosstool_autofdo
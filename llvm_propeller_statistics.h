@@ -2,13 +2,17 @@
 #define AUTOFDO_LLVM_PROPELLER_STATISTICS_H_
 
 #include <cstdint>
+#include <iterator>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "llvm_propeller_cfg.h"
 #include "llvm_propeller_chain_merge_order.h"
+#include "phase_timer.h"
 #include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "third_party/abseil/absl/time/time.h"
 
 namespace devtools_crosstool_autofdo {
 
@@ -27,6 +31,23 @@ struct PropellerStats {
     int n_single_node_chains = 0;
     // Number of initial multi-node chains.
     int n_multi_node_chains = 0;
+    // Whether code layout ran with a deadline.
+    bool has_layout_deadline = false;
+    // Number of chain builds which stopped merging chains at the layout
+    // deadline.
+    int n_chain_builds_stopped_at_deadline = 0;
+    // Number of CFGs whose layout started after the layout deadline. These
+    // keep the original order of their hot blocks.
+    int n_cfgs_laid_out_after_deadline = 0;
+    // The part of `optimized_intra_score + optimized_inter_score` contributed
+    // by CFGs whose layout started before the layout deadline.
+    double optimized_score_within_budget = 0;
+    // Total size of the hot text (all clusters built by code layout).
+    int64_t hot_text_size = 0;
+    // Number of `hot_text_page_size` pages spanned by the hot text of each
+    // section, assuming it starts at a page boundary. Only computed when
+    // page-aware packing is enabled.
+    int64_t hot_text_pages = 0;
 
     void operator+=(const CodeLayoutStats &other) {
       original_intra_score += other.original_intra_score;
@@ -39,6 +60,13 @@ struct PropellerStats {
       }
       n_single_node_chains += other.n_single_node_chains;
       n_multi_node_chains += other.n_multi_node_chains;
+      has_layout_deadline |= other.has_layout_deadline;
+      n_chain_builds_stopped_at_deadline +=
+          other.n_chain_builds_stopped_at_deadline;
+      n_cfgs_laid_out_after_deadline += other.n_cfgs_laid_out_after_deadline;
+      optimized_score_within_budget += other.optimized_score_within_budget;
+      hot_text_size += other.hot_text_size;
+      hot_text_pages += other.hot_text_pages;
     }
 
     std::string DebugString() const;
@@ -172,6 +200,30 @@ struct PropellerStats {
     std::string DebugString() const;
   };
 
+  // I-cache and iTLB simulation of the original and the optimized layouts.
+  struct LayoutSimulationStats {
+    int64_t n_icache_accesses = 0;
+    int64_t n_itlb_accesses = 0;
+    int64_t original_icache_misses = 0;
+    int64_t optimized_icache_misses = 0;
+    int64_t original_itlb_misses = 0;
+    int64_t optimized_itlb_misses = 0;
+
+    void operator+=(const LayoutSimulationStats &other) {
+      n_icache_accesses += other.n_icache_accesses;
+      n_itlb_accesses += other.n_itlb_accesses;
+      original_icache_misses += other.original_icache_misses;
+      optimized_icache_misses += other.optimized_icache_misses;
+      original_itlb_misses += other.original_itlb_misses;
+      optimized_itlb_misses += other.optimized_itlb_misses;
+    }
+
+    std::string DebugString() const;
+  };
+
+  // Time and memory used by each phase of profile generation.
+  using PhaseStats = ::devtools_crosstool_autofdo::PhaseStats;
+
   BbAddrMapStats bbaddrmap_stats;
 
   ProfileStats profile_stats;
@@ -180,6 +232,8 @@ struct PropellerStats {
   CfgStats cfg_stats;
   CodeLayoutStats code_layout_stats;
   CloningStats cloning_stats;
+  LayoutSimulationStats layout_simulation_stats;
+  PhaseStats phase_stats;
 
   void operator+=(const PropellerStats &other) {
     bbaddrmap_stats += other.bbaddrmap_stats;
@@ -188,6 +242,8 @@ struct PropellerStats {
     cfg_stats += other.cfg_stats;
     code_layout_stats += other.code_layout_stats;
     cloning_stats += other.cloning_stats;
+    layout_simulation_stats += other.layout_simulation_stats;
+    phase_stats += other.phase_stats;
   }
 
   std::string DebugString() const;
@@ -1,6 +1,7 @@
 #include "llvm_propeller_statistics.h"
 
 #include "llvm_propeller_cfg.h"
+#include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 namespace devtools_crosstool_autofdo {
@@ -16,5 +17,11 @@ TEST(PropellerStatisticsTest, TotalEdgeWeightCreatedDoesntOverflow) {
   EXPECT_EQ(statistics.cfg_stats.total_edge_weight_created(), 2202261886);
 }
 
+TEST(PropellerStatisticsTest, LayoutBudgetStatsWithoutScores) {
+  PropellerStats::CodeLayoutStats stats = {.has_layout_deadline = true};
+  EXPECT_THAT(stats.DebugString(),
+              testing::HasSubstr("score optimized within budget: 0.0%"));
+}
+
 }  // namespace
 }  // namespace  devtools_crosstool_autofdo
@@ -91,6 +91,12 @@ MiniDisassembler::Create(const llvm::object::ObjectFile *object_file) {
 
 absl::StatusOr<llvm::MCInst> MiniDisassembler::DisassembleOne(
     uint64_t binary_address) {
+  uint64_t size;
+  return DisassembleOne(binary_address, size);
+}
+
+absl::StatusOr<llvm::MCInst> MiniDisassembler::DisassembleOne(
+    uint64_t binary_address, uint64_t &size) {
   for (const auto &section : object_file_->sections()) {
     if (!section.isText() || section.isVirtual()) {
       continue;
@@ -107,7 +113,6 @@ absl::StatusOr<llvm::MCInst> MiniDisassembler::DisassembleOne(
         reinterpret_cast<const uint8_t *>(content->data()), content->size());
     uint64_t section_offset = binary_address - section.getAddress();
     llvm::MCInst inst;
-    uint64_t size;
     if (!disasm_->getInstruction(inst, size,
                                  content_bytes.slice(section_offset),
                                  binary_address, llvm::nulls())) {
@@ -33,6 +33,9 @@ class MiniDisassembler {
   MiniDisassembler &operator=(MiniDisassembler &&) = delete;
 
   absl::StatusOr<llvm::MCInst> DisassembleOne(uint64_t binary_address);
+  // Like above, but also stores the size of the instruction in `size`.
+  absl::StatusOr<llvm::MCInst> DisassembleOne(uint64_t binary_address,
+                                              uint64_t &size);
   bool MayAffectControlFlow(const llvm::MCInst &inst);
   llvm::StringRef GetInstructionName(const llvm::MCInst &inst) const;
   absl::StatusOr<bool> MayAffectControlFlow(uint64_t binary_address);
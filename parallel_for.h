@@ -0,0 +1,43 @@
+#ifndef AUTOFDO_PARALLEL_FOR_H_
+#define AUTOFDO_PARALLEL_FOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace devtools_crosstool_autofdo {
+
+// Returns the number of threads to use for parallel work by default: one per
+// hardware thread.
+inline int GetDefaultNumThreads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Calls `fn(i)` for every `i` in [0, `size`), spreading the calls over up to
+// `num_threads` threads, the calling thread included. Indices are handed out
+// one at a time, so uneven work items balance across the threads. `fn` must
+// be safe to call concurrently for distinct indices. Returns once every call
+// has returned.
+template <typename Fn>
+void ParallelFor(int64_t size, int num_threads, Fn fn) {
+  const int64_t used_threads =
+      std::max<int64_t>(1, std::min<int64_t>(num_threads, size));
+  std::atomic<int64_t> next_index = 0;
+  auto worker = [&]() {
+    for (int64_t i = next_index.fetch_add(1, std::memory_order_relaxed);
+         i < size; i = next_index.fetch_add(1, std::memory_order_relaxed)) {
+      fn(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(used_threads - 1);
+  for (int64_t t = 1; t < used_threads; ++t) threads.emplace_back(worker);
+  worker();
+  for (std::thread &thread : threads) thread.join();
+}
+
+}  // namespace devtools_crosstool_autofdo
+
+#endif  // AUTOFDO_PARALLEL_FOR_H_
@@ -0,0 +1,32 @@
+#include "parallel_for.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+
+using ::testing::Each;
+
+TEST(ParallelForTest, CallsEveryIndexOnce) {
+  for (int num_threads : {1, 2, 8}) {
+    std::vector<std::atomic<int>> calls(1000);
+    ParallelFor(calls.size(), num_threads,
+                [&](int64_t i) { calls[i].fetch_add(1); });
+    std::vector<int> counts(calls.begin(), calls.end());
+    EXPECT_THAT(counts, Each(1)) << "num_threads: " << num_threads;
+  }
+}
+
+TEST(ParallelForTest, EmptyRange) {
+  bool called = false;
+  ParallelFor(0, 4, [&](int64_t i) { called = true; });
+  EXPECT_FALSE(called);
+}
+
+}  // namespace
+}  // namespace devtools_crosstool_autofdo
@@ -0,0 +1,247 @@
+// Benchmarks profile ingestion end to end on synthetic perf.data files: LBR
+// aggregation for Propeller, sample reading for AutoFDO, and the complete
+// Propeller and AutoFDO profile generation pipelines. The perf.data files are
+// generated once per shape for the binary given by --binary. SPE aggregation
+// is benchmarked on the recorded profile given by --spe_perf_data, as there
+// is no synthetic SPE data. Example usage:
+// $ perf_data_ingestion_benchmark --binary=testdata/propeller_sample.bin \
+//     --benchmark_filter=BM_PerfLbrAggregator
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "base/logging.h"
+#include "branch_frequencies.h"
+#include "llvm_profile_writer.h"
+#include "llvm_propeller_binary_content.h"
+#include "llvm_propeller_file_perf_data_provider.h"
+#include "llvm_propeller_options.pb.h"
+#include "llvm_propeller_options_builder.h"
+#include "llvm_propeller_perf_data_provider.h"
+#include "llvm_propeller_perf_lbr_aggregator.h"
+#include "llvm_propeller_profile_generator.h"
+#include "llvm_propeller_statistics.h"
+#include "perfdata_reader.h"
+#include "profile_creator.h"
+#include "sample_reader.h"
+#include "synthetic_perf_data.h"
+#include "third_party/abseil/absl/container/flat_hash_map.h"
+#include "third_party/abseil/absl/flags/flag.h"
+#include "third_party/abseil/absl/flags/parse.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/strings/match.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "llvm/ProfileData/SampleProf.h"
+
+ABSL_FLAG(std::string, binary, "testdata/propeller_sample.bin",
+          "Binary for which the synthetic perf.data files are generated");
+ABSL_FLAG(std::string, spe_perf_data, "testdata/propeller_sample.arm.perfdata",
+          "ARM SPE perf.data file for the SPE aggregation benchmark");
+ABSL_FLAG(std::string, spe_binary, "testdata/propeller_sample.arm.bin",
+          "Binary profiled by --spe_perf_data");
+
+namespace devtools_crosstool_autofdo {
+namespace {
+
+// Returns the binary content of --binary, read once.
+const BinaryContent &GetBenchmarkBinaryContent() {
+  static const BinaryContent *binary_content = [] {
+    absl::StatusOr<std::unique_ptr<BinaryContent>> binary_content =
+        GetBinaryContent(absl::GetFlag(FLAGS_binary));
+    CHECK(binary_content.ok()) << binary_content.status();
+    return binary_content->release();
+  }();
+  return *binary_content;
+}
+
+// Returns a directory for the generated perf.data files and profiles.
+const std::string &GetOutputDir() {
+  static const std::string *output_dir = [] {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() /
+                                "perf_data_ingestion_benchmark";
+    std::filesystem::create_directories(dir);
+    return new std::string(dir.string());
+  }();
+  return *output_dir;
+}
+
+// Returns the options of the benchmark arguments: the number of samples, the
+// LBR depth, the number of processes and whether the binary is mapped as PIE.
+SyntheticPerfDataOptions GetSyntheticPerfDataOptions(
+    const benchmark::State &state) {
+  return {.n_samples = state.range(0),
+          .lbr_depth = static_cast<int>(state.range(1)),
+          .n_pids = static_cast<int>(state.range(2)),
+          .mmap_layout = state.range(3) ? SyntheticMmapLayout::kPie
+                                        : SyntheticMmapLayout::kNonPie};
+}
+
+// Returns the path of a synthetic perf.data file for `options`, generating
+// it on first use.
+const std::string &GetSyntheticPerfData(
+    const SyntheticPerfDataOptions &options) {
+  static auto *paths = new absl::flat_hash_map<std::string, std::string>();
+  const std::string key = absl::StrCat(
+      options.n_samples, "_", options.lbr_depth, "_", options.n_pids, "_",
+      options.mmap_layout == SyntheticMmapLayout::kPie ? "pie" : "nonpie");
+  auto [it, inserted] = paths->try_emplace(key);
+  if (inserted) {
+    it->second = absl::StrCat(GetOutputDir(), "/", key, ".perfdata");
+    absl::Status status = WriteSyntheticPerfData(GetBenchmarkBinaryContent(),
+                                                 options, it->second);
+    CHECK(status.ok()) << status;
+  }
+  return it->second;
+}
+
+// Returns `str` with the special characters of ECMAScript regular
+// expressions, which `PerfDataSampleReader` uses, escaped.
+std::string QuoteRegex(absl::string_view str) {
+  std::string quoted;
+  for (char c : str) {
+    if (absl::StrContains(R"(\^$.|?*+()[]{})", c)) quoted.push_back('\\');
+    quoted.push_back(c);
+  }
+  return quoted;
+}
+
+// Reports the throughput in samples and perf.data bytes.
+void ReportThroughput(benchmark::State &state,
+                      const SyntheticPerfDataOptions &options,
+                      const std::string &perf_data) {
+  state.SetItemsProcessed(state.iterations() * options.n_samples);
+  state.SetBytesProcessed(state.iterations() *
+                          std::filesystem::file_size(perf_data));
+}
+
+void BM_PerfLbrAggregator(benchmark::State &state) {
+  const SyntheticPerfDataOptions options = GetSyntheticPerfDataOptions(state);
+  const std::string &perf_data = GetSyntheticPerfData(options);
+  const BinaryContent &binary_content = GetBenchmarkBinaryContent();
+  const PropellerOptions propeller_options(
+      PropellerOptionsBuilder()
+          .SetBinaryName(absl::GetFlag(FLAGS_binary))
+          .AddInputProfiles(InputProfileBuilder().SetName(perf_data)));
+  for (auto s : state) {
+    PropellerStats stats;
+    PerfLbrAggregator lbr_aggregator(
+        std::make_unique<GenericFilePerfDataProvider>(
+            std::vector{perf_data}));
+    absl::StatusOr<LbrAggregation> lbr_aggregation =
+        lbr_aggregator.AggregateLbrData(propeller_options, binary_content,
+                                        stats);
+    CHECK(lbr_aggregation.ok()) << lbr_aggregation.status();
+    benchmark::DoNotOptimize(lbr_aggregation);
+  }
+  ReportThroughput(state, options, perf_data);
+}
+
+void BM_PerfDataSampleReader(benchmark::State &state) {
+  const SyntheticPerfDataOptions options = GetSyntheticPerfDataOptions(state);
+  const std::string &perf_data = GetSyntheticPerfData(options);
+  // Matches the file name of the binary, with or without a directory.
+  const std::string focus_binary_re = absl::StrCat(
+      "(^|/)",
+      QuoteRegex(std::filesystem::path(absl::GetFlag(FLAGS_binary))
+                     .filename()
+                     .string()),
+      "$");
+  for (auto s : state) {
+    PerfDataSampleReader sample_reader(perf_data, focus_binary_re,
+                                       /*build_id=*/"");
+    CHECK(sample_reader.ReadAndSetTotalCount());
+    CHECK_GT(sample_reader.GetTotalCount(), 0);
+  }
+  ReportThroughput(state, options, perf_data);
+}
+
+void BM_AggregateSpe(benchmark::State &state) {
+  const std::string perf_data = absl::GetFlag(FLAGS_spe_perf_data);
+  absl::StatusOr<std::unique_ptr<BinaryContent>> binary_content =
+      GetBinaryContent(absl::GetFlag(FLAGS_spe_binary));
+  CHECK(binary_content.ok()) << binary_content.status();
+  for (auto s : state) {
+    GenericFilePerfDataProvider provider({perf_data});
+    absl::StatusOr<std::optional<PerfDataProvider::BufferHandle>> buffer =
+        provider.GetNext();
+    CHECK(buffer.ok()) << buffer.status();
+    CHECK(buffer->has_value()) << "No perf data in " << perf_data;
+    absl::StatusOr<PerfDataReader> perf_data_reader =
+        BuildPerfDataReader(*std::move(*buffer), binary_content->get(),
+                            /*match_mmap_name=*/"");
+    CHECK(perf_data_reader.ok()) << perf_data_reader.status();
+    BranchFrequencies branch_frequencies;
+    absl::Status status = perf_data_reader->AggregateSpe(branch_frequencies);
+    CHECK(status.ok()) << status;
+    benchmark::DoNotOptimize(branch_frequencies);
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          std::filesystem::file_size(perf_data));
+}
+
+void BM_GeneratePropellerProfiles(benchmark::State &state) {
+  const SyntheticPerfDataOptions options = GetSyntheticPerfDataOptions(state);
+  const std::string &perf_data = GetSyntheticPerfData(options);
+  const PropellerOptions propeller_options(
+      PropellerOptionsBuilder()
+          .SetBinaryName(absl::GetFlag(FLAGS_binary))
+          .SetClusterOutName(absl::StrCat(GetOutputDir(), "/cc_profile.txt"))
+          .SetSymbolOrderOutName(
+              absl::StrCat(GetOutputDir(), "/ld_profile.txt"))
+          .AddInputProfiles(InputProfileBuilder().SetName(perf_data)));
+  for (auto s : state) {
+    absl::Status status = GeneratePropellerProfiles(propeller_options);
+    CHECK(status.ok()) << status;
+  }
+  ReportThroughput(state, options, perf_data);
+}
+
+void BM_CreateAutoFdoProfile(benchmark::State &state) {
+  const SyntheticPerfDataOptions options = GetSyntheticPerfDataOptions(state);
+  const std::string &perf_data = GetSyntheticPerfData(options);
+  const std::string profile = absl::StrCat(GetOutputDir(), "/afdo.prof");
+  for (auto s : state) {
+    LLVMProfileWriter writer(llvm::sampleprof::SPF_Ext_Binary);
+    CHECK(ProfileCreator(absl::GetFlag(FLAGS_binary))
+              .CreateProfile(perf_data, "perf", &writer, profile));
+  }
+  ReportThroughput(state, options, perf_data);
+}
+
+// Registers the perf.data shapes as benchmark arguments: files of increasing
+// size with the default shape, and medium-sized files with varying LBR depth,
+// number of processes and mmap layout.
+void SyntheticPerfDataArguments(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgNames({"samples", "lbr_depth", "pids", "pie"});
+  for (int n_samples : {10000, 100000, 1000000})
+    benchmark->Args({n_samples, 32, 1, 0});
+  for (int lbr_depth : {8, 16}) benchmark->Args({100000, lbr_depth, 1, 0});
+  for (int n_pids : {4, 16}) benchmark->Args({100000, 32, n_pids, 1});
+  benchmark->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_PerfLbrAggregator)->Apply(SyntheticPerfDataArguments);
+BENCHMARK(BM_PerfDataSampleReader)->Apply(SyntheticPerfDataArguments);
+BENCHMARK(BM_AggregateSpe)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_GeneratePropellerProfiles)->Apply(SyntheticPerfDataArguments);
+BENCHMARK(BM_CreateAutoFdoProfile)->Apply(SyntheticPerfDataArguments);
+
+}  // namespace
+}  // namespace devtools_crosstool_autofdo
+
+int main(int argc, char **argv) {
+  // The benchmark library removes its own flags, leaving the rest for absl.
+  benchmark::Initialize(&argc, argv);
+  absl::ParseCommandLine(argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
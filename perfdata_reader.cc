@@ -11,6 +11,7 @@
 #include "binary_address_branch.h"
 #include "branch_frequencies.h"
 #include "lbr_aggregation.h"
+#include "live_metrics.h"
 #include "llvm_propeller_binary_content.h"
 #include "llvm_propeller_perf_data_provider.h"
 #include "spe_tid_pid_provider.h"
@@ -390,6 +391,7 @@ absl::Status PerfDataReader::ReadWithSpeRecordCallBack(
 void PerfDataReader::AggregateLBR(LbrAggregation *result) const {
   const bool is_kernel_mode = IsKernelMode();
   if (is_kernel_mode) LOG(WARNING) << "Input binary is kernel";
+  BatchedLiveCounter samples_aggregated(LiveCounter::kSamplesAggregated);
   ReadWithSampleCallBack([&](const quipper::PerfDataProto::SampleEvent &event) {
     uint32_t pid;
     if (is_kernel_mode) {
@@ -404,6 +406,7 @@ void PerfDataReader::AggregateLBR(LbrAggregation *result) const {
     }
     const auto &brstack = event.branch_stack();
     if (brstack.empty()) return;
+    samples_aggregated.Increment();
     uint64_t last_from = kInvalidBinaryAddress;
     uint64_t last_to = kInvalidBinaryAddress;
     for (int p = brstack.size() - 1; p >= 0; --p) {
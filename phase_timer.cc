@@ -0,0 +1,79 @@
+#include "phase_timer.h"
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "live_metrics.h"
+#include "trace_event_recorder.h"
+#include "third_party/abseil/absl/strings/str_format.h"
+#include "third_party/abseil/absl/strings/str_join.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "third_party/abseil/absl/time/clock.h"
+#include "third_party/abseil/absl/time/time.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+// Returns the CPU time consumed so far as measured by `clock_id`.
+absl::Duration GetCpuTime(clockid_t clock_id) {
+  timespec ts;
+  if (clock_gettime(clock_id, &ts) != 0) return absl::ZeroDuration();
+  return absl::DurationFromTimespec(ts);
+}
+
+// Returns the peak resident set size of the process, or 0 if unavailable.
+int64_t GetPeakRssBytes() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  // `ru_maxrss` is in kilobytes.
+  return int64_t{usage.ru_maxrss} * 1024;
+}
+}  // namespace
+
+std::string PhaseStats::DebugString() const {
+  std::vector<std::string> lines;
+  for (const Phase &phase : phases) {
+    lines.push_back(absl::StrFormat(
+        "Phase '%s': wall %s, thread cpu %s, process cpu %s, peak rss %.1f "
+        "MiB, rss delta %+.1f MiB.",
+        phase.name, absl::FormatDuration(phase.wall_time),
+        absl::FormatDuration(phase.thread_cpu_time),
+        absl::FormatDuration(phase.process_cpu_time),
+        phase.peak_rss_bytes / (1024.0 * 1024),
+        phase.rss_delta_bytes / (1024.0 * 1024)));
+  }
+  return absl::StrJoin(lines, "\n");
+}
+
+PhaseTimer::PhaseTimer(absl::string_view name,
+                       absl::string_view trace_category)
+    : name_(name),
+      trace_category_(trace_category),
+      start_time_(absl::Now()),
+      start_thread_cpu_time_(GetCpuTime(CLOCK_THREAD_CPUTIME_ID)),
+      start_process_cpu_time_(GetCpuTime(CLOCK_PROCESS_CPUTIME_ID)),
+      start_rss_bytes_(GetCurrentRssBytes()) {}
+
+PhaseStats::Phase PhaseTimer::Stop() const {
+  return {.name = name_,
+          .wall_time = absl::Now() - start_time_,
+          .thread_cpu_time =
+              GetCpuTime(CLOCK_THREAD_CPUTIME_ID) - start_thread_cpu_time_,
+          .process_cpu_time =
+              GetCpuTime(CLOCK_PROCESS_CPUTIME_ID) - start_process_cpu_time_,
+          .peak_rss_bytes = GetPeakRssBytes(),
+          .rss_delta_bytes = GetCurrentRssBytes() - start_rss_bytes_};
+}
+
+void PhaseTimer::StopAndRecord(PhaseStats &stats) const {
+  PhaseStats::Phase phase = Stop();
+  RecordTraceEvent(trace_category_, name_, start_time_,
+                   start_time_ + phase.wall_time);
+  stats.phases.push_back(std::move(phase));
+}
+
+}  // namespace devtools_crosstool_autofdo
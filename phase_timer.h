@@ -0,0 +1,71 @@
+#ifndef AUTOFDO_PHASE_TIMER_H_
+#define AUTOFDO_PHASE_TIMER_H_
+
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "third_party/abseil/absl/algorithm/container.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "third_party/abseil/absl/time/time.h"
+
+namespace devtools_crosstool_autofdo {
+
+// Resources used by the phases of AutoFDO and Propeller profile generation.
+struct PhaseStats {
+  struct Phase {
+    std::string name;
+    absl::Duration wall_time;
+    // CPU time of the thread which ran the phase.
+    absl::Duration thread_cpu_time;
+    // CPU time of the whole process, including worker threads.
+    absl::Duration process_cpu_time;
+    // Peak resident set size of the process at the end of the phase.
+    int64_t peak_rss_bytes = 0;
+    // Change of the resident set size over the phase.
+    int64_t rss_delta_bytes = 0;
+  };
+
+  // Phases in the order they finished.
+  std::vector<Phase> phases;
+
+  void operator+=(const PhaseStats &other) {
+    absl::c_copy(other.phases, std::back_inserter(phases));
+  }
+
+  std::string DebugString() const;
+};
+
+// Measures the wall time, CPU time and resident set size of one phase of
+// profile generation, from construction until `Stop` is called. Thread CPU
+// time is measured for the constructing thread, so `Stop` must be called on
+// the same thread.
+class PhaseTimer {
+ public:
+  // `trace_category` is the category of the recorded trace event.
+  explicit PhaseTimer(absl::string_view name,
+                      absl::string_view trace_category = "propeller");
+
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+  // Returns the resources used since construction.
+  PhaseStats::Phase Stop() const;
+
+  // Records the resources used since construction as a phase in `stats`, and
+  // as a trace event if trace event recording is enabled.
+  void StopAndRecord(PhaseStats &stats) const;
+
+ private:
+  const std::string name_;
+  const std::string trace_category_;
+  const absl::Time start_time_;
+  const absl::Duration start_thread_cpu_time_;
+  const absl::Duration start_process_cpu_time_;
+  const int64_t start_rss_bytes_;
+};
+
+}  // namespace devtools_crosstool_autofdo
+
+#endif  // AUTOFDO_PHASE_TIMER_H_
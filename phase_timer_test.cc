@@ -0,0 +1,48 @@
+#include "phase_timer.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "third_party/abseil/absl/time/clock.h"
+#include "third_party/abseil/absl/time/time.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Field;
+
+TEST(PhaseTimerTest, MeasuresWallTimeAndMemory) {
+  PhaseTimer timer("phase");
+  absl::SleepFor(absl::Milliseconds(10));
+  PhaseStats::Phase phase = timer.Stop();
+  EXPECT_EQ(phase.name, "phase");
+  EXPECT_GE(phase.wall_time, absl::Milliseconds(10));
+  EXPECT_GE(phase.thread_cpu_time, absl::ZeroDuration());
+  EXPECT_GE(phase.process_cpu_time, absl::ZeroDuration());
+  EXPECT_GT(phase.peak_rss_bytes, 0);
+}
+
+TEST(PhaseTimerTest, MeasuresThreadCpuTime) {
+  PhaseTimer timer("busy");
+  const absl::Time end = absl::Now() + absl::Milliseconds(20);
+  volatile int64_t sink = 0;
+  while (absl::Now() < end) sink = sink + 1;
+  EXPECT_GT(timer.Stop().thread_cpu_time, absl::ZeroDuration());
+}
+
+TEST(PhaseTimerTest, RecordsPhasesInOrder) {
+  PhaseStats stats;
+  PhaseTimer("first").StopAndRecord(stats);
+  PhaseStats other;
+  PhaseTimer("second", "autofdo").StopAndRecord(other);
+  stats += other;
+  EXPECT_THAT(stats.phases,
+              ElementsAre(Field(&PhaseStats::Phase::name, "first"),
+                          Field(&PhaseStats::Phase::name, "second")));
+}
+
+}  // namespace
+}  // namespace devtools_crosstool_autofdo
@@ -8,6 +8,7 @@
 #include <ios>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -15,9 +16,11 @@
 #include "base/commandlineflags.h"
 #include "base/logging.h"
 #include "instruction_map.h"
+#include "phase_timer.h"
 #include "sample_reader.h"
 #include "source_info.h"
 #include "symbol_map.h"
+#include "trace_event_recorder.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/flags/flag.h"
 #include "third_party/abseil/absl/status/statusor.h"
@@ -34,13 +37,13 @@ ABSL_FLAG(bool, llc_misses, false, "The profile represents llc misses.");
 
 namespace devtools_crosstool_autofdo {
 Profile::ProfileMaps *Profile::GetProfileMaps(uint64_t addr) {
-  const std::string *name;
+  absl::string_view name;
   uint64_t start_addr, end_addr;
   if (symbol_map_->GetSymbolInfoByAddr(addr, &name,
                                        &start_addr, &end_addr)) {
     std::pair<SymbolProfileMaps::iterator, bool> ret =
         symbol_profile_maps_.insert(
-            SymbolProfileMaps::value_type(*name, nullptr));
+            SymbolProfileMaps::value_type(name, nullptr));
     if (ret.second) {
       ret.first->second = new ProfileMaps(start_addr, end_addr);
     }
@@ -57,6 +60,8 @@ void Profile::AggregatePerFunctionProfile(bool check_lbr_entry) {
     ProfileMaps *maps = GetProfileMaps(vaddr);
     if (maps != nullptr) {
       maps->address_count_map[vaddr] += count;
+    } else {
+      ++stats_.profile_stats.addresses_without_symbol;
     }
   }
 
@@ -64,7 +69,10 @@ void Profile::AggregatePerFunctionProfile(bool check_lbr_entry) {
   for (const auto &[addr, timestamp] : *address_timestamp_map) {
     uint64_t vaddr = symbol_map_->get_static_vaddr(addr);
     ProfileMaps *maps = GetProfileMaps(vaddr);
-    if (maps != nullptr && maps->timestamp == 0) {
+    // The map is ordered by address, so take the earliest timestamp of all
+    // the sampled addresses of the function. Zero means no timestamp.
+    if (maps != nullptr && timestamp != 0 &&
+        (maps->timestamp == 0 || timestamp < maps->timestamp)) {
       maps->timestamp = timestamp;
     }
   }
@@ -105,6 +113,8 @@ void Profile::AggregatePerFunctionProfile(bool check_lbr_entry) {
 
     if (maps != nullptr) {
       maps->range_count_map[std::make_pair(beg_vaddr, end_vaddr)] += count;
+    } else {
+      ++stats_.profile_stats.ranges_without_symbol;
     }
   }
   const BranchCountMap *branch_map = &sample_reader_->branch_count_map();
@@ -125,8 +135,11 @@ void Profile::AggregatePerFunctionProfile(bool check_lbr_entry) {
 
     if (maps != nullptr) {
       maps->branch_count_map[std::make_pair(from_vaddr, to_vaddr)] += count;
+    } else {
+      ++stats_.profile_stats.branches_without_symbol;
     }
   }
+  stats_.profile_stats.functions_sampled = symbol_profile_maps_.size();
 
   // Add an entry for each symbol so that later we can decide if the hot and
   // cold parts together need to be emitted.
@@ -152,7 +165,12 @@ uint64_t Profile::ProfileMaps::GetAggregatedCount() const {
 
 void Profile::ProcessPerFunctionProfile(absl::string_view func_name,
                                         const ProfileMaps &maps) {
+  ScopedTraceEvent trace_event("symbolization", func_name);
   InstructionMap inst_map(addr2line_, symbol_map_);
+  ++stats_.profile_stats.functions_processed;
+  if (maps.end_addr > maps.start_addr)
+    stats_.profile_stats.symbolization_queries +=
+        maps.end_addr - maps.start_addr;
   // LOG(INFO) << "ProcessPerFunctionProfile: " << func_name;
   inst_map.BuildPerFunctionInstructionMap(func_name, maps.start_addr,
                                           maps.end_addr);
@@ -178,26 +196,29 @@ void Profile::ProcessPerFunctionProfile(absl::string_view func_name,
     map_ptr = &maps.address_count_map;
   }
 
+  std::vector<SymbolMap::SourceCount> source_counts;
+  source_counts.reserve(map_ptr->size());
   for (const auto &[address, count] : *map_ptr) {
     const InstructionMap::InstInfo *info = inst_map.lookup(address);
     if (info == nullptr) {
       continue;
     }
     if (!info->source_stack.empty()) {
-      // LOG(INFO) << "adding source count for func: " << func_name
-      //           << " address: " << address;
-      symbol_map_->AddSourceCount(func_name, info->source_stack, count, 0,
-                                  info->source_stack[0].DuplicationFactor(),
-                                  SymbolMap::PERFDATA);
+      source_counts.push_back(
+          {.source = &info->source_stack,
+           .count = count,
+           .duplication = info->source_stack[0].DuplicationFactor()});
     }
   }
+  symbol_map_->AddSourceCounts(symbol_map_->GetMutableSymbolByName(func_name),
+                               source_counts, SymbolMap::PERFDATA);
 
   for (const auto &[branch, count] : maps.branch_count_map) {
     const InstructionMap::InstInfo *info = inst_map.lookup(branch.first);
     if (info == nullptr) {
       continue;
     }
-    const std::string *callee =
+    std::optional<absl::string_view> callee =
         symbol_map_->GetSymbolNameByStartAddr(branch.second);
     if (!callee) {
       continue;
@@ -217,7 +238,11 @@ void Profile::ProcessPerFunctionProfile(absl::string_view func_name,
 void Profile::ComputeProfile(bool check_lbr_entry) {
   symbol_map_->CalculateThresholdFromTotalCount(
       sample_reader_->GetTotalCount());
+  PhaseTimer aggregation_timer("aggregate samples by function", "autofdo");
   AggregatePerFunctionProfile(check_lbr_entry);
+  aggregation_timer.StopAndRecord(stats_.phase_stats);
+
+  PhaseTimer symbolization_timer("symbolize functions", "autofdo");
 
   if (absl::GetFlag(FLAGS_llc_misses)) {
     for (const auto &[func_name, maps] : symbol_profile_maps_) {
@@ -234,6 +259,7 @@ void Profile::ComputeProfile(bool check_lbr_entry) {
         SourceStack stack;
         // LOG(INFO) << "getting inline stack for pc: " << pc;
         symbol_map_->get_addr2line()->GetInlineStack(pc, &stack);
+        ++stats_.profile_stats.symbolization_queries;
         symbol_map_->AddIndirectCallTarget(func_name, stack, "__llc_misses__",
                                            count);
       }
@@ -266,11 +292,14 @@ void Profile::ComputeProfile(bool check_lbr_entry) {
           symbol_counts.at(symbol_map_->GetOriginalName(name));
       if (symbol_map_->ShouldEmit(count)) {
         ProcessPerFunctionProfile(name, *profile);
+      } else if (count != 0) {
+        ++stats_.profile_stats.functions_below_threshold;
       }
     }
     symbol_map_->ElideSuffixesAndMerge();
     symbol_map_->ComputeWorkingSets();
   }
+  symbolization_timer.StopAndRecord(stats_.phase_stats);
 }
 
 Profile::~Profile() {
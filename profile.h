@@ -10,6 +10,7 @@
 #include <set>
 #include <string>
 
+#include "autofdo_statistics.h"
 #include "base/integral_types.h"
 #include "sample_reader.h"
 #include "third_party/abseil/absl/container/node_hash_map.h"
@@ -48,6 +49,9 @@ class Profile {
   // is a branch, call, or return instruction.
   void ComputeProfile(bool check_lbr_entry = false);
 
+  // Returns the profile and phase statistics of `ComputeProfile`.
+  const AutoFdoStats &stats() const { return stats_; }
+
  private:
   // Internal data structure that aggregates profile for each symbol.
   struct ProfileMaps {
@@ -81,6 +85,7 @@ class Profile {
   SymbolMap *symbol_map_;
   AddressCountMap global_addr_count_map_;
   SymbolProfileMaps symbol_profile_maps_;
+  AutoFdoStats stats_;
 };
 }  // namespace devtools_crosstool_autofdo
 
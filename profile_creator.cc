@@ -11,24 +11,33 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <ios>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "addr2line.h"
+#include "autofdo_statistics.h"
+#include "autofdo_telemetry_reporter.h"
+#include "binary_image.h"
 #include "gcov.h"
+#include "phase_timer.h"
 #include "profile.h"
 #include "sample_reader.h"
 #include "source_info.h"
 #include "symbol_map.h"
+#include "trace_event_recorder.h"
 #include "base/commandlineflags.h"
 #include "base/integral_types.h"
 #include "base/logging.h"
 #include "base/logging.h"
 #include "third_party/abseil/absl/container/btree_map.h"
+#include "third_party/abseil/absl/container/flat_hash_set.h"
 #include "third_party/abseil/absl/flags/flag.h"
 #include "third_party/abseil/absl/memory/memory.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
 #include "third_party/abseil/absl/strings/string_view.h"
 #include "util/symbolize/elf_reader.h"
 #include "simple_spe_sample_reader.h"
@@ -48,6 +57,14 @@ AUTOFDO_PROFILE_SYMBOL_LIST_FLAGS;
 
 ABSL_FLAG(std::string, focus_binary_re, "",
           "RE for the focused binary file name");
+ABSL_FLAG(std::string, startup_symbol_order, "",
+          "If set, also write a linker symbol ordering file to this path, "
+          "placing the functions first executed during startup (in order of "
+          "first execution) before the steady-state functions (in decreasing "
+          "order of samples). Requires timestamped perf samples.");
+ABSL_FLAG(uint32_t, startup_window_ms, 1000,
+          "Length in milliseconds of the startup window for "
+          "--startup_symbol_order, measured from the earliest sample.");
 
 namespace {
 struct PrefetchHint {
@@ -58,6 +75,31 @@ struct PrefetchHint {
 
 typedef std::vector<PrefetchHint> PrefetchHints;
 
+// Writes the startup symbol ordering of `symbol_map` to `file_name`. Lines
+// starting with '#' are ignored by the linker and mark the buckets.
+bool WriteStartupSymbolOrder(
+    const devtools_crosstool_autofdo::SymbolMap &symbol_map,
+    const std::string &file_name) {
+  const uint32_t startup_window_ms = absl::GetFlag(FLAGS_startup_window_ms);
+  devtools_crosstool_autofdo::SymbolMap::StartupSymbolOrder order =
+      symbol_map.ComputeStartupSymbolOrder(uint64_t{startup_window_ms} *
+                                           1000000);
+  std::ofstream out(file_name);
+  if (!out) {
+    LOG(ERROR) << "Failed to open " << file_name << " for writing.";
+    return false;
+  }
+  out << "# startup: first executed within " << startup_window_ms
+      << "ms of the earliest sample\n";
+  for (const std::string &name : order.startup) out << name << "\n";
+  out << "# steady-state\n";
+  for (const std::string &name : order.steady_state) out << name << "\n";
+  LOG(INFO) << "Wrote " << order.startup.size() << " startup and "
+            << order.steady_state.size() << " steady-state symbols to "
+            << file_name;
+  return out.good();
+}
+
 // Experimental support for providing cache prefetch hints.
 // Currently, the format is a simple csv format, with no superfluous spaces or
 // markers (e.g. quotes).
@@ -105,6 +147,11 @@ uint64_t ProfileCreator::GetTotalCountFromTextProfile(
   return creator.TotalSamples();
 }
 
+std::shared_ptr<BinaryImage> ProfileCreator::GetBinaryImage() {
+  if (binary_image_ == nullptr) binary_image_ = BinaryImage::Open(binary_);
+  return binary_image_;
+}
+
 bool ProfileCreator::CheckAndAssignAddr2Line(SymbolMap *symbol_map,
                                              Addr2line *addr2line) {
   if (addr2line == nullptr) {
@@ -121,7 +168,7 @@ bool ProfileCreator::CreateProfile(const std::string &input_profile_name,
                                    const std::string &output_profile_name,
                                    bool store_sym_list_in_profile,
                                    bool check_lbr_entry) {
-  SymbolMap symbol_map(binary_);
+  SymbolMap symbol_map(GetBinaryImage());
 
   writer->setSymbolMap(&symbol_map);
   if (profiler == "prefetch") {
@@ -131,6 +178,11 @@ bool ProfileCreator::CreateProfile(const std::string &input_profile_name,
     if (!ReadSample(input_profile_name, profiler)) return false;
     symbol_map.ReadLoadableExecSegmentInfo(IsKernelSample());
     if (!ComputeProfile(&symbol_map, check_lbr_entry)) return false;
+    if (!absl::GetFlag(FLAGS_startup_symbol_order).empty() &&
+        !WriteStartupSymbolOrder(symbol_map,
+                                 absl::GetFlag(FLAGS_startup_symbol_order))) {
+      return false;
+    }
   }
 
 #if defined(HAVE_LLVM)
@@ -153,11 +205,26 @@ bool ProfileCreator::CreateProfile(const std::string &input_profile_name,
   }
 #endif
 
-  return writer->WriteToFile(output_profile_name);
+  PhaseTimer writing_timer("write profile", "autofdo");
+  if (!writer->WriteToFile(output_profile_name)) return false;
+  writing_timer.StopAndRecord(stats_.phase_stats);
+  ++stats_.writer_stats.profiles_written;
+  // Aliases of a function share its `Symbol`, so count every symbol once.
+  absl::flat_hash_set<const Symbol *> written_symbols;
+  for (const auto &[name, symbol] : symbol_map.map()) {
+    if (symbol_map.ShouldEmit(symbol->total_count))
+      written_symbols.insert(symbol);
+  }
+  stats_.writer_stats.functions_written += written_symbols.size();
+  LOG(INFO) << stats_.DebugString();
+  InvokeAutoFdoTelemetryReporters(binary_, stats_);
+  return true;
 }
 
 bool ProfileCreator::ReadSample(absl::string_view input_profile_name,
                                 const std::string &profiler) {
+  PhaseTimer reading_timer(absl::StrCat("read ", input_profile_name),
+                           "autofdo");
   if (profiler == "perf" || profiler == "perf_spe") {
     std::string focus_binary_re;
     std::string build_id;
@@ -175,12 +242,12 @@ bool ProfileCreator::ReadSample(absl::string_view input_profile_name,
       focus_binary_re = std::string(".*/") + file_base_name + "$";
       free(dup_name);
 
-      ElfReader reader(binary_);
+      std::shared_ptr<BinaryImage> image = GetBinaryImage();
       // Quipper (and other parts of google3's perf infrastructure) pads build
       // ids--if present--to 40 characters hex. Match that behavior here. See
       // quipper/perf_data_utils.h and b/21597512 for more info.
       const size_t kMinPerfBuildIDStringLength = 40;
-      build_id = reader.GetBuildId();
+      if (image != nullptr) build_id = image->build_id();
       if (!build_id.empty() && build_id.length() < kMinPerfBuildIDStringLength)
         build_id.resize(kMinPerfBuildIDStringLength, '0');
     }
@@ -209,15 +276,26 @@ bool ProfileCreator::ReadSample(absl::string_view input_profile_name,
     LOG(ERROR) << "Error reading profile from " << input_profile_name;
     return false;
   }
+  stats_.sample_stats += sample_reader_->sample_stats();
+  reading_timer.StopAndRecord(stats_.phase_stats);
   return true;
 }
 bool ProfileCreator::ComputeProfile(SymbolMap *symbol_map,
                                     bool check_lbr_entry) {
-  if (!CheckAndAssignAddr2Line(symbol_map, Addr2line::Create(binary_)))
+  // Only the debug info of the sampled functions is needed.
+  const std::map<uint64_t, uint64_t> sampled_functions =
+      symbol_map->GetSampledSymbolStartAddressSizeMap(
+          sample_reader_->GetSampledAddresses());
+  PhaseTimer dwarf_loading_timer("load debug info", "autofdo");
+  if (!CheckAndAssignAddr2Line(symbol_map,
+                               Addr2line::CreateWithSampledFunctions(
+                                   GetBinaryImage(), &sampled_functions)))
     return false;
+  dwarf_loading_timer.StopAndRecord(stats_.phase_stats);
   Profile profile(sample_reader_, binary_, symbol_map->get_addr2line(),
                   symbol_map);
   profile.ComputeProfile(check_lbr_entry);
+  stats_ += profile.stats();
   return true;
 }
 
@@ -227,14 +305,14 @@ bool ProfileCreator::ConvertPrefetchHints(const std::string &profile_file,
   // data. Otherwise, passing an empty sample profile map would elide all
   // addresses in the binary file, when the Google3Addr2line implementation is
   // used.
-  if (!CheckAndAssignAddr2Line(symbol_map, Addr2line::Create(binary_)))
+  if (!CheckAndAssignAddr2Line(symbol_map, Addr2line::Create(GetBinaryImage())))
     return false;
   PrefetchHints hints = ReadPrefetchHints(profile_file);
   absl::btree_map<uint64_t, uint8_t> repeated_prefetches_indices;
   for (auto &hint : hints) {
     uint64_t pc = hint.address;
     int64_t delta = hint.delta;
-    const std::string *name = nullptr;
+    absl::string_view name;
     if (!symbol_map->GetSymbolInfoByAddr(pc, &name, nullptr, nullptr)) {
       LOG(INFO) << "Instruction address not found:" << std::hex << pc;
       continue;
@@ -244,14 +322,14 @@ bool ProfileCreator::ConvertPrefetchHints(const std::string &profile_file,
     SourceStack stack;
     symbol_map->get_addr2line()->GetInlineStack(pc, &stack);
 
-    if (!symbol_map->EnsureEntryInFuncForSymbol(*name, pc)) continue;
+    if (!symbol_map->EnsureEntryInFuncForSymbol(name, pc)) continue;
 
     // Currently, the profile format expects unsigned values, corresponding to
     // number of collected samples. We're hacking support for prefetch hints on
     // top of that, and prefetch hints are signed. For now, we'll explicitly
     // cast to unsigned.
     if (!symbol_map->AddIndirectCallTarget(
-            *name, stack,
+            name, stack,
             "__prefetch_" + hint.type + "_" + std::to_string(prefetch_index),
             static_cast<uint64_t>(delta))) {
       LOG(WARNING) << "Ignoring address " << std::hex << pc
@@ -295,6 +373,7 @@ bool MergeSample(const std::vector<std::string> &input_files,
   }
   LOG(INFO) << "Merged " << input_files.size() << " " << input_profiler
             << " files";
+  ScopedTraceEvent trace_event("autofdo", "write merged samples");
   return writer.Write(nullptr);
 }
 }  // namespace devtools_crosstool_autofdo
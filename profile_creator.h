@@ -7,10 +7,13 @@
 #define AUTOFDO_PROFILE_CREATOR_H_
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "addr2line.h"
+#include "autofdo_statistics.h"
+#include "binary_image.h"
 #include "profile_writer.h"
 #include "sample_reader.h"
 #include "symbol_map.h"
@@ -63,13 +66,24 @@ class ProfileCreator {
     return sample_reader_->IsKernelSample();
   }
 
+  // Returns the statistics of all the samples read and profiles created so
+  // far.
+  const AutoFdoStats &stats() const { return stats_; }
+
  private:
   bool ConvertPrefetchHints(const std::string &profile_file,
                             SymbolMap *symbol_map);
   bool CheckAndAssignAddr2Line(SymbolMap *symbol_map, Addr2line *addr2line);
 
+  // Returns the mapped image of binary_, mapping it on first use. The image
+  // is shared by the symbol map and addr2line so the binary is only read
+  // once per run. Returns nullptr if the binary cannot be read.
+  std::shared_ptr<BinaryImage> GetBinaryImage();
+
   SampleReader *sample_reader_;
   std::string binary_;
+  std::shared_ptr<BinaryImage> binary_image_;
+  AutoFdoStats stats_;
 };
 
 // Merges all input_files into output_file. Returns `true` when all merges have
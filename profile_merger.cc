@@ -14,10 +14,12 @@
 #include "profile_writer.h"
 #include "source_info.h"
 #include "symbol_map.h"
+#include "trace_event_recorder.h"
 #include "third_party/abseil/absl/base/macros.h"
 #include "third_party/abseil/absl/container/node_hash_set.h"
 #include "third_party/abseil/absl/flags/flag.h"
 #include "third_party/abseil/absl/memory/memory.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
 #if defined(HAVE_LLVM)
 #include "llvm/Config/llvm-config.h"
 #endif
@@ -25,6 +27,9 @@
 #include "third_party/abseil/absl/flags/usage.h"
 
 ABSL_FLAG(std::string, output_file, "fbdata.afdo", "Output file name");
+ABSL_FLAG(std::string, trace_out, "",
+          "If set, write a Chrome trace event JSON timeline of the run to this "
+          "path, viewable with chrome://tracing or Perfetto.");
 #if defined(HAVE_LLVM)
 ABSL_FLAG(bool, is_llvm, false, "Whether the profile is for LLVM");
 ABSL_FLAG(std::string, format, "binary",
@@ -145,6 +150,8 @@ bool verifyProperFlags(bool has_prof_sym_list) {
 int main(int argc, char **argv) {
   absl::SetProgramUsageMessage(argv[0]);
   std::vector<char*> positionalArguments = absl::ParseCommandLine(argc, argv);
+  devtools_crosstool_autofdo::ScopedTraceEventRecording trace_event_recording(
+      absl::GetFlag(FLAGS_trace_out));
   devtools_crosstool_autofdo::SymbolMap symbol_map;
 
   if (argc < 2) {
@@ -173,6 +180,8 @@ int main(int argc, char **argv) {
       new AutoFDOProfileReaderPtr[positionalArguments.size() - 1]);
     // TODO(dehao): merge profile reader/writer into a single class
     for (int i = 1; i < positionalArguments.size(); i++) {
+      devtools_crosstool_autofdo::ScopedTraceEvent trace_event(
+          "autofdo", absl::StrCat("read ", positionalArguments[i]));
       readers[i - 1] =
           std::make_unique<AutoFDOProfileReader>(&symbol_map, true);
       readers[i - 1]->ReadFromFile(positionalArguments[i]);
@@ -181,6 +190,8 @@ int main(int argc, char **argv) {
     symbol_map.CalculateThreshold();
     devtools_crosstool_autofdo::AutoFDOProfileWriter writer(
         &symbol_map, absl::GetFlag(FLAGS_gcov_version));
+    devtools_crosstool_autofdo::ScopedTraceEvent trace_event("autofdo",
+                                                             "write profile");
     if (!writer.WriteToFile(absl::GetFlag(FLAGS_output_file))) {
       LOG(FATAL) << "Error writing to " << absl::GetFlag(FLAGS_output_file);
     }
@@ -200,6 +211,8 @@ int main(int argc, char **argv) {
 #endif
 
     for (int i = 1; i < positionalArguments.size(); i++) {
+      devtools_crosstool_autofdo::ScopedTraceEvent trace_event(
+          "autofdo", absl::StrCat("read ", positionalArguments[i]));
       auto reader = std::make_unique<LLVMProfileReader>(
           &symbol_map, names,
           absl::GetFlag(FLAGS_merge_special_syms) ? nullptr : &special_syms);
@@ -305,6 +318,8 @@ int main(int argc, char **argv) {
     }
 
     writer->setSymbolMap(&symbol_map);
+    devtools_crosstool_autofdo::ScopedTraceEvent trace_event("autofdo",
+                                                             "write profile");
     if (!writer->WriteToFile(absl::GetFlag(FLAGS_output_file))) {
       LOG(FATAL) << "Error writing to " << absl::GetFlag(FLAGS_output_file);
     }
@@ -8,6 +8,7 @@
 
 #include "base/commandlineflags.h"
 #include "profile_creator.h"
+#include "trace_event_recorder.h"
 #include "third_party/abseil/absl/flags/flag.h"
 #include "third_party/abseil/absl/flags/parse.h"
 #include "third_party/abseil/absl/flags/usage.h"
@@ -21,10 +22,15 @@ ABSL_FLAG(
 ABSL_FLAG(std::string, profiler, "perf", "Profile type");
 ABSL_FLAG(std::string, output_file, "data.txt", "Merged profile file name");
 ABSL_FLAG(std::string, binary, "data.binary", "Binary file name");
+ABSL_FLAG(std::string, trace_out, "",
+          "If set, write a Chrome trace event JSON timeline of the run to this "
+          "path, viewable with chrome://tracing or Perfetto.");
 
 int main(int argc, char **argv) {
   absl::SetProgramUsageMessage(argv[0]);
   absl::ParseCommandLine(argc, argv);
+  devtools_crosstool_autofdo::ScopedTraceEventRecording trace_event_recording(
+      absl::GetFlag(FLAGS_trace_out));
 
   std::vector<std::string> profiles = absl::GetFlag(FLAGS_profiles);
   if (profiles.empty()) {
@@ -7,6 +7,7 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
@@ -104,14 +105,14 @@ void PerfDataSampleReader::GetFileNameFromBuildID(
 
 std::set<uint64_t> SampleReader::GetSampledAddresses() const {
   std::set<uint64_t> addrs;
-  if (!range_count_map_.empty()) {
-    for (const auto &[range, count] : range_count_map_) {
-      addrs.insert(range.first);
-    }
-  } else {
-    for (const auto &[addr, count] : address_count_map_) {
-      addrs.insert(addr);
-    }
+  for (const auto &[range, count] : range_count_map_) {
+    addrs.insert(range.first);
+  }
+  for (const auto &[branch, count] : branch_count_map_) {
+    addrs.insert(branch.first);
+  }
+  for (const auto &[addr, count] : address_count_map_) {
+    addrs.insert(addr);
   }
   return addrs;
 }
@@ -272,6 +273,7 @@ bool PerfDataSampleReader::Append(const std::string &profile_file) {
   if (!reader.ReadFile(profile_file) || !parser.ParseRawEvents()) {
     return false;
   }
+  ++sample_stats_.perf_files_read;
 
   // If we can find build_id from binary, and the exact build_id was found
   // in the profile, then we use focus_bins to match samples. Otherwise,
@@ -283,6 +285,7 @@ bool PerfDataSampleReader::Append(const std::string &profile_file) {
       // That could happen when e.g. perf.data is a system-wide profile,
       // and the binary of interest was not running when the profile
       // was collected.
+      ++sample_stats_.perf_files_without_binary;
       return true;
     }
   } else {
@@ -294,11 +297,18 @@ bool PerfDataSampleReader::Append(const std::string &profile_file) {
         event.event_ptr->header().type() != quipper::PERF_RECORD_SAMPLE) {
       continue;
     }
+    ++sample_stats_.samples_read;
     if (MatchBinary(event.dso_and_offset)) {
       address_count_map_[event.dso_and_offset.offset()]++;
       uint64_t address = event.dso_and_offset.offset();
       uint64_t timestamp = event.event_ptr->timestamp();
-      address_timestamp_map_.insert({address, timestamp});
+      // Keep the earliest sample of every address, whichever order the
+      // samples are read in.
+      auto [it, inserted] =
+          address_timestamp_map_.insert({address, timestamp});
+      if (!inserted) it->second = std::min(it->second, timestamp);
+    } else {
+      ++sample_stats_.samples_not_matching_binary;
     }
     int start_index = 0;
     while (start_index < event.branch_stack.size() &&
@@ -317,7 +327,9 @@ bool PerfDataSampleReader::Append(const std::string &profile_file) {
         continue;
       }
 
+      ++sample_stats_.lbr_entries_read;
       if (!MatchBinary(event.branch_stack[i].to)) {
+        ++sample_stats_.lbr_entries_not_matching_binary;
         continue;
       }
 
@@ -337,6 +349,7 @@ bool PerfDataSampleReader::Append(const std::string &profile_file) {
                event.branch_stack[0].to.offset() >
            absl::GetFlag(FLAGS_strip_dup_backedge_stride_limit))) {
         LOG(WARNING) << "Bogus LBR data (duplicated top entry)";
+        ++sample_stats_.bogus_lbr_duplicated_top_entries;
         continue;
       }
       uint64_t begin = event.branch_stack[i].to.offset();
@@ -347,6 +360,11 @@ bool PerfDataSampleReader::Append(const std::string &profile_file) {
             (end < begin ? "(range is negative)" : "(range is too large)");
         LOG(WARNING) << "Bogus LBR data " << reason << ": " << std::hex << begin
                      << "->" << end << " index=" << i;
+        if (end < begin) {
+          ++sample_stats_.bogus_lbr_negative_ranges;
+        } else {
+          ++sample_stats_.bogus_lbr_too_large_ranges;
+        }
         continue;
       }
       range_count_map_[Range(begin, end)]++;
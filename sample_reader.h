@@ -13,6 +13,7 @@
 #include <string>
 #include <utility>
 
+#include "autofdo_statistics.h"
 #include "base/integral_types.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/strings/string_view.h"
@@ -57,6 +58,8 @@ class SampleReader {
     return address_timestamp_map_;
   }
 
+  // Returns the addresses of all samples: sampled instructions, range begins
+  // and branch sources.
   std::set<uint64_t> GetSampledAddresses() const;
 
   // Returns the sample count for a given instruction.
@@ -74,6 +77,11 @@ class SampleReader {
   // Returns true if the sample is from Linux kernel.
   bool IsKernelSample() const { return is_kernel_; }
 
+  // Returns the statistics of all the samples read so far.
+  const AutoFdoStats::SampleStats &sample_stats() const {
+    return sample_stats_;
+  }
+
  protected:
   // Virtual read function to read from different types of profiles.
   virtual bool Read() = 0;
@@ -83,6 +91,7 @@ class SampleReader {
   RangeCountMap range_count_map_;
   BranchCountMap branch_count_map_;
   AddressTimestampMap address_timestamp_map_;
+  AutoFdoStats::SampleStats sample_stats_;
 
   bool is_kernel_ = false;
 };
@@ -62,6 +62,28 @@ TEST_F(SampleReaderTest, ReadLBR) {
   EXPECT_EQ(reader.GetTotalCount(), 5383657);
 }
 
+TEST_F(SampleReaderTest, ReadLBRStats) {
+  devtools_crosstool_autofdo::PerfDataSampleReader reader(
+      ::testing::SrcDir() + kTestDataDir + "test.lbr", "test.binary", "");
+  ASSERT_TRUE(reader.ReadAndSetTotalCount());
+
+  const devtools_crosstool_autofdo::AutoFdoStats::SampleStats &stats =
+      reader.sample_stats();
+  EXPECT_EQ(stats.perf_files_read, 1);
+  EXPECT_EQ(stats.perf_files_without_binary, 0);
+  EXPECT_GT(stats.samples_read, 0);
+  EXPECT_LE(stats.samples_not_matching_binary, stats.samples_read);
+  EXPECT_GT(stats.lbr_entries_read, 0);
+  EXPECT_LE(stats.lbr_entries_not_matching_binary, stats.lbr_entries_read);
+}
+
+TEST_F(SampleReaderTest, ReadLBRWithDupEntriesStats) {
+  devtools_crosstool_autofdo::PerfDataSampleReader reader(
+      ::testing::SrcDir() + kTestDataDir + "dup.lbr", "dup.binary", "");
+  ASSERT_TRUE(reader.ReadAndSetTotalCount());
+  EXPECT_GT(reader.sample_stats().bogus_lbr_duplicated_top_entries, 0);
+}
+
 TEST_F(SampleReaderTest, ReadText) {
   devtools_crosstool_autofdo::PerfDataSampleReader lbr_reader(
       ::testing::SrcDir() + kTestDataDir + "test.lbr", "test.binary", "");
@@ -36,15 +36,19 @@ struct SourceInfo {
   }
 
   uint64_t Offset(bool use_discriminator_encoding) const {
+    return UseBaseDiscriminator(use_discriminator_encoding)
+               ? Offset</*kUseBaseDiscriminator=*/true>()
+               : Offset</*kUseBaseDiscriminator=*/false>();
+  }
+
+  // Same as Offset(bool), with the discriminator mode already resolved by
+  // UseBaseDiscriminator(). Used by hot loops that resolve the mode once.
+  template <bool kUseBaseDiscriminator>
+  uint64_t Offset() const {
 #if defined(HAVE_LLVM)
-    bool use_base_discriminator;
-    if (use_fs_discriminator)
-      use_base_discriminator = use_base_only_in_fs_discriminator;
-    else
-      use_base_discriminator = use_discriminator_encoding;
     return GenerateOffset(
         line - start_line,
-        (use_base_discriminator
+        (kUseBaseDiscriminator
              ? llvm::DILocation::getBaseDiscriminatorFromDiscriminator(
                    discriminator)
              : discriminator));
@@ -53,6 +57,17 @@ struct SourceInfo {
 #endif
   }
 
+  // Returns true if Offset(use_discriminator_encoding) only keeps the base
+  // discriminator, taking the FS-discriminator mode into account.
+  static bool UseBaseDiscriminator(bool use_discriminator_encoding) {
+#if defined(HAVE_LLVM)
+    if (use_fs_discriminator) return use_base_only_in_fs_discriminator;
+    return use_discriminator_encoding;
+#else
+    return false;
+#endif
+  }
+
   uint32_t DuplicationFactor() const {
 #if defined(HAVE_LLVM)
     if (use_fs_discriminator) return 1;
@@ -15,16 +15,22 @@
 #include <limits>
 #include <map>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <set>
 #include <string>
+#include <thread>  // NOLINT
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "base/logging.h"
 #include "base/macros.h"
 #include "addr2line.h"
+#include "binary_image.h"
 #include "source_info.h"
+#include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/container/btree_map.h"
 #include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/container/flat_hash_set.h"
@@ -32,10 +38,12 @@
 #include "third_party/abseil/absl/debugging/internal/demangle.h"
 #include "third_party/abseil/absl/flags/flag.h"
 #include "third_party/abseil/absl/memory/memory.h"
+#include "third_party/abseil/absl/strings/ascii.h"
 #include "third_party/abseil/absl/strings/match.h"
 #include "third_party/abseil/absl/strings/str_format.h"
 #include "third_party/abseil/absl/strings/str_split.h"
 #include "third_party/abseil/absl/strings/string_view.h"
+#include "third_party/abseil/absl/types/span.h"
 #include "util/symbolize/elf_reader.h"
 
 #if defined(HAVE_LLVM)
@@ -89,6 +97,18 @@ void PrintSourceLocation(uint32_t start_line, uint64_t offset, int indent) {
 static const char *selectedSuffixes[] =
   {".cold", ".llvm.", ".lto_priv", ".__part.", ".isra"};
 
+// Returns true if `name` ends with ".__part.<digits>", the suffix of
+// function parts split by the compiler.
+bool HasPartSuffix(absl::string_view name) {
+  size_t num_digits = 0;
+  while (num_digits < name.size() &&
+         absl::ascii_isdigit(name[name.size() - num_digits - 1])) {
+    ++num_digits;
+  }
+  return num_digits > 0 &&
+         absl::EndsWith(name.substr(0, name.size() - num_digits), ".__part.");
+}
+
 std::string getPrintName(const char *name) {
   char tmp_buf[1024];
   if (!absl::GetFlag(FLAGS_demangle_symbol_names)) return name;
@@ -101,6 +121,28 @@ std::string getPrintName(const char *name) {
 }  // namespace
 
 namespace devtools_crosstool_autofdo {
+SymbolMap::SymbolMap(absl::string_view binary)
+    : SymbolMap(binary.empty() ? nullptr : BinaryImage::Open(binary)) {}
+
+SymbolMap::SymbolMap(std::shared_ptr<BinaryImage> image)
+    : binary_(image ? image->path() : ""),
+      image_(std::move(image)),
+      count_threshold_(0),
+      ignore_thresholds_(false),
+      suffix_elision_policy_(ElideAll) {
+  initSuffixElisionPolicy();
+  if (image_) {
+    BuildSymbolMap();
+    BuildNameAddressMap();
+  }
+}
+
+SymbolMap::SymbolMap() : count_threshold_(0), suffix_elision_policy_(ElideAll) {
+  initSuffixElisionPolicy();
+}
+
+SymbolMap::~SymbolMap() = default;
+
 ProfileInfo &ProfileInfo::operator+=(const ProfileInfo &s) {
   count += s.count;
   num_inst += s.num_inst;
@@ -142,6 +184,11 @@ Symbol::~Symbol() {
 void Symbol::Merge(const Symbol *other) {
   total_count += other->total_count;
   head_count += other->head_count;
+  // Keep the earliest first-execution timestamp.
+  if (other->timestamp != 0 &&
+      (timestamp == 0 || other->timestamp < timestamp)) {
+    timestamp = other->timestamp;
+  }
   if (info.file_name.empty()) {
     info.file_name = other->info.file_name;
     info.dir_name = other->info.dir_name;
@@ -390,24 +437,34 @@ void SymbolMap::CalculateThreshold() {
   }
 }
 
+const AddressSymbol *SymbolMap::FindSymbolStartingAtOrBefore(
+    uint64_t addr) const {
+  auto it = absl::c_upper_bound(
+      address_symbol_map_, addr,
+      [](uint64_t addr, const AddressSymbol &symbol) {
+        return addr < symbol.address;
+      });
+  if (it == address_symbol_map_.begin()) return nullptr;
+  return &*std::prev(it);
+}
+
 const bool SymbolMap::GetSymbolInfoByAddr(uint64_t addr,
-                                          const std::string **name,
+                                          absl::string_view *name,
                                           uint64_t *start_addr,
                                           uint64_t *end_addr) const {
-  AddressSymbolMap::const_iterator ret = address_symbol_map_.upper_bound(addr);
-  if (ret == address_symbol_map_.begin()) {
+  const AddressSymbol *symbol = FindSymbolStartingAtOrBefore(addr);
+  if (symbol == nullptr) {
     return false;
   }
-  ret--;
-  if (addr >= ret->first && addr < ret->first + ret->second.second) {
+  if (addr >= symbol->address && addr < symbol->address + symbol->size) {
     if (name) {
-      *name = &ret->second.first;
+      *name = symbol->name;
     }
     if (start_addr) {
-      *start_addr = ret->first;
+      *start_addr = symbol->address;
     }
     if (end_addr) {
-      *end_addr = ret->first + ret->second.second;
+      *end_addr = symbol->address + symbol->size;
     }
     return true;
   } else {
@@ -415,51 +472,22 @@ const bool SymbolMap::GetSymbolInfoByAddr(uint64_t addr,
   }
 }
 
-const std::string *SymbolMap::GetSymbolNameByStartAddr(uint64_t addr) const {
-  AddressSymbolMap::const_iterator ret = address_symbol_map_.find(addr);
-  if (ret == address_symbol_map_.end()) {
-    return nullptr;
+std::optional<absl::string_view> SymbolMap::GetSymbolNameByStartAddr(
+    uint64_t addr) const {
+  const AddressSymbol *symbol = FindSymbolStartingAtOrBefore(addr);
+  if (symbol == nullptr || symbol->address != addr) {
+    return std::nullopt;
   }
-  return &ret->second.first;
+  return symbol->name;
 }
 
-class SymbolReader : public ElfReader::SymbolSink {
- public:
-  explicit SymbolReader(NameAliasMap *name_alias_map,
-                        AddressSymbolMap *address_symbol_map)
-      : name_alias_map_(name_alias_map),
-        address_symbol_map_(address_symbol_map) {}
-
-  // This type is neither copyable nor movable.
-  SymbolReader(const SymbolReader &) = delete;
-  SymbolReader &operator=(const SymbolReader &) = delete;
-  void AddSymbol(const char *name, uint64_t address, uint64_t size, int binding,
-                 int type, int section) override {
-    if (strcmp(name, SymbolMap::get_fs_discriminator_symbol()) == 0)
-      use_fs_discriminaor_ = true;
-    std::pair<AddressSymbolMap::iterator, bool> ret =
-        address_symbol_map_->insert(
-            std::make_pair(address, std::make_pair(std::string(name), size)));
-    if (!ret.second) {
-      (*name_alias_map_)[ret.first->second.first].insert(name);
-    }
-  }
-  ~SymbolReader() override = default;
-  bool use_fs_discriminaor() const { return use_fs_discriminaor_; }
-
- private:
-  NameAliasMap *name_alias_map_;
-  AddressSymbolMap *address_symbol_map_;
-  bool use_fs_discriminaor_ = false;
-};
-
 void SymbolMap::ReadLoadableExecSegmentInfo(bool is_kernel) {
-  ElfReader elf_reader(binary_);
+  if (!image_) return;
   if (is_kernel) {
     LOG(INFO) << "Binary=" << binary_ << " is considered as a kernel image";
   }
   std::vector<ElfReader::SegmentInfo> si_vec =
-      elf_reader.GetSegmentInfo();
+      image_->elf_reader().GetSegmentInfo();
 
   // Get the executable segments from the SegmentInfo vector "si_vec" for
   // offset.
@@ -481,25 +509,51 @@ void SymbolMap::ReadLoadableExecSegmentInfo(bool is_kernel) {
 }
 
 void SymbolMap::BuildSymbolMap() {
-  ElfReader elf_reader(binary_);
 #if defined(HAVE_LLVM)
   SourceInfo::use_fs_discriminator = false;
   SourceInfo::use_base_only_in_fs_discriminator = false;
 #endif
-  SymbolReader symbol_reader(&name_alias_map_, &address_symbol_map_);
-  symbol_reader.filter = [](const char *name, uint64_t address, uint64_t size,
-                            int binding, int type, int section) {
-    if (strcmp(name, get_fs_discriminator_symbol()) == 0) return true;
-
-    static const std::regex kSuffixRe(R"(\.__part\.\d+$)");
-    return (size != 0 &&
-            (type == STT_FUNC || absl::EndsWith(name, ".cold") || std::regex_search(name, kSuffixRe)) &&
-            strcmp(name + strlen(name) - 4, "@plt") != 0);
-  };
-  elf_reader.VisitSymbols(&symbol_reader);
+  std::vector<ElfReader::SymbolInfo> symbols = image_->elf_reader().ReadSymbols(
+      [](const char *name, uint64_t address, uint64_t size, int binding,
+         int type, int section) {
+        if (strcmp(name, get_fs_discriminator_symbol()) == 0) return true;
+        absl::string_view name_view(name);
+        return (size != 0 &&
+                (type == STT_FUNC || absl::EndsWith(name_view, ".cold") ||
+                 HasPartSuffix(name_view)) &&
+                !absl::EndsWith(name_view, "@plt"));
+      },
+      std::thread::hardware_concurrency());
+
+  bool use_fs_discriminator = false;
+  address_symbol_map_.reserve(symbols.size());
+  for (const ElfReader::SymbolInfo &symbol : symbols) {
+    absl::string_view name(symbol.name);
+    if (name == get_fs_discriminator_symbol()) use_fs_discriminator = true;
+    address_symbol_map_.push_back(
+        {.address = symbol.address, .name = name, .size = symbol.size});
+  }
+  // Symbols are visited in symbol table order: the first symbol seen at an
+  // address is the primary one and the following ones are its aliases.
+  absl::c_stable_sort(address_symbol_map_,
+                      [](const AddressSymbol &a, const AddressSymbol &b) {
+                        return a.address < b.address;
+                      });
+  auto primary = address_symbol_map_.begin();
+  for (auto it = address_symbol_map_.begin(); it != address_symbol_map_.end();
+       ++it) {
+    if (it != primary && it->address == primary->address) {
+      name_alias_map_[primary->name].insert(std::string(it->name));
+      continue;
+    }
+    if (it != address_symbol_map_.begin()) ++primary;
+    *primary = *it;
+  }
+  if (!address_symbol_map_.empty())
+    address_symbol_map_.erase(std::next(primary), address_symbol_map_.end());
+
 #if defined(HAVE_LLVM)
-  if (symbol_reader.use_fs_discriminaor() ||
-      absl::GetFlag(FLAGS_use_fs_discriminator))
+  if (use_fs_discriminator || absl::GetFlag(FLAGS_use_fs_discriminator))
     SourceInfo::use_fs_discriminator = true;
   if (absl::GetFlag(FLAGS_use_base_only_in_fs_discriminator))
     SourceInfo::use_base_only_in_fs_discriminator = true;
@@ -518,13 +572,31 @@ void SymbolMap::AddSymbolTimestamp(absl::string_view symbol_name, uint64_t times
   symbol->timestamp = timestamp;
 }
 
-Symbol *SymbolMap::TraverseInlineStack(absl::string_view symbol_name,
-                                       const SourceStack &src, uint64_t count,
-                                       DataSource data_source) {
-  if (src.empty()) return nullptr;
-  bool use_discriminator_encoding =
-      absl::GetFlag(FLAGS_use_discriminator_encoding);
-  Symbol *symbol = map_.find(symbol_name)->second;
+namespace {
+// Invokes `fn` with the discriminator mode and the data source kind as
+// std::integral_constant<bool> arguments, so that `fn` can instantiate code
+// specialized on both.
+template <typename Fn>
+auto DispatchSourceMode(bool use_base_discriminator, bool need_conversion,
+                        Fn fn) {
+  if (use_base_discriminator) {
+    if (need_conversion) return fn(std::true_type(), std::true_type());
+    return fn(std::true_type(), std::false_type());
+  }
+  if (need_conversion) return fn(std::false_type(), std::true_type());
+  return fn(std::false_type(), std::false_type());
+}
+
+bool NeedConversion(SymbolMap::DataSource data_source) {
+  return data_source == SymbolMap::PERFDATA ||
+         data_source == SymbolMap::AFDOPROTO;
+}
+}  // namespace
+
+template <bool kUseBaseDiscriminator, bool kNeedConversion>
+Symbol *SymbolMap::TraverseInlineStackImpl(Symbol *symbol,
+                                           const SourceStack &src,
+                                           uint64_t count) {
   symbol->total_count += count;
   const SourceInfo &info = src[src.size() - 1];
   if (symbol->info.file_name.empty() && !info.file_name.empty()) {
@@ -532,12 +604,10 @@ Symbol *SymbolMap::TraverseInlineStack(absl::string_view symbol_name,
     symbol->info.dir_name = info.dir_name;
   }
   for (int i = src.size() - 1; i > 0; i--) {
-    if ((data_source == PERFDATA || data_source == AFDOPROTO) &&
-        src[i].HasInvalidInfo())
-      break;
+    if (kNeedConversion && src[i].HasInvalidInfo()) break;
     std::pair<CallsiteMap::iterator, bool> ret =
         symbol->callsites.insert(CallsiteMap::value_type(
-            Callsite{.location = src[i].Offset(use_discriminator_encoding),
+            Callsite{.location = src[i].Offset<kUseBaseDiscriminator>(),
                      .callee_name = src[i - 1].func_name},
             nullptr));
     if (ret.second) {
@@ -551,31 +621,77 @@ Symbol *SymbolMap::TraverseInlineStack(absl::string_view symbol_name,
   return symbol;
 }
 
+template <bool kUseBaseDiscriminator, bool kNeedConversion>
+void SymbolMap::AddSourceCountsImpl(Symbol *symbol,
+                                    absl::Span<const SourceCount> source_counts,
+                                    bool use_multiply_factor) {
+  for (const SourceCount &source_count : source_counts) {
+    const SourceStack &src = *source_count.source;
+    if (src.empty()) continue;
+    uint64_t count = source_count.count;
+    if (source_count.duplication != 1 && use_multiply_factor)
+      count *= source_count.duplication;
+    Symbol *leaf =
+        TraverseInlineStackImpl<kUseBaseDiscriminator, kNeedConversion>(
+            symbol, src, count);
+    if (kNeedConversion && src[0].HasInvalidInfo()) continue;
+    ProfileInfo &profile_info =
+        leaf->pos_counts[src[0].Offset<kUseBaseDiscriminator>()];
+    // If it is to convert perf data or afdoproto to afdo profile, select the
+    // MAX count if there are multiple records mapping to the same offset.
+    // If it is just to read afdo profile, merge those counts.
+    if (kNeedConversion) {
+      if (count > profile_info.count) profile_info.count = count;
+    } else {
+      profile_info.count += count;
+    }
+    profile_info.num_inst += source_count.num_inst;
+  }
+}
+
+Symbol *SymbolMap::TraverseInlineStack(absl::string_view symbol_name,
+                                       const SourceStack &src, uint64_t count,
+                                       DataSource data_source) {
+  if (src.empty()) return nullptr;
+  Symbol *symbol = map_.find(symbol_name)->second;
+  return DispatchSourceMode(
+      SourceInfo::UseBaseDiscriminator(
+          absl::GetFlag(FLAGS_use_discriminator_encoding)),
+      NeedConversion(data_source), [&](auto use_base, auto need_conversion) {
+        return TraverseInlineStackImpl<decltype(use_base)::value,
+                                       decltype(need_conversion)::value>(
+            symbol, src, count);
+      });
+}
+
 void SymbolMap::AddSourceCount(absl::string_view symbol_name,
                                const SourceStack &src, uint64_t count,
                                uint64_t num_inst, uint32_t duplication,
                                DataSource data_source) {
-  bool use_discriminator_encoding =
-      absl::GetFlag(FLAGS_use_discriminator_encoding);
-  if (duplication != 1 &&
-      absl::GetFlag(FLAGS_use_discriminator_multiply_factor))
-    count *= duplication;
-  Symbol *symbol = TraverseInlineStack(symbol_name, src, count, data_source);
-  if (!symbol) return;
-  bool need_conversion = (data_source == PERFDATA || data_source == AFDOPROTO);
-  if (need_conversion && src[0].HasInvalidInfo()) return;
-  uint64_t offset = src[0].Offset(use_discriminator_encoding);
-  // If it is to convert perf data or afdoproto to afdo profile, select the
-  // MAX count if there are multiple records mapping to the same offset.
-  // If it is just to read afdo profile, merge those counts.
-  if (need_conversion) {
-    if (count > symbol->pos_counts[offset].count) {
-      symbol->pos_counts[offset].count = count;
-    }
-  } else {
-    symbol->pos_counts[offset].count += count;
-  }
-  symbol->pos_counts[offset].num_inst += num_inst;
+  if (src.empty()) return;
+  const SourceCount source_count = {.source = &src,
+                                    .count = count,
+                                    .num_inst = num_inst,
+                                    .duplication = duplication};
+  AddSourceCounts(map_.find(symbol_name)->second, {&source_count, 1},
+                  data_source);
+}
+
+void SymbolMap::AddSourceCounts(Symbol *symbol,
+                                absl::Span<const SourceCount> source_counts,
+                                DataSource data_source) {
+  if (source_counts.empty()) return;
+  DCHECK(symbol != nullptr);
+  const bool use_multiply_factor =
+      absl::GetFlag(FLAGS_use_discriminator_multiply_factor);
+  DispatchSourceMode(
+      SourceInfo::UseBaseDiscriminator(
+          absl::GetFlag(FLAGS_use_discriminator_encoding)),
+      NeedConversion(data_source), [&](auto use_base, auto need_conversion) {
+        AddSourceCountsImpl<decltype(use_base)::value,
+                            decltype(need_conversion)::value>(
+            symbol, source_counts, use_multiply_factor);
+      });
 }
 
 bool SymbolMap::AddIndirectCallTarget(absl::string_view symbol_name,
@@ -1157,23 +1273,21 @@ std::map<uint64_t, uint64_t> SymbolMap::GetSampledSymbolStartAddressSizeMap(
       continue;
     }
 
-    AddressSymbolMap::const_iterator iter =
-        address_symbol_map_.upper_bound(adjusted_addr);
-    if (iter == address_symbol_map_.begin()) {
+    const AddressSymbol *symbol = FindSymbolStartingAtOrBefore(adjusted_addr);
+    if (symbol == nullptr) {
       continue;
     }
-    iter--;
-    ret.insert(std::make_pair(iter->first, iter->second.second));
-    next_start_addr = iter->first + iter->second.second;
+    ret.insert(std::make_pair(symbol->address, symbol->size));
+    next_start_addr = symbol->address + symbol->size;
   }
-  for (const auto &addr_symbol : address_symbol_map_) {
-    if (ret.find(addr_symbol.first) != ret.end()) {
+  for (const AddressSymbol &symbol : address_symbol_map_) {
+    if (ret.find(symbol.address) != ret.end()) {
       continue;
     }
-    const auto &iter = map_.find(addr_symbol.second.first);
+    const auto &iter = map_.find(symbol.name);
     if (iter != map_.end() && iter->second != nullptr &&
         iter->second->total_count > 0) {
-      ret[addr_symbol.first] = addr_symbol.second.second;
+      ret[symbol.address] = symbol.size;
     }
   }
   return ret;
@@ -1484,14 +1598,60 @@ void SymbolMap::RemoveSymsMatchingRegex(absl::string_view regex) {
   }
 }
 
+SymbolMap::StartupSymbolOrder SymbolMap::ComputeStartupSymbolOrder(
+    uint64_t startup_window_ns) const {
+  // Group the names of every sampled function by their (shared) symbol.
+  std::vector<const Symbol *> symbols;
+  absl::flat_hash_map<const Symbol *, std::vector<std::string>> names;
+  for (const auto &[name, symbol] : map_) {
+    if (symbol == nullptr) continue;
+    if (symbol->total_count == 0 && symbol->timestamp == 0) continue;
+    auto [it, inserted] = names.try_emplace(symbol);
+    if (inserted) symbols.push_back(symbol);
+    it->second.push_back(name);
+  }
+
+  uint64_t start_timestamp = std::numeric_limits<uint64_t>::max();
+  for (const Symbol *symbol : symbols) {
+    if (symbol->timestamp != 0)
+      start_timestamp = std::min(start_timestamp, symbol->timestamp);
+  }
+  auto is_startup = [&](const Symbol *symbol) {
+    return symbol->timestamp != 0 &&
+           symbol->timestamp - start_timestamp <= startup_window_ns;
+  };
+
+  std::vector<const Symbol *> startup_symbols, steady_state_symbols;
+  for (const Symbol *symbol : symbols) {
+    (is_startup(symbol) ? startup_symbols : steady_state_symbols)
+        .push_back(symbol);
+  }
+  // Ties are broken by name so the order is deterministic.
+  absl::c_sort(startup_symbols, [&](const Symbol *a, const Symbol *b) {
+    return std::forward_as_tuple(a->timestamp, names.at(a).front()) <
+           std::forward_as_tuple(b->timestamp, names.at(b).front());
+  });
+  absl::c_sort(steady_state_symbols, [&](const Symbol *a, const Symbol *b) {
+    return std::forward_as_tuple(b->total_count, names.at(a).front()) <
+           std::forward_as_tuple(a->total_count, names.at(b).front());
+  });
+
+  StartupSymbolOrder order;
+  for (const Symbol *symbol : startup_symbols)
+    absl::c_move(names.at(symbol), std::back_inserter(order.startup));
+  for (const Symbol *symbol : steady_state_symbols)
+    absl::c_move(names.at(symbol), std::back_inserter(order.steady_state));
+  return order;
+}
+
 #if defined(HAVE_LLVM)
 NameSizeList SymbolMap::collectNamesForProfSymList() {
   llvm::StringSet<> names_in_profile = collectNamesInProfile();
   NameSizeList name_size_list;
-  for (const auto &addr_symbol : address_symbol_map_) {
-    llvm::StringRef str = addr_symbol.second.first;
+  for (const AddressSymbol &symbol : address_symbol_map_) {
+    llvm::StringRef str(symbol.name.data(), symbol.name.size());
     if (names_in_profile.count(str)) continue;
-    name_size_list.emplace_back(str, addr_symbol.second.second);
+    name_size_list.emplace_back(str, symbol.size);
   }
   return name_size_list;
 }
@@ -10,6 +10,7 @@
 #include <limits>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <string>
 #include <utility>
@@ -18,13 +19,16 @@
 #include "base/macros.h"
 #include "base/logging.h"
 #include "addr2line.h"
+#include "binary_image.h"
 #include "source_info.h"
 #include "third_party/abseil/absl/algorithm/container.h"
 #include "third_party/abseil/absl/container/btree_map.h"
+#include "third_party/abseil/absl/container/flat_hash_map.h"
 #include "third_party/abseil/absl/container/flat_hash_set.h"
 #include "third_party/abseil/absl/container/node_hash_map.h"
 #include "third_party/abseil/absl/flags/declare.h"
 #include "third_party/abseil/absl/strings/string_view.h"
+#include "third_party/abseil/absl/types/span.h"
 
 #if defined(HAVE_LLVM)
 #include "llvm/ADT/StringSet.h"
@@ -164,7 +168,8 @@ class Symbol {
         total_count_incl(src->total_count_incl),
         head_count(src->head_count),
         callsites(0),
-        pos_counts() {
+        pos_counts(),
+        timestamp(src->timestamp) {
     info.func_name = new_func_name;
   }
 
@@ -173,7 +178,8 @@ class Symbol {
         total_count_incl(0),
         head_count(0),
         callsites(0),
-        pos_counts() {}
+        pos_counts(),
+        timestamp(0) {}
 
   ~Symbol();
 
@@ -250,10 +256,17 @@ class Symbol {
 
 // Vector of unique pointers to symbols.
 typedef std::vector<std::unique_ptr<Symbol>> SymbolUniquePtrVector;
-// Maps symbol's start address to its name and size.
-typedef std::map<uint64_t, std::pair<std::string, uint64_t>> AddressSymbolMap;
+// A function symbol read from the binary's symbol table. The name points into
+// the binary's mmapped string table, which is owned by the SymbolMap.
+struct AddressSymbol {
+  uint64_t address;
+  absl::string_view name;
+  uint64_t size;
+};
+// Function symbols sorted by (unique) start address.
+typedef std::vector<AddressSymbol> AddressSymbolMap;
 // Maps from symbol's name to its start address.
-typedef std::map<std::string, uint64_t> NameAddressMap;
+typedef absl::flat_hash_map<absl::string_view, uint64_t> NameAddressMap;
 // Maps function name to alias names.
 typedef absl::node_hash_map<std::string, absl::flat_hash_set<std::string>>
     NameAliasMap;
@@ -266,26 +279,20 @@ using NameSizeList = std::vector<std::pair<llvm::StringRef, uint64_t>>;
 // a map from symbol name to its related information.
 class SymbolMap {
  public:
-  explicit SymbolMap(absl::string_view binary)
-      : binary_(binary),
-        count_threshold_(0),
-        ignore_thresholds_(false),
-        suffix_elision_policy_(ElideAll) {
-    initSuffixElisionPolicy();
-    if (!binary.empty()) {
-      BuildSymbolMap();
-      BuildNameAddressMap();
-    }
-  }
+  explicit SymbolMap(absl::string_view binary);
 
-  SymbolMap() : count_threshold_(0), suffix_elision_policy_(ElideAll) {
-    initSuffixElisionPolicy();
-  }
+  // Reads the symbols from an image that is already mapped, which the symbol
+  // map keeps alive. An empty image yields an empty symbol map.
+  explicit SymbolMap(std::shared_ptr<BinaryImage> image);
+
+  SymbolMap();
 
   // This type is neither copyable nor movable.
   SymbolMap(const SymbolMap &) = delete;
   SymbolMap &operator=(const SymbolMap &) = delete;
 
+  ~SymbolMap();
+
   static bool IsLLVMCompiler(absl::string_view path);
 
   // Return the fs_discriminator flag variable name.
@@ -410,6 +417,12 @@ class SymbolMap {
     }
   }
 
+  // Same as GetSymbolByName, but returns a mutable symbol.
+  Symbol *GetMutableSymbolByName(absl::string_view name) {
+    NameSymbolMap::iterator ret = map_.find(name);
+    return ret != map_.end() ? ret->second : nullptr;
+  }
+
   // Trims suffix from name, returning trimmed name (according to
   // current suffix elision policy).
   std::string GetOriginalName(absl::string_view name) const;
@@ -446,6 +459,23 @@ class SymbolMap {
                       uint32_t duplication = 1,
                       DataSource data_source = AFDOPROFILE);
 
+  // A sampled source stack of one function, as consumed by AddSourceCounts.
+  // Fields have the same meaning as the AddSourceCount arguments.
+  struct SourceCount {
+    const SourceStack *source;
+    uint64_t count;
+    uint64_t num_inst = 0;
+    uint32_t duplication = 1;
+  };
+
+  // Batched version of AddSourceCount for the outline symbol `symbol`, which
+  // is typically obtained once per function with GetMutableSymbolByName.
+  // Flags and `data_source` are resolved once for the whole batch, so this is
+  // the preferred entry point when adding the samples of a whole function.
+  void AddSourceCounts(Symbol *symbol,
+                       absl::Span<const SourceCount> source_counts,
+                       DataSource data_source = AFDOPROFILE);
+
   // Generates hybrid profiles by flattening callsites whose total counts are
   // below the threshold, recursively. This is a fine-grained flattening
   // algorithm that allows inline calls close to the top-level function to
@@ -503,13 +533,14 @@ class SymbolMap {
 
   // Updates function name, start_addr, end_addr of a function that has a
   // given address. Returns false if no such symbol exists.
-  const bool GetSymbolInfoByAddr(uint64_t addr, const std::string **name,
+  const bool GetSymbolInfoByAddr(uint64_t addr, absl::string_view *name,
                                  uint64_t *start_addr,
                                  uint64_t *end_addr) const;
 
-  // Returns a pointer to the symbol name for a given start address. Returns
-  // nullptr if no such symbol exists.
-  const std::string *GetSymbolNameByStartAddr(uint64_t address) const;
+  // Returns the symbol name for a given start address. Returns std::nullopt if
+  // no such symbol exists.
+  std::optional<absl::string_view> GetSymbolNameByStartAddr(
+      uint64_t address) const;
 
   // Returns the overlap between two symbol maps. For two profiles, if
   // count_i_j denotes the function count of the ith function in profile j;
@@ -565,6 +596,24 @@ class SymbolMap {
   llvm::StringSet<> collectNamesInProfile();
 #endif
 
+  // Function names bucketed for a startup-oriented linker symbol ordering.
+  struct StartupSymbolOrder {
+    // Functions first executed within the startup window, in order of their
+    // first execution.
+    std::vector<std::string> startup;
+    // The remaining sampled functions, in decreasing order of their sample
+    // count.
+    std::vector<std::string> steady_state;
+  };
+
+  // Orders the sampled functions by their first-execution timestamps, so that
+  // code only run during startup can be laid out contiguously and apart from
+  // the steady-state hot code. The startup window spans `startup_window_ns`
+  // nanoseconds from the earliest timestamp, which approximates the process
+  // start. All aliases of a function are emitted together.
+  StartupSymbolOrder ComputeStartupSymbolOrder(
+      uint64_t startup_window_ns) const;
+
   // Limits the number of inline instances at the same callsite location in this
   // sample map, keeping those with the most count.
   // An example is multiple call targets can be inlined for the same indirect
@@ -581,16 +630,34 @@ class SymbolMap {
   // Reads from the binary's elf section to build the symbol map.
   void BuildSymbolMap();
 
+  // Implementations of TraverseInlineStack and AddSourceCounts starting from
+  // a resolved outline symbol, specialized on whether offsets only use the base
+  // discriminator (see SourceInfo::UseBaseDiscriminator) and on whether the
+  // data source is converted (PERFDATA or AFDOPROTO) rather than merged.
+  template <bool kUseBaseDiscriminator, bool kNeedConversion>
+  static Symbol *TraverseInlineStackImpl(Symbol *symbol,
+                                         const SourceStack &src,
+                                         uint64_t count);
+  template <bool kUseBaseDiscriminator, bool kNeedConversion>
+  static void AddSourceCountsImpl(Symbol *symbol,
+                                  absl::Span<const SourceCount> source_counts,
+                                  bool use_multiply_factor);
+
   // Initialize suffix elision policy from flags.
   void initSuffixElisionPolicy();
 
   // Reads from address_symbol_map_ and update name_addr_map_.
   void BuildNameAddressMap() {
-    for (const auto &[addr, symbol] : address_symbol_map_) {
-      name_addr_map_[symbol.first] = addr;
+    name_addr_map_.reserve(address_symbol_map_.size());
+    for (const AddressSymbol &symbol : address_symbol_map_) {
+      name_addr_map_[symbol.name] = symbol.address;
     }
   }
 
+  // Returns the last symbol in address_symbol_map_ starting at or before
+  // `addr`, or nullptr if there is none.
+  const AddressSymbol *FindSymbolStartingAtOrBefore(uint64_t addr) const;
+
   void add_loadable_exec_segment(uint64_t offset, uint64_t vaddr) {
     // Check the offset field in loadable_exec_segments is in ascending order.
     assert(loadable_exec_segments_.empty() ||
@@ -618,6 +685,9 @@ class SymbolMap {
   NameAddressMap name_addr_map_;
   AddressSymbolMap address_symbol_map_;
   const std::string binary_;
+  // Keeps the binary's string tables mapped for the names in
+  // address_symbol_map_ and name_addr_map_.
+  std::shared_ptr<BinaryImage> image_;
   // segments needs to sort by offset in ascending order.
   std::vector<segmentinfo> loadable_exec_segments_;
   int64_t count_threshold_;
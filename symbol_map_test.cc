@@ -9,20 +9,25 @@
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "base/logging.h"
+#include "binary_image.h"
 #include "llvm_profile_reader.h"
 #include "source_info.h"
 #include "gtest/gtest.h"
 #include "third_party/abseil/absl/container/node_hash_set.h"
 #include "third_party/abseil/absl/flags/flag.h"
 #include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/strings/string_view.h"
 
 namespace {
 
+using ::devtools_crosstool_autofdo::BinaryImage;
 using ::devtools_crosstool_autofdo::Callsite;
 using ::devtools_crosstool_autofdo::SymbolMap;
 using ::devtools_crosstool_autofdo::SourceStack;
@@ -125,6 +130,92 @@ TEST(SymbolMapTest, TestEntryCount) {
   EXPECT_EQ(qux->EntryCount(), 100);
 }
 
+TEST(SymbolMapTest, AddSourceCountsMatchesAddSourceCount) {
+  SourceStack stack1 = {
+      {"bar", "", "", 10, 25, 0},
+      {"foo", "", "", 40, 50, 0},
+  };
+  SourceStack stack2 = {
+      {"foo", "", "", 40, 55, 0},
+  };
+  // Invalid line info in the leaf is dropped when converting perf data.
+  SourceStack stack3 = {
+      {"baz", "", "", 0, 0, 0},
+      {"foo", "", "", 40, 60, 0},
+  };
+
+  for (SymbolMap::DataSource data_source :
+       {SymbolMap::PERFDATA, SymbolMap::AFDOPROFILE}) {
+    SymbolMap expected;
+    expected.AddSymbol("foo");
+    expected.AddSourceCount("foo", stack1, 100, 1, 1, data_source);
+    expected.AddSourceCount("foo", stack2, 150, 1, 2, data_source);
+    expected.AddSourceCount("foo", stack1, 70, 1, 1, data_source);
+    expected.AddSourceCount("foo", stack3, 30, 1, 1, data_source);
+
+    SymbolMap actual;
+    actual.AddSymbol("foo");
+    const std::vector<SymbolMap::SourceCount> source_counts = {
+        {.source = &stack1, .count = 100, .num_inst = 1},
+        {.source = &stack2, .count = 150, .num_inst = 1, .duplication = 2},
+        {.source = &stack1, .count = 70, .num_inst = 1},
+        {.source = &stack3, .count = 30, .num_inst = 1},
+    };
+    actual.AddSourceCounts(actual.GetMutableSymbolByName("foo"), source_counts,
+                           data_source);
+
+    const devtools_crosstool_autofdo::Symbol *expected_foo =
+        expected.GetSymbolByName("foo");
+    const devtools_crosstool_autofdo::Symbol *actual_foo =
+        actual.GetSymbolByName("foo");
+    EXPECT_EQ(actual_foo->total_count, expected_foo->total_count);
+    EXPECT_EQ(actual_foo->callsites.size(), expected_foo->callsites.size());
+    ASSERT_EQ(actual_foo->pos_counts.size(), expected_foo->pos_counts.size());
+    for (const auto &[offset, info] : expected_foo->pos_counts) {
+      auto it = actual_foo->pos_counts.find(offset);
+      ASSERT_TRUE(it != actual_foo->pos_counts.end());
+      EXPECT_EQ(it->second.count, info.count);
+      EXPECT_EQ(it->second.num_inst, info.num_inst);
+    }
+    const devtools_crosstool_autofdo::Symbol *expected_bar =
+        expected_foo->callsites.at(Callsite{stack1[1].Offset(false), "bar"});
+    const devtools_crosstool_autofdo::Symbol *actual_bar =
+        actual_foo->callsites.at(Callsite{stack1[1].Offset(false), "bar"});
+    EXPECT_EQ(actual_bar->total_count, expected_bar->total_count);
+    EXPECT_EQ(actual_bar->EntryCount(), expected_bar->EntryCount());
+  }
+}
+
+TEST(SymbolMapTest, SymbolLookupByAddress) {
+  SymbolMap symbol_map(::testing::SrcDir() + kTestDataDir + "test.binary");
+
+  ASSERT_FALSE(symbol_map.GetNameAddrMap().empty());
+  for (const auto &[name, addr] : symbol_map.GetNameAddrMap()) {
+    absl::string_view found_name;
+    uint64_t start_addr = 0;
+    uint64_t end_addr = 0;
+    ASSERT_TRUE(symbol_map.GetSymbolInfoByAddr(addr, &found_name, &start_addr,
+                                               &end_addr));
+    EXPECT_EQ(start_addr, addr);
+    EXPECT_EQ(symbol_map.GetSymbolNameByStartAddr(addr), found_name);
+    if (end_addr > start_addr + 1) {
+      EXPECT_EQ(symbol_map.GetSymbolNameByStartAddr(addr + 1), std::nullopt);
+    }
+  }
+  EXPECT_FALSE(symbol_map.GetSymbolInfoByAddr(0, nullptr, nullptr, nullptr));
+}
+
+TEST(SymbolMapTest, SharedBinaryImage) {
+  const std::string binary = ::testing::SrcDir() + kTestDataDir + "test.binary";
+  std::shared_ptr<BinaryImage> image = BinaryImage::Open(binary);
+  ASSERT_NE(image, nullptr);
+  SymbolMap from_path(binary);
+  SymbolMap from_image(image);
+  EXPECT_EQ(from_image.GetNameAddrMap(), from_path.GetNameAddrMap());
+  // The symbol map keeps the image alive for the names it hands out.
+  EXPECT_GT(image.use_count(), 1);
+}
+
 TEST(SymbolMapTest, ComputeAllCounts) {
   SymbolMap symbol_map;
   absl::node_hash_set<std::string> names;
@@ -486,6 +577,39 @@ TEST(SymbolMapTest, throttleInlineInstancesAtSameLocation) {
               hoo_cs_map.end());
 }
 
+TEST(SymbolMapTest, ComputeStartupSymbolOrder) {
+  SymbolMap symbol_map;
+  // Timestamps are in nanoseconds.
+  constexpr uint64_t kStart = 1000000000;
+  symbol_map.AddSymbol("main");
+  symbol_map.AddSymbolEntryCount("main", 1, 10);
+  symbol_map.AddSymbolTimestamp("main", kStart);
+  symbol_map.AddSymbol("init");
+  symbol_map.AddSymbolEntryCount("init", 1, 5);
+  symbol_map.AddSymbolTimestamp("init", kStart + 2000000);
+  symbol_map.AddSymbol("parse_args");
+  symbol_map.AddSymbolEntryCount("parse_args", 1, 1);
+  symbol_map.AddSymbolTimestamp("parse_args", kStart + 1000000);
+  symbol_map.AddSymbol("loop");
+  symbol_map.AddSymbolEntryCount("loop", 1, 1000);
+  symbol_map.AddSymbolTimestamp("loop", kStart + 50000000);
+  symbol_map.AddSymbol("helper");
+  symbol_map.AddSymbolEntryCount("helper", 1, 2000);
+  symbol_map.AddSymbolTimestamp("helper", kStart + 60000000);
+  // Sampled without a timestamp.
+  symbol_map.AddSymbol("untimed");
+  symbol_map.AddSymbolEntryCount("untimed", 1, 100);
+  // Never sampled.
+  symbol_map.AddSymbol("cold");
+
+  SymbolMap::StartupSymbolOrder order =
+      symbol_map.ComputeStartupSymbolOrder(/*startup_window_ns=*/10000000);
+  EXPECT_EQ(order.startup,
+            std::vector<std::string>({"main", "parse_args", "init"}));
+  EXPECT_EQ(order.steady_state,
+            std::vector<std::string>({"helper", "loop", "untimed"}));
+}
+
 TEST(AddressConversion, VaddrToOffset) {
   // clang-format off
   // NOLINTBEGIN(whitespace/line_length)
@@ -0,0 +1,448 @@
+#include "synthetic_perf_data.h"
+
+#if defined(HAVE_LLVM)
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "llvm_propeller_binary_content.h"
+#include "mini_disassembler.h"
+#include "third_party/abseil/absl/algorithm/container.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/status/statusor.h"
+#include "third_party/abseil/absl/strings/escaping.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Error.h"
+#include "quipper/kernel/perf_event.h"
+#include "quipper/kernel/perf_internals.h"
+#include "base/status_macros.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+// Pid of the kernel mmap events.
+constexpr uint32_t kKernelPid = static_cast<uint32_t>(-1);
+// Pid of the first profiled process.
+constexpr uint32_t kFirstPid = 1000;
+// Load address of the first PIE process. Every other process is mapped
+// `kPieBaseStride` higher.
+constexpr uint64_t kFirstPieBase = 0x555555554000;
+constexpr uint64_t kPieBaseStride = 0x100000000;
+constexpr uint64_t kPageSize = 0x1000;
+constexpr uint64_t kSampleType =
+    quipper::PERF_SAMPLE_IP | quipper::PERF_SAMPLE_TID |
+    quipper::PERF_SAMPLE_TIME | quipper::PERF_SAMPLE_PERIOD |
+    quipper::PERF_SAMPLE_BRANCH_STACK;
+constexpr uint64_t kSamplePeriod = 100003;
+// PERF_RECORD_MISC_KERNEL and PERF_RECORD_MISC_USER, which the kernel headers
+// define as macros.
+constexpr uint16_t kMiscKernel = 1;
+constexpr uint16_t kMiscUser = 2;
+// The mmap and sample_id_all bits of perf_event_attr.
+constexpr uint64_t kAttrFlags = uint64_t{1} << 8 | uint64_t{1} << 18;
+
+// Layout of the perf.data file format written by perf.
+constexpr uint64_t kPerfMagic = 0x32454c4946524550;  // "PERFILE2"
+constexpr uint64_t kFileHeaderSize = 104;
+// Size of a perf_file_section: an offset and a size.
+constexpr uint64_t kFileSectionSize = 16;
+// PERF_ATTR_SIZE_VER5.
+constexpr uint64_t kAttrSize = 112;
+// A perf_event_attr followed by the section of its sample ids.
+constexpr uint64_t kFileAttrSize = kAttrSize + kFileSectionSize;
+constexpr uint64_t kBuildIdSize = 24;
+// Header, pid and build id of a build-id record, followed by the file name.
+constexpr uint64_t kBuildIdEventFixedSize = 8 + 4 + kBuildIdSize;
+constexpr uint64_t kBuildIdFileNameAlignment = 64;
+
+// Sizes of the perf.data records written for `kSampleType` with
+// `sample_id_all` set.
+constexpr uint32_t kEventHeaderSize = 8;
+// Trailing pid/tid and time of non-sample records.
+constexpr uint32_t kSampleIdSize = 16;
+// ip, pid/tid, time, period and the number of branch entries.
+constexpr uint32_t kSampleFixedSize = 40;
+// from, to and flags.
+constexpr uint32_t kBranchEntrySize = 24;
+
+// A function symbol of the binary along with its control-flow instructions,
+// which are the possible branch sources.
+struct Function {
+  uint64_t addr;
+  // Addresses of the control-flow instructions, in increasing order.
+  std::vector<uint64_t> branch_addrs;
+  // Addresses following each of `branch_addrs`, which start basic blocks and
+  // are the possible intra-function branch targets along with `addr`.
+  std::vector<uint64_t> branch_end_addrs;
+};
+
+// Returns a number in [0, 1) drawn from `rng`. Uses the raw engine output
+// rather than a distribution so the result is the same across standard
+// library implementations.
+double NextUnitDouble(std::mt19937_64 &rng) {
+  return (rng() >> 11) * 0x1.0p-53;
+}
+
+// Returns the function symbols of `binary_content` which lie within its
+// executable segments and have at least one control-flow instruction, sorted
+// by address.
+absl::StatusOr<std::vector<Function>> GetFunctions(
+    const BinaryContent &binary_content) {
+  ASSIGN_OR_RETURN(std::unique_ptr<MiniDisassembler> disassembler,
+                   MiniDisassembler::Create(binary_content.object_file.get()));
+  std::vector<std::pair<uint64_t, uint64_t>> symbols;
+  const auto *elf_object_file = llvm::dyn_cast<llvm::object::ELFObjectFileBase>(
+      binary_content.object_file.get());
+  if (elf_object_file == nullptr) {
+    return absl::FailedPreconditionError(
+        absl::StrCat(binary_content.file_name, " is not an ELF file."));
+  }
+  for (const llvm::object::ELFSymbolRef symbol : elf_object_file->symbols()) {
+    llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
+    llvm::Expected<uint64_t> addr = symbol.getAddress();
+    if (!type || !addr) {
+      llvm::consumeError(type.takeError());
+      llvm::consumeError(addr.takeError());
+      continue;
+    }
+    if (*type != llvm::object::SymbolRef::ST_Function || symbol.getSize() == 0)
+      continue;
+    if (absl::c_none_of(binary_content.segments,
+                        [&](const BinaryContent::Segment &segment) {
+                          return segment.vaddr <= *addr &&
+                                 *addr + symbol.getSize() <=
+                                     segment.vaddr + segment.memsz;
+                        }))
+      continue;
+    symbols.emplace_back(*addr, symbol.getSize());
+  }
+  absl::c_sort(symbols);
+  symbols.erase(std::unique(symbols.begin(), symbols.end(),
+                            [](const auto &a, const auto &b) {
+                              return a.first == b.first;
+                            }),
+                symbols.end());
+
+  std::vector<Function> functions;
+  for (const auto &[function_addr, function_size] : symbols) {
+    Function function = {.addr = function_addr};
+    // Stop at the first address which can not be disassembled, such as
+    // padding or embedded data.
+    uint64_t inst_size = 0;
+    for (uint64_t addr = function_addr; addr < function_addr + function_size;
+         addr += inst_size) {
+      absl::StatusOr<llvm::MCInst> inst =
+          disassembler->DisassembleOne(addr, inst_size);
+      if (!inst.ok() || inst_size == 0) break;
+      if (!disassembler->MayAffectControlFlow(*inst)) continue;
+      function.branch_addrs.push_back(addr);
+      function.branch_end_addrs.push_back(addr + inst_size);
+    }
+    if (!function.branch_addrs.empty())
+      functions.push_back(std::move(function));
+  }
+  if (functions.empty()) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        binary_content.file_name,
+        " has no functions with control-flow instructions in its executable "
+        "segments."));
+  }
+  return functions;
+}
+
+
+// Buffers perf.data records and writes them to `out` in chunks of about
+// `kChunkSize` bytes, so the memory use does not depend on the file size.
+// Values are written in the host byte order, like perf does.
+class PerfDataWriter {
+ public:
+  explicit PerfDataWriter(std::ostream &out) : out_(out) {
+    buffer_.reserve(kChunkSize + kChunkSize / 2);
+  }
+
+  PerfDataWriter(const PerfDataWriter &) = delete;
+  PerfDataWriter &operator=(const PerfDataWriter &) = delete;
+
+  template <typename T>
+  void Append(T value) {
+    static_assert(std::is_integral_v<T>);
+    buffer_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    if (buffer_.size() >= kChunkSize) Flush();
+  }
+
+  void AppendZeros(size_t size) { buffer_.append(size, '\0'); }
+
+  // Appends `str` null-padded to `size` bytes.
+  void AppendString(absl::string_view str, size_t size) {
+    buffer_.append(str.data(), str.size());
+    AppendZeros(size - str.size());
+  }
+
+  void AppendEventHeader(uint32_t type, uint16_t misc, uint16_t size) {
+    Append(type);
+    Append(misc);
+    Append(size);
+  }
+
+  void Flush() {
+    out_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+
+ private:
+  static constexpr size_t kChunkSize = 1 << 20;
+
+  std::ostream &out_;
+  std::string buffer_;
+};
+
+// An mmap record of the profiled binary.
+struct MmapRecord {
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t start;
+  uint64_t len;
+  uint64_t pgoff;
+};
+
+// Returns the size of `str` null-terminated and padded to `alignment` bytes.
+uint64_t GetPaddedStringSize(absl::string_view str, uint64_t alignment) {
+  return (str.size() + alignment) / alignment * alignment;
+}
+}  // namespace
+
+absl::Status WriteSyntheticPerfData(const BinaryContent &binary_content,
+                                    const SyntheticPerfDataOptions &options,
+                                    absl::string_view path) {
+  if (options.n_pids <= 0 || options.lbr_depth <= 0 ||
+      options.n_samples < 0) {
+    return absl::InvalidArgumentError(
+        "The number of pids and the LBR depth must be positive and the "
+        "number of samples must not be negative.");
+  }
+  ASSIGN_OR_RETURN(const std::vector<Function> functions,
+                   GetFunctions(binary_content));
+  const bool is_kernel = options.mmap_layout == SyntheticMmapLayout::kKernel;
+  const std::string mmap_file_name =
+      is_kernel ? "[kernel.kallsyms]_text"
+      : options.mmap_file_name.empty() ? binary_content.file_name
+                                       : options.mmap_file_name;
+  const std::string build_id_file_name =
+      is_kernel ? "[kernel.kallsyms]" : mmap_file_name;
+  const uint16_t misc = is_kernel ? kMiscKernel : kMiscUser;
+  const uint64_t mmap_event_size = kEventHeaderSize + 8 + 24 +
+                                   GetPaddedStringSize(mmap_file_name, 8) +
+                                   kSampleIdSize;
+  const uint64_t sample_event_size = kEventHeaderSize + kSampleFixedSize +
+                                     kBranchEntrySize * options.lbr_depth;
+  const uint64_t build_id_event_size =
+      kBuildIdEventFixedSize +
+      GetPaddedStringSize(build_id_file_name, kBuildIdFileNameAlignment);
+  if (mmap_event_size > UINT16_MAX || sample_event_size > UINT16_MAX ||
+      build_id_event_size > UINT16_MAX) {
+    return absl::InvalidArgumentError(
+        "The LBR depth or the mmap file name is too large for a perf event.");
+  }
+  const bool has_build_id = !binary_content.build_id.empty();
+  const std::string build_id = absl::HexStringToBytes(binary_content.build_id);
+  if (build_id.size() > kBuildIdSize) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        binary_content.file_name, " has a build id longer than ", kBuildIdSize,
+        " bytes."));
+  }
+
+  // Returns the runtime address of binary address `addr` in process
+  // `pid_index`.
+  auto get_runtime_address = [&](int pid_index, uint64_t addr) {
+    if (options.mmap_layout != SyntheticMmapLayout::kPie) return addr;
+    return kFirstPieBase + pid_index * kPieBaseStride + addr;
+  };
+
+  std::vector<MmapRecord> mmaps;
+  if (is_kernel) {
+    // The kernel is mapped once for all processes. Kernel addresses are
+    // translated relative to the start of the mapping, so the text segment
+    // is mapped from its exact start rather than from its page.
+    const BinaryContent::Segment &segment = binary_content.segments.front();
+    mmaps.push_back({.pid = kKernelPid,
+                     .tid = 0,
+                     .start = segment.vaddr,
+                     .len = segment.memsz,
+                     .pgoff = segment.vaddr});
+  } else {
+    for (int pid_index = 0; pid_index != options.n_pids; ++pid_index) {
+      for (const BinaryContent::Segment &segment : binary_content.segments) {
+        const uint64_t page_delta = segment.vaddr % kPageSize;
+        const uint32_t pid = kFirstPid + pid_index;
+        mmaps.push_back({.pid = pid,
+                         .tid = pid,
+                         .start = get_runtime_address(
+                             pid_index, segment.vaddr - page_delta),
+                         .len = segment.memsz + page_delta,
+                         .pgoff = segment.offset - page_delta});
+      }
+    }
+  }
+
+  const uint64_t data_offset = kFileHeaderSize + kFileAttrSize;
+  const uint64_t data_size =
+      mmaps.size() * mmap_event_size + options.n_samples * sample_event_size;
+
+  std::ofstream file{std::string(path), std::ios::binary};
+  if (!file) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Failed to open perf data file: ", path));
+  }
+  PerfDataWriter writer(file);
+
+  // perf_file_header, with the sizes of all sections computed up front so the
+  // file is written sequentially.
+  writer.Append(kPerfMagic);
+  writer.Append(kFileHeaderSize);
+  writer.Append(kFileAttrSize);
+  writer.Append(kFileHeaderSize);  // attrs.offset
+  writer.Append(kFileAttrSize);    // attrs.size
+  writer.Append(data_offset);
+  writer.Append(data_size);
+  writer.AppendZeros(16);  // event_types
+  // The adds_features bitmap of 256 bits.
+  writer.Append(has_build_id ? uint64_t{1} << quipper::HEADER_BUILD_ID
+                             : uint64_t{0});
+  writer.AppendZeros(24);
+
+  // perf_file_attr: a perf_event_attr followed by an empty ids section.
+  writer.Append<uint32_t>(quipper::PERF_TYPE_HARDWARE);
+  writer.Append<uint32_t>(kAttrSize);
+  writer.Append<uint64_t>(quipper::PERF_COUNT_HW_CPU_CYCLES);
+  writer.Append(kSamplePeriod);
+  writer.Append(kSampleType);
+  writer.Append<uint64_t>(0);  // read_format
+  writer.Append(kAttrFlags);
+  writer.AppendZeros(24);  // wakeup_events, bp_type, config1 and config2
+  writer.Append<uint64_t>(quipper::PERF_SAMPLE_BRANCH_ANY |
+                          (is_kernel ? quipper::PERF_SAMPLE_BRANCH_KERNEL
+                                     : quipper::PERF_SAMPLE_BRANCH_USER));
+  writer.AppendZeros(kAttrSize - 80);
+  writer.AppendZeros(16);  // ids
+
+  uint64_t time_ns = 1000;
+  for (const MmapRecord &mmap : mmaps) {
+    writer.AppendEventHeader(quipper::PERF_RECORD_MMAP, misc, mmap_event_size);
+    writer.Append(mmap.pid);
+    writer.Append(mmap.tid);
+    writer.Append(mmap.start);
+    writer.Append(mmap.len);
+    writer.Append(mmap.pgoff);
+    writer.AppendString(mmap_file_name, GetPaddedStringSize(mmap_file_name, 8));
+    writer.Append(mmap.pid);
+    writer.Append(mmap.tid);
+    writer.Append(time_ns);
+  }
+
+  // Zipf weights are assigned to the functions in a random order so hotness
+  // does not depend on the address.
+  std::mt19937_64 rng(options.seed);
+  std::vector<int> function_indices(functions.size());
+  absl::c_iota(function_indices, 0);
+  for (int i = function_indices.size() - 1; i > 0; --i)
+    std::swap(function_indices[i], function_indices[rng() % (i + 1)]);
+  std::vector<double> cumulative_weights;
+  cumulative_weights.reserve(functions.size());
+  for (int rank = 0; rank != functions.size(); ++rank) {
+    cumulative_weights.push_back(
+        (cumulative_weights.empty() ? 0 : cumulative_weights.back()) +
+        1 / std::pow(rank + 1, options.branch_target_skew));
+  }
+  auto pick_function = [&]() -> const Function & {
+    const double target = NextUnitDouble(rng) * cumulative_weights.back();
+    const int rank = std::min<int>(
+        absl::c_upper_bound(cumulative_weights, target) -
+            cumulative_weights.begin(),
+        functions.size() - 1);
+    return functions[function_indices[rank]];
+  };
+
+  std::vector<std::pair<uint64_t, uint64_t>> branches(options.lbr_depth);
+  for (int64_t i = 0; i != options.n_samples; ++i) {
+    const int pid_index = i % options.n_pids;
+    const uint32_t pid = kFirstPid + pid_index;
+    time_ns += 1000;
+
+    // Walk `lbr_depth` branches, oldest first. The walk is positioned before
+    // the control-flow instruction `branch_index` of `function` and the next
+    // branch source is any of the following control-flow instructions, so
+    // the fallthrough range from every branch target to the next branch
+    // source is valid.
+    const Function *function = &pick_function();
+    int branch_index = rng() % function->branch_addrs.size();
+    uint64_t pc = branch_index == 0
+                      ? function->addr
+                      : function->branch_end_addrs[branch_index - 1];
+    for (auto &[from, to] : branches) {
+      const int n_branches = function->branch_addrs.size();
+      from = function->branch_addrs[branch_index +
+                                    rng() % (n_branches - branch_index)];
+      if (NextUnitDouble(rng) < options.call_probability) {
+        function = &pick_function();
+        branch_index = 0;
+        to = function->addr;
+      } else {
+        branch_index = rng() % n_branches;
+        to = branch_index == 0 ? function->addr
+                               : function->branch_end_addrs[branch_index - 1];
+      }
+      pc = to;
+    }
+
+    writer.AppendEventHeader(quipper::PERF_RECORD_SAMPLE, misc,
+                             sample_event_size);
+    writer.Append(get_runtime_address(pid_index, pc));
+    writer.Append(pid);
+    writer.Append(pid);
+    writer.Append(time_ns);
+    writer.Append(kSamplePeriod);
+    writer.Append<uint64_t>(options.lbr_depth);
+    // The branch stack holds the most recent branch first.
+    for (auto it = branches.rbegin(); it != branches.rend(); ++it) {
+      writer.Append(get_runtime_address(pid_index, it->first));
+      writer.Append(get_runtime_address(pid_index, it->second));
+      writer.Append<uint64_t>(0);  // flags
+    }
+  }
+
+  // The feature sections follow the data: a perf_file_section for every
+  // feature in adds_features, then the features themselves.
+  if (has_build_id) {
+    writer.Append(data_offset + data_size + kFileSectionSize);
+    writer.Append(build_id_event_size);
+    writer.AppendEventHeader(/*type=*/0, misc, build_id_event_size);
+    writer.Append(kKernelPid);
+    writer.AppendString(build_id, kBuildIdSize);
+    writer.AppendString(
+        build_id_file_name,
+        GetPaddedStringSize(build_id_file_name, kBuildIdFileNameAlignment));
+  }
+  writer.Flush();
+  file.close();
+  if (!file) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Failed to write perf data file: ", path));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace devtools_crosstool_autofdo
+#endif  // HAVE_LLVM
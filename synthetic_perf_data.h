@@ -0,0 +1,66 @@
+#ifndef AUTOFDO_SYNTHETIC_PERF_DATA_H_
+#define AUTOFDO_SYNTHETIC_PERF_DATA_H_
+
+#if defined(HAVE_LLVM)
+#include <cstdint>
+#include <string>
+
+#include "llvm_propeller_binary_content.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+
+namespace devtools_crosstool_autofdo {
+
+// How the profiled binary is mapped into the address space of the profiled
+// processes.
+enum class SyntheticMmapLayout {
+  // The executable segments are mapped at their link-time addresses.
+  kNonPie,
+  // The executable segments are mapped at a different base address in every
+  // process.
+  kPie,
+  // The binary is a kernel image, mapped as "[kernel.kallsyms]_text".
+  kKernel,
+};
+
+// Shape of a synthetic perf.data file.
+struct SyntheticPerfDataOptions {
+  // Number of sample events.
+  int64_t n_samples = 10000;
+  // Number of LBR entries in every sample.
+  int lbr_depth = 32;
+  // Number of profiled processes. Samples are spread evenly across them and
+  // each gets its own mmap events.
+  int n_pids = 1;
+  SyntheticMmapLayout mmap_layout = SyntheticMmapLayout::kNonPie;
+  // Exponent of the Zipf distribution of branch targets over the functions
+  // of the binary: 0 spreads branches uniformly and larger values concentrate
+  // them in fewer functions.
+  double branch_target_skew = 1.0;
+  // Probability that a branch leaves its function (a call) rather than
+  // staying within it.
+  double call_probability = 0.1;
+  // File name recorded in the mmap and build-id events. Defaults to the file
+  // name of the binary.
+  std::string mmap_file_name;
+  // Seed of the pseudo-random generator. The same binary, options and seed
+  // always yield the same perf data.
+  uint64_t seed = 1;
+};
+
+// Writes synthetic LBR perf data for `binary_content`, shaped by `options`,
+// to `path` in the perf.data file format. Branches are random walks over the
+// function symbols of the binary: every branch source is a control-flow
+// instruction after the previous branch target within the same function, so
+// the implied fallthrough ranges are valid. Records are streamed to the file
+// as they are generated, so the memory use does not grow with the number of
+// samples. Returns an error if the binary can not be disassembled or has no
+// functions with control-flow instructions in its executable segments.
+absl::Status WriteSyntheticPerfData(const BinaryContent &binary_content,
+                                    const SyntheticPerfDataOptions &options,
+                                    absl::string_view path);
+
+}  // namespace devtools_crosstool_autofdo
+
+#endif  // HAVE_LLVM
+#endif  // AUTOFDO_SYNTHETIC_PERF_DATA_H_
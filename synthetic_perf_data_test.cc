@@ -0,0 +1,195 @@
+#include "synthetic_perf_data.h"
+
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm_propeller_binary_content.h"
+#include "llvm_propeller_file_perf_data_provider.h"
+#include "llvm_propeller_options.pb.h"
+#include "llvm_propeller_options_builder.h"
+#include "llvm_propeller_perf_lbr_aggregator.h"
+#include "llvm_propeller_statistics.h"
+#include "perf_data.pb.h"
+#include "sample_reader.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "quipper/perf_reader.h"
+#include "util/testing/status_matchers.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Not;
+using ::testing::SizeIs;
+
+static std::string GetAutoFdoTestDataFilePath(absl::string_view filename) {
+  return absl::StrCat(::testing::SrcDir(), "/testdata/", filename);
+}
+
+static std::string GetTempFilePath(absl::string_view filename) {
+  return absl::StrCat(::testing::TempDir(), "/", filename);
+}
+
+static std::string ReadFileContents(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+// Returns the statistics of aggregating the LBR data of `perfdata` for
+// `binary`.
+static PropellerStats AggregateLbrData(const std::string &binary,
+                                       const BinaryContent &binary_content,
+                                       const std::string &perfdata) {
+  const PropellerOptions options = PropellerOptions(
+      PropellerOptionsBuilder().SetBinaryName(binary).AddInputProfiles(
+          InputProfileBuilder().SetName(perfdata)));
+  PerfLbrAggregator lbr_aggregator(
+      std::make_unique<GenericFilePerfDataProvider>(std::vector{perfdata}));
+  PropellerStats stats;
+  EXPECT_OK(lbr_aggregator.AggregateLbrData(options, binary_content, stats));
+  return stats;
+}
+
+TEST(SyntheticPerfDataTest, GeneratesRequestedSamples) {
+  const std::string perfdata = GetTempFilePath("synthetic_samples.perfdata");
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetAutoFdoTestDataFilePath("propeller_sample.bin")));
+  ASSERT_OK(WriteSyntheticPerfData(
+      *binary_content, {.n_samples = 100, .lbr_depth = 16, .n_pids = 3},
+      perfdata));
+
+  quipper::PerfReader perf_reader;
+  ASSERT_TRUE(perf_reader.ReadFile(perfdata));
+  int n_samples = 0;
+  int n_mmaps = 0;
+  for (const quipper::PerfDataProto::PerfEvent &event : perf_reader.events()) {
+    if (event.has_sample_event()) {
+      ++n_samples;
+      EXPECT_THAT(event.sample_event().branch_stack(), SizeIs(16));
+    } else if (event.has_mmap_event()) {
+      ++n_mmaps;
+      EXPECT_EQ(event.mmap_event().filename(), binary_content->file_name);
+    }
+  }
+  EXPECT_EQ(n_samples, 100);
+  EXPECT_EQ(n_mmaps, 3 * binary_content->segments.size());
+  EXPECT_THAT(perf_reader.build_ids(), SizeIs(1));
+}
+
+TEST(SyntheticPerfDataTest, IsDeterministicForSeed) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetAutoFdoTestDataFilePath("propeller_sample.bin")));
+  const std::string perfdata1 = GetTempFilePath("synthetic_seed1.perfdata");
+  const std::string perfdata2 = GetTempFilePath("synthetic_seed2.perfdata");
+  const std::string perfdata3 = GetTempFilePath("synthetic_seed3.perfdata");
+  ASSERT_OK(WriteSyntheticPerfData(*binary_content,
+                                   {.n_samples = 50, .seed = 7}, perfdata1));
+  ASSERT_OK(WriteSyntheticPerfData(*binary_content,
+                                   {.n_samples = 50, .seed = 7}, perfdata2));
+  ASSERT_OK(WriteSyntheticPerfData(*binary_content,
+                                   {.n_samples = 50, .seed = 8}, perfdata3));
+  EXPECT_EQ(ReadFileContents(perfdata1), ReadFileContents(perfdata2));
+  EXPECT_NE(ReadFileContents(perfdata1), ReadFileContents(perfdata3));
+}
+
+TEST(SyntheticPerfDataTest, NonPieProfileIsAggregatedWithoutInvalidBranches) {
+  const std::string binary = GetAutoFdoTestDataFilePath("propeller_sample.bin");
+  const std::string perfdata = GetTempFilePath("synthetic_nonpie.perfdata");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(binary));
+  ASSERT_OK(WriteSyntheticPerfData(
+      *binary_content,
+      {.n_samples = 1000,
+       .lbr_depth = 32,
+       .mmap_layout = SyntheticMmapLayout::kNonPie},
+      perfdata));
+
+  const PropellerStats stats =
+      AggregateLbrData(binary, *binary_content, perfdata);
+  EXPECT_EQ(stats.profile_stats.br_counters_accumulated, 1000 * 32);
+  EXPECT_EQ(stats.disassembly_stats.could_not_disassemble.absolute, 0);
+  EXPECT_EQ(stats.disassembly_stats.cant_affect_control_flow.absolute, 0);
+  EXPECT_GT(stats.disassembly_stats.may_affect_control_flow.absolute, 0);
+}
+
+TEST(SyntheticPerfDataTest, PieProfileIsAggregatedWithoutInvalidBranches) {
+  const std::string binary = GetAutoFdoTestDataFilePath("propeller_sample.bin");
+  const std::string perfdata = GetTempFilePath("synthetic_pie.perfdata");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(binary));
+  ASSERT_OK(WriteSyntheticPerfData(
+      *binary_content,
+      {.n_samples = 1000,
+       .lbr_depth = 32,
+       .n_pids = 4,
+       .mmap_layout = SyntheticMmapLayout::kPie},
+      perfdata));
+
+  const PropellerStats stats =
+      AggregateLbrData(binary, *binary_content, perfdata);
+  EXPECT_EQ(stats.profile_stats.br_counters_accumulated, 1000 * 32);
+  EXPECT_EQ(stats.disassembly_stats.could_not_disassemble.absolute, 0);
+  EXPECT_EQ(stats.disassembly_stats.cant_affect_control_flow.absolute, 0);
+  EXPECT_GT(stats.disassembly_stats.may_affect_control_flow.absolute, 0);
+}
+
+TEST(SyntheticPerfDataTest, KernelProfileIsAggregatedWithoutInvalidBranches) {
+  const std::string binary = GetAutoFdoTestDataFilePath("propeller_sample.bin");
+  const std::string perfdata = GetTempFilePath("synthetic_kernel.perfdata");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(binary));
+  ASSERT_OK(WriteSyntheticPerfData(
+      *binary_content,
+      {.n_samples = 1000,
+       .lbr_depth = 32,
+       .n_pids = 4,
+       .mmap_layout = SyntheticMmapLayout::kKernel},
+      perfdata));
+
+  quipper::PerfReader perf_reader;
+  ASSERT_TRUE(perf_reader.ReadFile(perfdata));
+  std::vector<std::string> mmap_file_names;
+  for (const quipper::PerfDataProto::PerfEvent &event : perf_reader.events()) {
+    if (event.has_mmap_event())
+      mmap_file_names.push_back(event.mmap_event().filename());
+  }
+  // The kernel is mapped once, whatever the number of processes.
+  EXPECT_THAT(mmap_file_names, ElementsAre("[kernel.kallsyms]_text"));
+
+  // The kernel image is matched by its build id, so branches from all
+  // processes are aggregated.
+  const PropellerStats stats =
+      AggregateLbrData(binary, *binary_content, perfdata);
+  EXPECT_EQ(stats.profile_stats.br_counters_accumulated, 1000 * 32);
+  EXPECT_EQ(stats.disassembly_stats.could_not_disassemble.absolute, 0);
+  EXPECT_EQ(stats.disassembly_stats.cant_affect_control_flow.absolute, 0);
+  EXPECT_GT(stats.disassembly_stats.may_affect_control_flow.absolute, 0);
+}
+
+TEST(SyntheticPerfDataTest, IsReadByPerfDataSampleReader) {
+  const std::string binary = GetAutoFdoTestDataFilePath("propeller_sample.bin");
+  const std::string perfdata = GetTempFilePath("synthetic_autofdo.perfdata");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(binary));
+  ASSERT_OK(WriteSyntheticPerfData(
+      *binary_content, {.n_samples = 1000, .lbr_depth = 32}, perfdata));
+
+  PerfDataSampleReader sample_reader(perfdata, "/propeller_sample\\.bin$",
+                                     /*build_id=*/"");
+  ASSERT_TRUE(sample_reader.ReadAndSetTotalCount());
+  EXPECT_GT(sample_reader.GetTotalCount(), 0);
+  EXPECT_THAT(sample_reader.range_count_map(), Not(SizeIs(0)));
+  EXPECT_THAT(sample_reader.branch_count_map(), Not(SizeIs(0)));
+}
+
+}  // namespace
+}  // namespace devtools_crosstool_autofdo
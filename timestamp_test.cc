@@ -1,10 +1,30 @@
+#include <cstdint>
 #include <string>
+#include <utility>
+#include "addr2line.h"
+#include "profile.h"
 #include "profile_creator.h"
+#include "sample_reader.h"
 #include "symbol_map.h"
 #include "gmock/gmock.h"
+#include "third_party/abseil/absl/memory/memory.h"
 
 using namespace devtools_crosstool_autofdo;
 
+// Provides the given samples, keyed by file offset.
+class FakeSampleReader : public SampleReader {
+ public:
+  FakeSampleReader(AddressCountMap address_count_map,
+                   AddressTimestampMap address_timestamp_map) {
+    address_count_map_ = std::move(address_count_map);
+    address_timestamp_map_ = std::move(address_timestamp_map);
+    for (const auto &[addr, count] : address_count_map_) total_count_ += count;
+  }
+
+ protected:
+  bool Read() override { return true; }
+};
+
 TEST(TimestampTest, AssignTimestampToSymbol) {
   std::string binary = ::testing::SrcDir() + "/testdata/llvm_function_samples.binary";
   std::string profile_name = ::testing::SrcDir() + "/testdata/llvm_function_samples_perf.data";
@@ -17,8 +37,8 @@ TEST(TimestampTest, AssignTimestampToSymbol) {
   symbol_map.ReadLoadableExecSegmentInfo(creator.IsKernelSample());
   EXPECT_TRUE(creator.ComputeProfile(&symbol_map, false));
 
-  // The timestamp associated with function is the timestamp of first execution
-  // of the first sampled instruction in the function.
+  // The timestamp associated with function is the timestamp of its earliest
+  // sample.
 
   const Symbol *main_sym = symbol_map.GetSymbolByName("main");
   EXPECT_EQ(main_sym->timestamp, 801840661247321);
@@ -29,3 +49,23 @@ TEST(TimestampTest, AssignTimestampToSymbol) {
   const Symbol *Z3fooi = symbol_map.GetSymbolByName("_Z3fooi");
   EXPECT_EQ(Z3fooi->timestamp, 801841064917429);
 }
+
+TEST(TimestampTest, SymbolTimestampIsEarliestSample) {
+  std::string binary =
+      ::testing::SrcDir() + "/testdata/llvm_function_samples.binary";
+  SymbolMap symbol_map(binary);
+  symbol_map.ReadLoadableExecSegmentInfo(/*is_kernel=*/false);
+  symbol_map.set_addr2line(absl::WrapUnique(Addr2line::Create(binary)));
+  const uint64_t main_offset = symbol_map.GetFileOffsetFromStaticVaddr(
+      symbol_map.GetNameAddrMap().at("main"));
+
+  // The high address of main is sampled before the low one.
+  FakeSampleReader sample_reader(
+      {{main_offset + 0x10, 100}, {main_offset + 0x100, 100}},
+      {{main_offset + 0x10, 2000}, {main_offset + 0x100, 1000}});
+  Profile profile(&sample_reader, binary, symbol_map.get_addr2line(),
+                  &symbol_map);
+  profile.ComputeProfile();
+
+  EXPECT_EQ(symbol_map.GetSymbolByName("main")->timestamp, 1000);
+}
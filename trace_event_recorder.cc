@@ -0,0 +1,172 @@
+#include "trace_event_recorder.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "third_party/abseil/absl/base/thread_annotations.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/strings/str_format.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "third_party/abseil/absl/synchronization/mutex.h"
+#include "third_party/abseil/absl/time/clock.h"
+#include "third_party/abseil/absl/time/time.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+struct TraceEvent {
+  std::string category;
+  std::string name;
+  absl::Time start;
+  absl::Time end;
+  int thread_id;
+};
+
+// The global trace event buffer.
+struct TraceEventBuffer {
+  std::atomic<bool> enabled = false;
+  absl::Mutex mutex;
+  // Time recording was enabled. Event timestamps are relative to it.
+  absl::Time origin ABSL_GUARDED_BY(mutex);
+  std::vector<TraceEvent> events ABSL_GUARDED_BY(mutex);
+};
+
+TraceEventBuffer &GetTraceEventBuffer() {
+  static auto *const buffer = new TraceEventBuffer;
+  return *buffer;
+}
+
+// Returns a small id for the calling thread, assigned in the order threads
+// first record an event. The main thread usually gets 0.
+int GetTraceThreadId() {
+  static std::atomic<int> next_thread_id = 0;
+  thread_local const int thread_id = next_thread_id.fetch_add(1);
+  return thread_id;
+}
+
+// Returns `str` as a quoted JSON string.
+std::string JsonQuote(absl::string_view str) {
+  std::string quoted = "\"";
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        quoted += "\\\"";
+        break;
+      case '\\':
+        quoted += "\\\\";
+        break;
+      case '\n':
+        quoted += "\\n";
+        break;
+      case '\t':
+        quoted += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          absl::StrAppendFormat(&quoted, "\\u%04x", c);
+        } else {
+          quoted += c;
+        }
+    }
+  }
+  quoted += "\"";
+  return quoted;
+}
+}  // namespace
+
+void EnableTraceEventRecording() {
+  TraceEventBuffer &buffer = GetTraceEventBuffer();
+  absl::MutexLock lock(&buffer.mutex);
+  if (buffer.enabled.load()) return;
+  buffer.origin = absl::Now();
+  buffer.enabled.store(true);
+}
+
+bool IsTraceEventRecordingEnabled() {
+  return GetTraceEventBuffer().enabled.load(std::memory_order_relaxed);
+}
+
+void RecordTraceEvent(absl::string_view category, absl::string_view name,
+                      absl::Time start, absl::Time end) {
+  if (!IsTraceEventRecordingEnabled()) return;
+  TraceEvent event = {.category = std::string(category),
+                      .name = std::string(name),
+                      .start = start,
+                      .end = end,
+                      .thread_id = GetTraceThreadId()};
+  TraceEventBuffer &buffer = GetTraceEventBuffer();
+  absl::MutexLock lock(&buffer.mutex);
+  buffer.events.push_back(std::move(event));
+}
+
+absl::Status WriteTraceEvents(absl::string_view path) {
+  std::ofstream out{std::string(path)};
+  if (!out) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Failed to open '", path, "' for writing."));
+  }
+  const int pid = getpid();
+  TraceEventBuffer &buffer = GetTraceEventBuffer();
+  absl::MutexLock lock(&buffer.mutex);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for (int i = 0; i != buffer.events.size(); ++i) {
+    const TraceEvent &event = buffer.events[i];
+    out << (i == 0 ? "\n" : ",\n")
+        << absl::StrFormat(
+               "{\"ph\":\"X\",\"cat\":%s,\"name\":%s,\"pid\":%d,\"tid\":%d,"
+               "\"ts\":%d,\"dur\":%d}",
+               JsonQuote(event.category), JsonQuote(event.name), pid,
+               event.thread_id,
+               absl::ToInt64Microseconds(event.start - buffer.origin),
+               absl::ToInt64Microseconds(event.end - event.start));
+  }
+  out << "\n]}\n";
+  out.close();
+  if (!out) {
+    return absl::InternalError(
+        absl::StrCat("Failed to write trace events to '", path, "'."));
+  }
+  return absl::OkStatus();
+}
+
+void ResetTraceEventRecordingForTest() {
+  TraceEventBuffer &buffer = GetTraceEventBuffer();
+  absl::MutexLock lock(&buffer.mutex);
+  buffer.enabled.store(false);
+  buffer.events.clear();
+}
+
+ScopedTraceEvent::ScopedTraceEvent(absl::string_view category,
+                                   absl::string_view name)
+    : enabled_(IsTraceEventRecordingEnabled()) {
+  if (!enabled_) return;
+  category_ = std::string(category);
+  name_ = std::string(name);
+  start_ = absl::Now();
+}
+
+ScopedTraceEvent::~ScopedTraceEvent() {
+  if (enabled_) RecordTraceEvent(category_, name_, start_, absl::Now());
+}
+
+ScopedTraceEventRecording::ScopedTraceEventRecording(absl::string_view path)
+    : path_(path) {
+  if (!path_.empty()) EnableTraceEventRecording();
+}
+
+ScopedTraceEventRecording::~ScopedTraceEventRecording() {
+  if (path_.empty()) return;
+  if (absl::Status status = WriteTraceEvents(path_); !status.ok()) {
+    LOG(ERROR) << status;
+  } else {
+    LOG(INFO) << "Wrote trace events to " << path_;
+  }
+}
+}  // namespace devtools_crosstool_autofdo
@@ -0,0 +1,67 @@
+#ifndef AUTOFDO_TRACE_EVENT_RECORDER_H_
+#define AUTOFDO_TRACE_EVENT_RECORDER_H_
+
+#include <string>
+
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/strings/string_view.h"
+#include "third_party/abseil/absl/time/time.h"
+
+namespace devtools_crosstool_autofdo {
+// Starts recording trace events in the global trace event buffer. Until this is
+// called, recording trace events is a no-op.
+void EnableTraceEventRecording();
+
+// Returns whether trace events are being recorded.
+bool IsTraceEventRecordingEnabled();
+
+// Records a complete event named `name` in `category`, spanning [`start`,
+// `end`) on the calling thread. Does nothing unless recording is enabled. Safe
+// to call concurrently.
+void RecordTraceEvent(absl::string_view category, absl::string_view name,
+                      absl::Time start, absl::Time end);
+
+// Writes all recorded trace events to `path` in the Chrome trace event JSON
+// format, which can be opened with chrome://tracing or Perfetto. Safe to call
+// concurrently with `RecordTraceEvent`.
+absl::Status WriteTraceEvents(absl::string_view path);
+
+// Disables recording and drops all recorded trace events. To be only used in
+// tests. Not safe to call concurrently.
+void ResetTraceEventRecordingForTest();
+
+// Records a trace event spanning the lifetime of this object on the
+// constructing thread, if recording was enabled at construction.
+class ScopedTraceEvent {
+ public:
+  ScopedTraceEvent(absl::string_view category, absl::string_view name);
+  ~ScopedTraceEvent();
+
+  ScopedTraceEvent(const ScopedTraceEvent &) = delete;
+  ScopedTraceEvent &operator=(const ScopedTraceEvent &) = delete;
+
+ private:
+  const bool enabled_;
+  std::string category_;
+  std::string name_;
+  absl::Time start_;
+};
+
+// Enables trace event recording if `path` is not empty, and writes the
+// recorded events to `path` on destruction. Meant to be declared at the top of
+// `main` for a `--trace_out` flag.
+class ScopedTraceEventRecording {
+ public:
+  explicit ScopedTraceEventRecording(absl::string_view path);
+  ~ScopedTraceEventRecording();
+
+  ScopedTraceEventRecording(const ScopedTraceEventRecording &) = delete;
+  ScopedTraceEventRecording &operator=(const ScopedTraceEventRecording &) =
+      delete;
+
+ private:
+  const std::string path_;
+};
+}  // namespace devtools_crosstool_autofdo
+
+#endif  // AUTOFDO_TRACE_EVENT_RECORDER_H_
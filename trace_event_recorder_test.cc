@@ -0,0 +1,70 @@
+#include "trace_event_recorder.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "third_party/abseil/absl/status/status.h"
+#include "third_party/abseil/absl/strings/str_cat.h"
+#include "third_party/abseil/absl/time/clock.h"
+#include "third_party/abseil/absl/time/time.h"
+
+namespace devtools_crosstool_autofdo {
+namespace {
+
+using ::testing::AllOf;
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+std::string ReadFile(const std::string &path) {
+  std::ifstream in(path);
+  std::stringstream content;
+  content << in.rdbuf();
+  return content.str();
+}
+
+class TraceEventRecorderTest : public testing::Test {
+ protected:
+  void TearDown() override { ResetTraceEventRecordingForTest(); }
+};
+
+TEST_F(TraceEventRecorderTest, DoesNotRecordUnlessEnabled) {
+  EXPECT_FALSE(IsTraceEventRecordingEnabled());
+  { ScopedTraceEvent trace_event("test", "ignored"); }
+  const std::string path = absl::StrCat(testing::TempDir(), "/disabled.json");
+  ASSERT_TRUE(WriteTraceEvents(path).ok());
+  EXPECT_THAT(ReadFile(path), AllOf(HasSubstr("\"traceEvents\":["),
+                                    Not(HasSubstr("ignored"))));
+}
+
+TEST_F(TraceEventRecorderTest, WritesCompleteEvents) {
+  EnableTraceEventRecording();
+  ASSERT_TRUE(IsTraceEventRecordingEnabled());
+  { ScopedTraceEvent trace_event("test", "main \"thread\""); }
+  std::thread([] { ScopedTraceEvent trace_event("test", "worker"); }).join();
+  const absl::Time start = absl::Now();
+  RecordTraceEvent("test", "explicit", start, start + absl::Milliseconds(2));
+
+  const std::string path = absl::StrCat(testing::TempDir(), "/trace.json");
+  ASSERT_TRUE(WriteTraceEvents(path).ok());
+  const std::string trace = ReadFile(path);
+  EXPECT_THAT(trace, HasSubstr("\"name\":\"main \\\"thread\\\"\""));
+  EXPECT_THAT(trace, HasSubstr("\"name\":\"worker\""));
+  EXPECT_THAT(trace, HasSubstr("\"name\":\"explicit\""));
+  EXPECT_THAT(trace, HasSubstr("\"dur\":2000}"));
+  EXPECT_THAT(trace, HasSubstr("\"ph\":\"X\",\"cat\":\"test\""));
+  // The main thread and the worker thread get distinct thread ids.
+  EXPECT_THAT(trace, HasSubstr("\"tid\":0"));
+  EXPECT_THAT(trace, HasSubstr("\"tid\":1"));
+}
+
+TEST_F(TraceEventRecorderTest, FailsOnUnwritablePath) {
+  EXPECT_EQ(WriteTraceEvents("/nonexistent/dir/trace.json").code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+}  // namespace
+}  // namespace devtools_crosstool_autofdo
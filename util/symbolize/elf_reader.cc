@@ -51,6 +51,7 @@
 #include <algorithm>
 #include <map>
 #include <string>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "symbolize/elf_reader.h"
@@ -61,6 +62,9 @@ namespace {
 // The lowest bit of an ARM symbol value is used to indicate a Thumb address.
 const int kARMThumbBitOffset = 0;
 
+// ElfReader::ReadSymbols does not start a thread for fewer symbols than this.
+const uint64 kMinSymbolsPerThread = 1 << 16;
+
 // Converts an ARM Thumb symbol value to a true aligned address value.
 template <typename T>
 T AdjustARMThumbSymbolValue(const T& symbol_table_value) {
@@ -70,6 +74,26 @@ T AdjustARMThumbSymbolValue(const T& symbol_table_value) {
 
 namespace devtools_crosstool_autofdo {
 
+// The bytes of an ELF file: either an open file descriptor, whose sections
+// are mmapped as they are needed, or an image of the whole file that the
+// caller has already mapped into memory.
+struct ElfFileSource {
+  int fd = -1;
+  const char *image = NULL;
+  size_t image_size = 0;
+
+  bool valid() const { return image != NULL || fd >= 0; }
+
+  // Copies up to `size` bytes at `offset` into `buf`, like pread().
+  ssize_t Read(void *buf, size_t size, off_t offset) const {
+    if (image == NULL) return pread(fd, buf, size, offset);
+    if (offset < 0 || static_cast<size_t>(offset) >= image_size) return 0;
+    size = std::min(size, image_size - offset);
+    memcpy(buf, image + offset, size);
+    return size;
+  }
+};
+
 template <class ElfArch> class ElfReaderImpl;
 
 // 32-bit and 64-bit ELF files are processed exactly the same, except
@@ -125,19 +149,28 @@ class Elf64 {
 // The motivation for mmaping individual sections of the file is that
 // many Google executables are large enough when unstripped that we
 // have to worry about running out of virtual address space.
+// When the whole file is already mapped, the section points into that
+// image instead.
 template<class ElfArch>
 class ElfSectionReader {
  public:
-  ElfSectionReader(const string &path, int fd,
+  ElfSectionReader(const string &path, const ElfFileSource &file,
                    const typename ElfArch::Shdr &section_header)
-      : header_(section_header) {
+      : contents_aligned_(NULL), size_aligned_(0), header_(section_header) {
+    section_size_ = header_.sh_size;
+    if (file.image != NULL) {
+      if (header_.sh_type != SHT_NOBITS)
+        CHECK_LE(header_.sh_offset + section_size_, file.image_size)
+            << "Section extends past the end of " << path;
+      contents_ = file.image + header_.sh_offset;
+      return;
+    }
     // Back up to the beginning of the page we're interested in.
     const size_t additional = header_.sh_offset % getpagesize();
     const size_t offset_aligned = header_.sh_offset - additional;
-    section_size_ = header_.sh_size;
     size_aligned_ = section_size_ + additional;
     contents_aligned_ = mmap(NULL, size_aligned_, PROT_READ, MAP_SHARED,
-                             fd, offset_aligned);
+                             file.fd, offset_aligned);
     if (contents_aligned_ == MAP_FAILED)
       PLOG(FATAL) << "Could not mmap " << path;
     // Set where the offset really should begin.
@@ -146,7 +179,8 @@ class ElfSectionReader {
   }
 
   ~ElfSectionReader() {
-    munmap(contents_aligned_, size_aligned_);
+    if (contents_aligned_ != NULL)
+      munmap(contents_aligned_, size_aligned_);
   }
 
   // Return the section header for this section.
@@ -162,7 +196,7 @@ class ElfSectionReader {
   size_t section_size() const { return section_size_; }
 
  private:
-  // page-aligned file contents
+  // page-aligned file contents; NULL when pointing into a mapped image
   void *contents_aligned_;
   // pointer within contents_aligned_ to where the section data begins
   const char *contents_;
@@ -259,16 +293,16 @@ static inline bool MyHasSuffixString(const string& str, const string& suffix) {
 template<class ElfArch>
 class ElfReaderImpl {
  public:
-  explicit ElfReaderImpl(const string &path, int fd)
+  explicit ElfReaderImpl(const string &path, const ElfFileSource &file)
       : path_(path),
-        fd_(fd),
+        file_(file),
         section_headers_(NULL),
         program_headers_(NULL) {
-    CHECK_GE(fd_, 0);
+    CHECK(file_.valid());
     string error;
-    CHECK(IsArchElfFile(fd, &error)) << " Could not parse file: " << error;
+    CHECK(IsArchElfFile(file, &error)) << " Could not parse file: " << error;
     is_dwp_ = MyHasSuffixString(path, ".dwp");
-    ParseHeaders(fd, path);
+    ParseHeaders(file, path);
   }
 
   ~ElfReaderImpl() {
@@ -284,9 +318,9 @@ class ElfReaderImpl {
   // to see if the ELF file appears to match the current
   // architecture. If error is non-NULL, it will be set with a reason
   // in case of failure.
-  static bool IsArchElfFile(int fd, string *error) {
+  static bool IsArchElfFile(const ElfFileSource &file, string *error) {
     unsigned char header[EI_NIDENT];
-    if (pread(fd, header, sizeof(header), 0) != sizeof(header)) {
+    if (file.Read(header, sizeof(header), 0) != sizeof(header)) {
       if (error != NULL) *error = "Could not read header";
       return false;
     }
@@ -343,6 +377,62 @@ class ElfReaderImpl {
     }
   }
 
+  // Append the symbols of the first section of type "section_type" that
+  // pass "filter" to "symbols", in symbol table order. The section is split
+  // into contiguous chunks scanned by up to "num_threads" threads.
+  void ReadSymbols(typename ElfArch::Word section_type,
+                   const ElfReader::SymbolFilter &filter, int num_threads,
+                   vector<ElfReader::SymbolInfo> *symbols) {
+    CHECK(section_type == SHT_SYMTAB || section_type == SHT_DYNSYM);
+    // Sections are mmapped lazily by GetSection, which is not thread-safe, so
+    // map both the symbol and string sections before starting any thread.
+    const ElfSectionReader<ElfArch> *symbol_section =
+        GetSectionByType(section_type);
+    if (symbol_section == NULL) return;
+    CHECK_NE(symbol_section->header().sh_link, 0);
+    const ElfSectionReader<ElfArch> *string_section =
+        GetSection(symbol_section->header().sh_link);
+    const uint64 entsize = symbol_section->header().sh_entsize;
+    const uint64 num_symbols = symbol_section->header().sh_size / entsize;
+
+    const uint64 max_threads =
+        std::max<uint64>(1, num_symbols / kMinSymbolsPerThread);
+    const int num_chunks = static_cast<int>(
+        std::min<uint64>(std::max(num_threads, 1), max_threads));
+    vector<vector<ElfReader::SymbolInfo> > chunks(num_chunks);
+    auto read_chunk = [&](int chunk) {
+      const uint64 begin = num_symbols * chunk / num_chunks;
+      const uint64 end = num_symbols * (chunk + 1) / num_chunks;
+      for (uint64 i = begin; i < end; ++i) {
+        const typename ElfArch::Sym *sym =
+            reinterpret_cast<const typename ElfArch::Sym *>(
+                symbol_section->contents() + i * entsize);
+        if (sym->st_name == 0) continue;
+        const char *name = string_section->GetOffset(sym->st_name);
+        if (filter && !filter(name, sym->st_value, sym->st_size,
+                              ElfArch::Bind(sym), ElfArch::Type(sym),
+                              sym->st_shndx))
+          continue;
+        typename ElfArch::Sym symbol = *sym;
+        AdjustSymbolValue(&symbol);
+        chunks[chunk].push_back({name, symbol.st_value, symbol.st_size,
+                                 ElfArch::Bind(sym), ElfArch::Type(sym),
+                                 sym->st_shndx});
+      }
+    };
+    vector<std::thread> threads;
+    for (int chunk = 1; chunk < num_chunks; ++chunk)
+      threads.emplace_back(read_chunk, chunk);
+    read_chunk(0);
+    for (std::thread &thread : threads) thread.join();
+
+    size_t total = symbols->size();
+    for (const auto &chunk : chunks) total += chunk.size();
+    symbols->reserve(total);
+    for (const auto &chunk : chunks)
+      symbols->insert(symbols->end(), chunk.begin(), chunk.end());
+  }
+
   // Return an ElfSectionReader for the first section of the given
   // type by iterating through all section headers. Returns NULL if
   // the section type is not found.
@@ -564,7 +654,7 @@ class ElfReaderImpl {
       name = GetSectionNameByIndex(num);
     ElfSectionReader<ElfArch> *& reader = sections_[num];
     if (reader == NULL)
-      reader = new ElfSectionReader<ElfArch>(path_, fd_,
+      reader = new ElfSectionReader<ElfArch>(path_, file_,
                                              section_headers_[num]);
     return reader;
   }
@@ -572,9 +662,9 @@ class ElfReaderImpl {
   // Parse out the overall header information from the file and assert
   // that it looks sane. This contains information like the magic
   // number and target architecture.
-  bool ParseHeaders(int fd, const string &path) {
+  bool ParseHeaders(const ElfFileSource &file, const string &path) {
     // Read in the global ELF header.
-    if (pread(fd, &header_, sizeof(header_), 0) != sizeof(header_)) {
+    if (file.Read(&header_, sizeof(header_), 0) != sizeof(header_)) {
       LOG(ERROR) << "Could not read ELF header: " << path;
       return false;
     }
@@ -599,7 +689,7 @@ class ElfReaderImpl {
       // will read SHN_UNDEF and the true number of section header table entries
       // is found in the sh_size field of the first section header.
       // See: http://www.sco.com/developers/gabi/2003-12-17/ch4.sheader.html
-      if (pread(fd, &first_section_header_, sizeof(first_section_header_),
+      if (file.Read(&first_section_header_, sizeof(first_section_header_),
                 header_.e_shoff) != sizeof(first_section_header_)) {
         LOG(ERROR) << "Failed to read first section header: " << path;
         return false;
@@ -611,7 +701,7 @@ class ElfReaderImpl {
     const int section_headers_size =
         GetNumSections() * sizeof(*section_headers_);
     section_headers_ = new typename ElfArch::Shdr[section_headers_size];
-    if (pread(fd, section_headers_, section_headers_size, header_.e_shoff) !=
+    if (file.Read(section_headers_, section_headers_size, header_.e_shoff) !=
         section_headers_size) {
       LOG(ERROR) << "Could not read section headers: " << path;
       return false;
@@ -622,7 +712,7 @@ class ElfReaderImpl {
     const int program_headers_size =
         GetNumProgramHeaders() * sizeof(*program_headers_);
     program_headers_ = new typename ElfArch::Phdr[GetNumProgramHeaders()];
-    if (pread(fd, program_headers_, program_headers_size, header_.e_phoff) !=
+    if (file.Read(program_headers_, program_headers_size, header_.e_phoff) !=
         program_headers_size) {
       LOG(ERROR) << "Could not read program headers: " << path
                  << " Continue anyway";
@@ -658,8 +748,8 @@ class ElfReaderImpl {
 
   // The file we're reading.
   const string path_ {};
-  // Open file descriptor for path_. Not owned by this object.
-  const int fd_ {};
+  // Open file descriptor or mapped image of path_. Not owned by this object.
+  const ElfFileSource file_ {};
 
   // The global header of the ELF file.
   typename ElfArch::Ehdr header_ {};
@@ -688,7 +778,8 @@ class ElfReaderImpl {
 };
 
 ElfReader::ElfReader(const string &path)
-    : path_(path), fd_(-1), impl32_(NULL), impl64_(NULL) {
+    : path_(path), fd_(-1), image_(NULL), image_size_(0), impl32_(NULL),
+      impl64_(NULL) {
   // linux 2.6.XX kernel can show deleted files like this:
   //   /var/run/nscd/dbYLJYaE (deleted)
   // and the kernel-supplied vdso and vsyscall mappings like this:
@@ -708,6 +799,12 @@ ElfReader::ElfReader(const string &path)
   }
 }
 
+ElfReader::ElfReader(const string &path, const char *image, size_t image_size)
+    : path_(path), fd_(-1), image_(image), image_size_(image_size),
+      impl32_(NULL), impl64_(NULL) {
+  CHECK(image != NULL) << path;
+}
+
 ElfReader::~ElfReader() {
   if (fd_ != -1)
     close(fd_);
@@ -728,10 +825,10 @@ ElfReader::~ElfReader() {
 #endif
 
 template <typename ElfArch>
-static bool IsElfFile(const int fd, const string &path) {
-  if (fd < 0)
+static bool IsElfFile(const ElfFileSource &file, const string &path) {
+  if (!file.valid())
     return false;
-  if (!ElfReaderImpl<ElfArch>::IsArchElfFile(fd, NULL)) {
+  if (!ElfReaderImpl<ElfArch>::IsArchElfFile(file, NULL)) {
     // No error message here.  IsElfFile gets called many times.
     return false;
   }
@@ -739,15 +836,15 @@ static bool IsElfFile(const int fd, const string &path) {
 }
 
 bool ElfReader::IsNativeElfFile() const {
-  return IsElfFile<NATIVE_ELF_ARCH>(fd_, path_);
+  return IsElfFile<NATIVE_ELF_ARCH>(file(), path_);
 }
 
 bool ElfReader::IsElf32File() const {
-  return IsElfFile<Elf32>(fd_, path_);
+  return IsElfFile<Elf32>(file(), path_);
 }
 
 bool ElfReader::IsElf64File() const {
-  return IsElfFile<Elf64>(fd_, path_);
+  return IsElfFile<Elf64>(file(), path_);
 }
 
 void ElfReader::VisitSymbols(ElfReader::SymbolSink *sink) {
@@ -777,6 +874,19 @@ void ElfReader::VisitSymbols(ElfReader::SymbolSink *sink,
   }
 }
 
+std::vector<ElfReader::SymbolInfo> ElfReader::ReadSymbols(
+    const SymbolFilter &filter, int num_threads) {
+  std::vector<SymbolInfo> symbols;
+  if (IsElf32File()) {
+    GetImpl32()->ReadSymbols(SHT_SYMTAB, filter, num_threads, &symbols);
+    GetImpl32()->ReadSymbols(SHT_DYNSYM, filter, num_threads, &symbols);
+  } else if (IsElf64File()) {
+    GetImpl64()->ReadSymbols(SHT_SYMTAB, filter, num_threads, &symbols);
+    GetImpl64()->ReadSymbols(SHT_DYNSYM, filter, num_threads, &symbols);
+  }
+  return symbols;
+}
+
 uint64 ElfReader::VaddrOfFirstLoadSegment() {
   if (IsElf32File()) {
     return GetImpl32()->VaddrOfFirstLoadSegment();
@@ -940,16 +1050,24 @@ bool ElfReader::IsDynamicSharedObject() {
   }
 }
 
+ElfFileSource ElfReader::file() const {
+  ElfFileSource file;
+  file.fd = fd_;
+  file.image = image_;
+  file.image_size = image_size_;
+  return file;
+}
+
 ElfReaderImpl<Elf32> *ElfReader::GetImpl32() {
   if (impl32_ == NULL) {
-    impl32_ = new ElfReaderImpl<Elf32>(path_, fd_);
+    impl32_ = new ElfReaderImpl<Elf32>(path_, file());
   }
   return impl32_;
 }
 
 ElfReaderImpl<Elf64> *ElfReader::GetImpl64() {
   if (impl64_ == NULL) {
-    impl64_ = new ElfReaderImpl<Elf64>(path_, fd_);
+    impl64_ = new ElfReaderImpl<Elf64>(path_, file());
   }
   return impl64_;
 }
@@ -960,8 +1078,10 @@ ElfReaderImpl<Elf64> *ElfReader::GetImpl64() {
 template <typename ElfArch>
 static bool IsNonStrippedELFBinaryImpl(const string &path, const int fd,
                                        bool debug_only) {
-  if (!ElfReaderImpl<ElfArch>::IsArchElfFile(fd, NULL)) return false;
-  ElfReaderImpl<ElfArch> elf_reader(path, fd);
+  ElfFileSource file;
+  file.fd = fd;
+  if (!ElfReaderImpl<ElfArch>::IsArchElfFile(file, NULL)) return false;
+  ElfReaderImpl<ElfArch> elf_reader(path, file);
   return debug_only ?
       elf_reader.HasDebugSections()
       : (elf_reader.GetSectionByType(SHT_SYMTAB) != NULL);
@@ -27,6 +27,7 @@
 
 #include <functional>
 #include <string>
+#include <vector>
 #include "base/common.h"
 
 namespace devtools_crosstool_autofdo {
@@ -35,10 +36,15 @@ class Elf32;
 class Elf64;
 template<typename ElfArch>
 class ElfReaderImpl;
+struct ElfFileSource;
 
 class ElfReader {
  public:
   explicit ElfReader(const string &path);
+  // Reads the ELF file at path from image, a copy of the whole file that
+  // is already mapped into memory, instead of opening and mmapping the
+  // file again. Sections point into image, which must outlive this object.
+  ElfReader(const string &path, const char *image, size_t image_size);
   ~ElfReader();
 
   // Parse the ELF prologue of this file and return whether it was
@@ -55,6 +61,11 @@ class ElfReader {
   // Checks if it's an ELF file of type ET_DYN (shared object file).
   bool IsDynamicSharedObject();
 
+  // Predicate deciding whether a symbol table entry should be reported.
+  typedef std::function<bool(const char *name, uint64 address, uint64 size,
+                             int binding, int type, int section)>
+      SymbolFilter;
+
   class SymbolSink {
    public:
     virtual ~SymbolSink() {}
@@ -62,9 +73,18 @@ class ElfReader {
                            int binding, int type, int section) = 0;
 
     // If "filter" is set, only entries for which it returns true are added.
-    std::function<bool(const char *name, uint64 address, uint64 size,
-                       int binding, int type, int section)>
-        filter;
+    SymbolFilter filter;
+  };
+
+  // A symbol table entry, as reported by ReadSymbols. "name" points into the
+  // mmapped string table of the symbol section.
+  struct SymbolInfo {
+    const char *name;
+    uint64 address;
+    uint64 size;
+    int binding;
+    int type;
+    int section;
   };
 
   // Like AddSymbols above, but with no address correction.
@@ -81,6 +101,15 @@ class ElfReader {
   void VisitSymbols(SymbolSink *sink, int symbol_binding, int symbol_type,
                     bool get_raw_symbol_values);
 
+  // Bulk alternative to VisitSymbols(sink): returns the symbols of any
+  // SHT_SYMTAB section, followed by those of any SHT_DYNSYM section, for which
+  // "filter" returns true, in symbol table order. Each symbol table is split
+  // into chunks that are scanned concurrently by up to "num_threads" threads,
+  // so "filter" must be thread-safe. Symbol names are not copied; they stay
+  // valid until this ElfReader is destroyed.
+  std::vector<SymbolInfo> ReadSymbols(const SymbolFilter &filter,
+                                      int num_threads);
+
   // p_vaddr of the first PT_LOAD segment (if any), or 0 if no PT_LOAD
   // segments are present. This is the address an ELF image was linked
   // (by static linker) to be loaded at. Usually (but not always) 0 for
@@ -165,6 +194,8 @@ class ElfReader {
   static bool SectionNamesMatch(const string &name, const string &sh_name);
 
  private:
+  // Where to read the file's bytes from.
+  ElfFileSource file() const;
   // Lazily initialize impl32_ and return it.
   ElfReaderImpl<Elf32> *GetImpl32();
   // Ditto for impl64_.
@@ -175,6 +206,9 @@ class ElfReader {
   // Read-only file descriptor for the file. May be -1 if there was an
   // error during open.
   int fd_;
+  // Mapped image of the whole file, or NULL to read through fd_. Not owned.
+  const char *image_;
+  size_t image_size_;
   ElfReaderImpl<Elf32> *impl32_;
   ElfReaderImpl<Elf64> *impl64_;
 